@@ -1,7 +1,7 @@
 #version 450
 
 layout (location = 0) in vec3 VertexPosition;
-layout (location = 1) in vec3 VertexNormal;
+layout (location = 1) in vec2 VertexNormal;
 layout (location = 2) in vec3 VertexColor;
 
 layout (binding = 0) uniform UniformBufferObject {
@@ -17,10 +17,19 @@ layout (push_constant) uniform PushConstants {
     mat4 Model;
 } pushConsts;
 
+// 八面体に写像した法線を単位ベクトルに戻します。
+vec3 OctDecode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
 void main () {
     WorldPos = vec3(pushConsts.Model * vec4(VertexPosition, 1.0));
     Color = VertexColor;
-    Normal = mat3(pushConsts.Model) * VertexNormal;
+    // モデル行列には位置を戻すスケールが含まれるため、正規化してから書き込みます。
+    Normal = normalize(mat3(pushConsts.Model) * OctDecode(VertexNormal));
     
     gl_Position = ubo.Proj * ubo.View * vec4(WorldPos, 1.0);
 }
@@ -1,5 +1,12 @@
 #version 450
 
+// LightCull.cs.glslと一致させます。
+const uint TILE_SIZE = 16;
+const uint MAX_LIGHTS_PER_TILE = 255;
+const uint TILE_STRIDE = MAX_LIGHTS_PER_TILE + 1;
+const uint TILE_OVERFLOW = 0x80000000u;
+const uint SPOT = 1;
+
 layout (location = 0) in vec2 UV;
 
 layout (binding = 1) uniform sampler2D PosTex;
@@ -12,18 +19,36 @@ struct Light {
     vec4 Position;
     vec3 Color;
     float Radius;
+    vec3 Direction;
+    float Range;
+    float CosInner;
+    float CosOuter;
+    uint Type;
+    float Padding;
 };
 
 layout (binding = 4) uniform UniformBufferObject {
-    Light Lights[8];
     vec4 ViewPos;
     int LightsNum;
     int DisplayRenderTarget;
+    uint TileCountX;
+    uint TileCountY;
+    // UVにかけるとタイルの番号になります。
+    vec2 TileScale;
 } ubo;
 
-vec3 BlinnPhongModel(vec3 pos, vec3 norm, vec4 albedo, int lightIdx) {
+layout (std430, binding = 5) readonly buffer Lights {
+    Light lights[];
+};
+
+// タイルごとに先頭がライトの数、続けてライトの番号です。
+layout (std430, binding = 6) readonly buffer TileLights {
+    uint tileLights[];
+};
+
+vec3 BlinnPhongModel(vec3 pos, vec3 norm, vec4 albedo, Light light) {
     // ライトのベクトルを計算します。
-    vec3 L = ubo.Lights[lightIdx].Position.xyz - pos;
+    vec3 L = light.Position.xyz - pos;
     float dist = length(L);
     L = normalize(L);
 
@@ -31,19 +56,32 @@ vec3 BlinnPhongModel(vec3 pos, vec3 norm, vec4 albedo, int lightIdx) {
     vec3 V = normalize(ubo.ViewPos.xyz - pos);
 
     // 減衰します。
-    float atten = ubo.Lights[lightIdx].Position.w == 0.0
-        ? 1.0 
-        : ubo.Lights[lightIdx].Radius / (pow(dist, 2.0) + 1.0);
+    float atten = light.Position.w == 0.0
+        ? 1.0
+        : light.Radius / (pow(dist, 2.0) + 1.0);
+
+    // 距離が有限のライトは、影響する距離で滑らかに0にします。
+    if (light.Range > 0.0) {
+        float ratio = dist / light.Range;
+        float window = clamp(1.0 - ratio * ratio * ratio * ratio, 0.0, 1.0);
+        atten *= window * window;
+    }
+
+    // スポットライトは内側と外側の角度の間で減衰します。
+    if (light.Type == SPOT) {
+        atten *= smoothstep(light.CosOuter, light.CosInner,
+                            dot(-L, light.Direction));
+    }
 
     // ディフューズを計算します。
     vec3 N = normalize(norm);
     float NoL = clamp((dot(N, L)), 0.0, 1.0);
-    vec3 diff = ubo.Lights[lightIdx].Color * albedo.rgb * NoL;
+    vec3 diff = light.Color * albedo.rgb * NoL;
 
     // スペキュラを計算します。
     vec3 H = normalize(V + L);
     float NoH = clamp((dot(N, H)), 0.0, 1.0);
-    vec3 spec = ubo.Lights[lightIdx].Color * pow(NoH, 16.0f);
+    vec3 spec = light.Color * pow(NoH, 16.0f);
 
     return (diff + spec) * atten;
 }
@@ -54,11 +92,20 @@ void main() {
     vec3 norm = texture(NormTex, UV).rgb;
     vec4 albedo = texture(AlbedoTex, UV);
 
+    // 画素のタイルのライトのリストを求めます。
+    // タイルは選別したときの画面の大きさで分けているため、UVから求めます。
+    uvec2 tile = min(uvec2(UV * ubo.TileScale),
+                     uvec2(ubo.TileCountX, ubo.TileCountY) - 1u);
+    uint base = (tile.y * ubo.TileCountX + tile.x) * TILE_STRIDE;
+    // 最大数を超えたタイルは、最大数までのライトのみを計算します。
+    uint count = tileLights[base] & ~TILE_OVERFLOW;
+    bool overflow = (tileLights[base] & TILE_OVERFLOW) != 0u;
+
     // デバッグなどに使用します。
     vec3 fragColor = vec3(0.0);
     if (ubo.DisplayRenderTarget > 0) {
         switch (ubo.DisplayRenderTarget) {
-            case 1: 
+            case 1:
                 fragColor = pos;
                 break;
             case 2:
@@ -67,13 +114,21 @@ void main() {
             case 3:
                 fragColor = albedo.rgb;
                 break;
+            case 4:
+                // タイルのライトの数を青から赤で表し、最大数を超えたタイルは白にします。
+                fragColor = overflow
+                    ? vec3(1.0)
+                    : mix(vec3(0.0, 0.0, 1.0), vec3(1.0, 0.0, 0.0),
+                          clamp(float(count) / 32.0, 0.0, 1.0));
+                break;
         }
         FragColor = vec4(fragColor, 1.0);
         return;
     }
-    
-    for (int i = 0 ; i < ubo.LightsNum; i++) {
-        fragColor += BlinnPhongModel(pos, norm, albedo, i);
+
+    for (uint i = 0; i < count; i++) {
+        fragColor += BlinnPhongModel(pos, norm, albedo,
+                                     lights[tileLights[base + 1 + i]]);
     }
     FragColor = vec4(fragColor, 1.0);
 }
@@ -0,0 +1,171 @@
+#version 450
+
+// 1つのワークグループが1つのタイル、1つのスレッドがタイルの1つの画素を担当します。
+const uint TILE_SIZE = 16;
+const uint MAX_LIGHTS_PER_TILE = 255;
+const uint TILE_STRIDE = MAX_LIGHTS_PER_TILE + 1;
+// ライトが最大数を超えたタイルは、数にこのビットを立てます。
+const uint TILE_OVERFLOW = 0x80000000u;
+const uint THREAD_COUNT = TILE_SIZE * TILE_SIZE;
+const uint SPOT = 1;
+const uint FLT_MAX_BITS = 0x7f7fffff;
+
+layout (local_size_x = TILE_SIZE, local_size_y = TILE_SIZE) in;
+
+struct Light {
+    vec4 Position;
+    vec3 Color;
+    float Radius;
+    vec3 Direction;
+    float Range;
+    float CosInner;
+    float CosOuter;
+    uint Type;
+    float Padding;
+};
+
+layout (binding = 0) uniform UniformBufferObject {
+    mat4 View;
+    mat4 InvProj;
+    uvec2 ScreenSize;
+    uint LightsNum;
+    uint TileCountX;
+    // 0の場合はG-Bufferを読まず、深度の範囲で選別しません。
+    uint DepthBounds;
+} ubo;
+
+layout (binding = 1) uniform sampler2D PosTex;
+
+layout (std430, binding = 2) readonly buffer Lights {
+    Light lights[];
+};
+
+// タイルごとに先頭がライトの数、続けてライトの番号です。
+layout (std430, binding = 3) writeonly buffer TileLights {
+    uint tileLights[];
+};
+
+// 1つのタイルに触れたライトの数の最大値です。(ホストが最大数を超えたかを確認します。)
+layout (std430, binding = 4) buffer MaxTileLights {
+    uint maxTileLights;
+};
+
+// 深度は正の浮動小数点数なので、ビット列を整数として比較しても順序は変わりません。
+shared uint minDepthBits;
+shared uint maxDepthBits;
+shared uint tileLightCount;
+shared uint tileLightIndices[MAX_LIGHTS_PER_TILE];
+shared vec3 tilePlanes[4];
+
+// 画面の正規化デバイス座標を、ビュー空間のその方向の点に変換します。
+vec3 Unproject(vec2 ndc) {
+    vec4 p = ubo.InvProj * vec4(ndc, 1.0, 1.0);
+    return p.xyz / p.w;
+}
+
+// ライトの影響する範囲を囲むワールド空間の境界球を求めます。
+vec4 BoundingSphere(Light light) {
+    if (light.Type != SPOT) {
+        return vec4(light.Position.xyz, light.Range);
+    }
+    // 円錐が細い場合は底面の円と頂点を通る球、太い場合は底面の円を囲む球にします。
+    float cosA = light.CosOuter;
+    if (cosA > 0.70710678) {
+        float r = light.Range / (2.0 * cosA);
+        return vec4(light.Position.xyz + light.Direction * r, r);
+    }
+    float sinA = sqrt(max(1.0 - cosA * cosA, 0.0));
+    return vec4(light.Position.xyz + light.Direction * (cosA * light.Range),
+                sinA * light.Range);
+}
+
+bool IsVisible(Light light, float minDepth, float maxDepth) {
+    // 距離が無制限のライトはすべてのタイルに影響します。
+    if (light.Range <= 0.0) {
+        return true;
+    }
+    vec4 sphere = BoundingSphere(light);
+    vec3 center = vec3(ubo.View * vec4(sphere.xyz, 1.0));
+    float depth = -center.z;
+    if (depth + sphere.w < minDepth || depth - sphere.w > maxDepth) {
+        return false;
+    }
+    for (int i = 0; i < 4; i++) {
+        if (dot(tilePlanes[i], center) < -sphere.w) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void main() {
+    if (gl_LocalInvocationIndex == 0) {
+        minDepthBits = ubo.DepthBounds != 0u ? FLT_MAX_BITS : 0u;
+        maxDepthBits = ubo.DepthBounds != 0u ? 0u : FLT_MAX_BITS;
+        tileLightCount = 0;
+
+        // タイルの4隅の方向から、原点を通る内向きの側面の平面を求めます。
+        vec2 screenSize = vec2(ubo.ScreenSize);
+        vec2 tileMin = vec2(gl_WorkGroupID.xy * TILE_SIZE) / screenSize;
+        vec2 tileMax = vec2((gl_WorkGroupID.xy + 1u) * TILE_SIZE) / screenSize;
+        tileMin = tileMin * 2.0 - 1.0;
+        tileMax = min(tileMax, vec2(1.0)) * 2.0 - 1.0;
+        vec3 corners[4] = vec3[](
+            Unproject(tileMin),
+            Unproject(vec2(tileMax.x, tileMin.y)),
+            Unproject(tileMax),
+            Unproject(vec2(tileMin.x, tileMax.y))
+        );
+        vec3 center = Unproject((tileMin + tileMax) * 0.5);
+        for (int i = 0; i < 4; i++) {
+            vec3 n = normalize(cross(corners[i], corners[(i + 1) % 4]));
+            tilePlanes[i] = dot(n, center) < 0.0 ? -n : n;
+        }
+    }
+    barrier();
+
+    // 背景(wが0)を除いた画素のビュー空間の深度の範囲を求めます。
+    uvec2 pixel = gl_GlobalInvocationID.xy;
+    if (ubo.DepthBounds != 0u && all(lessThan(pixel, ubo.ScreenSize))) {
+        vec4 pos = texelFetch(PosTex, ivec2(pixel), 0);
+        if (pos.w > 0.0) {
+            float depth = -(ubo.View * vec4(pos.xyz, 1.0)).z;
+            uint bits = floatBitsToUint(max(depth, 0.0));
+            atomicMin(minDepthBits, bits);
+            atomicMax(maxDepthBits, bits);
+        }
+    }
+    barrier();
+
+    // 画素が無いタイルはライトを計算しないため、リストを空にします。
+    if (minDepthBits <= maxDepthBits) {
+        float minDepth = uintBitsToFloat(minDepthBits);
+        float maxDepth = uintBitsToFloat(maxDepthBits);
+        for (uint i = gl_LocalInvocationIndex; i < ubo.LightsNum;
+             i += THREAD_COUNT) {
+            if (IsVisible(lights[i], minDepth, maxDepth)) {
+                uint slot = atomicAdd(tileLightCount, 1u);
+                if (slot < MAX_LIGHTS_PER_TILE) {
+                    tileLightIndices[slot] = i;
+                }
+            }
+        }
+    }
+    barrier();
+
+    // リストの順はスレッドの実行順に依存しますが、加算するだけなので結果は変わりません。
+    uint tileIndex = gl_WorkGroupID.y * ubo.TileCountX + gl_WorkGroupID.x;
+    uint base = tileIndex * TILE_STRIDE;
+    // 最大数を超えた分は打ち切り、超えたことを数のビットとホストに伝えます。
+    uint count = min(tileLightCount, MAX_LIGHTS_PER_TILE);
+    if (gl_LocalInvocationIndex == 0) {
+        bool overflow = tileLightCount > MAX_LIGHTS_PER_TILE;
+        tileLights[base] = overflow ? count | TILE_OVERFLOW : count;
+        if (overflow) {
+            atomicMax(maxTileLights, tileLightCount);
+        }
+    }
+    for (uint i = gl_LocalInvocationIndex; i < count; i += THREAD_COUNT) {
+        tileLights[base + 1 + i] = tileLightIndices[i];
+    }
+}
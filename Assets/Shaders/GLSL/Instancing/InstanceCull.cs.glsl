@@ -0,0 +1,74 @@
+#version 450
+
+// 1つのスレッドが1つのインスタンスを担当します。
+layout (local_size_x = 64) in;
+
+const uint NO_CULL = 1;
+
+struct Instance {
+    mat4 Model;
+    vec4 Sphere;
+    uint Material;
+    uint Batch;
+    uint Flags;
+    uint BatchFirstInstance;
+};
+
+struct DrawCommand {
+    uint IndexCount;
+    uint InstanceCount;
+    uint FirstIndex;
+    int VertexOffset;
+    uint FirstInstance;
+};
+
+layout (std430, binding = 0) readonly buffer Instances {
+    Instance instances[];
+};
+
+layout (std430, binding = 1) writeonly buffer VisibleInstances {
+    uint visibleInstances[];
+};
+
+layout (std430, binding = 2) buffer DrawCommands {
+    DrawCommand commands[];
+};
+
+layout (binding = 3) uniform UniformBufferObject {
+    vec4 Frustum[6];
+} ubo;
+
+layout (push_constant) uniform PushConstants {
+    uint InstanceCount;
+} pushConsts;
+
+bool IsVisible(Instance instance) {
+    // モデル行列の最大の拡大率で半径を広げ、ワールド空間の境界球にします。
+    vec3 center = vec3(instance.Model * vec4(instance.Sphere.xyz, 1.0));
+    float scale = max(max(length(instance.Model[0].xyz),
+                          length(instance.Model[1].xyz)),
+                      length(instance.Model[2].xyz));
+    float radius = instance.Sphere.w * scale;
+
+    for (int i = 0; i < 6; i++) {
+        if (dot(ubo.Frustum[i].xyz, center) + ubo.Frustum[i].w < -radius) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void main() {
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= pushConsts.InstanceCount) {
+        return;
+    }
+    Instance instance = instances[index];
+    if ((instance.Flags & NO_CULL) == 0 && !IsVisible(instance)) {
+        return;
+    }
+
+    // 見えるインスタンスをバッチの先頭から詰め、描画するインスタンスの数を数えます。
+    uint slot = atomicAdd(commands[instance.Batch].InstanceCount, 1);
+    visibleInstances[instance.BatchFirstInstance + slot] = index;
+}
@@ -6,29 +6,31 @@ const int LIGHTS_MAX = 8;
 
 layout (location=0) in vec3 Position;
 layout (location=1) in vec3 Normal;
+layout (location=2) flat in int MaterialIndex;
 
 layout (location=0) out vec4 FragColor;
 
+const int MATERIALS_MAX = 3;
+
 struct LightInfo {
     vec4 Position;
     float Intensity;
 };
 
+struct MaterialInfo {
+    vec4 Color;
+    float Roughness;
+    float Metallic;
+    float Reflectance;
+};
+
 layout (binding=1) uniform UniformBufferObjectShared {
     vec3 CamPos;
     LightInfo Lights[LIGHTS_MAX];
     int LightsNum;
+    MaterialInfo Materials[MATERIALS_MAX];
 } UBOParams;
 
-layout (push_constant) uniform PushConstants {
-    layout (offset=64) float Roughness;
-    layout (offset=68) float Metallic;
-    layout (offset=72) float Reflectance;
-    layout (offset=76) float R;
-    layout (offset=80) float G;
-    layout (offset=84) float B;
-} Material;
-
 /**
  * @brief The GGX distribution (GGX分布関数)
  */
@@ -59,12 +61,12 @@ vec3 GammaCorrection(vec3 color) {
     return pow(color, vec3(1.0 / GAMMA));
 }
 
-vec3 MicroFacetModel(int lightIdx, vec3 pos, vec3 n) {
+vec3 MicroFacetModel(int lightIdx, vec3 pos, vec3 n, MaterialInfo Material) {
     // 誘電体(非金属)ならDiffuse色(Albedo)取得
-    vec3 diff = (1.0 - Material.Metallic) * vec3(Material.R, Material.G, Material.B);
+    vec3 diff = (1.0 - Material.Metallic) * Material.Color.rgb;
 
     // 金属(導体)ならSpecular色取得
-    vec3 f0 = 0.16 * Material.Reflectance * Material.Reflectance * (1.0 - Material.Metallic) + vec3(Material.R, Material.G, Material.B) * Material.Metallic;
+    vec3 f0 = 0.16 * Material.Reflectance * Material.Reflectance * (1.0 - Material.Metallic) + Material.Color.rgb * Material.Metallic;
 
     // ライトに関して。
     vec3 l = vec3(0.0);
@@ -100,9 +102,10 @@ vec3 MicroFacetModel(int lightIdx, vec3 pos, vec3 n) {
 void main() {
     vec3 color = vec3(0.0);
     vec3 n = normalize(Normal);
+    MaterialInfo material = UBOParams.Materials[MaterialIndex];
 
     for (int i = 0; i < UBOParams.LightsNum; i++) {
-        color += MicroFacetModel(i, Position, n);
+        color += MicroFacetModel(i, Position, n, material);
     }
 
     FragColor = vec4(GammaCorrection(color), 1.0);
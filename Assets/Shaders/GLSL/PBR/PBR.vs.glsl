@@ -1,25 +1,57 @@
 #version 450
 
 layout (location=0) in vec3 VertexPosition;
-layout (location=1) in vec3 VertexNormal;
+layout (location=1) in vec2 VertexNormal;
 
 layout (location=0) out vec3 Position;
 layout (location=1) out vec3 Normal;
+layout (location=2) flat out int MaterialIndex;
 
 layout (binding=0) uniform UniformBufferObject {
     mat4 ViewProj;
 } ubo;
 
-layout (push_constant) uniform PushConstants {
+struct Instance {
     mat4 Model;
+    vec4 Sphere;
+    uint Material;
+    uint Batch;
+    uint Flags;
+    uint BatchFirstInstance;
+};
+
+layout (std430, binding=2) readonly buffer Instances {
+    Instance instances[];
+};
+
+// コンピュートシェーダーが選別した、バッチごとの見えるインスタンスの番号
+layout (std430, binding=3) readonly buffer VisibleInstances {
+    uint visibleInstances[];
+};
+
+// 引数のfirstInstanceを使えない場合のみ、バッチの先頭を渡します。
+layout (push_constant) uniform PushConstants {
+    uint BaseInstance;
 } pushConsts;
 
 out gl_PerVertex {
     vec4 gl_Position;
 };
 
+// 八面体に写像した法線を単位ベクトルに戻します。
+vec3 OctDecode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
 void main() {
-    Position = vec3(pushConsts.Model * vec4(VertexPosition, 1.0));
-    Normal = mat3(pushConsts.Model) * VertexNormal;
+    uint index = visibleInstances[pushConsts.BaseInstance + gl_InstanceIndex];
+    Instance instance = instances[index];
+
+    Position = vec3(instance.Model * vec4(VertexPosition, 1.0));
+    Normal = mat3(instance.Model) * OctDecode(VertexNormal);
+    MaterialIndex = int(instance.Material);
     gl_Position = ubo.ViewProj * vec4(Position, 1.0);
 }
@@ -0,0 +1,56 @@
+#version 450
+
+// 0: 横方向、1: 縦方向
+layout (constant_id = 0) const int AXIS = 0;
+
+const int TILE_SIZE = 64;
+const int RADIUS = 4;
+const float SIGMA = float(RADIUS) * 0.5;
+// 深度の差に対する重みの鋭さ(カメラからの距離に対する割合)
+const float DEPTH_TOLERANCE = 0.05;
+
+layout (local_size_x = TILE_SIZE) in;
+
+layout (binding = 0) uniform sampler2D AOTex;
+layout (binding = 1) uniform sampler2D PositionDepthTex;
+layout (binding = 2, r32f) uniform writeonly image2D BlurredAOImage;
+
+// タイルの両端に半径分のエプロンを加えて共有メモリに読み込みます。
+shared float sharedAO[TILE_SIZE + 2 * RADIUS];
+shared float sharedZ[TILE_SIZE + 2 * RADIUS];
+
+void main() {
+    ivec2 texDim = textureSize(AOTex, 0);
+    ivec2 axis = AXIS == 0 ? ivec2(1, 0) : ivec2(0, 1);
+    ivec2 across = ivec2(1) - axis;
+
+    // ワークグループはX方向がブラーの軸に沿ったタイル、Y方向が軸と直交する行です。
+    ivec2 origin = axis * int(gl_WorkGroupID.x) * TILE_SIZE +
+                   across * int(gl_WorkGroupID.y);
+    int local = int(gl_LocalInvocationID.x);
+    for (int i = local; i < TILE_SIZE + 2 * RADIUS; i += TILE_SIZE) {
+        ivec2 p = clamp(origin + axis * (i - RADIUS), ivec2(0), texDim - 1);
+        sharedAO[i] = texelFetch(AOTex, p, 0).r;
+        sharedZ[i] = texelFetch(PositionDepthTex, p, 0).z;
+    }
+    barrier();
+
+    ivec2 dst = origin + axis * local;
+    if (any(greaterThanEqual(dst, texDim))) {
+        return;
+    }
+
+    // 空間のガウス重みに深度の差による重みを掛け、エッジを越えてぼかさないようにします。
+    float centerZ = sharedZ[local + RADIUS];
+    float tolerance = max(abs(centerZ) * DEPTH_TOLERANCE, 1e-3);
+    float acc = 0.0;
+    float weightSum = 0.0;
+    for (int i = -RADIUS; i <= RADIUS; i++) {
+        int idx = local + RADIUS + i;
+        float dz = (sharedZ[idx] - centerZ) / tolerance;
+        float w = exp(-float(i * i) / (2.0 * SIGMA * SIGMA) - dz * dz);
+        acc += sharedAO[idx] * w;
+        weightSum += w;
+    }
+    imageStore(BlurredAOImage, dst, vec4(acc / weightSum));
+}
@@ -0,0 +1,108 @@
+#version 450
+
+// 1つのワークグループが1つのクラスターを担当します。
+layout (local_size_x = 64) in;
+
+// 描画で裏面を棄却する場合のみ、裏を向いたクラスターを棄却します。
+layout (constant_id = 0) const int BACKFACE_CULLING = 0;
+
+struct Cluster {
+    vec3 Center;
+    float Radius;
+    vec3 ConeAxis;
+    float ConeCutoff;
+    uint FirstIndex;
+    uint IndexCount;
+};
+
+layout (std430, binding = 0) readonly buffer Clusters {
+    Cluster clusters[];
+};
+
+// 16bitのインデックスも32bit単位で読み、シェーダーで取り出します。
+layout (std430, binding = 1) readonly buffer SourceIndices {
+    uint sourceIndices[];
+};
+
+layout (std430, binding = 2) writeonly buffer VisibleIndices {
+    uint visibleIndices[];
+};
+
+layout (std430, binding = 3) buffer DrawCommand {
+    uint IndexCount;
+    uint InstanceCount;
+    uint FirstIndex;
+    int VertexOffset;
+    uint FirstInstance;
+} command;
+
+layout (binding = 4) uniform UniformBufferObject {
+    vec4 Frustum[6];
+    vec4 CameraPos;
+} ubo;
+
+layout (push_constant) uniform PushConstants {
+    mat4 Model;
+    uint ClusterCount;
+    uint Index16;
+} pushConsts;
+
+shared bool visible;
+shared uint base;
+
+uint FetchIndex(uint i) {
+    if (pushConsts.Index16 != 0) {
+        uint word = sourceIndices[i >> 1];
+        return (i & 1) == 0 ? word & 0xffff : word >> 16;
+    }
+    return sourceIndices[i];
+}
+
+bool IsVisible(Cluster cluster) {
+    // モデル行列の最大の拡大率で半径を広げ、ワールド空間の境界球にします。
+    vec3 center = vec3(pushConsts.Model * vec4(cluster.Center, 1.0));
+    float scale = max(max(length(pushConsts.Model[0].xyz),
+                          length(pushConsts.Model[1].xyz)),
+                      length(pushConsts.Model[2].xyz));
+    float radius = cluster.Radius * scale;
+
+    for (int i = 0; i < 6; i++) {
+        if (dot(ubo.Frustum[i].xyz, center) + ubo.Frustum[i].w < -radius) {
+            return false;
+        }
+    }
+
+    // すべての三角形がカメラから見て裏を向いていれば棄却します。(一様なスケールを仮定します。)
+    if (BACKFACE_CULLING != 0 && cluster.ConeCutoff < 1.0) {
+        vec3 axis = normalize(mat3(pushConsts.Model) * cluster.ConeAxis);
+        vec3 view = center - ubo.CameraPos.xyz;
+        if (dot(view, axis) >= cluster.ConeCutoff * length(view) + radius) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void main() {
+    uint clusterIndex = gl_WorkGroupID.x;
+    if (clusterIndex >= pushConsts.ClusterCount) {
+        return;
+    }
+    Cluster cluster = clusters[clusterIndex];
+
+    if (gl_LocalInvocationIndex == 0) {
+        visible = IsVisible(cluster);
+        if (visible) {
+            base = atomicAdd(command.IndexCount, cluster.IndexCount);
+        }
+    }
+    barrier();
+    if (!visible) {
+        return;
+    }
+
+    for (uint i = gl_LocalInvocationIndex; i < cluster.IndexCount;
+         i += gl_WorkGroupSize.x) {
+        visibleIndices[base + i] = FetchIndex(cluster.FirstIndex + i);
+    }
+}
@@ -0,0 +1,32 @@
+#version 450
+
+layout (local_size_x = 8, local_size_y = 8) in;
+
+layout (binding = 0) uniform sampler2D PositionDepthTex;
+layout (binding = 1) uniform sampler2D NormalTex;
+layout (binding = 2, rgba32f) uniform writeonly image2D HalfPositionDepthImage;
+layout (binding = 3, rgba16f) uniform writeonly image2D HalfNormalImage;
+
+void main() {
+    ivec2 dst = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(dst, imageSize(HalfPositionDepthImage)))) {
+        return;
+    }
+
+    // 2x2のテクセルから、ジオメトリが書き込まれた最もカメラに近いものを選びます。
+    // 平均するとエッジに存在しない深度が生まれるため、実際のテクセルをそのまま使います。
+    ivec2 src = dst * 2;
+    ivec2 srcMax = textureSize(PositionDepthTex, 0) - 1;
+    ivec2 best = src;
+    vec4 bestPos = vec4(0.0);
+    for (int i = 0; i < 4; i++) {
+        ivec2 p = min(src + ivec2(i & 1, i >> 1), srcMax);
+        vec4 pos = texelFetch(PositionDepthTex, p, 0);
+        if (pos.w > 0.0 && (bestPos.w == 0.0 || pos.z > bestPos.z)) {
+            best = p;
+            bestPos = pos;
+        }
+    }
+    imageStore(HalfPositionDepthImage, dst, bestPos);
+    imageStore(HalfNormalImage, dst, texelFetch(NormalTex, best, 0));
+}
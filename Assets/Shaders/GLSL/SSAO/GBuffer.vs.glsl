@@ -1,7 +1,7 @@
 #version 450
 
 layout (location = 0) in vec3 VertexPosition;
-layout (location = 1) in vec3 VertexNormal;
+layout (location = 1) in vec2 VertexNormal;
 layout (location = 2) in vec3 VertexColor;
 layout (location = 3) in vec2 VertexUV;
 
@@ -10,23 +10,55 @@ layout (binding = 0) uniform UniformBufferObject {
     mat4 Proj;
 } ubo;
 
+struct Instance {
+    mat4 Model;
+    vec4 Sphere;
+    uint Material;
+    uint Batch;
+    uint Flags;
+    uint BatchFirstInstance;
+};
+
+layout (std430, binding = 4) readonly buffer Instances {
+    Instance instances[];
+};
+
+// コンピュートシェーダーが選別した、バッチごとの見えるインスタンスの番号
+layout (std430, binding = 5) readonly buffer VisibleInstances {
+    uint visibleInstances[];
+};
+
 layout (location = 0) out vec3 Position;
 layout (location = 1) out vec3 Normal;
 layout (location = 2) out vec3 Color;
 layout (location = 3) out vec2 UV;
+layout (location = 4) flat out int Tex;
 
+// 引数のfirstInstanceを使えない場合のみ、バッチの先頭を渡します。
 layout (push_constant) uniform PushConstants {
-    mat4 Model;
+    uint BaseInstance;
 } pushConsts;
 
+// 八面体に写像した法線を単位ベクトルに戻します。
+vec3 OctDecode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
 void main () {
-    Position = vec3(ubo.View * pushConsts.Model * vec4(VertexPosition, 1.0));
+    uint index = visibleInstances[pushConsts.BaseInstance + gl_InstanceIndex];
+    Instance instance = instances[index];
+
+    Position = vec3(ubo.View * instance.Model * vec4(VertexPosition, 1.0));
 
-    mat3 normalMatrix = transpose(inverse(mat3(ubo.View * pushConsts.Model)));
-    Normal = normalMatrix * VertexNormal;
+    mat3 normalMatrix = transpose(inverse(mat3(ubo.View * instance.Model)));
+    Normal = normalMatrix * OctDecode(VertexNormal);
 
     Color = VertexColor;
     UV = VertexUV;
+    Tex = int(instance.Material);
 
     gl_Position = ubo.Proj * vec4(Position, 1.0);
 }
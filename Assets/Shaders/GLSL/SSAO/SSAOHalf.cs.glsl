@@ -0,0 +1,62 @@
+#version 450
+
+layout (local_size_x = 8, local_size_y = 8) in;
+
+layout (constant_id = 0) const int KERNEL_SIZE = 64;
+
+layout (binding = 0) uniform sampler2D PositionDepthTex;
+layout (binding = 1) uniform sampler2D NormalTex;
+layout (binding = 2) uniform sampler2D RandRotTex;
+
+layout (binding = 3) uniform UniformBufferObject {
+    vec4 Samples[KERNEL_SIZE];
+    mat4 Proj;
+    float Radius;
+    float Bias;
+} ubo;
+
+layout (binding = 4, r32f) uniform writeonly image2D AOImage;
+
+void main() {
+    ivec2 dst = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 texDim = imageSize(AOImage);
+    if (any(greaterThanEqual(dst, texDim))) {
+        return;
+    }
+
+    // 背景は遮蔽されません。
+    vec4 posDepth = texelFetch(PositionDepthTex, dst, 0);
+    if (posDepth.w == 0.0) {
+        imageStore(AOImage, dst, vec4(1.0));
+        return;
+    }
+    vec3 pos = posDepth.xyz;
+    vec3 norm = normalize(texelFetch(NormalTex, dst, 0).xyz);
+
+    vec2 UV = (vec2(dst) + 0.5) / vec2(texDim);
+    ivec2 noiseDim = textureSize(RandRotTex, 0);
+    vec2 noiseUV = vec2(texDim) / vec2(noiseDim) * UV;
+    vec3 randDir = normalize(texture(RandRotTex, noiseUV).xyz);
+
+    // 接座標空間->カメラ座標空間変換行列を生成します。
+    vec3 tang = normalize(randDir - norm * dot(randDir, norm));
+    vec3 bitang = cross(norm, tang);
+    mat3 TBN = mat3(tang, bitang, norm);
+
+    // フラグメントシェーダー版と同じサンプリングを半分の解像度で行います。
+    float occ = 0.0;
+    for (int i = 0; i < KERNEL_SIZE; i++) {
+        vec3 samplePos = pos + ubo.Radius * (TBN * ubo.Samples[i].xyz);
+
+        // カメラ座標->クリップ座標->正規化デバイス座標->テクスチャ座標
+        vec4 p = ubo.Proj * vec4(samplePos, 1.0);
+        p *= 1.0 / p.w;
+        p.xyz = p.xyz * 0.5 + 0.5;
+
+        float surfZ = textureLod(PositionDepthTex, p.xy, 0.0).z;
+        float range = smoothstep(0.0, 1.0, ubo.Radius / abs(pos.z - surfZ));
+        occ += (surfZ >= samplePos.z + ubo.Bias ? 1.0 : 0.0) * range;
+    }
+    occ = 1.0 - (occ / float(KERNEL_SIZE));
+    imageStore(AOImage, dst, vec4(occ));
+}
@@ -0,0 +1,37 @@
+#version 450
+
+layout (local_size_x = 8, local_size_y = 8) in;
+
+layout (binding = 0) uniform sampler2D HalfAOTex;
+layout (binding = 1) uniform sampler2D HalfPositionDepthTex;
+layout (binding = 2) uniform sampler2D PositionDepthTex;
+layout (binding = 3, r32f) uniform writeonly image2D AOImage;
+
+void main() {
+    ivec2 dst = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(dst, imageSize(AOImage)))) {
+        return;
+    }
+
+    float z = texelFetch(PositionDepthTex, dst, 0).z;
+
+    // 半分の解像度のテクセル中心を基準にした双線形の重みを求めます。
+    vec2 halfCoord = (vec2(dst) + 0.5) * 0.5 - 0.5;
+    ivec2 base = ivec2(floor(halfCoord));
+    vec2 f = halfCoord - vec2(base);
+    ivec2 halfMax = textureSize(HalfAOTex, 0) - 1;
+
+    // 深度が近いテクセルほど重みを大きくし、エッジの向こう側のAOを持ち込まないようにします。
+    float acc = 0.0;
+    float weightSum = 0.0;
+    for (int i = 0; i < 4; i++) {
+        ivec2 offset = ivec2(i & 1, i >> 1);
+        ivec2 p = clamp(base + offset, ivec2(0), halfMax);
+        vec2 b = mix(1.0 - f, f, vec2(offset));
+        float halfZ = texelFetch(HalfPositionDepthTex, p, 0).z;
+        float w = b.x * b.y / (1e-3 + abs(z - halfZ));
+        acc += texelFetch(HalfAOTex, p, 0).r * w;
+        weightSum += w;
+    }
+    imageStore(AOImage, dst, vec4(acc / weightSum));
+}
@@ -0,0 +1,157 @@
+#version 450
+
+// 1つのワークグループが縮小元の64x64の画素を担当し、続く最大6つのレベルを生成します。
+// それより多いレベルは、最後に終わったワークグループがレベル6から続けて生成します。
+layout (local_size_x = 16, local_size_y = 16) in;
+
+// 1の場合は色を線形の値に戻してから平均し、sRGBに戻して書き込みます。
+layout (constant_id = 0) const int SRGB = 0;
+
+const int MAX_LEVELS = 13;
+const int TILE_LEVELS = 6;
+
+// レベルごとのビューです。(使わない要素は最後のレベルのビューで埋めます。)
+layout (binding = 0, rgba8) uniform coherent image2D Levels[MAX_LEVELS];
+
+// 終わったワークグループの数です。(最後のワークグループが0に戻します。)
+layout (std430, binding = 1) coherent buffer Counter {
+    uint finishedGroups;
+};
+
+layout (push_constant) uniform PushConstants {
+    ivec2 Size;
+    int LevelCount;
+    uint GroupCount;
+} pushConsts;
+
+shared vec4 tile[16][16];
+shared bool lastGroup;
+
+vec4 ToLinear(vec4 c) {
+    if (SRGB == 0) {
+        return c;
+    }
+    vec3 lo = c.rgb / 12.92;
+    vec3 hi = pow((c.rgb + 0.055) / 1.055, vec3(2.4));
+    return vec4(mix(hi, lo, lessThanEqual(c.rgb, vec3(0.04045))), c.a);
+}
+
+vec4 FromLinear(vec4 c) {
+    if (SRGB == 0) {
+        return c;
+    }
+    vec3 lo = c.rgb * 12.92;
+    vec3 hi = 1.055 * pow(c.rgb, vec3(1.0 / 2.4)) - 0.055;
+    return vec4(mix(hi, lo, lessThanEqual(c.rgb, vec3(0.0031308))), c.a);
+}
+
+ivec2 LevelSize(int level) {
+    return max(pushConsts.Size >> level, ivec2(1));
+}
+
+// 記述子の配列は定数の添字でのみ参照します。(動的な添字には機能が必要です。)
+// 画像の外の画素(端のタイルの余り)は端の画素を読みます。
+vec4 Load(int level, ivec2 p) {
+    p = min(p, LevelSize(level) - 1);
+    if (level == 0) {
+        return ToLinear(imageLoad(Levels[0], p));
+    }
+    return ToLinear(imageLoad(Levels[TILE_LEVELS], p));
+}
+
+void Store(int level, ivec2 p, vec4 v) {
+    if (level >= pushConsts.LevelCount ||
+        any(greaterThanEqual(p, LevelSize(level)))) {
+        return;
+    }
+    v = FromLinear(v);
+    switch (level) {
+        case 1: imageStore(Levels[1], p, v); break;
+        case 2: imageStore(Levels[2], p, v); break;
+        case 3: imageStore(Levels[3], p, v); break;
+        case 4: imageStore(Levels[4], p, v); break;
+        case 5: imageStore(Levels[5], p, v); break;
+        case 6: imageStore(Levels[6], p, v); break;
+        case 7: imageStore(Levels[7], p, v); break;
+        case 8: imageStore(Levels[8], p, v); break;
+        case 9: imageStore(Levels[9], p, v); break;
+        case 10: imageStore(Levels[10], p, v); break;
+        case 11: imageStore(Levels[11], p, v); break;
+        case 12: imageStore(Levels[12], p, v); break;
+    }
+}
+
+// 2x2の画素の右と下の位置です。(大きさが1の辺では同じ画素を重ねて読みます。)
+ivec2 FarCorner(ivec2 p, int level) {
+    return p + ivec2(lessThan(p + 1, LevelSize(level)));
+}
+
+// srcLevelの64x64の画素から、続く最大6つのレベルを生成します。
+void DownsampleTile(int srcLevel, ivec2 tileId) {
+    ivec2 local = ivec2(gl_LocalInvocationID.xy);
+
+    // スレッドごとに縮小元の4x4の画素から、次のレベルの2x2の画素を求めます。
+    ivec2 mid = tileId * 32 + local * 2;
+    vec4 v[4];
+    for (int i = 0; i < 4; i++) {
+        ivec2 p = mid + ivec2(i & 1, i >> 1);
+        ivec2 a = p * 2;
+        ivec2 b = FarCorner(a, srcLevel);
+        v[i] = (Load(srcLevel, a) + Load(srcLevel, ivec2(b.x, a.y)) +
+                Load(srcLevel, ivec2(a.x, b.y)) + Load(srcLevel, b)) * 0.25;
+        Store(srcLevel + 1, p, v[i]);
+    }
+
+    // 2x2の画素を平均して、その次のレベルの1つの画素にします。
+    ivec2 far = FarCorner(mid, srcLevel + 1) - mid;
+    vec4 value = (v[0] + v[far.x] + v[far.y * 2] + v[far.x + far.y * 2]) *
+                 0.25;
+    Store(srcLevel + 2, tileId * 16 + local, value);
+    tile[local.y][local.x] = value;
+
+    // 残りのレベルは共有メモリの2x2の画素を平均します。
+    int level = srcLevel + 2;
+    for (int size = 8; size >= 1; size >>= 1) {
+        level++;
+        barrier();
+        bool active = all(lessThan(local, ivec2(size)));
+        if (active) {
+            ivec2 origin = tileId * size * 2;
+            ivec2 a = local * 2;
+            ivec2 b = FarCorner(origin + a, level - 1) - origin;
+            value = (tile[a.y][a.x] + tile[a.y][b.x] + tile[b.y][a.x] +
+                     tile[b.y][b.x]) * 0.25;
+        }
+        barrier();
+        if (active) {
+            tile[local.y][local.x] = value;
+            Store(level, tileId * size + local, value);
+        }
+    }
+}
+
+void main() {
+    DownsampleTile(0, ivec2(gl_WorkGroupID.xy));
+    if (pushConsts.LevelCount <= TILE_LEVELS + 1) {
+        return;
+    }
+
+    // 書き込んだレベル6を他のワークグループから読めるようにしてから数えます。
+    memoryBarrierImage();
+    barrier();
+    if (gl_LocalInvocationIndex == 0) {
+        uint finished = atomicAdd(finishedGroups, 1u);
+        lastGroup = finished == pushConsts.GroupCount - 1u;
+    }
+    barrier();
+    if (!lastGroup) {
+        return;
+    }
+
+    // 4096x4096まではレベル6が64x64以下なので、1つのワークグループで残りを生成できます。
+    memoryBarrierImage();
+    DownsampleTile(TILE_LEVELS, ivec2(0));
+    if (gl_LocalInvocationIndex == 0) {
+        finishedGroups = 0u;
+    }
+}
@@ -1,7 +1,7 @@
 struct VSOutput {
     [[vk::location(0)]] float3 WorldPos : POSITION0;
-    [[vk::location(1)]] float3 Color : COLOR0;
-    [[vk::location(2)]] float3 Normal : NORMAL0;
+    [[vk::location(1)]] float3 Normal : NORMAL0;
+    [[vk::location(2)]] float3 Color : COLOR0;
 };
 
 struct FSOutput {
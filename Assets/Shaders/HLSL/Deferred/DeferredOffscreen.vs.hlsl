@@ -1,15 +1,18 @@
+// 位置は半精度、法線は八面体に写像した16bitの値、色は8bitの正規化した値です。
 struct VSInput {
     [[vk::location(0)]] float3 Pos : POSITION0;
-    [[vk::location(1)]] float3 Color : COLOR0;
-    [[vk::location(2)]] float3 Normal : NORMAL0;
+    [[vk::location(1)]] float2 Normal : NORMAL0;
+    [[vk::location(2)]] float3 Color : COLOR0;
 };
 
 struct UniformBufferObject {
-    float4x4 ViewProj;
+    float4x4 View;
+    float4x4 Proj;
 };
 
 cbuffer ubo : register(b0) { UniformBufferObject ubo; }
 
+// モデル行列にはModel::DequantizeMatrixが掛けてあり、半精度の位置を元の座標に戻します。
 struct PushConstants {
     float4x4 Model;
 };
@@ -18,19 +21,27 @@ struct PushConstants {
 struct VSOutput {
     float4 Pos : SV_POSITION;
     [[vk::location(0)]] float3 WorldPos : POSITION0;
-    [[vk::location(1)]] float3 Color : COLOR0;
-    [[vk::location(2)]] float3 Normal : NORMAL;
+    [[vk::location(1)]] float3 Normal : NORMAL0;
+    [[vk::location(2)]] float3 Color : COLOR0;
 };
 
+// 八面体に写像した法線を単位ベクトルに戻します。
+float3 OctDecode(float2 e) {
+    float3 n = float3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += float2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
 VSOutput main(VSInput input) {
     VSOutput output = (VSOutput)0;
     
     float4 localPos = float4(input.Pos, 1.0);
-    output.Pos =  mul(ubo.ViewProj, mul(pushConsts.Model, localPos));
-    
     output.WorldPos = mul(pushConsts.Model, localPos).xyz;
+    output.Pos = mul(ubo.Proj, mul(ubo.View, float4(output.WorldPos, 1.0)));
     output.Color = input.Color;
-    output.Normal = mul((float3x3)pushConsts.Model, input.Normal);
+    // モデル行列には位置を戻すスケールが含まれるため、正規化してから書き込みます。
+    output.Normal = normalize(mul((float3x3)pushConsts.Model, OctDecode(input.Normal)));
 
     return output;
 }
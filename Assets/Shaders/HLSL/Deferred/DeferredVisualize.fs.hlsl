@@ -1,3 +1,9 @@
+// LightCull.cs.glslと一致させます。
+static const uint TILE_SIZE = 16;
+static const uint MAX_LIGHTS_PER_TILE = 255;
+static const uint TILE_STRIDE = MAX_LIGHTS_PER_TILE + 1;
+static const uint TILE_OVERFLOW = 0x80000000;
+static const uint SPOT = 1;
 
 Texture2D PosTex : register (t1);
 SamplerState PosSamp : register(s1);
@@ -10,22 +16,35 @@ struct Light {
     float4 Position;
     float3 Color;
     float Radius;
+    float3 Direction;
+    float Range;
+    float CosInner;
+    float CosOuter;
+    uint Type;
+    float Padding;
 };
 
 struct UniformBufferObject {
-    Light Lights[8];
     float4 ViewPos;
     int LightsNum;
     int DisplayRenderTarget;
+    uint TileCountX;
+    uint TileCountY;
+    // UVにかけるとタイルの番号になります。
+    float2 TileScale;
 };
 
-cbuffer ubo : register(b4) { 
+cbuffer ubo : register(b4) {
     UniformBufferObject ubo;
 }
 
-float3 BlinnPhongModel(float3 pos, float3 norm, float4 albedo, int lightIdx) {
+StructuredBuffer<Light> Lights : register(t5);
+// タイルごとに先頭がライトの数、続けてライトの番号です。
+StructuredBuffer<uint> TileLights : register(t6);
+
+float3 BlinnPhongModel(float3 pos, float3 norm, float4 albedo, Light light) {
     // ライトのベクトルを計算します。
-    float3 L = ubo.Lights[lightIdx].Position.xyz - pos;
+    float3 L = light.Position.xyz - pos;
     float dist = length(L);
     L = normalize(L);
 
@@ -33,19 +52,32 @@ float3 BlinnPhongModel(float3 pos, float3 norm, float4 albedo, int lightIdx) {
     float3 V = normalize(ubo.ViewPos.xyz - pos);
 
     // 減衰します。
-    float atten = ubo.Lights[lightIdx].Position.w == 0.0
-        ? 1.0 
-        : ubo.Lights[lightIdx].Radius / (pow(dist, 2.0) + 1.0);
+    float atten = light.Position.w == 0.0
+        ? 1.0
+        : light.Radius / (pow(dist, 2.0) + 1.0);
+
+    // 距離が有限のライトは、影響する距離で滑らかに0にします。
+    if (light.Range > 0.0) {
+        float ratio = dist / light.Range;
+        float window = saturate(1.0 - ratio * ratio * ratio * ratio);
+        atten *= window * window;
+    }
+
+    // スポットライトは内側と外側の角度の間で減衰します。
+    if (light.Type == SPOT) {
+        atten *= smoothstep(light.CosOuter, light.CosInner,
+                            dot(-L, light.Direction));
+    }
 
     // ディフューズを計算します。
     float3 N = normalize(norm);
     float NoL = saturate(dot(N, L));
-    float3 diff = ubo.Lights[lightIdx].Color * albedo.rgb * NoL;
+    float3 diff = light.Color * albedo.rgb * NoL;
 
     // スペキュラを計算します。
     float3 H = normalize(V + L);
     float NoH = saturate(dot(N, H));
-    float3 spec = ubo.Lights[lightIdx].Color * pow(NoH, 16.0f);
+    float3 spec = light.Color * pow(NoH, 16.0f);
 
     return (diff + spec) * atten;
 }
@@ -56,11 +88,20 @@ float4 main([[vk::location(0)]] float2 uv : TEXCOORD0) : SV_TARGET {
     float3 norm = NormTex.Sample(NormSamp, uv).rgb;
     float4 albedo = AlbedoTex.Sample(AlbedoSamp, uv);
 
+    // 画素のタイルのライトのリストを求めます。
+    // タイルは選別したときの画面の大きさで分けているため、UVから求めます。
+    uint2 tile = min(uint2(uv * ubo.TileScale),
+                     uint2(ubo.TileCountX, ubo.TileCountY) - 1);
+    uint base = (tile.y * ubo.TileCountX + tile.x) * TILE_STRIDE;
+    // 最大数を超えたタイルは、最大数までのライトのみを計算します。
+    uint count = TileLights[base] & ~TILE_OVERFLOW;
+    bool overflow = (TileLights[base] & TILE_OVERFLOW) != 0;
+
     // デバッグなどに使用します。
     float3 fragColor = float3(0.0);
     if (ubo.DisplayRenderTarget > 0) {
         switch (ubo.DisplayRenderTarget) {
-            case 1: 
+            case 1:
                 fragColor = pos;
                 break;
             case 2:
@@ -69,12 +110,20 @@ float4 main([[vk::location(0)]] float2 uv : TEXCOORD0) : SV_TARGET {
             case 3:
                 fragColor = albedo.rgb;
                 break;
+            case 4:
+                // タイルのライトの数を青から赤で表し、最大数を超えたタイルは白にします。
+                fragColor = overflow
+                    ? float3(1.0, 1.0, 1.0)
+                    : lerp(float3(0.0, 0.0, 1.0), float3(1.0, 0.0, 0.0),
+                           saturate(float(count) / 32.0));
+                break;
         }
         return float4(fragColor, 1.0);
     }
 
-    for (int i = 0 ; i < ubo.LightsNum; i++) {
-        fragColor += BlinnPhongModel(pos, norm, albedo, i);
+    for (uint i = 0 ; i < count; i++) {
+        fragColor += BlinnPhongModel(pos, norm, albedo,
+                                     Lights[TileLights[base + 1 + i]]);
     }
     return float4(fragColor, 1.0);
 }
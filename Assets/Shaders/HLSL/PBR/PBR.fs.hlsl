@@ -1,10 +1,12 @@
 static const float PI = 3.14159265358979323846264;
 static const float GAMMA = 2.2;
 static const int LIGHTS_MAX = 8;
+static const int MATERIALS_MAX = 3;
 
 struct VSOutput {
     [[vk::location(0)]] float3 WorldPos : POSITION0;
     [[vk::location(1)]] float3 Normal : NORMAL0;
+    [[vk::location(2)]] nointerpolation int MaterialIndex : MATERIAL0;
 };
 
 struct LightInfo {
@@ -12,31 +14,24 @@ struct LightInfo {
     float Intensity;
 };
 
+struct MaterialInfo {
+    float4 Color;
+    float Roughness;
+    float Metallic;
+    float Reflectance;
+};
+
 struct UniformBufferObjectShared {
     float3 CamPos;
     LightInfo Lights[LIGHTS_MAX];
     int LightsNum;
+    MaterialInfo Materials[MATERIALS_MAX];
 };
 
 cbuffer uboParams : register(b1) {
     UniformBufferObjectShared uboParams;
 }
 
-struct PushConstants {
-    [[vk::offset(12)]] float Roughness;
-    [[vk::offset(16)]] float Metallic;
-    [[vk::offset(20)]] float Reflectance;
-    [[vk::offset(24)]] float R;
-    [[vk::offset(28)]] float G;
-    [[vk::offset(32)]] float B;
-};
-
-[[vk::push_constant]] PushConstants material;
-
-float3 MaterialBaseColor() {
-    return float3(material.R, material.G, material.B);
-}
-
 /**
  * @brief The GGX distribution (GGX分布関数)
  */
@@ -67,12 +62,12 @@ float3 GammaCorrection(float3 color) {
     return pow(color, float3(1.0 / GAMMA, 1.0 / GAMMA, 1.0 / GAMMA));
 }
 
-float3 MicroFacetModel(int lightIdx, float3 pos, float3 n) {
+float3 MicroFacetModel(int lightIdx, float3 pos, float3 n, MaterialInfo material) {
     // 誘電体(非金属)ならDiffuse色(Albedo)取得
-    float3 diff = (1.0 - material.Metallic) * MaterialBaseColor();
+    float3 diff = (1.0 - material.Metallic) * material.Color.rgb;
 
     // 金属(導体)ならSpecular色取得
-    float3 f0 = 0.16 * material.Reflectance * material.Reflectance * (1.0 - material.Metallic) + MaterialBaseColor() * material.Metallic;
+    float3 f0 = 0.16 * material.Reflectance * material.Reflectance * (1.0 - material.Metallic) + material.Color.rgb * material.Metallic;
 
     // ライトに関して。
     float3 l = float3(0.0, 0.0, 0.0);
@@ -108,9 +103,10 @@ float3 MicroFacetModel(int lightIdx, float3 pos, float3 n) {
 float4 main(VSOutput input) : SV_TARGET {
     float3 color = float3(0.0, 0.0, 0.0);
     float3 n = normalize(input.Normal);
+    MaterialInfo material = uboParams.Materials[input.MaterialIndex];
 
     for (int i = 0; i < uboParams.LightsNum; i++) {
-        color += MicroFacetModel(i, input.WorldPos, n);
+        color += MicroFacetModel(i, input.WorldPos, n, material);
     }
 
     return float4(GammaCorrection(color), 1.0);
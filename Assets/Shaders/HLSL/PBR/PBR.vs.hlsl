@@ -1,35 +1,63 @@
+// 位置は半精度、法線は八面体に写像した16bitの値です。
+// (半精度の位置はモデル行列に掛けたModel::DequantizeMatrixで元の座標に戻ります。)
 struct VSInput {
     [[vk::location(0)]] float3 Position : POSITION0;
-    [[vk::location(1)]] float3 Normal : NORMAL0;
+    [[vk::location(1)]] float2 Normal : NORMAL0;
+    uint InstanceIndex : SV_InstanceID;
 };
 
 struct UniformBufferObject {
-    float4x4 Model;
-    float4x4 View;
-    float4x4 Proj;
+    float4x4 ViewProj;
 };
 
-cbuffer ubo :register(b0) {
+cbuffer ubo : register(b0) {
     UniformBufferObject ubo;
 }
 
+struct Instance {
+    float4x4 Model;
+    float4 Sphere;
+    uint Material;
+    uint Batch;
+    uint Flags;
+    uint BatchFirstInstance;
+};
+
+StructuredBuffer<Instance> instances : register(t2);
+
+// コンピュートシェーダーが選別した、バッチごとの見えるインスタンスの番号
+StructuredBuffer<uint> visibleInstances : register(t3);
+
+// 引数のfirstInstanceを使えない場合のみ、バッチの先頭を渡します。
+struct PushConstants {
+    uint BaseInstance;
+};
+
+[[vk::push_constant]] PushConstants pushConsts;
+
 struct VSOutput {
     float4 Position : SV_POSITION;
     [[vk::location(0)]] float3 WorldPos : POSITION0;
     [[vk::location(1)]] float3 Normal : NORMAL0;
+    [[vk::location(2)]] nointerpolation int MaterialIndex : MATERIAL0;
 };
 
-struct PushConstants {
-    float3 ObjPos;
-};
-
-[[vk::push_constant]] 
-PushConstants pushConsts;
+// 八面体に写像した法線を単位ベクトルに戻します。
+float3 OctDecode(float2 e) {
+    float3 n = float3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += float2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
 
 VSOutput main(VSInput input) {
     VSOutput output = (VSOutput)0;
-    output.WorldPos = mul(ubo.Model, float4(input.Position, 1.0)).xyz + pushConsts.ObjPos;
-    output.Normal = mul((float3x3)ubo.Model, input.Normal);
-    output.Position = mul(ubo.Proj, mul(ubo.View, float4(output.WorldPos, 1.0)));
+    uint index = visibleInstances[pushConsts.BaseInstance + input.InstanceIndex];
+    Instance instance = instances[index];
+
+    output.WorldPos = mul(instance.Model, float4(input.Position, 1.0)).xyz;
+    output.Normal = mul((float3x3)instance.Model, OctDecode(input.Normal));
+    output.MaterialIndex = int(instance.Material);
+    output.Position = mul(ubo.ViewProj, float4(output.WorldPos, 1.0));
     return output;
 }
@@ -0,0 +1,221 @@
+/**
+ * @brief BVHの構築と問い合わせの時間を、オブジェクトの数を変えて計測します。
+ * @note
+ * デバイスを使用しないため、Vulkanの無い環境でも実行できます。<br>
+ * 比較のため、同じ視錐台を線形のFrustumCullerと、BVHで粗く棄却してから葉をFrustumCullerで判定する方法でも判定します。
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <glm/gtc/matrix_transform.hpp>
+#include <nlohmann/json.hpp>
+#include <random>
+#include <spdlog/spdlog.h>
+#include <string>
+#include <vector>
+
+#include "Geometry/BVH.h"
+#include "View/Frustum.h"
+#include "View/FrustumCuller.h"
+
+/** @brief 問い合わせごとの繰り返しの回数 */
+static constexpr uint32_t kQueryCount = 256;
+/** @brief オブジェクトを散らばらせる立方体の半分の大きさ */
+static constexpr float kWorldExtent = 1000.0f;
+
+/**
+ * @brief 関数の実行時間を計測します。
+ * @return 経過時間(ミリ秒)
+ */
+template <typename F> static double Measure(F &&func) {
+  const auto begin = std::chrono::steady_clock::now();
+  func();
+  const auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(end - begin).count();
+}
+
+/**
+ * @brief 大きさの異なる箱をシーンに散らばらせます。
+ */
+static std::vector<AABB> MakeScene(uint32_t count, std::mt19937 &rng) {
+  std::uniform_real_distribution<float> position(-kWorldExtent, kWorldExtent);
+  std::uniform_real_distribution<float> size(0.5f, 8.0f);
+  std::vector<AABB> bounds(count);
+  for (auto &aabb : bounds) {
+    const glm::vec3 center(position(rng), position(rng) * 0.1f, position(rng));
+    const glm::vec3 extent(size(rng), size(rng), size(rng));
+    aabb.Merge(center - extent);
+    aabb.Merge(center + extent);
+  }
+  return bounds;
+}
+
+/**
+ * @brief シーンを斜めに見下ろすカメラの視錐台を作成します。
+ */
+static std::vector<FrustumCuller::Planes> MakeFrustums(std::mt19937 &rng) {
+  std::uniform_real_distribution<float> position(-kWorldExtent, kWorldExtent);
+  const glm::mat4 proj =
+      glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.3f, 500.0f);
+  std::vector<FrustumCuller::Planes> frustums(kQueryCount);
+  for (auto &planes : frustums) {
+    const glm::vec3 eye(position(rng), 50.0f, position(rng));
+    const glm::vec3 target(position(rng), 0.0f, position(rng));
+    planes = Frustum::ExtractPlanes(
+        proj * glm::lookAt(eye, target, glm::vec3(0.0f, 1.0f, 0.0f)));
+  }
+  return frustums;
+}
+
+static nlohmann::json Run(uint32_t count, std::mt19937 &rng) {
+  auto bounds = MakeScene(count, rng);
+  const auto frustums = MakeFrustums(rng);
+  std::uniform_real_distribution<float> position(-kWorldExtent, kWorldExtent);
+
+  BVH bvh{};
+  const double buildMs = Measure([&] { bvh.Build(bounds); });
+
+  // すべてのオブジェクトを少し動かしてから境界を更新します。
+  const glm::vec3 offset(1.0f, 0.0f, -1.0f);
+  for (auto &aabb : bounds) {
+    aabb.mini += offset;
+    aabb.maxi += offset;
+  }
+  const double refitMs = Measure([&] { bvh.Refit(bounds); });
+
+  std::vector<uint32_t> result{};
+  size_t visible = 0;
+  const double bvhCullMs = Measure([&] {
+    for (const auto &planes : frustums) {
+      bvh.Cull(planes, result);
+      visible += result.size();
+    }
+  });
+
+  FrustumCuller culler{};
+  culler.Reserve(count);
+  for (const auto &aabb : bounds) {
+    static_cast<void>(culler.Add(aabb));
+  }
+  size_t linearVisible = 0;
+  const double linearCullMs = Measure([&] {
+    for (const auto &planes : frustums) {
+      culler.Cull(planes, result);
+      linearVisible += result.size();
+    }
+  });
+
+  // 葉の順に並べたFrustumCullerで、BVHが平面と交差すると判定した葉の範囲を判定します。
+  FrustumCuller leafCuller{};
+  leafCuller.Reserve(count);
+  for (const auto index : bvh.GetIndices()) {
+    static_cast<void>(leafCuller.Add(bounds[index]));
+  }
+  std::vector<BVH::LeafRange> partial{};
+  std::vector<uint32_t> leaves{};
+  size_t layeredVisible = 0;
+  const double layeredCullMs = Measure([&] {
+    for (const auto &planes : frustums) {
+      bvh.Cull(planes, result, partial);
+      leaves.clear();
+      for (const auto &range : partial) {
+        leafCuller.CullRange(planes, range.first, range.count, leaves);
+      }
+      layeredVisible += result.size() + leaves.size();
+    }
+  });
+
+  uint32_t rayHits = 0;
+  const double raycastMs = Measure([&] {
+    for (uint32_t i = 0; i < kQueryCount; i++) {
+      const glm::vec3 origin(position(rng), 50.0f, position(rng));
+      const glm::vec3 target(position(rng), 0.0f, position(rng));
+      if (bvh.Raycast(origin, glm::normalize(target - origin),
+                      kWorldExtent * 4.0f)) {
+        rayHits++;
+      }
+    }
+  });
+
+  size_t overlaps = 0;
+  const double overlapMs = Measure([&] {
+    for (uint32_t i = 0; i < kQueryCount; i++) {
+      const BSphere light{glm::vec3(position(rng), 0.0f, position(rng)),
+                          25.0f};
+      bvh.Overlap(light, result);
+      overlaps += result.size();
+    }
+  });
+
+  const double queries = kQueryCount;
+  spdlog::info("{:>8} objects: build {:8.2f} ms, refit {:6.2f} ms, "
+               "cull {:8.1f} us (linear {:8.1f} us, layered {:8.1f} us), "
+               "ray {:6.2f} us, overlap {:6.2f} us",
+               count, buildMs, refitMs, bvhCullMs * 1000.0 / queries,
+               linearCullMs * 1000.0 / queries,
+               layeredCullMs * 1000.0 / queries, raycastMs * 1000.0 / queries,
+               overlapMs * 1000.0 / queries);
+  // 平面上のオブジェクトは丸め(FMAの有無など)で判定が変わるため、問い合わせごとに1個まで許します。
+  const auto disagree = [](size_t a, size_t b) {
+    return (a > b ? a - b : b - a) > kQueryCount;
+  };
+  if (disagree(visible, linearVisible) || disagree(visible, layeredVisible)) {
+    spdlog::error("BVH, linear and layered culling disagree: {}, {}, {}",
+                  visible, linearVisible, layeredVisible);
+  }
+
+  return {
+      {"Objects", count},
+      {"Nodes", bvh.GetNodes().size()},
+      {"BuildMs", buildMs},
+      {"RefitMs", refitMs},
+      {"CullUs", bvhCullMs * 1000.0 / queries},
+      {"LinearCullUs", linearCullMs * 1000.0 / queries},
+      {"LayeredCullUs", layeredCullMs * 1000.0 / queries},
+      {"AverageVisible", static_cast<double>(visible) / queries},
+      {"RaycastUs", raycastMs * 1000.0 / queries},
+      {"RayHits", rayHits},
+      {"OverlapUs", overlapMs * 1000.0 / queries},
+      {"AverageOverlaps", static_cast<double>(overlaps) / queries},
+  };
+}
+
+/**
+ * @brief 使い方を表示します。
+ */
+static void PrintUsage(const char *program) {
+  spdlog::info("Usage: {} [--output <path>]", program);
+  spdlog::info("  -o, --output <path>  "
+               "report path (default: ./BVHBenchmark.json)");
+  spdlog::info("  -h, --help           show this help");
+}
+
+int main(int argc, char **argv) {
+  std::string output = "./BVHBenchmark.json";
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (arg == "-h" || arg == "--help") {
+      PrintUsage(argv[0]);
+      return EXIT_SUCCESS;
+    }
+    if ((arg == "-o" || arg == "--output") && i + 1 < argc) {
+      output = argv[++i];
+      continue;
+    }
+    spdlog::error("Unknown or incomplete argument: {}", arg);
+    PrintUsage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  std::mt19937 rng(1234);
+  nlohmann::json report = nlohmann::json::array();
+  for (const uint32_t count : {10'000u, 100'000u, 1'000'000u}) {
+    report.push_back(Run(count, rng));
+  }
+
+  std::ofstream ofs(output);
+  ofs << report.dump(2) << std::endl;
+  spdlog::info("BVH benchmark report written to {}", output);
+  return EXIT_SUCCESS;
+}
@@ -25,6 +25,38 @@ struct AABB {
     maxi.z = std::fmax(maxi.z, z);
   }
 
+  void Merge(const AABB &aabb) {
+    mini = glm::min(mini, aabb.mini);
+    maxi = glm::max(maxi, aabb.maxi);
+  }
+
+  bool IsEmpty() const {
+    return mini.x > maxi.x || mini.y > maxi.y || mini.z > maxi.z;
+  }
+
+  glm::vec3 Center() const { return (mini + maxi) * 0.5f; }
+  glm::vec3 Extent() const { return (maxi - mini) * 0.5f; }
+
+  /**
+   * @brief 変換した箱を囲む軸に平行な箱を返します。
+   * @note 中心を変換し、半分の大きさは行列の要素の絶対値で変換します。
+   */
+  AABB Transform(const glm::mat4 &m) const {
+    if (IsEmpty()) {
+      return *this;
+    }
+    const glm::vec3 center = glm::vec3(m * glm::vec4(Center(), 1.0f));
+    const glm::vec3 extent = Extent();
+    glm::vec3 halfSize(0.0f);
+    for (int i = 0; i < 3; i++) {
+      halfSize += glm::abs(glm::vec3(m[i])) * extent[i];
+    }
+    AABB res;
+    res.mini = center - halfSize;
+    res.maxi = center + halfSize;
+    return res;
+  }
+
   glm::vec3 mini;
   glm::vec3 maxi;
 };
@@ -0,0 +1,466 @@
+/**
+ * @brief シーンのオブジェクトの境界を階層に分け、カリングや空間の問い合わせを対数時間で行います。
+ */
+
+#include "Geometry/BVH.h"
+
+#include <algorithm>
+#include <boost/assert.hpp>
+#include <limits>
+
+/** @brief SAHで分割の位置を探すビンの数 */
+static constexpr uint32_t kBinCount = 16;
+/** @brief 木の深さの上限(これより深いノードは葉にして、走査のスタックを固定長にします。) */
+static constexpr uint32_t kMaxDepth = 48;
+/** @brief 走査のスタックの長さ(子を2つずつ積むため、深さより少し長くします。) */
+static constexpr uint32_t kStackSize = kMaxDepth + 2;
+
+/**
+ * @brief 箱の表面積の半分を返します。(SAHでは比のみを使うため、半分で十分です。)
+ */
+static float HalfArea(const AABB &aabb) {
+  if (aabb.IsEmpty()) {
+    return 0.0f;
+  }
+  const glm::vec3 e = aabb.maxi - aabb.mini;
+  return e.x * e.y + e.y * e.z + e.z * e.x;
+}
+
+static AABB BoundsOf(const BVH::Node &node) {
+  AABB aabb;
+  aabb.mini = node.mini;
+  aabb.maxi = node.maxi;
+  return aabb;
+}
+
+/**
+ * @brief 箱とレイの交差を求めます。
+ * @return 箱に入るまでのパラメータ(交差しない場合は無限大です。)
+ */
+static float IntersectRay(const glm::vec3 &mini, const glm::vec3 &maxi,
+                          const glm::vec3 &origin,
+                          const glm::vec3 &invDirection, float tMax) {
+  const glm::vec3 t0 = (mini - origin) * invDirection;
+  const glm::vec3 t1 = (maxi - origin) * invDirection;
+  const glm::vec3 tNear = glm::min(t0, t1);
+  const glm::vec3 tFar = glm::max(t0, t1);
+  const float enter = std::max({tNear.x, tNear.y, tNear.z, 0.0f});
+  const float exit = std::min({tFar.x, tFar.y, tFar.z, tMax});
+  return enter <= exit ? enter : std::numeric_limits<float>::infinity();
+}
+
+/**
+ * @brief 箱と球が重なるかを、箱の中で球の中心に最も近い点との距離で判定します。
+ */
+static bool IntersectSphere(const glm::vec3 &mini, const glm::vec3 &maxi,
+                            const BSphere &sphere) {
+  const glm::vec3 d = glm::clamp(sphere.center, mini, maxi) - sphere.center;
+  return glm::dot(d, d) <= sphere.radius * sphere.radius;
+}
+
+//*-----------------------------------------------------------------------------
+// Build
+//*-----------------------------------------------------------------------------
+
+/**
+ * @brief オブジェクトの境界から木を構築します。
+ * @param bounds オブジェクトのワールド空間の境界(添字がオブジェクトの番号です。)
+ * @param maxLeafSize 葉に入れるオブジェクトの最大数
+ */
+void BVH::Build(const std::vector<AABB> &bounds, uint32_t maxLeafSize) {
+  nodes_.clear();
+  indices_.clear();
+  leafBounds_.clear();
+  if (bounds.empty()) {
+    return;
+  }
+
+  const auto count = static_cast<uint32_t>(bounds.size());
+  std::vector<Primitive> primitives(count);
+  for (uint32_t i = 0; i < count; i++) {
+    primitives[i].bounds = bounds[i];
+    primitives[i].centroid = bounds[i].Center();
+    primitives[i].id = i;
+  }
+
+  // 2分木なので、ノードは高々2 * count - 1個です。
+  nodes_.reserve(size_t{count} * 2);
+  static_cast<void>(
+      BuildNode(primitives, 0, count, 0, std::max(maxLeafSize, 1u)));
+  nodes_.shrink_to_fit();
+
+  indices_.resize(count);
+  leafBounds_.resize(count);
+  for (uint32_t i = 0; i < count; i++) {
+    indices_[i] = primitives[i].id;
+    leafBounds_[i] = primitives[i].bounds;
+  }
+}
+
+/**
+ * @brief [first, first + count)のオブジェクトを持つノードを追加し、必要なら2つに分割します。
+ * @return 追加したノードの番号
+ */
+uint32_t BVH::BuildNode(std::vector<Primitive> &primitives, uint32_t first,
+                        uint32_t count, uint32_t depth,
+                        uint32_t maxLeafSize) {
+  const auto index = static_cast<uint32_t>(nodes_.size());
+  nodes_.emplace_back();
+
+  AABB bounds;
+  AABB centroidBounds;
+  for (uint32_t i = first; i < first + count; i++) {
+    bounds.Merge(primitives[i].bounds);
+    centroidBounds.Merge(primitives[i].centroid);
+  }
+  nodes_[index].mini = bounds.mini;
+  nodes_[index].maxi = bounds.maxi;
+
+  const auto makeLeaf = [&] {
+    nodes_[index].offset = first;
+    nodes_[index].count = count;
+    return index;
+  };
+  if (count <= maxLeafSize || depth >= kMaxDepth) {
+    return makeLeaf();
+  }
+
+  // 重心の広がりが最も大きい軸で分割します。
+  const glm::vec3 extent = centroidBounds.maxi - centroidBounds.mini;
+  int axis = 0;
+  if (extent.y > extent[axis]) {
+    axis = 1;
+  }
+  if (extent.z > extent[axis]) {
+    axis = 2;
+  }
+
+  uint32_t mid = first + count / 2;
+  if (extent[axis] > 0.0f) {
+    const float origin = centroidBounds.mini[axis];
+    const float scale = static_cast<float>(kBinCount) / extent[axis];
+    const auto binOf = [&](const Primitive &primitive) {
+      const auto bin =
+          static_cast<uint32_t>((primitive.centroid[axis] - origin) * scale);
+      return std::min(bin, kBinCount - 1);
+    };
+
+    std::array<AABB, kBinCount> binBounds{};
+    std::array<uint32_t, kBinCount> binCounts{};
+    for (uint32_t i = first; i < first + count; i++) {
+      const uint32_t bin = binOf(primitives[i]);
+      binBounds[bin].Merge(primitives[i].bounds);
+      binCounts[bin]++;
+    }
+
+    // 右から累積した面積と数を求め、左から走査しながら分割の費用を比べます。
+    std::array<float, kBinCount> rightAreas{};
+    std::array<uint32_t, kBinCount> rightCounts{};
+    AABB right;
+    uint32_t rightCount = 0;
+    for (uint32_t b = kBinCount - 1; b > 0; b--) {
+      right.Merge(binBounds[b]);
+      rightCount += binCounts[b];
+      rightAreas[b] = HalfArea(right);
+      rightCounts[b] = rightCount;
+    }
+
+    float bestCost = std::numeric_limits<float>::max();
+    uint32_t bestSplit = 0;
+    AABB left;
+    uint32_t leftCount = 0;
+    for (uint32_t b = 0; b + 1 < kBinCount; b++) {
+      left.Merge(binBounds[b]);
+      leftCount += binCounts[b];
+      if (leftCount == 0 || rightCounts[b + 1] == 0) {
+        continue;
+      }
+      const float cost =
+          HalfArea(left) * static_cast<float>(leftCount) +
+          rightAreas[b + 1] * static_cast<float>(rightCounts[b + 1]);
+      if (cost < bestCost) {
+        bestCost = cost;
+        bestSplit = b;
+      }
+    }
+
+    // 分割しても走査の費用が下がらない場合は、小さいノードのみ葉にします。
+    const float leafCost = HalfArea(bounds) * static_cast<float>(count);
+    if (bestCost >= leafCost && count <= maxLeafSize * 4) {
+      return makeLeaf();
+    }
+    if (bestCost < std::numeric_limits<float>::max()) {
+      const auto it = std::partition(
+          primitives.begin() + first, primitives.begin() + first + count,
+          [&](const Primitive &primitive) {
+            return binOf(primitive) <= bestSplit;
+          });
+      mid = static_cast<uint32_t>(it - primitives.begin());
+    }
+  }
+
+  // すべての重心が重なっている場合などは、数で半分に分けます。
+  if (mid == first || mid == first + count) {
+    mid = first + count / 2;
+    std::nth_element(primitives.begin() + first, primitives.begin() + mid,
+                     primitives.begin() + first + count,
+                     [axis](const Primitive &a, const Primitive &b) {
+                       return a.centroid[axis] < b.centroid[axis];
+                     });
+  }
+
+  static_cast<void>(
+      BuildNode(primitives, first, mid - first, depth + 1, maxLeafSize));
+  const uint32_t rightChild = BuildNode(primitives, mid, first + count - mid,
+                                        depth + 1, maxLeafSize);
+  nodes_[index].offset = rightChild;
+  nodes_[index].count = 0;
+  return index;
+}
+
+/**
+ * @brief 木の形を保ったまま、動いたオブジェクトの境界でノードの境界を更新します。
+ * @param bounds Buildと同じ数のオブジェクトの境界
+ * @note
+ * 子は親より後ろに並ぶため、後ろから更新すれば子の境界は更新済みです。<br>
+ * 大きく動いた場合は木の質が下がるため、Buildで構築し直してください。
+ */
+void BVH::Refit(const std::vector<AABB> &bounds) {
+  BOOST_ASSERT_MSG(bounds.size() == indices_.size(),
+                   "Refit requires the same objects as Build!");
+  for (size_t i = 0; i < indices_.size(); i++) {
+    leafBounds_[i] = bounds[indices_[i]];
+  }
+  for (size_t i = nodes_.size(); i-- > 0;) {
+    Node &node = nodes_[i];
+    AABB aabb;
+    if (node.count > 0) {
+      for (uint32_t k = node.offset; k < node.offset + node.count; k++) {
+        aabb.Merge(leafBounds_[k]);
+      }
+    } else {
+      aabb.Merge(BoundsOf(nodes_[i + 1]));
+      aabb.Merge(BoundsOf(nodes_[node.offset]));
+    }
+    node.mini = aabb.mini;
+    node.maxi = aabb.maxi;
+  }
+}
+
+//*-----------------------------------------------------------------------------
+// Query
+//*-----------------------------------------------------------------------------
+
+/**
+ * @brief 視錐台の内側にあるオブジェクトを求めます。
+ * @param planes Frustum::ExtractPlanesで求めた内向きの平面
+ * @param visible 見えるオブジェクトの番号(葉の順に並びます。)
+ * @note
+ * ノードが平面の外側にあれば子をすべて棄却し、内側にある平面は子で判定しません。<br>
+ * すべての平面の内側にあるノードは、判定せずに子孫のオブジェクトをまとめて加えます。
+ */
+void BVH::Cull(const Planes &planes, std::vector<uint32_t> &visible) const {
+  Traverse(planes, visible, nullptr);
+}
+
+/**
+ * @brief 視錐台の内側にあるオブジェクトと、平面と交差する葉の範囲を求めます。
+ * @param visible すべての平面の内側にあるノードのオブジェクトの番号
+ * @param partial
+ * 平面と交差する葉のGetIndicesの範囲(走査の順に並び、隣り合う範囲はまとめます。)
+ * @note
+ * 葉の中のオブジェクトは判定しないため、FrustumCuller::CullRangeなどでまとめて判定してください。
+ */
+void BVH::Cull(const Planes &planes, std::vector<uint32_t> &visible,
+               std::vector<LeafRange> &partial) const {
+  partial.clear();
+  Traverse(planes, visible, &partial);
+}
+
+/**
+ * @brief 視錐台で木を走査します。
+ * @param partial
+ * nullptrでなければ平面と交差する葉の範囲を加え、nullptrなら葉のオブジェクトを個別に判定します。
+ */
+void BVH::Traverse(const Planes &planes, std::vector<uint32_t> &visible,
+                   std::vector<LeafRange> *partial) const {
+  visible.clear();
+  if (nodes_.empty()) {
+    return;
+  }
+
+  // 判定が必要な平面をビットで表します。
+  constexpr uint32_t kAllPlanes = (1u << 6) - 1;
+  const auto classify = [&](const glm::vec3 &mini, const glm::vec3 &maxi,
+                            uint32_t &mask) {
+    const glm::vec3 center = (mini + maxi) * 0.5f;
+    const glm::vec3 extent = (maxi - mini) * 0.5f;
+    for (uint32_t p = 0; p < 6; p++) {
+      if ((mask & (1u << p)) == 0) {
+        continue;
+      }
+      const glm::vec3 normal(planes[p]);
+      const float d = glm::dot(normal, center) + planes[p].w;
+      const float r = glm::dot(glm::abs(normal), extent);
+      if (d + r < 0.0f) {
+        return false;
+      }
+      if (d - r >= 0.0f) {
+        mask &= ~(1u << p);
+      }
+    }
+    return true;
+  };
+
+  std::array<std::pair<uint32_t, uint32_t>, kStackSize> stack{};
+  uint32_t top = 0;
+  stack[top++] = {0, kAllPlanes};
+  while (top > 0) {
+    auto [index, mask] = stack[--top];
+    const Node &node = nodes_[index];
+    if (!classify(node.mini, node.maxi, mask)) {
+      continue;
+    }
+    if (mask == 0) {
+      AppendSubtree(index, visible);
+    } else if (node.count > 0 && partial != nullptr) {
+      // 葉は左から順に訪れるため、直前の範囲と接していればまとめます。
+      if (!partial->empty() &&
+          partial->back().first + partial->back().count == node.offset) {
+        partial->back().count += node.count;
+      } else {
+        partial->push_back({node.offset, node.count});
+      }
+    } else if (node.count > 0) {
+      for (uint32_t k = node.offset; k < node.offset + node.count; k++) {
+        uint32_t primitiveMask = mask;
+        if (classify(leafBounds_[k].mini, leafBounds_[k].maxi,
+                     primitiveMask)) {
+          visible.emplace_back(indices_[k]);
+        }
+      }
+    } else {
+      BOOST_ASSERT_MSG(top + 2 <= kStackSize, "BVH is too deep!");
+      stack[top++] = {node.offset, mask};
+      stack[top++] = {index + 1, mask};
+    }
+  }
+}
+
+/**
+ * @brief レイが最初に当たるオブジェクトの境界を求めます。(ピッキングに使います。)
+ * @param direction レイの方向(正規化していない場合、tは方向の長さを単位とします。)
+ * @param tMax レイの長さ
+ * @note 近い子から走査し、見つけた交差より遠いノードは棄却します。
+ */
+std::optional<BVH::Hit> BVH::Raycast(const glm::vec3 &origin,
+                                     const glm::vec3 &direction,
+                                     float tMax) const {
+  if (nodes_.empty()) {
+    return std::nullopt;
+  }
+
+  const glm::vec3 invDirection = 1.0f / direction;
+  std::optional<Hit> hit{};
+  float closest = tMax;
+
+  std::array<std::pair<uint32_t, float>, kStackSize> stack{};
+  uint32_t top = 0;
+  const float rootT =
+      IntersectRay(nodes_[0].mini, nodes_[0].maxi, origin, invDirection,
+                   closest);
+  if (rootT != std::numeric_limits<float>::infinity()) {
+    stack[top++] = {0, rootT};
+  }
+  while (top > 0) {
+    const auto [index, t] = stack[--top];
+    if (t > closest) {
+      continue;
+    }
+    const Node &node = nodes_[index];
+    if (node.count > 0) {
+      for (uint32_t k = node.offset; k < node.offset + node.count; k++) {
+        const float tk = IntersectRay(leafBounds_[k].mini, leafBounds_[k].maxi,
+                                      origin, invDirection, closest);
+        if (tk != std::numeric_limits<float>::infinity() && tk <= closest) {
+          closest = tk;
+          hit = Hit{indices_[k], tk};
+        }
+      }
+      continue;
+    }
+
+    const uint32_t children[2] = {index + 1, node.offset};
+    float ts[2];
+    for (int c = 0; c < 2; c++) {
+      const Node &child = nodes_[children[c]];
+      ts[c] = IntersectRay(child.mini, child.maxi, origin, invDirection,
+                           closest);
+    }
+    // 遠い子を先に積み、近い子から走査します。
+    const int nearChild = ts[0] <= ts[1] ? 0 : 1;
+    const int farChild = 1 - nearChild;
+    BOOST_ASSERT_MSG(top + 2 <= kStackSize, "BVH is too deep!");
+    if (ts[farChild] != std::numeric_limits<float>::infinity()) {
+      stack[top++] = {children[farChild], ts[farChild]};
+    }
+    if (ts[nearChild] != std::numeric_limits<float>::infinity()) {
+      stack[top++] = {children[nearChild], ts[nearChild]};
+    }
+  }
+  return hit;
+}
+
+/**
+ * @brief 球と重なるオブジェクトを求めます。(点光源が照らすオブジェクトの判定などに使います。)
+ * @param hits 重なるオブジェクトの番号(葉の順に並びます。)
+ */
+void BVH::Overlap(const BSphere &sphere, std::vector<uint32_t> &hits) const {
+  hits.clear();
+  if (nodes_.empty()) {
+    return;
+  }
+
+  std::array<uint32_t, kStackSize> stack{};
+  uint32_t top = 0;
+  stack[top++] = 0;
+  while (top > 0) {
+    const uint32_t index = stack[--top];
+    const Node &node = nodes_[index];
+    if (!IntersectSphere(node.mini, node.maxi, sphere)) {
+      continue;
+    }
+    if (node.count > 0) {
+      for (uint32_t k = node.offset; k < node.offset + node.count; k++) {
+        if (IntersectSphere(leafBounds_[k].mini, leafBounds_[k].maxi,
+                            sphere)) {
+          hits.emplace_back(indices_[k]);
+        }
+      }
+    } else {
+      BOOST_ASSERT_MSG(top + 2 <= kStackSize, "BVH is too deep!");
+      stack[top++] = node.offset;
+      stack[top++] = index + 1;
+    }
+  }
+}
+
+/**
+ * @brief ノードの子孫のオブジェクトをすべて加えます。
+ * @note
+ * 葉は深さ優先の順に並ぶため、子孫のオブジェクトは最も左の葉から最も右の葉までの連続した範囲です。
+ */
+void BVH::AppendSubtree(uint32_t node, std::vector<uint32_t> &visible) const {
+  uint32_t leftmost = node;
+  while (nodes_[leftmost].count == 0) {
+    leftmost++;
+  }
+  uint32_t rightmost = node;
+  while (nodes_[rightmost].count == 0) {
+    rightmost = nodes_[rightmost].offset;
+  }
+  const uint32_t first = nodes_[leftmost].offset;
+  const uint32_t last = nodes_[rightmost].offset + nodes_[rightmost].count;
+  visible.insert(visible.end(), indices_.begin() + first,
+                 indices_.begin() + last);
+}
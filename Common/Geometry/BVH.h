@@ -0,0 +1,94 @@
+/**
+ * @brief シーンのオブジェクトの境界を階層に分け、カリングや空間の問い合わせを対数時間で行います。
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <optional>
+#include <vector>
+
+#include "Geometry/AABB.h"
+#include "Geometry/BSphere.h"
+
+/**
+ * @brief オブジェクトのバウンディングボックスの2分木(Bounding Volume Hierarchy)
+ * @note
+ * 分割はSAH(表面積ヒューリスティック)をビンで近似して選びます。<br>
+ * ノードは深さ優先の順に1つの配列へ並べ、左の子は親の直後、右の子はoffsetに置きます。<br>
+ * オブジェクトが動いた場合は、木の形を保ったまま境界だけをRefitで更新します。
+ */
+class BVH {
+public:
+  /**
+   * @brief 木のノード(32バイト)
+   * @note
+   * countが0でなければ葉で、indices_の[offset, offset + count)のオブジェクトを持ちます。<br>
+   * countが0なら内部ノードで、左の子は次のノード、右の子はoffset番目のノードです。
+   */
+  struct Node {
+    glm::vec3 mini = glm::vec3(0.0f);
+    uint32_t offset = 0;
+    glm::vec3 maxi = glm::vec3(0.0f);
+    uint32_t count = 0;
+  };
+  static_assert(sizeof(Node) == 32, "Node must fit in half a cache line");
+
+  /** @brief レイが当たったオブジェクト */
+  struct Hit {
+    uint32_t id = 0;
+    /** @brief 箱に入るまでのレイのパラメータ */
+    float t = 0.0f;
+  };
+
+  /** @brief 葉の順に並べたオブジェクトの範囲(GetIndicesの添字です。) */
+  struct LeafRange {
+    uint32_t first = 0;
+    uint32_t count = 0;
+  };
+
+  using Planes = std::array<glm::vec4, 6>;
+
+  void Build(const std::vector<AABB> &bounds, uint32_t maxLeafSize = 4);
+  void Refit(const std::vector<AABB> &bounds);
+
+  void Cull(const Planes &planes, std::vector<uint32_t> &visible) const;
+  void Cull(const Planes &planes, std::vector<uint32_t> &visible,
+            std::vector<LeafRange> &partial) const;
+  [[nodiscard]] std::optional<Hit> Raycast(const glm::vec3 &origin,
+                                           const glm::vec3 &direction,
+                                           float tMax) const;
+  void Overlap(const BSphere &sphere, std::vector<uint32_t> &hits) const;
+
+  [[nodiscard]] const std::vector<Node> &GetNodes() const { return nodes_; }
+  /** @brief 葉の順に並べたオブジェクトの番号 */
+  [[nodiscard]] const std::vector<uint32_t> &GetIndices() const {
+    return indices_;
+  }
+  /** @brief 木に入れたオブジェクトの数 */
+  [[nodiscard]] uint32_t Size() const {
+    return static_cast<uint32_t>(indices_.size());
+  }
+
+private:
+  /** @brief 構築中のオブジェクトの境界と重心 */
+  struct Primitive {
+    AABB bounds{};
+    glm::vec3 centroid = glm::vec3(0.0f);
+    uint32_t id = 0;
+  };
+
+  uint32_t BuildNode(std::vector<Primitive> &primitives, uint32_t first,
+                     uint32_t count, uint32_t depth, uint32_t maxLeafSize);
+  void Traverse(const Planes &planes, std::vector<uint32_t> &visible,
+                std::vector<LeafRange> *partial) const;
+  void AppendSubtree(uint32_t node, std::vector<uint32_t> &visible) const;
+
+  std::vector<Node> nodes_{};
+  /** @brief 葉の順に並べたオブジェクトの番号(Buildに渡した配列の添字です。) */
+  std::vector<uint32_t> indices_{};
+  /** @brief 葉の順に並べたオブジェクトの境界(葉の中のオブジェクトを個別に判定します。) */
+  std::vector<AABB> leafBounds_{};
+};
@@ -67,6 +67,28 @@ BSphere Frustum::ComputeBSphere() const {
   return {center, radius};
 }
 
+/**
+ * @brief ビュー射影行列から視錐台の6つの平面を求めます。
+ * @return 左、右、下、上、近、遠の順の平面(xyzは内向きの単位法線、wは原点からの距離です。)
+ * @note
+ * 平面はビュー射影行列の行の和と差から求めます。<br>
+ * 近平面は[-1, 1]の深度の範囲で求め、[0, 1]の射影行列でも見える物を棄却しないようにします。
+ */
+std::array<glm::vec4, 6> Frustum::ExtractPlanes(const glm::mat4 &viewProj) {
+  const auto row = [&](int i) {
+    return glm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i],
+                     viewProj[3][i]);
+  };
+  std::array<glm::vec4, 6> planes = {
+      row(3) + row(0), row(3) - row(0), row(3) + row(1),
+      row(3) - row(1), row(3) + row(2), row(3) - row(2),
+  };
+  for (auto &plane : planes) {
+    plane /= glm::length(glm::vec3(plane));
+  }
+  return planes;
+}
+
 glm::mat4 Frustum::GetProjectionMatrix() const {
   glm::mat4 proj = (type_ == ProjectionType::Perspective)
                        ? glm::perspective(fovy_, ar_, near_, far_)
@@ -32,6 +32,8 @@ public:
   glm::vec3 GetCorner(std::size_t idx) const { return corners_.at(idx); }
   BSphere ComputeBSphere() const;
 
+  static std::array<glm::vec4, 6> ExtractPlanes(const glm::mat4 &viewProj);
+
 private:
   ProjectionType type_;
 
@@ -0,0 +1,287 @@
+/**
+ * @brief 多数の境界を視錐台とまとめて判定し、見えるオブジェクトの番号を返します。
+ * @note
+ * 平面の法線をnとすると、箱は中心の距離n・c + wと半分の大きさの射影|n|・eの和が負、
+ * 球は距離と半径の和が負のとき、その平面の外側にあるため棄却します。
+ */
+
+#include "View/FrustumCuller.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+/** @brief 配列を埋める単位(AVX2の幅) */
+static constexpr size_t kLaneWidth = 8;
+
+/**
+ * @brief 判定の結果のビットから、見えるオブジェクトの番号を追加します。
+ * @param mask iビット目が1ならbase + i番目が見えます。
+ */
+static void Append(uint32_t mask, size_t base, const std::vector<uint32_t> &ids,
+                   std::vector<uint32_t> &visible) {
+  while (mask != 0) {
+    visible.emplace_back(ids[base + std::countr_zero(mask)]);
+    mask &= mask - 1;
+  }
+}
+
+/**
+ * @brief base番目からwidth個のうち、[begin, end)に含まれる要素のビットを返します。
+ * @note 末尾を埋めた要素や範囲の外の要素を判定の結果から除きます。
+ */
+static uint32_t RangeMask(size_t base, size_t width, size_t begin,
+                          size_t end) {
+  const size_t lo = begin > base ? begin - base : 0;
+  const size_t hi = end - base < width ? end - base : width;
+  const uint32_t upper = hi >= 32 ? ~0u : (1u << hi) - 1u;
+  return upper & ~((1u << lo) - 1u);
+}
+
+#if defined(__AVX2__)
+/**
+ * @brief a * b + cを求めます。(FMAを使えない場合は乗算と加算に分けます。)
+ */
+static __m256 MulAdd(__m256 a, __m256 b, __m256 c) {
+#if defined(__FMA__)
+  return _mm256_fmadd_ps(a, b, c);
+#else
+  return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+}
+#endif
+
+//*-----------------------------------------------------------------------------
+// Lanes
+//*-----------------------------------------------------------------------------
+
+void FrustumCuller::Lanes::Clear() {
+  for (auto *lane : {&x, &y, &z, &ex, &ey, &ez}) {
+    lane->clear();
+  }
+  ids.clear();
+  size = 0;
+}
+
+void FrustumCuller::Lanes::Reserve(size_t count) {
+  const size_t padded = (count + kLaneWidth - 1) / kLaneWidth * kLaneWidth;
+  for (auto *lane : {&x, &y, &z, &ex, &ey, &ez}) {
+    lane->reserve(padded);
+  }
+  ids.reserve(padded);
+}
+
+/**
+ * @brief 境界を末尾に追加し、配列の長さをSIMDの幅の倍数に保ちます。
+ */
+void FrustumCuller::Lanes::Push(const glm::vec3 &center,
+                                const glm::vec3 &extent, uint32_t id) {
+  if (size % kLaneWidth == 0) {
+    const size_t padded = size + kLaneWidth;
+    for (auto *lane : {&x, &y, &z, &ex, &ey, &ez}) {
+      lane->resize(padded, 0.0f);
+    }
+    ids.resize(padded, 0);
+  }
+  x[size] = center.x;
+  y[size] = center.y;
+  z[size] = center.z;
+  ex[size] = extent.x;
+  ey[size] = extent.y;
+  ez[size] = extent.z;
+  ids[size] = id;
+  size++;
+}
+
+//*-----------------------------------------------------------------------------
+// Culler
+//*-----------------------------------------------------------------------------
+
+void FrustumCuller::Clear() {
+  boxes_.Clear();
+  spheres_.Clear();
+  count_ = 0;
+}
+
+void FrustumCuller::Reserve(size_t count) {
+  boxes_.Reserve(count);
+  spheres_.Reserve(count);
+}
+
+/**
+ * @brief ワールド空間の箱を追加します。
+ * @return オブジェクトの番号(追加した順に0から振ります。)
+ */
+uint32_t FrustumCuller::Add(const AABB &aabb) {
+  boxes_.Push(aabb.Center(), aabb.Extent(), count_);
+  return count_++;
+}
+
+/**
+ * @brief ワールド空間の球を追加します。
+ * @return オブジェクトの番号(追加した順に0から振ります。)
+ */
+uint32_t FrustumCuller::Add(const BSphere &sphere) {
+  spheres_.Push(sphere.center, glm::vec3(sphere.radius), count_);
+  return count_++;
+}
+
+/**
+ * @brief すべてのオブジェクトを視錐台と判定します。
+ * @param planes Frustum::ExtractPlanesで求めた内向きの平面
+ * @param visible 見えるオブジェクトの番号(箱、球の順に並び、番号の昇順とは限りません。)
+ */
+void FrustumCuller::Cull(const Planes &planes,
+                         std::vector<uint32_t> &visible) const {
+  visible.clear();
+  visible.reserve(count_);
+  CullBoxes(planes, boxes_, 0, boxes_.size, visible);
+  CullSpheres(planes, spheres_, visible);
+}
+
+/**
+ * @brief 追加した順のfirst番目からcount個の箱を視錐台と判定し、見える番号を追加します。
+ * @note
+ * 箱のみを追加した場合に使用します。BVHの葉の順に追加しておくと、
+ * 平面と交差する葉の範囲だけをまとめて判定できます。
+ * @param visible 見えるオブジェクトの番号(クリアせずに末尾へ追加します。)
+ */
+void FrustumCuller::CullRange(const Planes &planes, uint32_t first,
+                              uint32_t count,
+                              std::vector<uint32_t> &visible) const {
+  const size_t end = std::min<size_t>(size_t{first} + count, boxes_.size);
+  if (first < end) {
+    CullBoxes(planes, boxes_, first, end, visible);
+  }
+}
+
+void FrustumCuller::CullBoxes(const Planes &planes, const Lanes &lanes,
+                              size_t begin, size_t end,
+                              std::vector<uint32_t> &visible) {
+#if defined(__AVX2__)
+  for (size_t i = begin / 8 * 8; i < end; i += 8) {
+    const __m256 x = _mm256_loadu_ps(&lanes.x[i]);
+    const __m256 y = _mm256_loadu_ps(&lanes.y[i]);
+    const __m256 z = _mm256_loadu_ps(&lanes.z[i]);
+    const __m256 ex = _mm256_loadu_ps(&lanes.ex[i]);
+    const __m256 ey = _mm256_loadu_ps(&lanes.ey[i]);
+    const __m256 ez = _mm256_loadu_ps(&lanes.ez[i]);
+    __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    for (const auto &plane : planes) {
+      __m256 d = MulAdd(_mm256_set1_ps(plane.x), x, _mm256_set1_ps(plane.w));
+      d = MulAdd(_mm256_set1_ps(plane.y), y, d);
+      d = MulAdd(_mm256_set1_ps(plane.z), z, d);
+      __m256 r = _mm256_mul_ps(_mm256_set1_ps(std::abs(plane.x)), ex);
+      r = MulAdd(_mm256_set1_ps(std::abs(plane.y)), ey, r);
+      r = MulAdd(_mm256_set1_ps(std::abs(plane.z)), ez, r);
+      inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(d, r),
+                                                   _mm256_setzero_ps(),
+                                                   _CMP_GE_OQ));
+    }
+    const auto mask = static_cast<uint32_t>(_mm256_movemask_ps(inside)) &
+                      RangeMask(i, 8, begin, end);
+    Append(mask, i, lanes.ids, visible);
+  }
+#elif defined(__SSE2__) || defined(_M_X64)
+  for (size_t i = begin / 4 * 4; i < end; i += 4) {
+    const __m128 x = _mm_loadu_ps(&lanes.x[i]);
+    const __m128 y = _mm_loadu_ps(&lanes.y[i]);
+    const __m128 z = _mm_loadu_ps(&lanes.z[i]);
+    const __m128 ex = _mm_loadu_ps(&lanes.ex[i]);
+    const __m128 ey = _mm_loadu_ps(&lanes.ey[i]);
+    const __m128 ez = _mm_loadu_ps(&lanes.ez[i]);
+    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (const auto &plane : planes) {
+      __m128 d = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), x),
+                            _mm_set1_ps(plane.w));
+      d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(plane.y), y));
+      d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(plane.z), z));
+      __m128 r = _mm_mul_ps(_mm_set1_ps(std::abs(plane.x)), ex);
+      r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(std::abs(plane.y)), ey));
+      r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(std::abs(plane.z)), ez));
+      inside = _mm_and_ps(
+          inside, _mm_cmpge_ps(_mm_add_ps(d, r), _mm_setzero_ps()));
+    }
+    const auto mask = static_cast<uint32_t>(_mm_movemask_ps(inside)) &
+                      RangeMask(i, 4, begin, end);
+    Append(mask, i, lanes.ids, visible);
+  }
+#else
+  for (size_t i = begin; i < end; i++) {
+    bool inside = true;
+    for (const auto &plane : planes) {
+      const float d = plane.x * lanes.x[i] + plane.y * lanes.y[i] +
+                      plane.z * lanes.z[i] + plane.w;
+      const float r = std::abs(plane.x) * lanes.ex[i] +
+                      std::abs(plane.y) * lanes.ey[i] +
+                      std::abs(plane.z) * lanes.ez[i];
+      inside = inside && d + r >= 0.0f;
+    }
+    if (inside) {
+      visible.emplace_back(lanes.ids[i]);
+    }
+  }
+#endif
+}
+
+/**
+ * @note 球の半径はexに並べています。
+ */
+void FrustumCuller::CullSpheres(const Planes &planes, const Lanes &lanes,
+                                std::vector<uint32_t> &visible) {
+#if defined(__AVX2__)
+  for (size_t i = 0; i < lanes.size; i += 8) {
+    const __m256 x = _mm256_loadu_ps(&lanes.x[i]);
+    const __m256 y = _mm256_loadu_ps(&lanes.y[i]);
+    const __m256 z = _mm256_loadu_ps(&lanes.z[i]);
+    const __m256 radius = _mm256_loadu_ps(&lanes.ex[i]);
+    __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    for (const auto &plane : planes) {
+      __m256 d = MulAdd(_mm256_set1_ps(plane.x), x, _mm256_set1_ps(plane.w));
+      d = MulAdd(_mm256_set1_ps(plane.y), y, d);
+      d = MulAdd(_mm256_set1_ps(plane.z), z, d);
+      inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(d, radius),
+                                                   _mm256_setzero_ps(),
+                                                   _CMP_GE_OQ));
+    }
+    const auto mask = static_cast<uint32_t>(_mm256_movemask_ps(inside)) &
+                      RangeMask(i, 8, 0, lanes.size);
+    Append(mask, i, lanes.ids, visible);
+  }
+#elif defined(__SSE2__) || defined(_M_X64)
+  for (size_t i = 0; i < lanes.size; i += 4) {
+    const __m128 x = _mm_loadu_ps(&lanes.x[i]);
+    const __m128 y = _mm_loadu_ps(&lanes.y[i]);
+    const __m128 z = _mm_loadu_ps(&lanes.z[i]);
+    const __m128 radius = _mm_loadu_ps(&lanes.ex[i]);
+    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (const auto &plane : planes) {
+      __m128 d = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), x),
+                            _mm_set1_ps(plane.w));
+      d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(plane.y), y));
+      d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(plane.z), z));
+      inside = _mm_and_ps(
+          inside, _mm_cmpge_ps(_mm_add_ps(d, radius), _mm_setzero_ps()));
+    }
+    const auto mask = static_cast<uint32_t>(_mm_movemask_ps(inside)) &
+                      RangeMask(i, 4, 0, lanes.size);
+    Append(mask, i, lanes.ids, visible);
+  }
+#else
+  for (size_t i = 0; i < lanes.size; i++) {
+    bool inside = true;
+    for (const auto &plane : planes) {
+      const float d = plane.x * lanes.x[i] + plane.y * lanes.y[i] +
+                      plane.z * lanes.z[i] + plane.w;
+      inside = inside && d + lanes.ex[i] >= 0.0f;
+    }
+    if (inside) {
+      visible.emplace_back(lanes.ids[i]);
+    }
+  }
+#endif
+}
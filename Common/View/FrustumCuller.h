@@ -0,0 +1,66 @@
+/**
+ * @brief 多数の境界を視錐台とまとめて判定し、見えるオブジェクトの番号を返します。
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "Geometry/AABB.h"
+#include "Geometry/BSphere.h"
+
+/**
+ * @brief 境界を成分ごとの配列(SoA)に並べた視錐台カリング
+ * @note
+ * 箱と球は別の配列に並べ、AVX2(8個)またはSSE2(4個)でまとめて6つの平面と判定します。<br>
+ * どちらも使えない場合はスカラーで判定します。
+ */
+class FrustumCuller {
+public:
+  using Planes = std::array<glm::vec4, 6>;
+
+  void Clear();
+  void Reserve(size_t count);
+  uint32_t Add(const AABB &aabb);
+  uint32_t Add(const BSphere &sphere);
+
+  void Cull(const Planes &planes, std::vector<uint32_t> &visible) const;
+  void CullRange(const Planes &planes, uint32_t first, uint32_t count,
+                 std::vector<uint32_t> &visible) const;
+
+  /** @brief 追加したオブジェクトの数(Addが返す番号はこの数未満です。) */
+  [[nodiscard]] uint32_t Size() const { return count_; }
+
+private:
+  /**
+   * @brief 中心と半分の大きさ(球の場合は半径)を成分ごとに並べた配列
+   * @note 末尾はSIMDの幅の倍数まで埋め、埋めた要素は判定の結果から除きます。
+   */
+  struct Lanes {
+    std::vector<float> x{};
+    std::vector<float> y{};
+    std::vector<float> z{};
+    std::vector<float> ex{};
+    std::vector<float> ey{};
+    std::vector<float> ez{};
+    std::vector<uint32_t> ids{};
+    size_t size = 0;
+
+    void Clear();
+    void Reserve(size_t count);
+    void Push(const glm::vec3 &center, const glm::vec3 &extent, uint32_t id);
+  };
+
+  static void CullBoxes(const Planes &planes, const Lanes &lanes,
+                        size_t begin, size_t end,
+                        std::vector<uint32_t> &visible);
+  static void CullSpheres(const Planes &planes, const Lanes &lanes,
+                          std::vector<uint32_t> &visible);
+
+  Lanes boxes_{};
+  Lanes spheres_{};
+  uint32_t count_ = 0;
+};
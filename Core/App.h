@@ -14,6 +14,7 @@
 #include <iostream>
 #include <memory>
 #include <nlohmann/json.hpp>
+#include <string>
 
 #include "VK/VkBase.h"
 #include "Window.h"
@@ -24,7 +25,33 @@
 
 class App : private boost::noncopyable {
 public:
-  explicit App(const nlohmann::json &config) {
+  /**
+   * @param config シーン設定
+   * @param argc コマンドライン引数の数
+   * @param argv
+   * コマンドライン引数(--benchmark, --headless, --prewarmを受け付けます。)
+   */
+  explicit App(const nlohmann::json &config, int argc = 0,
+               char **argv = nullptr) {
+    config_ = config;
+    for (int i = 1; i < argc; i++) {
+      const std::string arg(argv[i]);
+      if (arg == "--benchmark") {
+        config_["Benchmark"]["Enabled"] = true;
+      } else if (arg == "--headless") {
+        config_["Headless"] = true;
+      } else if (arg == "--prewarm") {
+        config_["PipelineCache"]["Prewarm"] = true;
+      }
+    }
+
+    // ヘッドレス時はウィンドウシステムを使用しません。
+    isHeadless_ =
+        config_.contains("Headless") && config_["Headless"].get<bool>();
+    if (isHeadless_) {
+      return;
+    }
+
     if (glfwInit() == GLFW_FALSE) {
       BOOST_ASSERT_MSG(false, "glfw Initialization failed!");
     }
@@ -37,23 +64,40 @@ public:
         config.contains("Resizable") && config["Resizable"].get<bool>();
 
     window_ = Window::Create(width, height, appName.c_str(), samples, resizable);
-    config_ = config;
   }
 
   ~App() {
+    if (isHeadless_) {
+      return;
+    }
     Window::Destroy(window_);
     glfwTerminate();
   }
 
   int Run(std::unique_ptr<VkBase> app) {
-    if (window_ == nullptr) {
+    if (window_ == nullptr && !isHeadless_) {
       return EXIT_FAILURE;
     }
 
-    glfwSetWindowUserPointer(window_, app.get());
-    glfwSetFramebufferSizeCallback(window_, VkBase::OnResized);
+    if (window_ != nullptr) {
+      glfwSetWindowUserPointer(window_, app.get());
+      glfwSetFramebufferSizeCallback(window_, VkBase::OnResized);
+    }
     app->OnInit(config_, window_);
 
+    // OnInitで全パイプラインが構築されるため、そのままキャッシュを保存して終了します。
+    if (app->IsPrewarm()) {
+      app->WaitIdle();
+      app->OnDestroy();
+      return EXIT_SUCCESS;
+    }
+
+    if (app->IsBenchmark()) {
+      app->RunBenchmark();
+      app->OnDestroy();
+      return EXIT_SUCCESS;
+    }
+
     while (!glfwWindowShouldClose(window_) &&
            !glfwGetKey(window_, GLFW_KEY_ESCAPE)) {
       glfwPollEvents();
@@ -72,6 +116,7 @@ public:
 protected:
   GLFWwindow *window_ = nullptr;
   nlohmann::json config_{};
+  bool isHeadless_ = false;
 };
 
 #endif // APP_HPP
@@ -0,0 +1,541 @@
+/**
+ * @brief デバイスメモリをブロック単位で確保し、リソースへサブアロケーションします。
+ */
+
+#include "VK/Allocator.h"
+
+#include <algorithm>
+#include <boost/assert.hpp>
+#include <cstddef>
+#include <set>
+#include <spdlog/spdlog.h>
+#include <unordered_map>
+
+#include "VK/Common.h"
+#include "VK/Device.h"
+#include "VK/Initializer.h"
+
+/** @brief バディ割り当ての最小単位 */
+static constexpr VkDeviceSize kMinNodeSize = 256;
+
+static VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+static VkDeviceSize AlignDown(VkDeviceSize value, VkDeviceSize alignment) {
+  return value / alignment * alignment;
+}
+
+static VkDeviceSize FloorPow2(VkDeviceSize value) {
+  VkDeviceSize result = 1;
+  while (result * 2 <= value) {
+    result *= 2;
+  }
+  return result;
+}
+
+//*-----------------------------------------------------------------------------
+// Memory block
+//*-----------------------------------------------------------------------------
+
+/**
+ * @brief vkAllocateMemoryで確保した1つのメモリブロックとその空き領域の管理
+ */
+struct MemoryBlock {
+  MemoryBlock(VkDeviceMemory memory, VkDeviceSize size, void *mapped,
+              AllocationStrategy strategy, uint32_t poolIndex);
+
+  bool TryAllocate(VkDeviceSize allocSize, VkDeviceSize alignment,
+                   VkDeviceSize &offset);
+  void Free(VkDeviceSize offset, VkDeviceSize allocSize);
+
+  [[nodiscard]] bool IsEmpty() const { return allocationCount == 0; }
+  [[nodiscard]] VkDeviceSize GetFreeBytes() const;
+  [[nodiscard]] VkDeviceSize GetLargestFreeRange() const;
+
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  VkDeviceSize size = 0;
+  void *mapped = nullptr;
+  AllocationStrategy strategy = AllocationStrategy::Buddy;
+  uint32_t poolIndex = 0;
+
+  uint32_t allocationCount = 0;
+  VkDeviceSize usedBytes = 0;
+
+  /** @brief (Buddy) 次数kの空きノードのオフセット(ノードサイズはkMinNodeSize << k) */
+  std::vector<std::set<VkDeviceSize>> freeLists{};
+  /** @brief (Buddy) 割り当て済みのノードのオフセットと次数 */
+  std::unordered_map<VkDeviceSize, uint32_t> orders{};
+  /** @brief (Linear) 次に割り当てる位置 */
+  VkDeviceSize head = 0;
+};
+
+MemoryBlock::MemoryBlock(VkDeviceMemory memory, VkDeviceSize size,
+                         void *mapped, AllocationStrategy strategy,
+                         uint32_t poolIndex)
+    : memory(memory), size(size), mapped(mapped), strategy(strategy),
+      poolIndex(poolIndex) {
+  if (strategy == AllocationStrategy::Buddy) {
+    uint32_t maxOrder = 0;
+    while ((kMinNodeSize << maxOrder) < size) {
+      maxOrder++;
+    }
+    freeLists.resize(maxOrder + 1);
+    freeLists[maxOrder].insert(0);
+  }
+}
+
+/**
+ * @brief ブロック内に領域を割り当てます。
+ * @param allocSize 要求するサイズ
+ * @param alignment 要求するアライメント(2の冪)
+ * @param offset 割り当てた領域のブロック先頭からのオフセット
+ * @return 割り当てに成功したか？
+ */
+bool MemoryBlock::TryAllocate(VkDeviceSize allocSize, VkDeviceSize alignment,
+                              VkDeviceSize &offset) {
+  if (strategy == AllocationStrategy::Linear) {
+    const VkDeviceSize aligned = AlignUp(head, alignment);
+    if (aligned + allocSize > size) {
+      return false;
+    }
+    offset = aligned;
+    head = aligned + allocSize;
+  } else {
+    // 次数kのノードはブロック内で(kMinNodeSize << k)の倍数に配置されるため、
+    // アライメント以上のノードを選べばアライメントも満たします。
+    const VkDeviceSize need = std::max({allocSize, alignment, kMinNodeSize});
+    uint32_t order = 0;
+    while ((kMinNodeSize << order) < need) {
+      order++;
+    }
+    uint32_t k = order;
+    while (k < freeLists.size() && freeLists[k].empty()) {
+      k++;
+    }
+    if (k >= freeLists.size()) {
+      return false;
+    }
+
+    const VkDeviceSize node = *freeLists[k].begin();
+    freeLists[k].erase(freeLists[k].begin());
+    // 大きなノードを分割し、使わない半分を空きリストに戻します。
+    while (k > order) {
+      k--;
+      freeLists[k].insert(node + (kMinNodeSize << k));
+    }
+    orders[node] = order;
+    offset = node;
+  }
+
+  allocationCount++;
+  usedBytes += allocSize;
+  return true;
+}
+
+/**
+ * @brief 割り当てた領域を解放します。
+ */
+void MemoryBlock::Free(VkDeviceSize offset, VkDeviceSize allocSize) {
+  BOOST_ASSERT_MSG(allocationCount > 0, "Double free in memory block!");
+  allocationCount--;
+  usedBytes -= allocSize;
+
+  if (strategy == AllocationStrategy::Linear) {
+    // 途中の領域は再利用せず、すべて解放されたときにブロック全体を再利用します。
+    if (allocationCount == 0) {
+      head = 0;
+    }
+    return;
+  }
+
+  const auto it = orders.find(offset);
+  BOOST_ASSERT_MSG(it != orders.end(), "Invalid offset in memory block!");
+  uint32_t order = it->second;
+  orders.erase(it);
+
+  // 隣接するバディが空いている限り結合します。
+  while (order + 1 < freeLists.size()) {
+    const VkDeviceSize buddy = offset ^ (kMinNodeSize << order);
+    const auto found = freeLists[order].find(buddy);
+    if (found == freeLists[order].end()) {
+      break;
+    }
+    freeLists[order].erase(found);
+    offset = std::min(offset, buddy);
+    order++;
+  }
+  freeLists[order].insert(offset);
+}
+
+VkDeviceSize MemoryBlock::GetFreeBytes() const {
+  if (strategy == AllocationStrategy::Linear) {
+    return size - head;
+  }
+  VkDeviceSize bytes = 0;
+  for (size_t k = 0; k < freeLists.size(); k++) {
+    bytes += static_cast<VkDeviceSize>(freeLists[k].size()) *
+             (kMinNodeSize << k);
+  }
+  return bytes;
+}
+
+VkDeviceSize MemoryBlock::GetLargestFreeRange() const {
+  if (strategy == AllocationStrategy::Linear) {
+    return size - head;
+  }
+  for (size_t k = freeLists.size(); k > 0; k--) {
+    if (!freeLists[k - 1].empty()) {
+      return kMinNodeSize << (k - 1);
+    }
+  }
+  return 0;
+}
+
+//*-----------------------------------------------------------------------------
+// Init & Deinit
+//*-----------------------------------------------------------------------------
+
+Allocator::Allocator() = default;
+
+Allocator::~Allocator() = default;
+
+void Allocator::Init(const Device &device) {
+  const auto &memoryProperties = device.memoryProperties;
+  memoryTypeFlags_.resize(memoryProperties.memoryTypeCount);
+  for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+    memoryTypeFlags_[i] = memoryProperties.memoryTypes[i].propertyFlags;
+  }
+  // メモリタイプごとに、リソースの種類(リニア/最適タイリング)と割り当て方法の組み合わせでプールを持ちます。
+  pools_.resize(memoryProperties.memoryTypeCount * 4);
+  bufferImageGranularity_ =
+      std::max<VkDeviceSize>(device.properties.limits.bufferImageGranularity,
+                             1);
+}
+
+void Allocator::Destroy(const Device &device) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto &pool : pools_) {
+    for (auto &block : pool) {
+      if (!block->IsEmpty()) {
+        spdlog::warn("Memory block destroyed with {} live allocations.",
+                     block->allocationCount);
+      }
+      vkFreeMemory(device, block->memory, nullptr);
+    }
+    pool.clear();
+  }
+  if (dedicatedAllocationCount_ > 0) {
+    spdlog::warn("{} dedicated allocations were not freed.",
+                 dedicatedAllocationCount_);
+  }
+}
+
+//*-----------------------------------------------------------------------------
+// Allocate & Free
+//*-----------------------------------------------------------------------------
+
+/**
+ * @brief メモリ要件を満たす領域を割り当てます。
+ * @note
+ * ブロックの半分を超えるもの、大きなアタッチメント、デバイスアドレスが必要なもの、
+ * 遅延割り当てのもの(ブロックにまとめると確保時に実メモリを使うため)は専用のVkDeviceMemoryを割り当てます。
+ * @param device デバイスオブジェクト
+ * @param requirements リソースのメモリ要件
+ * @param createInfo 割り当ての要求
+ * @param allocation 割り当てた領域
+ * @return 割り当てに成功した場合、VK_SUCCESSを返します。
+ */
+VkResult Allocator::Allocate(const Device &device,
+                             const VkMemoryRequirements &requirements,
+                             const AllocationCreateInfo &createInfo,
+                             Allocation &allocation) {
+  const uint32_t memoryTypeIndex = device.FindMemoryType(
+      requirements.memoryTypeBits, createInfo.memoryPropertyFlags);
+
+  // 小さなヒープ(統合GPUのホスト可視領域など)を1ブロックで使い切らないようにします。
+  const auto heapIndex =
+      device.memoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+  const VkDeviceSize poolBlockSize = std::min(
+      blockSize,
+      FloorPow2(device.memoryProperties.memoryHeaps[heapIndex].size / 8));
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (createInfo.deviceAddress || requirements.size > poolBlockSize / 2 ||
+      (createInfo.memoryPropertyFlags &
+       VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) ||
+      (createInfo.attachment &&
+       requirements.size >= dedicatedAttachmentSize)) {
+    return AllocateDedicated(device, requirements, memoryTypeIndex,
+                             createInfo.deviceAddress, allocation);
+  }
+
+  // bufferImageGranularityが1より大きい場合、リニアなリソースと最適タイリングのイメージが
+  // 同じページを共有しないように、それらを別々のブロックに割り当てます。
+  const uint32_t kind =
+      createInfo.optimalTiling && bufferImageGranularity_ > 1 ? 1 : 0;
+  const uint32_t linear =
+      createInfo.strategy == AllocationStrategy::Linear ? 1 : 0;
+  const uint32_t poolIndex = (memoryTypeIndex * 2 + kind) * 2 + linear;
+  auto &pool = pools_[poolIndex];
+
+  VkDeviceSize offset = 0;
+  MemoryBlock *block = nullptr;
+  for (auto &candidate : pool) {
+    if (candidate->TryAllocate(requirements.size, requirements.alignment,
+                               offset)) {
+      block = candidate.get();
+      break;
+    }
+  }
+
+  // 既存のブロックに空きがなければ新しいブロックを確保します。
+  if (block == nullptr) {
+    VkMemoryAllocateInfo memoryAllocateInfo =
+        Initializer::MemoryAllocateInfo();
+    memoryAllocateInfo.allocationSize = poolBlockSize;
+    memoryAllocateInfo.memoryTypeIndex = memoryTypeIndex;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    const VkResult result =
+        vkAllocateMemory(device, &memoryAllocateInfo, nullptr, &memory);
+    if (result != VK_SUCCESS) {
+      return result;
+    }
+
+    // ホストから見えるブロックは確保時に一度だけマップし、解放まで保持します。
+    void *mapped = nullptr;
+    if (memoryTypeFlags_[memoryTypeIndex] &
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+      VK_CHECK_RESULT(
+          vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &mapped));
+    }
+    pool.emplace_back(std::make_unique<MemoryBlock>(
+        memory, poolBlockSize, mapped, createInfo.strategy, poolIndex));
+    block = pool.back().get();
+    const bool allocated =
+        block->TryAllocate(requirements.size, requirements.alignment, offset);
+    BOOST_ASSERT_MSG(allocated, "Failed to allocate from a new block!");
+  }
+
+  allocation.memory = block->memory;
+  allocation.offset = offset;
+  allocation.size = requirements.size;
+  allocation.mapped = block->mapped != nullptr
+                          ? static_cast<std::byte *>(block->mapped) + offset
+                          : nullptr;
+  allocation.memoryTypeIndex = memoryTypeIndex;
+  allocation.block = block;
+  return VK_SUCCESS;
+}
+
+VkResult Allocator::AllocateDedicated(const Device &device,
+                                      const VkMemoryRequirements &req,
+                                      uint32_t memoryTypeIndex,
+                                      bool deviceAddress,
+                                      Allocation &allocation) {
+  VkMemoryAllocateInfo memoryAllocateInfo = Initializer::MemoryAllocateInfo();
+  memoryAllocateInfo.allocationSize = req.size;
+  memoryAllocateInfo.memoryTypeIndex = memoryTypeIndex;
+
+  // VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BITが設定されているバッファは、メモリ割り当て中に適切なフラグも有効にする必要があります。
+  VkMemoryAllocateFlagsInfoKHR allocateFlagsInfo{};
+  if (deviceAddress) {
+    allocateFlagsInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO_KHR;
+    allocateFlagsInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT_KHR;
+    memoryAllocateInfo.pNext = &allocateFlagsInfo;
+  }
+
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  const VkResult result =
+      vkAllocateMemory(device, &memoryAllocateInfo, nullptr, &memory);
+  if (result != VK_SUCCESS) {
+    return result;
+  }
+  void *mapped = nullptr;
+  if (memoryTypeFlags_[memoryTypeIndex] & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+    VK_CHECK_RESULT(vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &mapped));
+  }
+
+  allocation.memory = memory;
+  allocation.offset = 0;
+  allocation.size = req.size;
+  allocation.mapped = mapped;
+  allocation.memoryTypeIndex = memoryTypeIndex;
+  allocation.block = nullptr;
+
+  dedicatedAllocationCount_++;
+  dedicatedBytes_ += req.size;
+  return VK_SUCCESS;
+}
+
+/**
+ * @brief 割り当てた領域を解放します。
+ * @note 空になったブロックはプールごとに1つだけ残し、それ以外はデバイスに返却します。
+ */
+void Allocator::Free(const Device &device, const Allocation &allocation) {
+  if (allocation.memory == VK_NULL_HANDLE) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (allocation.IsDedicated()) {
+    vkFreeMemory(device, allocation.memory, nullptr);
+    dedicatedAllocationCount_--;
+    dedicatedBytes_ -= allocation.size;
+    return;
+  }
+
+  MemoryBlock *block = allocation.block;
+  block->Free(allocation.offset, allocation.size);
+  if (!block->IsEmpty()) {
+    return;
+  }
+
+  auto &pool = pools_[block->poolIndex];
+  const auto emptyCount =
+      std::count_if(pool.begin(), pool.end(),
+                    [](const auto &b) { return b->IsEmpty(); });
+  if (emptyCount > 1) {
+    vkFreeMemory(device, block->memory, nullptr);
+    pool.erase(std::find_if(pool.begin(), pool.end(), [block](const auto &b) {
+      return b.get() == block;
+    }));
+  }
+}
+
+/**
+ * @brief バッファのメモリを割り当ててバインドします。
+ */
+VkResult Allocator::AllocateBufferMemory(const Device &device, VkBuffer buffer,
+                                         const AllocationCreateInfo &createInfo,
+                                         Allocation &allocation) {
+  VkMemoryRequirements memoryRequirements{};
+  vkGetBufferMemoryRequirements(device, buffer, &memoryRequirements);
+  const VkResult result =
+      Allocate(device, memoryRequirements, createInfo, allocation);
+  if (result != VK_SUCCESS) {
+    return result;
+  }
+  return vkBindBufferMemory(device, buffer, allocation.memory,
+                            allocation.offset);
+}
+
+/**
+ * @brief イメージのメモリを割り当ててバインドします。
+ */
+VkResult Allocator::AllocateImageMemory(const Device &device, VkImage image,
+                                        const AllocationCreateInfo &createInfo,
+                                        Allocation &allocation) {
+  VkMemoryRequirements memoryRequirements{};
+  vkGetImageMemoryRequirements(device, image, &memoryRequirements);
+  const VkResult result =
+      Allocate(device, memoryRequirements, createInfo, allocation);
+  if (result != VK_SUCCESS) {
+    return result;
+  }
+  return vkBindImageMemory(device, image, allocation.memory,
+                           allocation.offset);
+}
+
+//*-----------------------------------------------------------------------------
+// Mapped memory
+//*-----------------------------------------------------------------------------
+
+/**
+ * @brief 割り当てた領域をフラッシュして、デバイスから見えるようにします。
+ * @note ホストコヒーレントなメモリの場合は何もしません。
+ * @param offset (オプションです。) 割り当てた領域の先頭からのバイトオフセット
+ * @param size (オプションです。) VK_WHOLE_SIZEを渡すと、割り当てた領域全体をフラッシュします。
+ */
+VkResult Allocator::Flush(const Device &device, const Allocation &allocation,
+                          VkDeviceSize offset, VkDeviceSize size) const {
+  if (allocation.mapped == nullptr ||
+      IsHostCoherent(allocation.memoryTypeIndex)) {
+    return VK_SUCCESS;
+  }
+  const VkMappedMemoryRange range =
+      GetMappedRange(device, allocation, offset, size);
+  return vkFlushMappedMemoryRanges(device, 1, &range);
+}
+
+/**
+ * @brief 割り当てた領域を無効にして、ホストから見えるようにします。
+ * @note ホストコヒーレントなメモリの場合は何もしません。
+ * @param offset (オプションです。) 割り当てた領域の先頭からのバイトオフセット
+ * @param size (オプションです。) VK_WHOLE_SIZEを渡すと、割り当てた領域全体を無効にします。
+ */
+VkResult Allocator::Invalidate(const Device &device,
+                               const Allocation &allocation,
+                               VkDeviceSize offset, VkDeviceSize size) const {
+  if (allocation.mapped == nullptr ||
+      IsHostCoherent(allocation.memoryTypeIndex)) {
+    return VK_SUCCESS;
+  }
+  const VkMappedMemoryRange range =
+      GetMappedRange(device, allocation, offset, size);
+  return vkInvalidateMappedMemoryRanges(device, 1, &range);
+}
+
+/**
+ * @brief 割り当てた領域の範囲をnonCoherentAtomSizeに揃えたVkMappedMemoryRangeを求めます。
+ * @note ブロックは他のリソースと共有しているため、範囲を割り当てた領域の外まで広げないようにします。
+ */
+VkMappedMemoryRange Allocator::GetMappedRange(const Device &device,
+                                              const Allocation &allocation,
+                                              VkDeviceSize offset,
+                                              VkDeviceSize size) const {
+  const VkDeviceSize atom = device.properties.limits.nonCoherentAtomSize;
+  const VkDeviceSize memorySize =
+      allocation.IsDedicated() ? allocation.size : allocation.block->size;
+  const VkDeviceSize begin = allocation.offset + offset;
+  const VkDeviceSize end = size == VK_WHOLE_SIZE
+                               ? allocation.offset + allocation.size
+                               : begin + size;
+
+  VkMappedMemoryRange range = Initializer::MappedMemoryRange();
+  range.memory = allocation.memory;
+  range.offset = AlignDown(begin, atom);
+  const VkDeviceSize alignedEnd = AlignUp(end, atom);
+  range.size =
+      alignedEnd >= memorySize ? VK_WHOLE_SIZE : alignedEnd - range.offset;
+  return range;
+}
+
+bool Allocator::IsHostCoherent(uint32_t memoryTypeIndex) const {
+  return (memoryTypeFlags_[memoryTypeIndex] &
+          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+}
+
+//*-----------------------------------------------------------------------------
+// Statistics
+//*-----------------------------------------------------------------------------
+
+/**
+ * @brief 現在の使用量と断片化の統計を取得します。
+ */
+AllocatorStats Allocator::GetStats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  AllocatorStats stats{};
+  for (const auto &pool : pools_) {
+    for (const auto &block : pool) {
+      stats.blockCount++;
+      stats.allocationCount += block->allocationCount;
+      stats.reservedBytes += block->size;
+      stats.usedBytes += block->usedBytes;
+      stats.freeBytes += block->GetFreeBytes();
+      stats.largestFreeRange =
+          std::max(stats.largestFreeRange, block->GetLargestFreeRange());
+    }
+  }
+  stats.dedicatedAllocationCount = dedicatedAllocationCount_;
+  stats.allocationCount += dedicatedAllocationCount_;
+  stats.reservedBytes += dedicatedBytes_;
+  stats.usedBytes += dedicatedBytes_;
+  if (stats.freeBytes > 0) {
+    stats.fragmentation =
+        1.0f - static_cast<float>(stats.largestFreeRange) /
+                   static_cast<float>(stats.freeBytes);
+  }
+  return stats;
+}
@@ -0,0 +1,139 @@
+/**
+ * @brief デバイスメモリをブロック単位で確保し、リソースへサブアロケーションします。
+ */
+
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <boost/noncopyable.hpp>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct Device;
+struct MemoryBlock;
+
+/**
+ * @brief ブロック内の領域の割り当て方法
+ */
+enum class AllocationStrategy {
+  /**
+   * @brief 2の冪で分割する汎用の割り当て
+   * @note 解放した領域は隣接する空き領域と結合します。
+   */
+  Buddy,
+  /**
+   * @brief 先頭から順に割り当て、ブロック内がすべて解放されたときに再利用します。
+   * @note ステージングバッファなどの一時的なリソース向けです。
+   */
+  Linear,
+};
+
+/**
+ * @brief 割り当ての要求
+ */
+struct AllocationCreateInfo {
+  VkMemoryPropertyFlags memoryPropertyFlags = 0;
+  AllocationStrategy strategy = AllocationStrategy::Buddy;
+  /** @brief VK_IMAGE_TILING_OPTIMALのイメージか？(bufferImageGranularityの判定に使用します。) */
+  bool optimalTiling = false;
+  /** @brief フレームバッファのアタッチメントか？(大きなものは専用の割り当てにします。) */
+  bool attachment = false;
+  /** @brief VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BITが必要か？(常に専用の割り当てにします。) */
+  bool deviceAddress = false;
+};
+
+/**
+ * @brief リソースにバインドされたデバイスメモリの範囲
+ */
+struct Allocation {
+  [[nodiscard]] bool IsDedicated() const { return block == nullptr; }
+
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  VkDeviceSize offset = 0;
+  VkDeviceSize size = 0;
+  /** @brief ホストから見えるメモリの場合、offsetの位置を指す永続的にマップされたポインタ */
+  void *mapped = nullptr;
+  uint32_t memoryTypeIndex = 0;
+  /** @brief 割り当て元のブロック(専用の割り当ての場合はnullptr) */
+  MemoryBlock *block = nullptr;
+};
+
+/**
+ * @brief アロケータの使用状況
+ */
+struct AllocatorStats {
+  uint32_t blockCount = 0;
+  uint32_t dedicatedAllocationCount = 0;
+  uint32_t allocationCount = 0;
+  /** @brief vkAllocateMemoryで確保したバイト数 */
+  VkDeviceSize reservedBytes = 0;
+  /** @brief リソースが要求したバイト数 */
+  VkDeviceSize usedBytes = 0;
+  /** @brief ブロック内の空き領域のバイト数 */
+  VkDeviceSize freeBytes = 0;
+  /** @brief ブロック内で連続している最大の空き領域のバイト数 */
+  VkDeviceSize largestFreeRange = 0;
+  /** @brief 外部断片化率(1 - largestFreeRange / freeBytes) */
+  float fragmentation = 0.0f;
+};
+
+class Allocator : private boost::noncopyable {
+public:
+  Allocator();
+  ~Allocator();
+
+  void Init(const Device &device);
+  void Destroy(const Device &device);
+
+  [[nodiscard]] VkResult Allocate(const Device &device,
+                                  const VkMemoryRequirements &requirements,
+                                  const AllocationCreateInfo &createInfo,
+                                  Allocation &allocation);
+  void Free(const Device &device, const Allocation &allocation);
+
+  [[nodiscard]] VkResult
+  AllocateBufferMemory(const Device &device, VkBuffer buffer,
+                       const AllocationCreateInfo &createInfo,
+                       Allocation &allocation);
+  [[nodiscard]] VkResult
+  AllocateImageMemory(const Device &device, VkImage image,
+                      const AllocationCreateInfo &createInfo,
+                      Allocation &allocation);
+
+  [[nodiscard]] VkResult Flush(const Device &device,
+                               const Allocation &allocation,
+                               VkDeviceSize offset = 0,
+                               VkDeviceSize size = VK_WHOLE_SIZE) const;
+  [[nodiscard]] VkResult Invalidate(const Device &device,
+                                    const Allocation &allocation,
+                                    VkDeviceSize offset = 0,
+                                    VkDeviceSize size = VK_WHOLE_SIZE) const;
+
+  [[nodiscard]] AllocatorStats GetStats() const;
+
+  /** @brief 1つのブロックのサイズ(2の冪) */
+  VkDeviceSize blockSize = 64ull * 1024 * 1024;
+  /** @brief この大きさ以上のアタッチメントは専用の割り当てにします。 */
+  VkDeviceSize dedicatedAttachmentSize = 4ull * 1024 * 1024;
+
+private:
+  [[nodiscard]] VkResult AllocateDedicated(const Device &device,
+                                           const VkMemoryRequirements &req,
+                                           uint32_t memoryTypeIndex,
+                                           bool deviceAddress,
+                                           Allocation &allocation);
+  [[nodiscard]] VkMappedMemoryRange
+  GetMappedRange(const Device &device, const Allocation &allocation,
+                 VkDeviceSize offset, VkDeviceSize size) const;
+  [[nodiscard]] bool IsHostCoherent(uint32_t memoryTypeIndex) const;
+
+  /** @brief メモリタイプ、リソースの種類、割り当て方法ごとのブロックのリスト */
+  std::vector<std::vector<std::unique_ptr<MemoryBlock>>> pools_{};
+  std::vector<VkMemoryPropertyFlags> memoryTypeFlags_{};
+  VkDeviceSize bufferImageGranularity_ = 1;
+  uint32_t dedicatedAllocationCount_ = 0;
+  VkDeviceSize dedicatedBytes_ = 0;
+  mutable std::mutex mutex_{};
+};
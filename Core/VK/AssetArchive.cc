@@ -0,0 +1,157 @@
+/**
+ * @brief アセットをまとめたアーカイブをマップし、ファイルの内容を参照します。
+ */
+
+#include "VK/AssetArchive.h"
+
+#include <algorithm>
+#include <boost/assert.hpp>
+#include <climits>
+#include <cstring>
+#include <filesystem>
+#include <spdlog/spdlog.h>
+
+#include <stb/stb_image.h>
+
+#include "VK/MappedFile.h"
+
+/**
+ * @brief 目次を引くためにパスを正規化します。
+ * @note "./Assets/a.spv"と"Assets/a.spv"は同じファイルを指します。
+ */
+static std::string NormalizePath(const std::string &filepath) {
+  return std::filesystem::path(filepath).lexically_normal().generic_string();
+}
+
+/**
+ * @brief アーカイブをマップし、目次を検証します。
+ * @param path アーカイブのパス
+ * @return マウントできたか？(失敗した場合、Readは個別のファイルを読み込みます。)
+ */
+bool AssetArchive::Mount(const std::string &path) {
+  Unmount();
+  auto archive = std::make_shared<MappedFile>(path);
+  if (!archive->IsOpen()) {
+    spdlog::warn("Asset archive {} is not found; using loose files.", path);
+    return false;
+  }
+
+  Header header{};
+  if (archive->Size() < sizeof(header)) {
+    spdlog::error("Asset archive {} is corrupted; using loose files.", path);
+    return false;
+  }
+  std::memcpy(&header, archive->Data(), sizeof(header));
+  const size_t tocSize = size_t{header.entryCount} * sizeof(Entry);
+  if (header.magic != kMagic || header.version != kVersion ||
+      sizeof(header) + tocSize > header.stringsOffset ||
+      header.stringsOffset + header.stringsSize > archive->Size()) {
+    spdlog::error("Asset archive {} is corrupted; using loose files.", path);
+    return false;
+  }
+
+  // 目次の範囲を先に検証し、Readでは範囲を確かめずに参照します。
+  const auto *entries =
+      reinterpret_cast<const Entry *>(archive->Data() + sizeof(header));
+  for (uint32_t i = 0; i < header.entryCount; i++) {
+    const Entry &entry = entries[i];
+    if (entry.offset + entry.storedSize > archive->Size() ||
+        uint64_t{entry.pathOffset} + entry.pathLength > header.stringsSize ||
+        ((entry.flags & kDeflate) == 0 && entry.storedSize != entry.size)) {
+      spdlog::error("Asset archive {} is corrupted; using loose files.", path);
+      return false;
+    }
+  }
+
+  archive_ = std::move(archive);
+  entries_ = entries;
+  entryCount_ = header.entryCount;
+  strings_ =
+      reinterpret_cast<const char *>(archive_->Data() + header.stringsOffset);
+  spdlog::info("Mounted asset archive {} ({} entries)", path, entryCount_);
+  return true;
+}
+
+/**
+ * @brief アーカイブのマップを解除します。
+ * @note 参照中のビューがある間は、ビューがマップを保持します。
+ */
+void AssetArchive::Unmount() {
+  archive_.reset();
+  entries_ = nullptr;
+  entryCount_ = 0;
+  strings_ = nullptr;
+}
+
+bool AssetArchive::Contains(const std::string &filepath) const {
+  return Find(filepath) != nullptr;
+}
+
+/**
+ * @brief ファイルの内容を参照します。
+ * @param filepath ファイルのパス
+ * @return 内容のビュー(読み込めない場合は空です。)
+ * @note
+ * 圧縮していないファイルはマップしたアーカイブを直接指し、コピーしません。<br>
+ * アーカイブにないファイルは個別にマップします。
+ */
+AssetData AssetArchive::Read(const std::string &filepath) const {
+  AssetData asset{};
+  if (const Entry *entry = Find(filepath)) {
+    const auto *stored = archive_->Data() + entry->offset;
+    if ((entry->flags & kDeflate) == 0) {
+      asset.data = stored;
+      asset.size = entry->size;
+      asset.owner = archive_;
+      return asset;
+    }
+
+    BOOST_ASSERT_MSG(entry->size <= INT_MAX && entry->storedSize <= INT_MAX,
+                     "Compressed entry is too large!");
+    auto buffer = std::make_shared<std::vector<uint8_t>>(entry->size);
+    const int decoded = stbi_zlib_decode_buffer(
+        reinterpret_cast<char *>(buffer->data()),
+        static_cast<int>(buffer->size()),
+        reinterpret_cast<const char *>(stored),
+        static_cast<int>(entry->storedSize));
+    if (decoded < 0 || static_cast<uint64_t>(decoded) != entry->size) {
+      spdlog::error("Failed to inflate {} from the asset archive", filepath);
+      return asset;
+    }
+    asset.data = buffer->data();
+    asset.size = buffer->size();
+    asset.owner = std::move(buffer);
+    return asset;
+  }
+
+  auto file = std::make_shared<MappedFile>(filepath);
+  if (!file->IsOpen()) {
+    return asset;
+  }
+  asset.data = file->Data();
+  asset.size = file->Size();
+  asset.owner = std::move(file);
+  return asset;
+}
+
+/**
+ * @brief 目次を二分探索します。
+ * @return 項目(アーカイブにない場合はnullptrです。)
+ */
+const AssetArchive::Entry *
+AssetArchive::Find(const std::string &filepath) const {
+  if (archive_ == nullptr) {
+    return nullptr;
+  }
+  const auto key = NormalizePath(filepath);
+  const Entry *last = entries_ + entryCount_;
+  const Entry *it = std::lower_bound(
+      entries_, last, key, [this](const Entry &entry, const std::string &k) {
+        return PathOf(entry) < std::string_view(k);
+      });
+  return it != last && PathOf(*it) == key ? it : nullptr;
+}
+
+std::string_view AssetArchive::PathOf(const Entry &entry) const {
+  return {strings_ + entry.pathOffset, entry.pathLength};
+}
@@ -0,0 +1,93 @@
+/**
+ * @brief アセットをまとめたアーカイブをマップし、ファイルの内容を参照します。
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Utils/Singleton.h"
+
+class MappedFile;
+
+/**
+ * @brief ファイルの内容を参照するビュー
+ * @note ownerが生存している間、dataはマップしたページ(または展開したバッファ)を指します。
+ */
+struct AssetData {
+  const uint8_t *data = nullptr;
+  size_t size = 0;
+  /** @brief マップしたファイル、または展開したバッファ */
+  std::shared_ptr<const void> owner{};
+
+  explicit operator bool() const { return data != nullptr; }
+};
+
+/**
+ * @brief パックしたアセットのアーカイブ
+ * @note
+ * アーカイブはScripts/pack_assets.pyで生成します。
+ * 先頭のヘッダーと目次に続いて、各ファイルをアラインメントを揃えて格納します。<br>
+ * Readはワーカースレッドから呼び出せますが、MountとUnmountは読み込み中に呼び出さないでください。
+ */
+class AssetArchive : public Singleton<AssetArchive> {
+public:
+  /** @brief ファイルの格納方法 */
+  enum Flags : uint32_t {
+    /** @brief zlib形式で圧縮しています。(Readで展開したバッファを返します。) */
+    kDeflate = 1u << 0,
+  };
+
+  /** @brief アーカイブのヘッダー */
+  struct Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t alignment;
+    /** @brief パスを連結した文字列表の位置とバイト数 */
+    uint64_t stringsOffset;
+    uint64_t stringsSize;
+  };
+  static_assert(sizeof(Header) == 32, "Archive header layout mismatch!");
+
+  /** @brief 目次の項目(パスの昇順に並べます。) */
+  struct Entry {
+    uint64_t offset;
+    /** @brief アーカイブ内のバイト数 */
+    uint64_t storedSize;
+    /** @brief 元のファイルのバイト数 */
+    uint64_t size;
+    uint32_t pathOffset;
+    uint32_t pathLength;
+    uint32_t flags;
+    uint32_t reserved;
+  };
+  static_assert(sizeof(Entry) == 40, "Archive entry layout mismatch!");
+
+  /** @brief マジックナンバー("RVPK") */
+  static constexpr uint32_t kMagic = 0x4b505652;
+  static constexpr uint32_t kVersion = 1;
+
+  AssetArchive() = default;
+
+  bool Mount(const std::string &path);
+  void Unmount();
+
+  [[nodiscard]] bool IsMounted() const { return archive_ != nullptr; }
+  [[nodiscard]] bool Contains(const std::string &filepath) const;
+  [[nodiscard]] AssetData Read(const std::string &filepath) const;
+
+private:
+  [[nodiscard]] const Entry *Find(const std::string &filepath) const;
+  [[nodiscard]] std::string_view PathOf(const Entry &entry) const;
+
+  std::shared_ptr<const MappedFile> archive_{};
+  const Entry *entries_ = nullptr;
+  uint32_t entryCount_ = 0;
+  const char *strings_ = nullptr;
+};
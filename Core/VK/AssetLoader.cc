@@ -0,0 +1,128 @@
+/**
+ * @brief モデルとテクスチャの読み込みをワーカースレッドで並列に行います。
+ */
+
+#include "VK/AssetLoader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <spdlog/spdlog.h>
+#include <thread>
+
+#include "VK/Texture.h"
+#include "VK/UploadManager.h"
+
+//*-----------------------------------------------------------------------------
+// Declare
+//*-----------------------------------------------------------------------------
+
+/**
+ * @brief 読み込むモデルを宣言します。
+ * @note モデルはLoadが終わるまで破棄してはいけません。
+ */
+void AssetLoader::AddModel(Model &model, const std::string &filepath,
+                           const VertexLayout &vertexLayout,
+                           const ModelCreateInfo &modelCreateInfo) {
+  Task task{};
+  task.filepath = filepath;
+  task.decode = [&model, filepath, vertexLayout, modelCreateInfo] {
+    return model.Decode(filepath, vertexLayout, modelCreateInfo);
+  };
+  task.upload = [&model, modelCreateInfo](const Device &device,
+                                          UploadManager &uploader) {
+    model.Upload(device, uploader, modelCreateInfo);
+  };
+  tasks_.emplace_back(std::move(task));
+}
+
+/**
+ * @brief 読み込むテクスチャを宣言します。
+ * @note テクスチャはLoadが終わるまで破棄してはいけません。
+ */
+void AssetLoader::AddTexture(Texture2D &texture, const std::string &filepath,
+                             VkFormat format,
+                             VkImageUsageFlags imageUsageFlags,
+                             VkImageLayout imageLayout) {
+  Task task{};
+  task.filepath = filepath;
+  task.decode = [&texture, filepath, format] {
+    return texture.Decode(filepath, format);
+  };
+  task.upload = [&texture, format, imageUsageFlags, imageLayout](
+                    const Device &device, UploadManager &uploader) {
+    texture.Upload(device, uploader, format, imageUsageFlags, imageLayout);
+  };
+  tasks_.emplace_back(std::move(task));
+}
+
+//*-----------------------------------------------------------------------------
+// Load
+//*-----------------------------------------------------------------------------
+
+/** @brief 他のスレッドと並列にタスクを読み込んでいるか？ */
+static thread_local bool isParallelWorker = false;
+
+/**
+ * @brief 呼び出したスレッドが、他のスレッドと並列にアセットを読み込んでいるかを返します。
+ * @note
+ * trueの場合はすべてのスレッドがタスクを処理しているため、読み込みの中でさらにスレッドを作成しないでください。
+ */
+bool AssetLoader::IsParallelWorker() { return isParallelWorker; }
+
+/**
+ * @brief 宣言したアセットをすべて読み込み、転送を記録します。
+ * @param device デバイスオブジェクト
+ * @param uploader 転送を記録するアップロードマネージャー(送信は呼び出し側で行います。)
+ * @return すべてのアセットを読み込めたか？
+ */
+bool AssetLoader::Load(const Device &device, UploadManager &uploader) {
+  const auto tasks = std::move(tasks_);
+  tasks_.clear();
+  if (tasks.empty()) {
+    return true;
+  }
+  const auto start = std::chrono::steady_clock::now();
+
+  const uint32_t hardwareThreads =
+      std::max(std::thread::hardware_concurrency(), 1u);
+  const auto threads = static_cast<uint32_t>(
+      std::min<size_t>(threadCount == 0 ? hardwareThreads : threadCount,
+                       tasks.size()));
+
+  // タスクを先頭から順に取り出して読み込みます。(呼び出したスレッドも参加します。)
+  std::vector<uint8_t> decoded(tasks.size(), 0);
+  std::atomic<size_t> next{0};
+  const auto work = [&] {
+    isParallelWorker = threads > 1;
+    for (size_t i = next++; i < tasks.size(); i = next++) {
+      decoded[i] = tasks[i].decode() ? 1 : 0;
+    }
+    isParallelWorker = false;
+  };
+  std::vector<std::thread> workers{};
+  for (uint32_t i = 1; i < threads; i++) {
+    workers.emplace_back(work);
+  }
+  work();
+  for (auto &worker : workers) {
+    worker.join();
+  }
+
+  // デバイスのリソースの生成と転送の記録は、このスレッドで宣言した順に行います。
+  bool result = true;
+  for (size_t i = 0; i < tasks.size(); i++) {
+    if (decoded[i] == 0) {
+      spdlog::error("Failed to load asset {}", tasks[i].filepath);
+      result = false;
+      continue;
+    }
+    tasks[i].upload(device, uploader);
+  }
+
+  const std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  spdlog::info("Loaded {} assets on {} threads in {:.1f} ms", tasks.size(),
+               std::max(threads, 1u), elapsed.count());
+  return result;
+}
@@ -0,0 +1,53 @@
+/**
+ * @brief モデルとテクスチャの読み込みをワーカースレッドで並列に行います。
+ */
+
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <boost/noncopyable.hpp>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "VK/Model.h"
+
+struct Device;
+struct Texture2D;
+class UploadManager;
+
+/**
+ * @brief 宣言されたアセットをまとめて読み込みます。
+ * @note
+ * ファイルの読み込みと変換(Assimp、gli、頂点の詰め込み)はワーカースレッドで並列に行い、
+ * デバイスのリソースの生成と転送の記録は呼び出したスレッドで宣言した順に行います。
+ */
+class AssetLoader : private boost::noncopyable {
+public:
+  void AddModel(Model &model, const std::string &filepath,
+                const VertexLayout &vertexLayout,
+                const ModelCreateInfo &modelCreateInfo = {});
+  void AddTexture(
+      Texture2D &texture, const std::string &filepath,
+      VkFormat format = VK_FORMAT_R8G8B8A8_UNORM,
+      VkImageUsageFlags imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT,
+      VkImageLayout imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+  bool Load(const Device &device, UploadManager &uploader);
+
+  [[nodiscard]] static bool IsParallelWorker();
+
+  /** @brief 読み込みに使用するスレッドの数(呼び出したスレッドを含みます。0の場合はハードウェアのスレッド数です。) */
+  uint32_t threadCount = 0;
+
+private:
+  struct Task {
+    std::string filepath{};
+    /** @brief ワーカースレッドで実行する読み込みと変換 */
+    std::function<bool()> decode{};
+    /** @brief 呼び出したスレッドで実行するリソースの生成と転送 */
+    std::function<void(const Device &, UploadManager &)> upload{};
+  };
+  std::vector<Task> tasks_{};
+};
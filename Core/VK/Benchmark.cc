@@ -0,0 +1,358 @@
+/**
+ * @brief ベンチマークモードでのフレーム時間の計測とレポート出力を行います。
+ */
+
+#include "VK/Benchmark.h"
+
+#include <algorithm>
+#include <array>
+#include <boost/assert.hpp>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <glm/glm.hpp>
+#include <numeric>
+#include <spdlog/spdlog.h>
+
+#include "VK/Common.h"
+#include "VK/Device.h"
+#include "VK/Initializer.h"
+
+/**
+ * @brief 計測値の統計(平均、パーセンタイル)を求めます。
+ * @param samples 計測値
+ * @param skip 先頭から除外するサンプル数
+ * @return 統計をまとめたJSON(サンプルがない場合はnull)
+ */
+static nlohmann::json Summarize(const std::vector<double> &samples,
+                                size_t skip) {
+  if (samples.size() <= skip) {
+    return nullptr;
+  }
+  std::vector<double> sorted(samples.begin() + static_cast<long>(skip),
+                             samples.end());
+  std::sort(sorted.begin(), sorted.end());
+
+  // nearest-rank法でパーセンタイルを求めます。
+  const auto percentile = [&sorted](double p) {
+    const auto rank = static_cast<size_t>(
+        std::ceil(p / 100.0 * static_cast<double>(sorted.size())));
+    return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+  };
+
+  nlohmann::json summary;
+  summary["Samples"] = sorted.size();
+  summary["Mean"] = std::accumulate(sorted.begin(), sorted.end(), 0.0) /
+                    static_cast<double>(sorted.size());
+  summary["P50"] = percentile(50.0);
+  summary["P95"] = percentile(95.0);
+  summary["P99"] = percentile(99.0);
+  summary["Min"] = sorted.front();
+  summary["Max"] = sorted.back();
+  return summary;
+}
+
+static glm::vec3 ToVec3(const nlohmann::json &v) {
+  return glm::vec3(v[0].get<float>(), v[1].get<float>(), v[2].get<float>());
+}
+
+//*-----------------------------------------------------------------------------
+// Init & Deinit
+//*-----------------------------------------------------------------------------
+
+/**
+ * @brief シーン設定の"Benchmark"からパラメータを読み込み、計測用のリソースを生成します。
+ * @param device デバイスオブジェクト
+ * @param config シーン設定
+ * @param framesInFlight 同時に処理中にできるフレームの最大数
+ * @param useMemoryBudget VK_EXT_memory_budgetが有効になっているか？
+ */
+void Benchmark::Init(const Device &device, const nlohmann::json &config,
+                     uint32_t framesInFlight, bool useMemoryBudget) {
+  if (config.contains("Benchmark")) {
+    const auto &bench = config["Benchmark"];
+    frameCount = bench.value("Frames", frameCount);
+    warmupFrames = bench.value("WarmupFrames", warmupFrames);
+    timeStep = bench.value("TimeStep", timeStep);
+    output = bench.value("Output", output);
+    if (bench.contains("CameraPath")) {
+      cameraPath = bench["CameraPath"];
+    }
+  }
+  BOOST_ASSERT_MSG(timeStep > 0.0f, "Benchmark TimeStep must be positive!");
+  cpuTimes.reserve(frameCount);
+  gpuTimes.reserve(frameCount);
+
+  // タイムスタンプはグラフィックスキューがサポートしている場合にのみ計測します。
+  const auto &queueFamily =
+      device.queueFamilyProperties[device.queueFamilyIndices.graphics];
+  isSupportedTimestamp = queueFamily.timestampValidBits != 0;
+  timestampMask = queueFamily.timestampValidBits >= 64
+                      ? ~0ull
+                      : (1ull << queueFamily.timestampValidBits) - 1;
+
+  isSupportedMemoryBudget =
+      useMemoryBudget &&
+      device.vkGetPhysicalDeviceMemoryProperties2KHR != nullptr;
+  if (!isSupportedMemoryBudget) {
+    spdlog::warn("VK_EXT_memory_budget is not available; peak device memory "
+                 "will not be reported.");
+  }
+
+  VkQueryPoolCreateInfo queryPoolCreateInfo = Initializer::QueryPoolCreateInfo(
+      VK_QUERY_TYPE_TIMESTAMP, framesInFlight * 2);
+  VK_CHECK_RESULT(
+      vkCreateQueryPool(device, &queryPoolCreateInfo, nullptr, &queryPool));
+
+  commandPool = device.CreateCommandPool(device.queueFamilyIndices.graphics, 0);
+  beginCmdBuffers.resize(framesInFlight);
+  endCmdBuffers.resize(framesInFlight);
+  VkCommandBufferAllocateInfo alloc = Initializer::CommandBufferAllocateInfo(
+      commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, framesInFlight);
+  VK_CHECK_RESULT(
+      vkAllocateCommandBuffers(device, &alloc, beginCmdBuffers.data()));
+  VK_CHECK_RESULT(
+      vkAllocateCommandBuffers(device, &alloc, endCmdBuffers.data()));
+
+  // 内容はフレームごとに変わらないため、一度だけ記録します。
+  VkCommandBufferBeginInfo commandBufferBeginInfo =
+      Initializer::CommandBufferBeginInfo();
+  for (uint32_t i = 0; i < framesInFlight; i++) {
+    VK_CHECK_RESULT(
+        vkBeginCommandBuffer(beginCmdBuffers[i], &commandBufferBeginInfo));
+    vkCmdResetQueryPool(beginCmdBuffers[i], queryPool, i * 2, 2);
+    if (isSupportedTimestamp) {
+      vkCmdWriteTimestamp(beginCmdBuffers[i],
+                          VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, i * 2);
+    }
+    VK_CHECK_RESULT(vkEndCommandBuffer(beginCmdBuffers[i]));
+
+    VK_CHECK_RESULT(
+        vkBeginCommandBuffer(endCmdBuffers[i], &commandBufferBeginInfo));
+    if (isSupportedTimestamp) {
+      vkCmdWriteTimestamp(endCmdBuffers[i],
+                          VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool,
+                          i * 2 + 1);
+    }
+    VK_CHECK_RESULT(vkEndCommandBuffer(endCmdBuffers[i]));
+  }
+
+  VkFenceCreateInfo fenceCreateInfo =
+      Initializer::FenceCreateInfo(VK_FENCE_CREATE_SIGNALED_BIT);
+  fences.resize(framesInFlight);
+  for (auto &fence : fences) {
+    VK_CHECK_RESULT(vkCreateFence(device, &fenceCreateInfo, nullptr, &fence));
+  }
+  pending.assign(framesInFlight, false);
+}
+
+void Benchmark::Destroy(const Device &device) {
+  for (auto &fence : fences) {
+    vkDestroyFence(device, fence, nullptr);
+  }
+  vkDestroyCommandPool(device, commandPool, nullptr);
+  vkDestroyQueryPool(device, queryPool, nullptr);
+}
+
+//*-----------------------------------------------------------------------------
+// Frame
+//*-----------------------------------------------------------------------------
+
+/**
+ * @brief フレームの開始タイムスタンプを送信します。
+ * @note
+ * 同じスロットを使用していた前回のフレームの結果はここで読み戻すため、GPUを待機させることはありません。
+ * @param device デバイスオブジェクト
+ * @param queue グラフィックスキュー
+ * @param frame 現在のフレームのインデックス
+ * @param signalSemaphore(オプションです。)
+ * 送信完了時にシグナルするセマフォ(ヘッドレス時のイメージ取得の代わりに使用します。)
+ */
+void Benchmark::BeginFrame(const Device &device, VkQueue queue, uint32_t frame,
+                           VkSemaphore signalSemaphore) {
+  VK_CHECK_RESULT(
+      vkWaitForFences(device, 1, &fences[frame], VK_TRUE, UINT64_MAX));
+  if (pending[frame]) {
+    CollectGpuTime(device, frame);
+  }
+  SampleDeviceMemory(device);
+
+  VkSubmitInfo submitInfo = Initializer::SubmitInfo();
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &beginCmdBuffers[frame];
+  if (signalSemaphore != VK_NULL_HANDLE) {
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &signalSemaphore;
+  }
+  VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+}
+
+/**
+ * @brief フレームの終了タイムスタンプを送信します。
+ * @param device デバイスオブジェクト
+ * @param queue グラフィックスキュー
+ * @param frame 現在のフレームのインデックス
+ * @param waitSemaphore(オプションです。)
+ * 送信前に待機するセマフォ(ヘッドレス時のプレゼンテーションの代わりに使用します。)
+ */
+void Benchmark::EndFrame(const Device &device, VkQueue queue, uint32_t frame,
+                         VkSemaphore waitSemaphore) {
+  const VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+  VkSubmitInfo submitInfo = Initializer::SubmitInfo();
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &endCmdBuffers[frame];
+  if (waitSemaphore != VK_NULL_HANDLE) {
+    submitInfo.waitSemaphoreCount = 1;
+    submitInfo.pWaitSemaphores = &waitSemaphore;
+    submitInfo.pWaitDstStageMask = &waitStage;
+  }
+  VK_CHECK_RESULT(vkResetFences(device, 1, &fences[frame]));
+  VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, fences[frame]));
+  pending[frame] = true;
+  nextFrame = (frame + 1) % static_cast<uint32_t>(fences.size());
+}
+
+void Benchmark::RecordCpuTime(double milliseconds) {
+  cpuTimes.emplace_back(milliseconds);
+}
+
+/**
+ * @brief 未回収のフレームの結果をすべて読み戻します。
+ * @note デバイスがアイドル状態になってから呼び出してください。
+ */
+void Benchmark::Finish(const Device &device) {
+  const auto size = static_cast<uint32_t>(pending.size());
+  for (uint32_t i = 0; i < size; i++) {
+    const uint32_t frame = (nextFrame + i) % size;
+    if (pending[frame]) {
+      CollectGpuTime(device, frame);
+    }
+  }
+  SampleDeviceMemory(device);
+}
+
+/**
+ * @brief 指定したフレームのGPU時間を読み戻します。
+ * @note
+ * 前のフレームとオーバーラップしている区間は除外し、GPUがそのフレームのために稼働していた時間を記録します。
+ */
+void Benchmark::CollectGpuTime(const Device &device, uint32_t frame) {
+  pending[frame] = false;
+  if (!isSupportedTimestamp) {
+    return;
+  }
+
+  std::array<uint64_t, 2> timestamps{};
+  VK_CHECK_RESULT(vkGetQueryPoolResults(
+      device, queryPool, frame * 2, 2, sizeof(timestamps), timestamps.data(),
+      sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+  const uint64_t end = timestamps[1] & timestampMask;
+  const uint64_t begin =
+      std::max(timestamps[0] & timestampMask, lastTimestamp);
+  lastTimestamp = end;
+
+  const double period =
+      static_cast<double>(device.properties.limits.timestampPeriod);
+  const double ticks = end > begin ? static_cast<double>(end - begin) : 0.0;
+  gpuTimes.emplace_back(ticks * period / 1000000.0);
+}
+
+/**
+ * @brief デバイスローカルヒープの使用量を取得して最大値を更新します。
+ */
+void Benchmark::SampleDeviceMemory(const Device &device) {
+  VkDeviceSize budget = 0;
+  VkDeviceSize usage = 0;
+  if (!isSupportedMemoryBudget || !device.GetDeviceLocalBudget(budget, usage)) {
+    return;
+  }
+  peakDeviceMemory = std::max(peakDeviceMemory, usage);
+}
+
+//*-----------------------------------------------------------------------------
+// Camera path
+//*-----------------------------------------------------------------------------
+
+/**
+ * @brief 時刻tにおけるカメラの位置と注視点をカメラパスから線形補間して設定します。
+ * @param t 経過時間(秒)
+ * @param camera シーン設定の"Camera"(PositionとTargetを上書きします。)
+ * @return カメラを更新したか？
+ */
+bool Benchmark::UpdateCamera(float t, nlohmann::json &camera) const {
+  if (cameraPath.empty()) {
+    return false;
+  }
+
+  // tを挟むキーフレームを探します。範囲外の場合は端のキーフレームを使用します。
+  size_t next = 0;
+  while (next < cameraPath.size() &&
+         cameraPath[next]["Time"].get<float>() <= t) {
+    next++;
+  }
+  const auto &k0 = cameraPath[next == 0 ? 0 : next - 1];
+  const auto &k1 = cameraPath[std::min(next, cameraPath.size() - 1)];
+
+  const float t0 = k0["Time"].get<float>();
+  const float t1 = k1["Time"].get<float>();
+  const float a = t1 > t0 ? std::clamp((t - t0) / (t1 - t0), 0.0f, 1.0f) : 0.0f;
+
+  const auto position =
+      glm::mix(ToVec3(k0["Position"]), ToVec3(k1["Position"]), a);
+  const auto target = glm::mix(ToVec3(k0["Target"]), ToVec3(k1["Target"]), a);
+  camera["Position"] = {position.x, position.y, position.z};
+  camera["Target"] = {target.x, target.y, target.z};
+  return true;
+}
+
+//*-----------------------------------------------------------------------------
+// Report
+//*-----------------------------------------------------------------------------
+
+/**
+ * @brief 計測結果をJSONとして出力します。
+ * @param device デバイスオブジェクト
+ * @param config シーン設定
+ */
+void Benchmark::WriteReport(const Device &device,
+                            const nlohmann::json &config) const {
+  nlohmann::json report;
+  report["AppName"] = config["AppName"];
+  report["Device"] = device.properties.deviceName;
+  report["Headless"] = config.value("Headless", false);
+  report["Width"] = config["Width"];
+  report["Height"] = config["Height"];
+  report["FramesInFlight"] = fences.size();
+  report["Frames"] = cpuTimes.size();
+  report["WarmupFrames"] = warmupFrames;
+  report["TimeStep"] = timeStep;
+  report["CpuFrameTimeMs"] = Summarize(cpuTimes, warmupFrames);
+  report["GpuFrameTimeMs"] = Summarize(gpuTimes, warmupFrames);
+  if (isSupportedMemoryBudget) {
+    report["PeakDeviceMemoryBytes"] = peakDeviceMemory;
+  } else {
+    report["PeakDeviceMemoryBytes"] = nullptr;
+  }
+  const auto allocatorStats = device.allocator->GetStats();
+  report["Allocator"] = {
+      {"Blocks", allocatorStats.blockCount},
+      {"DedicatedAllocations", allocatorStats.dedicatedAllocationCount},
+      {"Allocations", allocatorStats.allocationCount},
+      {"ReservedBytes", allocatorStats.reservedBytes},
+      {"UsedBytes", allocatorStats.usedBytes},
+      {"FreeBytes", allocatorStats.freeBytes},
+      {"LargestFreeRange", allocatorStats.largestFreeRange},
+      {"Fragmentation", allocatorStats.fragmentation},
+  };
+
+  const std::filesystem::path path(output);
+  if (path.has_parent_path()) {
+    std::filesystem::create_directories(path.parent_path());
+  }
+  std::ofstream ofs(path);
+  BOOST_ASSERT_MSG(ofs, "Failed to open benchmark report!");
+  ofs << report.dump(4) << std::endl;
+
+  spdlog::info("Benchmark report written to {}", output);
+  spdlog::info("{}", report.dump());
+}
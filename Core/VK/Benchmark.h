@@ -0,0 +1,65 @@
+/**
+ * @brief ベンチマークモードでのフレーム時間の計測とレポート出力を行います。
+ */
+
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+struct Device;
+
+struct Benchmark {
+  void Init(const Device &device, const nlohmann::json &config,
+            uint32_t framesInFlight, bool useMemoryBudget);
+  void Destroy(const Device &device);
+
+  void BeginFrame(const Device &device, VkQueue queue, uint32_t frame,
+                  VkSemaphore signalSemaphore = VK_NULL_HANDLE);
+  void EndFrame(const Device &device, VkQueue queue, uint32_t frame,
+                VkSemaphore waitSemaphore = VK_NULL_HANDLE);
+  void RecordCpuTime(double milliseconds);
+  void Finish(const Device &device);
+
+  bool UpdateCamera(float t, nlohmann::json &camera) const;
+  void WriteReport(const Device &device, const nlohmann::json &config) const;
+
+  /** @brief 計測するフレーム数 */
+  uint32_t frameCount = 600;
+  /** @brief 統計から除外する最初のフレーム数 */
+  uint32_t warmupFrames = 0;
+  /** @brief 1フレームあたりの固定時間(秒) */
+  float timeStep = 1.0f / 60.0f;
+  /** @brief レポートの出力先 */
+  std::string output = "./Benchmark.json";
+  /** @brief カメラパスのキーフレーム({Time, Position, Target}の配列) */
+  nlohmann::json cameraPath = nlohmann::json::array();
+
+  /** @brief フレームの開始と終了のタイムスタンプ(フレームごとに2つ) */
+  VkQueryPool queryPool = VK_NULL_HANDLE;
+  VkCommandPool commandPool = VK_NULL_HANDLE;
+  std::vector<VkCommandBuffer> beginCmdBuffers{};
+  std::vector<VkCommandBuffer> endCmdBuffers{};
+  /** @brief 終了タイムスタンプの送信完了を通知するフェンス */
+  std::vector<VkFence> fences{};
+  /** @brief 結果をまだ読み戻していないフレーム */
+  std::vector<bool> pending{};
+
+  std::vector<double> cpuTimes{};
+  std::vector<double> gpuTimes{};
+  /** @brief 使用中のデバイスローカルメモリの最大値(VK_EXT_memory_budgetが必要) */
+  VkDeviceSize peakDeviceMemory = 0;
+
+private:
+  void CollectGpuTime(const Device &device, uint32_t frame);
+  void SampleDeviceMemory(const Device &device);
+
+  uint64_t timestampMask = 0;
+  uint64_t lastTimestamp = 0;
+  uint32_t nextFrame = 0;
+  bool isSupportedTimestamp = false;
+  bool isSupportedMemoryBudget = false;
+};
@@ -0,0 +1,606 @@
+/**
+ * @brief RGBA8の画像をBCn形式のブロックに圧縮します。
+ * @note
+ * 端点は主成分の方向に画素を射影した範囲から求め、インデックスは量子化した端点を結ぶ線分への射影で選びます。<br>
+ * 射影はAVX2(8画素)またはSSE2(4画素)で計算し、どちらも使えない場合はスカラーで計算します。
+ */
+
+#include "VK/BlockCompression.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <optional>
+#include <thread>
+#include <utility>
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+namespace BlockCompression {
+
+/**
+ * @brief 4x4画素のブロック(チャンネルごとに並べ替えたもの)
+ */
+struct Block {
+  alignas(32) std::array<float, 16> r{};
+  alignas(32) std::array<float, 16> g{};
+  alignas(32) std::array<float, 16> b{};
+  alignas(32) std::array<float, 16> a{};
+};
+
+using Color = std::array<float, 4>;
+using Indices = std::array<uint8_t, 16>;
+
+/**
+ * @brief 128ビットのブロックに下位のビットから書き込みます。
+ */
+class BitWriter {
+public:
+  explicit BitWriter(uint8_t *block) : block_(block) {
+    std::fill(block_, block_ + 16, uint8_t{0});
+  }
+  void Write(uint32_t value, uint32_t bits) {
+    for (uint32_t i = 0; i < bits; i++, offset_++) {
+      block_[offset_ >> 3] |=
+          static_cast<uint8_t>(((value >> i) & 1u) << (offset_ & 7));
+    }
+  }
+
+private:
+  uint8_t *block_ = nullptr;
+  uint32_t offset_ = 0;
+};
+
+//*-----------------------------------------------------------------------------
+// Endpoints
+//*-----------------------------------------------------------------------------
+
+static Block LoadBlock(const uint8_t *pixels) {
+  Block block{};
+  for (size_t i = 0; i < 16; i++) {
+    block.r[i] = static_cast<float>(pixels[i * 4 + 0]);
+    block.g[i] = static_cast<float>(pixels[i * 4 + 1]);
+    block.b[i] = static_cast<float>(pixels[i * 4 + 2]);
+    block.a[i] = static_cast<float>(pixels[i * 4 + 3]);
+  }
+  return block;
+}
+
+/**
+ * @brief 画素の分布の主成分の方向に沿って、すべての画素を含む線分の端点を求めます。
+ * @param mask 考慮するチャンネル(それ以外のチャンネルの端点は0です。)
+ */
+static std::pair<Color, Color> FindEndpoints(const Block &block,
+                                             const Color &mask) {
+  const std::array<const std::array<float, 16> *, 4> channels = {
+      &block.r, &block.g, &block.b, &block.a};
+  Color mean{};
+  for (size_t c = 0; c < 4; c++) {
+    for (const auto v : *channels[c]) {
+      mean[c] += v;
+    }
+    mean[c] = mean[c] / 16.0f * mask[c];
+  }
+
+  std::array<std::array<float, 4>, 4> covariance{};
+  for (size_t i = 0; i < 16; i++) {
+    Color d{};
+    for (size_t c = 0; c < 4; c++) {
+      d[c] = ((*channels[c])[i] - mean[c]) * mask[c];
+    }
+    for (size_t r = 0; r < 4; r++) {
+      for (size_t c = 0; c < 4; c++) {
+        covariance[r][c] += d[r] * d[c];
+      }
+    }
+  }
+
+  // べき乗法で最大の固有値の固有ベクトルを求めます。(分散が最大のチャンネルの行から始めます。)
+  size_t largest = 0;
+  for (size_t c = 1; c < 4; c++) {
+    if (covariance[c][c] > covariance[largest][largest]) {
+      largest = c;
+    }
+  }
+  Color axis = covariance[largest];
+  for (uint32_t iteration = 0; iteration < 8; iteration++) {
+    Color next{};
+    for (size_t r = 0; r < 4; r++) {
+      for (size_t c = 0; c < 4; c++) {
+        next[r] += covariance[r][c] * axis[c];
+      }
+    }
+    const float length = std::sqrt(next[0] * next[0] + next[1] * next[1] +
+                                   next[2] * next[2] + next[3] * next[3]);
+    if (length < 1e-6f) {
+      break;
+    }
+    for (size_t c = 0; c < 4; c++) {
+      axis[c] = next[c] / length;
+    }
+  }
+
+  float tMin = 0.0f;
+  float tMax = 0.0f;
+  for (size_t i = 0; i < 16; i++) {
+    float t = 0.0f;
+    for (size_t c = 0; c < 4; c++) {
+      t += ((*channels[c])[i] - mean[c]) * axis[c] * mask[c];
+    }
+    tMin = std::min(tMin, t);
+    tMax = std::max(tMax, t);
+  }
+
+  Color e0{};
+  Color e1{};
+  for (size_t c = 0; c < 4; c++) {
+    e0[c] = std::clamp(mean[c] + axis[c] * tMin, 0.0f, 255.0f) * mask[c];
+    e1[c] = std::clamp(mean[c] + axis[c] * tMax, 0.0f, 255.0f) * mask[c];
+  }
+  return {e0, e1};
+}
+
+/**
+ * @brief 画素を端点を結ぶ線分に射影し、[0, steps]の最も近い位置を求めます。
+ * @note 端点の差が0のチャンネルは射影に影響しません。
+ */
+static Indices Project(const Block &block, const Color &e0, const Color &e1,
+                       uint32_t steps) {
+  const Color d = {e1[0] - e0[0], e1[1] - e0[1], e1[2] - e0[2],
+                   e1[3] - e0[3]};
+  const float length2 = d[0] * d[0] + d[1] * d[1] + d[2] * d[2] + d[3] * d[3];
+  const float scale =
+      length2 > 0.0f ? static_cast<float>(steps) / length2 : 0.0f;
+
+  alignas(32) std::array<int32_t, 16> positions{};
+#if defined(__AVX2__)
+  const __m256 maxPosition = _mm256_set1_ps(static_cast<float>(steps));
+  for (size_t i = 0; i < 16; i += 8) {
+    __m256 dot = _mm256_mul_ps(
+        _mm256_sub_ps(_mm256_load_ps(&block.r[i]), _mm256_set1_ps(e0[0])),
+        _mm256_set1_ps(d[0]));
+    dot = _mm256_add_ps(
+        dot, _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(&block.g[i]),
+                                         _mm256_set1_ps(e0[1])),
+                           _mm256_set1_ps(d[1])));
+    dot = _mm256_add_ps(
+        dot, _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(&block.b[i]),
+                                         _mm256_set1_ps(e0[2])),
+                           _mm256_set1_ps(d[2])));
+    dot = _mm256_add_ps(
+        dot, _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(&block.a[i]),
+                                         _mm256_set1_ps(e0[3])),
+                           _mm256_set1_ps(d[3])));
+    const __m256 t = _mm256_min_ps(
+        _mm256_max_ps(_mm256_mul_ps(dot, _mm256_set1_ps(scale)),
+                      _mm256_setzero_ps()),
+        maxPosition);
+    _mm256_store_si256(reinterpret_cast<__m256i *>(&positions[i]),
+                       _mm256_cvtps_epi32(t));
+  }
+#elif defined(__SSE2__) || defined(_M_X64)
+  const __m128 maxPosition = _mm_set1_ps(static_cast<float>(steps));
+  for (size_t i = 0; i < 16; i += 4) {
+    __m128 dot = _mm_mul_ps(
+        _mm_sub_ps(_mm_load_ps(&block.r[i]), _mm_set1_ps(e0[0])),
+        _mm_set1_ps(d[0]));
+    dot = _mm_add_ps(
+        dot, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(&block.g[i]),
+                                   _mm_set1_ps(e0[1])),
+                        _mm_set1_ps(d[1])));
+    dot = _mm_add_ps(
+        dot, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(&block.b[i]),
+                                   _mm_set1_ps(e0[2])),
+                        _mm_set1_ps(d[2])));
+    dot = _mm_add_ps(
+        dot, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(&block.a[i]),
+                                   _mm_set1_ps(e0[3])),
+                        _mm_set1_ps(d[3])));
+    const __m128 t = _mm_min_ps(
+        _mm_max_ps(_mm_mul_ps(dot, _mm_set1_ps(scale)), _mm_setzero_ps()),
+        maxPosition);
+    _mm_store_si128(reinterpret_cast<__m128i *>(&positions[i]),
+                    _mm_cvtps_epi32(t));
+  }
+#else
+  for (size_t i = 0; i < 16; i++) {
+    const float dot = (block.r[i] - e0[0]) * d[0] +
+                      (block.g[i] - e0[1]) * d[1] +
+                      (block.b[i] - e0[2]) * d[2] + (block.a[i] - e0[3]) * d[3];
+    positions[i] = static_cast<int32_t>(std::lround(
+        std::clamp(dot * scale, 0.0f, static_cast<float>(steps))));
+  }
+#endif
+
+  Indices indices{};
+  for (size_t i = 0; i < 16; i++) {
+    indices[i] = static_cast<uint8_t>(positions[i]);
+  }
+  return indices;
+}
+
+//*-----------------------------------------------------------------------------
+// Encode
+//*-----------------------------------------------------------------------------
+
+static uint16_t Pack565(const Color &color) {
+  const auto quantize = [](float v, float max) {
+    return static_cast<uint32_t>(std::lround(v / 255.0f * max));
+  };
+  return static_cast<uint16_t>((quantize(color[0], 31.0f) << 11) |
+                               (quantize(color[1], 63.0f) << 5) |
+                               quantize(color[2], 31.0f));
+}
+
+static Color Unpack565(uint16_t packed) {
+  const uint32_t r = (packed >> 11) & 0x1f;
+  const uint32_t g = (packed >> 5) & 0x3f;
+  const uint32_t b = packed & 0x1f;
+  return {static_cast<float>((r << 3) | (r >> 2)),
+          static_cast<float>((g << 2) | (g >> 4)),
+          static_cast<float>((b << 3) | (b >> 2)), 0.0f};
+}
+
+/**
+ * @brief 線分上の位置を固定して、誤差の二乗和が最小になる端点を最小二乗法で求めます。
+ * @param weights 画素ごとの2つ目の端点の重み([0, 1])
+ * @return 端点(位置が1か所に集まっていて解けない場合は空です。)
+ */
+static std::optional<std::pair<Color, Color>>
+RefineEndpoints(const Block &block, const std::array<float, 16> &weights,
+                const Color &mask) {
+  const std::array<const std::array<float, 16> *, 4> channels = {
+      &block.r, &block.g, &block.b, &block.a};
+  float a00 = 0.0f;
+  float a01 = 0.0f;
+  float a11 = 0.0f;
+  Color b0{};
+  Color b1{};
+  for (size_t i = 0; i < 16; i++) {
+    const float w = weights[i];
+    a00 += (1.0f - w) * (1.0f - w);
+    a01 += (1.0f - w) * w;
+    a11 += w * w;
+    for (size_t c = 0; c < 4; c++) {
+      b0[c] += (1.0f - w) * (*channels[c])[i];
+      b1[c] += w * (*channels[c])[i];
+    }
+  }
+  const float determinant = a00 * a11 - a01 * a01;
+  if (std::abs(determinant) < 1e-4f) {
+    return std::nullopt;
+  }
+
+  Color e0{};
+  Color e1{};
+  for (size_t c = 0; c < 4; c++) {
+    e0[c] = std::clamp((a11 * b0[c] - a01 * b1[c]) / determinant, 0.0f,
+                       255.0f) *
+            mask[c];
+    e1[c] = std::clamp((a00 * b1[c] - a01 * b0[c]) / determinant, 0.0f,
+                       255.0f) *
+            mask[c];
+  }
+  return std::make_pair(e0, e1);
+}
+
+/**
+ * @brief 量子化した端点と線分上の位置で復元した画素の誤差の二乗和を求めます。
+ */
+static float Error(const Block &block, const Color &e0, const Color &e1,
+                   const std::array<float, 16> &weights) {
+  const std::array<const std::array<float, 16> *, 4> channels = {
+      &block.r, &block.g, &block.b, &block.a};
+  float error = 0.0f;
+  for (size_t i = 0; i < 16; i++) {
+    for (size_t c = 0; c < 4; c++) {
+      const float d = e0[c] + (e1[c] - e0[c]) * weights[i] -
+                      (*channels[c])[i];
+      error += d * d;
+    }
+  }
+  return error;
+}
+
+/**
+ * @brief BC1のカラーブロックの端点とインデックス
+ */
+struct ColorBlock {
+  uint16_t c0 = 0;
+  uint16_t c1 = 0;
+  /** @brief c0からc1への線分上の位置(0..3) */
+  Indices positions{};
+  std::array<float, 16> weights{};
+  float error = 0.0f;
+};
+
+static ColorBlock FitColor(const Block &block, const Color &e0,
+                           const Color &e1) {
+  ColorBlock fit{};
+  fit.c0 = Pack565(e1);
+  fit.c1 = Pack565(e0);
+  // 4色モードでは1つ目の端点の値が大きい必要があります。
+  if (fit.c0 < fit.c1) {
+    std::swap(fit.c0, fit.c1);
+  }
+  Color q0 = Unpack565(fit.c0);
+  Color q1 = Unpack565(fit.c1);
+  if (fit.c0 != fit.c1) {
+    fit.positions = Project(block, q0, q1, 3);
+  }
+  for (size_t i = 0; i < 16; i++) {
+    fit.weights[i] = static_cast<float>(fit.positions[i]) / 3.0f;
+  }
+  // 誤差はアルファを含めずに求めます。
+  q0[3] = 0.0f;
+  q1[3] = 0.0f;
+  Block color = block;
+  color.a.fill(0.0f);
+  fit.error = Error(color, q0, q1, fit.weights);
+  return fit;
+}
+
+/**
+ * @brief RGBを4色モードのBC1ブロック(8バイト)に圧縮します。
+ */
+static void EncodeColor(const Block &block, uint8_t *dst) {
+  const Color mask = {1.0f, 1.0f, 1.0f, 0.0f};
+  const auto [e0, e1] = FindEndpoints(block, mask);
+  auto fit = FitColor(block, e0, e1);
+  if (fit.c0 != fit.c1) {
+    if (const auto refined = RefineEndpoints(block, fit.weights, mask)) {
+      // FitColorはe1を1つ目の端点にするため、c0とc1の順に渡し直します。
+      const auto next = FitColor(block, refined->second, refined->first);
+      if (next.error < fit.error) {
+        fit = next;
+      }
+    }
+  }
+
+  uint32_t bits = 0;
+  if (fit.c0 != fit.c1) {
+    // 線分上の位置(c0から0..3)をBC1のインデックスの順序(c0, c1, 2/3c0+1/3c1, 1/3c0+2/3c1)に変えます。
+    static constexpr std::array<uint32_t, 4> kOrder = {0, 2, 3, 1};
+    for (size_t i = 0; i < 16; i++) {
+      bits |= kOrder[fit.positions[i]] << (i * 2);
+    }
+  }
+  dst[0] = static_cast<uint8_t>(fit.c0 & 0xff);
+  dst[1] = static_cast<uint8_t>(fit.c0 >> 8);
+  dst[2] = static_cast<uint8_t>(fit.c1 & 0xff);
+  dst[3] = static_cast<uint8_t>(fit.c1 >> 8);
+  for (size_t i = 0; i < 4; i++) {
+    dst[4 + i] = static_cast<uint8_t>(bits >> (i * 8));
+  }
+}
+
+/**
+ * @brief 1チャンネルを8値モードのBC4ブロック(8バイト)に圧縮します。
+ * @param channel 圧縮するチャンネル(0: R, 1: G, 3: A)
+ */
+static void EncodeChannel(const Block &block, size_t channel, uint8_t *dst) {
+  const std::array<const std::array<float, 16> *, 4> channels = {
+      &block.r, &block.g, &block.b, &block.a};
+  const auto &values = *channels[channel];
+  const auto [minValue, maxValue] =
+      std::minmax_element(values.begin(), values.end());
+  const auto a0 = static_cast<uint8_t>(*maxValue);
+  const auto a1 = static_cast<uint8_t>(*minValue);
+
+  uint64_t bits = 0;
+  if (a0 != a1) {
+    // 線分上の位置(a0から0..7)をBC4のインデックスの順序(a0, a1, 補間した6値)に変えます。
+    static constexpr std::array<uint64_t, 8> kOrder = {0, 2, 3, 4,
+                                                       5, 6, 7, 1};
+    Color e0{};
+    Color e1{};
+    e0[channel] = static_cast<float>(a0);
+    e1[channel] = static_cast<float>(a1);
+    const auto indices = Project(block, e0, e1, 7);
+    for (size_t i = 0; i < 16; i++) {
+      bits |= kOrder[indices[i]] << (i * 3);
+    }
+  }
+  dst[0] = a0;
+  dst[1] = a1;
+  for (size_t i = 0; i < 6; i++) {
+    dst[2 + i] = static_cast<uint8_t>(bits >> (i * 8));
+  }
+}
+
+/**
+ * @brief BC7のモード6の端点(7ビットの値とpビット)
+ */
+struct Endpoint {
+  std::array<uint32_t, 4> values{};
+  uint32_t p = 0;
+  Color color{};
+};
+
+/**
+ * @brief 端点を量子化し、誤差の小さいpビットを選びます。
+ */
+static Endpoint QuantizeEndpoint(const Color &color) {
+  Endpoint best{};
+  float bestError = std::numeric_limits<float>::max();
+  for (uint32_t p = 0; p < 2; p++) {
+    Endpoint endpoint{};
+    endpoint.p = p;
+    float error = 0.0f;
+    for (size_t c = 0; c < 4; c++) {
+      const auto v = static_cast<uint32_t>(std::clamp(
+          std::lround((color[c] - static_cast<float>(p)) / 2.0f), 0l, 127l));
+      endpoint.values[c] = v;
+      endpoint.color[c] = static_cast<float>((v << 1) | p);
+      error += (endpoint.color[c] - color[c]) * (endpoint.color[c] - color[c]);
+    }
+    if (error < bestError) {
+      best = endpoint;
+      bestError = error;
+    }
+  }
+  return best;
+}
+
+/**
+ * @brief BC7のモード6のブロックの端点とインデックス
+ */
+struct BC7Block {
+  Endpoint e0{};
+  Endpoint e1{};
+  Indices indices{};
+  std::array<float, 16> weights{};
+  float error = 0.0f;
+};
+
+static BC7Block FitBC7(const Block &block, const Color &e0, const Color &e1) {
+  // 4ビットのインデックスの補間の重み(64分率)
+  static constexpr std::array<uint32_t, 16> kWeights = {
+      0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+  BC7Block fit{};
+  fit.e0 = QuantizeEndpoint(e0);
+  fit.e1 = QuantizeEndpoint(e1);
+  fit.indices = Project(block, fit.e0.color, fit.e1.color, 15);
+  for (size_t i = 0; i < 16; i++) {
+    fit.weights[i] = static_cast<float>(kWeights[fit.indices[i]]) / 64.0f;
+  }
+  fit.error = Error(block, fit.e0.color, fit.e1.color, fit.weights);
+  return fit;
+}
+
+/**
+ * @brief RGBAをBC7のモード6のブロック(16バイト)に圧縮します。
+ * @note 端点は7ビットと共有しない下位ビット(pビット)で8ビットを表します。
+ */
+static void EncodeBC7(const Block &block, uint8_t *dst) {
+  const Color mask = {1.0f, 1.0f, 1.0f, 1.0f};
+  const auto [e0, e1] = FindEndpoints(block, mask);
+  auto fit = FitBC7(block, e0, e1);
+  if (const auto refined = RefineEndpoints(block, fit.weights, mask)) {
+    const auto next = FitBC7(block, refined->first, refined->second);
+    if (next.error < fit.error) {
+      fit = next;
+    }
+  }
+
+  // 最初の画素のインデックスの最上位ビットは省略されるため、0になるように端点を入れ替えます。
+  if (fit.indices[0] >= 8) {
+    std::swap(fit.e0, fit.e1);
+    for (auto &index : fit.indices) {
+      index = static_cast<uint8_t>(15 - index);
+    }
+  }
+
+  BitWriter writer(dst);
+  writer.Write(1u << 6, 7);
+  for (size_t c = 0; c < 4; c++) {
+    writer.Write(fit.e0.values[c], 7);
+    writer.Write(fit.e1.values[c], 7);
+  }
+  writer.Write(fit.e0.p, 1);
+  writer.Write(fit.e1.p, 1);
+  writer.Write(fit.indices[0], 3);
+  for (size_t i = 1; i < 16; i++) {
+    writer.Write(fit.indices[i], 4);
+  }
+}
+
+/**
+ * @brief 4x4画素のブロックを圧縮します。
+ * @param format 圧縮する形式
+ * @param pixels 行優先で並んだ16画素のRGBA8
+ * @param block 出力先(BlockBytesのバイト数)
+ */
+void EncodeBlock(Format format, const uint8_t *pixels, uint8_t *block) {
+  const Block source = LoadBlock(pixels);
+  switch (format) {
+  case Format::BC1:
+    EncodeColor(source, block);
+    break;
+  case Format::BC3:
+    EncodeChannel(source, 3, block);
+    EncodeColor(source, block + 8);
+    break;
+  case Format::BC4:
+    EncodeChannel(source, 0, block);
+    break;
+  case Format::BC5:
+    EncodeChannel(source, 0, block);
+    EncodeChannel(source, 1, block + 8);
+    break;
+  case Format::BC7:
+    EncodeBC7(source, block);
+    break;
+  }
+}
+
+//*-----------------------------------------------------------------------------
+// Compress
+//*-----------------------------------------------------------------------------
+
+/**
+ * @brief 圧縮した画像のバイト数を求めます。
+ */
+size_t CompressedSize(Format format, uint32_t width, uint32_t height) {
+  return size_t{(width + 3) / 4} * ((height + 3) / 4) * BlockBytes(format);
+}
+
+/**
+ * @brief 画像全体を圧縮します。
+ * @param format 圧縮する形式
+ * @param pixels RGBA8の画素
+ * @param width 画像の幅
+ * @param height 画像の高さ
+ * @param threadCount ブロックの行を分担するスレッドの数(0の場合はハードウェアのスレッド数です。)
+ * @return 行優先で並んだブロック
+ * @note 4の倍数でない大きさの画像は、端の画素を繰り返してブロックを埋めます。
+ */
+std::vector<uint8_t> Compress(Format format, const uint8_t *pixels,
+                              uint32_t width, uint32_t height,
+                              uint32_t threadCount) {
+  const uint32_t blocksX = (width + 3) / 4;
+  const uint32_t blocksY = (height + 3) / 4;
+  const uint32_t blockBytes = BlockBytes(format);
+  std::vector<uint8_t> blocks(CompressedSize(format, width, height));
+
+  const auto encodeRows = [&](uint32_t begin, uint32_t end) {
+    std::array<uint8_t, 64> block{};
+    for (uint32_t by = begin; by < end; by++) {
+      for (uint32_t bx = 0; bx < blocksX; bx++) {
+        for (uint32_t y = 0; y < 4; y++) {
+          const uint32_t sy = std::min(by * 4 + y, height - 1);
+          for (uint32_t x = 0; x < 4; x++) {
+            const uint32_t sx = std::min(bx * 4 + x, width - 1);
+            std::copy_n(pixels + (size_t{sy} * width + sx) * 4, 4,
+                        block.data() + (y * 4 + x) * 4);
+          }
+        }
+        EncodeBlock(format, block.data(),
+                    blocks.data() +
+                        (size_t{by} * blocksX + bx) * blockBytes);
+      }
+    }
+  };
+
+  const uint32_t hardwareThreads =
+      std::max(std::thread::hardware_concurrency(), 1u);
+  const uint32_t threads =
+      std::clamp(threadCount == 0 ? hardwareThreads : threadCount, 1u,
+                 std::max(blocksY, 1u));
+  const uint32_t rowsPerThread = (blocksY + threads - 1) / threads;
+  std::vector<std::thread> workers{};
+  for (uint32_t i = 1; i < threads; i++) {
+    workers.emplace_back(encodeRows, std::min(i * rowsPerThread, blocksY),
+                         std::min((i + 1) * rowsPerThread, blocksY));
+  }
+  encodeRows(0, std::min(rowsPerThread, blocksY));
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  return blocks;
+}
+
+} // namespace BlockCompression
@@ -0,0 +1,38 @@
+/**
+ * @brief RGBA8の画像をBCn形式のブロックに圧縮します。
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace BlockCompression {
+
+/**
+ * @brief 圧縮する形式
+ * @note BC7はモード6(1サブセット、RGBA、4ビットのインデックス)のみを出力します。
+ */
+enum class Format {
+  BC1, // RGB(アルファは無視します。)
+  BC3, // RGBA
+  BC4, // R
+  BC5, // RG
+  BC7, // RGBA
+};
+
+/** @brief 4x4画素のブロックのバイト数 */
+[[nodiscard]] constexpr uint32_t BlockBytes(Format format) {
+  return format == Format::BC1 || format == Format::BC4 ? 8 : 16;
+}
+
+[[nodiscard]] size_t CompressedSize(Format format, uint32_t width,
+                                    uint32_t height);
+void EncodeBlock(Format format, const uint8_t *pixels, uint8_t *block);
+[[nodiscard]] std::vector<uint8_t> Compress(Format format,
+                                            const uint8_t *pixels,
+                                            uint32_t width, uint32_t height,
+                                            uint32_t threadCount = 0);
+
+} // namespace BlockCompression
@@ -6,31 +6,31 @@
 #include "VK/Buffer.h"
 
 #include <boost/assert.hpp>
+#include <cstddef>
 
 #include "VK/Device.h"
 #include "VK/Initializer.h"
 
 /**
  * @brief
- * このバッファのメモリ範囲をマップします。成功した場合、マップされたポイントは指定されたバッファ範囲を指します。
- * @param size (オプションです。)
- * マップするメモリ範囲のサイズ。VK_WHOLE_SIZEを渡すと、完全なバッファ範囲をマップします。
+ * このバッファのメモリをマップします。成功した場合、マップされたポイントはoffsetの位置を指します。
+ * @note
+ * ホストから見えるメモリのブロックは永続的にマップされているため、vkMapMemoryは呼び出さず、常にバッファ全体がマップされています。
  * @param offset (オプションです。) 先頭からのバイトオフセット
  */
-VkResult Buffer::Map(const Device &device, VkDeviceSize size,
-                     VkDeviceSize offset) {
-  return vkMapMemory(device, memory, offset, size, 0, &mapped);
+VkResult Buffer::Map(const Device &, VkDeviceSize offset) {
+  if (allocation.mapped == nullptr) {
+    return VK_ERROR_MEMORY_MAP_FAILED;
+  }
+  BOOST_ASSERT_MSG(offset < allocation.size, "Map offset is out of range!");
+  mapped = static_cast<std::byte *>(allocation.mapped) + offset;
+  return VK_SUCCESS;
 }
 
 /**
  * @brief マップされたメモリ範囲のマップを解除します。
  */
-void Buffer::Unmap(const Device &device) {
-  if (mapped != nullptr) {
-    vkUnmapMemory(device, memory);
-    mapped = nullptr;
-  }
-}
+void Buffer::Unmap(const Device &) { mapped = nullptr; }
 
 /**
  * @brief 割り当てられたメモリブロックをバッファにアタッチします。
@@ -38,7 +38,8 @@ void Buffer::Unmap(const Device &device) {
  * @return vkBindBufferMemory呼び出しのVkResult
  */
 VkResult Buffer::Bind(const Device &device, VkDeviceSize offset) const {
-  return vkBindBufferMemory(device, buffer, memory, offset);
+  return vkBindBufferMemory(device, buffer, allocation.memory,
+                            allocation.offset + offset);
 }
 
 /**
@@ -71,11 +72,7 @@ void Buffer::Copy(void *data, VkDeviceSize size) const {
  */
 VkResult Buffer::Flush(const Device &device, VkDeviceSize size,
                        VkDeviceSize offset) const {
-  VkMappedMemoryRange mappedMemoryRange = Initializer::MappedMemoryRange();
-  mappedMemoryRange.memory = memory;
-  mappedMemoryRange.offset = offset;
-  mappedMemoryRange.size = size;
-  return vkFlushMappedMemoryRanges(device, 1, &mappedMemoryRange);
+  return device.allocator->Flush(device, allocation, offset, size);
 }
 
 /**
@@ -87,11 +84,7 @@ VkResult Buffer::Flush(const Device &device, VkDeviceSize size,
  */
 VkResult Buffer::Invalidate(const Device &device, const VkDeviceSize size,
                             VkDeviceSize offset) const {
-  VkMappedMemoryRange mappedMemoryRange = Initializer::MappedMemoryRange();
-  mappedMemoryRange.memory = memory;
-  mappedMemoryRange.offset = offset;
-  mappedMemoryRange.size = size;
-  return vkInvalidateMappedMemoryRanges(device, 1, &mappedMemoryRange);
+  return device.allocator->Invalidate(device, allocation, offset, size);
 }
 
 /**
@@ -109,7 +102,7 @@ VkResult Buffer::Create(const Device &device,
                         VkMemoryPropertyFlags memoryPropertyFlags,
                         VkDeviceSize size, void *data) {
   VkResult result = device.CreateBuffer(bufferUsageFlags, memoryPropertyFlags,
-                                        data, size, buffer, memory);
+                                        data, size, buffer, allocation);
   SetupDescriptor(size);
   return result;
 }
@@ -134,10 +127,5 @@ VkResult Buffer::Create(const Device &device,
  * @brief バッファが持っているリソースを解放します。
  */
 void Buffer::Destroy(const Device &device) const {
-  if (memory != VK_NULL_HANDLE) {
-    vkFreeMemory(device, memory, nullptr);
-  }
-  if (buffer != VK_NULL_HANDLE) {
-    vkDestroyBuffer(device, buffer, nullptr);
-  }
+  device.DestroyBuffer(buffer, allocation);
 }
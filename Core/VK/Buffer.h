@@ -8,6 +8,8 @@
 #include <vector>
 #include <vulkan/vulkan.h>
 
+#include "VK/Allocator.h"
+
 struct Device;
 
 struct Buffer {
@@ -21,9 +23,7 @@ struct Buffer {
                                 VkDeviceSize size);
   void Destroy(const Device &device) const;
 
-  [[nodiscard]] VkResult Map(const Device &device,
-                             VkDeviceSize size = VK_WHOLE_SIZE,
-                             VkDeviceSize offset = 0);
+  [[nodiscard]] VkResult Map(const Device &device, VkDeviceSize offset = 0);
   void Unmap(const Device &device);
   [[nodiscard]] VkResult Bind(const Device &device,
                               VkDeviceSize offset = 0) const;
@@ -39,7 +39,7 @@ struct Buffer {
                                     VkDeviceSize offset = 0) const;
 
   VkBuffer buffer = VK_NULL_HANDLE;
-  VkDeviceMemory memory = VK_NULL_HANDLE;
+  Allocation allocation{};
   VkDescriptorBufferInfo descriptor{};
   void *mapped = nullptr;
 };
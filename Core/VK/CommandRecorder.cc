@@ -0,0 +1,177 @@
+/**
+ * @brief レンダーパスの描画をワーカースレッドでセカンダリコマンドバッファに並列に記録します。
+ */
+
+#include "VK/CommandRecorder.h"
+
+#include <algorithm>
+#include <boost/assert.hpp>
+
+#include "VK/Common.h"
+#include "VK/Device.h"
+#include "VK/Initializer.h"
+
+//*-----------------------------------------------------------------------------
+// Init & Deinit
+//*-----------------------------------------------------------------------------
+
+/**
+ * @brief スレッドごとのコマンドプールを生成し、ワーカースレッドを起動します。
+ * @param device デバイスオブジェクト
+ * @param threadCount 記録に使用するスレッドの数(呼び出したスレッドを含みます。0の場合はハードウェアのスレッド数です。)
+ */
+void CommandRecorder::Init(const Device &device, uint32_t threadCount) {
+  if (threadCount == 0) {
+    threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+
+  workers_.resize(threadCount);
+  for (uint32_t i = 0; i < threadCount; i++) {
+    workers_[i] = std::make_unique<Worker>();
+    // 記録し直すときにvkBeginCommandBufferで暗黙的にリセットできるようにします。
+    workers_[i]->pool = device.CreateCommandPool(
+        device.queueFamilyIndices.graphics,
+        VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+  }
+  // 0番目は呼び出したスレッドが使用します。
+  for (uint32_t i = 1; i < threadCount; i++) {
+    workers_[i]->thread = std::thread([this, i] { Run(i); });
+  }
+}
+
+void CommandRecorder::Destroy(const Device &device) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    quit_ = true;
+  }
+  wake_.notify_all();
+  for (auto &worker : workers_) {
+    if (worker->thread.joinable()) {
+      worker->thread.join();
+    }
+    // プールを破棄すると、割り当てられたコマンドバッファも解放されます。
+    vkDestroyCommandPool(device, worker->pool, nullptr);
+  }
+  workers_.clear();
+  quit_ = false;
+}
+
+//*-----------------------------------------------------------------------------
+// Record
+//*-----------------------------------------------------------------------------
+
+/**
+ * @brief 描画リストをスレッドに分割してセカンダリコマンドバッファに記録します。
+ * @param device デバイスオブジェクト
+ * @param slot
+ * セカンダリコマンドバッファを識別する番号(パスとスワップチェーンイメージの組ごとに一意にします。)
+ * @param inheritanceInfo 記録先のレンダーパス、サブパス、フレームバッファ
+ * @param drawCount 描画リストの長さ
+ * @param record 範囲を記録する関数(複数のスレッドから同時に呼び出されます。)
+ * @return
+ * 描画リストの順に並んだセカンダリコマンドバッファ(vkCmdExecuteCommandsに渡します。)
+ * @note
+ * 同じスロットの前回の記録を参照するプライマリコマンドバッファは、実行が完了している必要があります。
+ */
+std::vector<VkCommandBuffer>
+CommandRecorder::Record(const Device &device, uint32_t slot,
+                        const VkCommandBufferInheritanceInfo &inheritanceInfo,
+                        uint32_t drawCount, const RecordFunc &record) {
+  BOOST_ASSERT_MSG(!workers_.empty(), "Command recorder is not initialized!");
+  if (drawCount == 0) {
+    return {};
+  }
+
+  const uint32_t perThread = std::max(minDrawsPerThread, 1u);
+  const uint32_t threadCount =
+      std::clamp((drawCount + perThread - 1) / perThread, 1u,
+                 static_cast<uint32_t>(workers_.size()));
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    job_.device = &device;
+    job_.slot = slot;
+    job_.inheritanceInfo = &inheritanceInfo;
+    job_.record = &record;
+    job_.ranges.clear();
+    uint32_t first = 0;
+    for (uint32_t i = 0; i < threadCount; i++) {
+      const uint32_t count =
+          drawCount / threadCount + (i < drawCount % threadCount ? 1 : 0);
+      job_.ranges.emplace_back(first, count);
+      first += count;
+    }
+    pending_ = threadCount - 1;
+    generation_++;
+  }
+  if (threadCount > 1) {
+    wake_.notify_all();
+  }
+
+  std::vector<VkCommandBuffer> commandBuffers(threadCount);
+  commandBuffers[0] = RecordRange(0);
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return pending_ == 0; });
+  }
+  for (uint32_t i = 1; i < threadCount; i++) {
+    commandBuffers[i] = workers_[i]->commandBuffers[slot];
+  }
+  return commandBuffers;
+}
+
+/**
+ * @brief ワーカースレッドのループ(記録の要求を待ち、自分の範囲を記録します。)
+ */
+void CommandRecorder::Run(uint32_t index) {
+  uint64_t generation = 0;
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      wake_.wait(lock,
+                 [&] { return quit_ || generation_ != generation; });
+      if (quit_) {
+        return;
+      }
+      generation = generation_;
+      if (index >= job_.ranges.size()) {
+        continue;
+      }
+    }
+
+    static_cast<void>(RecordRange(index));
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      pending_--;
+    }
+    done_.notify_one();
+  }
+}
+
+/**
+ * @brief スレッドに割り当てられた範囲をセカンダリコマンドバッファに記録します。
+ */
+VkCommandBuffer CommandRecorder::RecordRange(uint32_t index) {
+  auto &worker = *workers_[index];
+  if (worker.commandBuffers.size() <= job_.slot) {
+    worker.commandBuffers.resize(job_.slot + 1, VK_NULL_HANDLE);
+  }
+  auto &commandBuffer = worker.commandBuffers[job_.slot];
+  if (commandBuffer == VK_NULL_HANDLE) {
+    commandBuffer = job_.device->CreateCommandBuffer(
+        worker.pool, VK_COMMAND_BUFFER_LEVEL_SECONDARY, false);
+  }
+
+  // レンダーパスの内側で実行されるため、RENDER_PASS_CONTINUEを指定して継承情報を渡します。
+  VkCommandBufferBeginInfo commandBufferBeginInfo =
+      Initializer::CommandBufferBeginInfo();
+  commandBufferBeginInfo.flags =
+      VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+  commandBufferBeginInfo.pInheritanceInfo = job_.inheritanceInfo;
+  VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo));
+
+  const auto &[first, count] = job_.ranges[index];
+  (*job_.record)(commandBuffer, first, count);
+
+  VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+  return commandBuffer;
+}
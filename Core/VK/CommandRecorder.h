@@ -0,0 +1,84 @@
+/**
+ * @brief レンダーパスの描画をワーカースレッドでセカンダリコマンドバッファに並列に記録します。
+ */
+
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <boost/noncopyable.hpp>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct Device;
+
+/**
+ * @brief 描画リストを分割し、スレッドごとのコマンドプールからセカンダリコマンドバッファに記録します。
+ * @note
+ * 呼び出したスレッドも最初の範囲を記録するため、threadCountが1の場合はワーカースレッドを生成しません。
+ */
+class CommandRecorder : private boost::noncopyable {
+public:
+  /**
+   * @brief 描画リストの[first, first + count)をセカンダリコマンドバッファに記録する関数
+   * @note
+   * セカンダリコマンドバッファはパイプラインや記述子セット、ビューポートなどの状態を継承しないため、関数の中でバインドし直す必要があります。
+   */
+  using RecordFunc = std::function<void(VkCommandBuffer commandBuffer,
+                                        uint32_t first, uint32_t count)>;
+
+  void Init(const Device &device, uint32_t threadCount);
+  void Destroy(const Device &device);
+
+  [[nodiscard]] std::vector<VkCommandBuffer>
+  Record(const Device &device, uint32_t slot,
+         const VkCommandBufferInheritanceInfo &inheritanceInfo,
+         uint32_t drawCount, const RecordFunc &record);
+
+  [[nodiscard]] uint32_t GetThreadCount() const {
+    return static_cast<uint32_t>(workers_.size());
+  }
+
+  /** @brief 1つのスレッドに割り当てる描画の最小数(少ない描画を分割しても速くなりません。) */
+  uint32_t minDrawsPerThread = 64;
+
+private:
+  /**
+   * @brief スレッドごとのコマンドプールと記録済みのセカンダリコマンドバッファ
+   * @note コマンドプールは外部同期が必要なため、各スレッドは自分のプールのみを使用します。
+   */
+  struct Worker {
+    VkCommandPool pool = VK_NULL_HANDLE;
+    /** @brief スロットごとのセカンダリコマンドバッファ */
+    std::vector<VkCommandBuffer> commandBuffers{};
+    std::thread thread{};
+  };
+
+  /** @brief ワーカースレッドに渡す記録の内容 */
+  struct Job {
+    const Device *device = nullptr;
+    uint32_t slot = 0;
+    const VkCommandBufferInheritanceInfo *inheritanceInfo = nullptr;
+    const RecordFunc *record = nullptr;
+    /** @brief スレッドごとの描画の範囲(first, count) */
+    std::vector<std::pair<uint32_t, uint32_t>> ranges{};
+  };
+
+  void Run(uint32_t index);
+  [[nodiscard]] VkCommandBuffer RecordRange(uint32_t index);
+
+  std::vector<std::unique_ptr<Worker>> workers_{};
+  Job job_{};
+
+  std::mutex mutex_{};
+  std::condition_variable wake_{};
+  std::condition_variable done_{};
+  /** @brief 記録の要求ごとに増加する世代(ワーカースレッドの起床に使用します。) */
+  uint64_t generation_ = 0;
+  uint32_t pending_ = 0;
+  bool quit_ = false;
+};
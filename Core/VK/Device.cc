@@ -45,6 +45,9 @@ void Device::Init(VkPhysicalDevice selectedDevice) {
 }
 
 void Device::Destroy() const {
+  if (allocator) {
+    allocator->Destroy(*this);
+  }
   if (commandPool) {
     vkDestroyCommandPool(logicalDevice, commandPool, nullptr);
   }
@@ -73,6 +76,22 @@ uint32_t Device::FindMemoryType(uint32_t typeBits,
   return 0;
 }
 
+/**
+ * @brief リソースが使えるメモリタイプに、要求するすべてのプロパティフラグを持つものがあるかを返します。
+ * @param typeBits リソースのメモリ要件のmemoryTypeBits
+ * @note FindMemoryTypeは見つからない場合にアサートするため、任意の機能(遅延割り当てなど)はこれで確認します。
+ */
+bool Device::HasMemoryType(uint32_t typeBits,
+                           VkMemoryPropertyFlags flags) const {
+  for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+    if (typeBits & (1 << i) &&
+        (memoryProperties.memoryTypes[i].propertyFlags & flags) == flags) {
+      return true;
+    }
+  }
+  return false;
+}
+
 /**
  * @brief
  * 要求されたキューフラグをサポートするキューファミリーインデックスを返します。
@@ -142,6 +161,28 @@ VkFormat Device::FindSupportedDepthFormat(bool checkSamplingSupport) const {
   return VK_FORMAT_D32_SFLOAT;
 }
 
+/**
+ * @brief 候補の中から、最適なタイリングでサンプリングと線形フィルタリングができる最初の形式を探します。
+ * @param candidates 優先する順に並べた形式(ブロック圧縮の形式から非圧縮の形式へ並べます。)
+ * @return 見つからない場合は最後の候補を返します。
+ */
+VkFormat Device::FindSupportedTextureFormat(
+    const std::vector<VkFormat> &candidates) const {
+  BOOST_ASSERT_MSG(!candidates.empty(), "No texture format candidates!");
+  constexpr VkFormatFeatureFlags required =
+      VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT |
+      VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+  for (const auto format : candidates) {
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, format,
+                                        &formatProperties);
+    if ((formatProperties.optimalTilingFeatures & required) == required) {
+      return format;
+    }
+  }
+  return candidates.back();
+}
+
 /**
  * @brief 拡張機能が物理デバイスでサポートされているか確認します。
  * @param extension チェックする拡張機能の名前
@@ -152,6 +193,39 @@ bool Device::IsSupportedExtension(const std::string &extension) const {
                    extension) != std::end(supportExtensions);
 }
 
+/**
+ * @brief デバイスローカルヒープの予算と使用量の合計を取得します。
+ * @param budget このプロセスが使えるバイト数(他のプロセスの使用量を除きます。)
+ * @param usage このプロセスが使用しているバイト数
+ * @return VK_EXT_memory_budgetが有効で取得できたか？
+ */
+bool Device::GetDeviceLocalBudget(VkDeviceSize &budget,
+                                  VkDeviceSize &usage) const {
+  if (vkGetPhysicalDeviceMemoryProperties2KHR == nullptr) {
+    return false;
+  }
+
+  VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{};
+  budgetProperties.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+  VkPhysicalDeviceMemoryProperties2 memoryProperties2{};
+  memoryProperties2.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+  memoryProperties2.pNext = &budgetProperties;
+  vkGetPhysicalDeviceMemoryProperties2KHR(physicalDevice, &memoryProperties2);
+
+  budget = 0;
+  usage = 0;
+  const auto &heaps = memoryProperties2.memoryProperties;
+  for (uint32_t i = 0; i < heaps.memoryHeapCount; i++) {
+    if (heaps.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+      budget += budgetProperties.heapBudget[i];
+      usage += budgetProperties.heapUsage[i];
+    }
+  }
+  return true;
+}
+
 /**
  * @brief
  * 割り当てられた物理デバイスに基づいて論理デバイスを生成し、デフォルトのキューファミリーインデックスも取得します。
@@ -267,6 +341,10 @@ Device::CreateLogicalDevice(VkPhysicalDeviceFeatures requestedFeatures,
   // グラフィックコマンドバッファのデフォルトのコマンドプールを生成します。
   commandPool = CreateCommandPool(queueFamilyIndices.graphics);
 
+  // バッファとイメージはこのアロケータが確保したブロックからメモリを割り当てます。
+  allocator = std::make_unique<Allocator>();
+  allocator->Init(*this);
+
   return result;
 }
 
@@ -278,59 +356,40 @@ Device::CreateLogicalDevice(VkPhysicalDeviceFeatures requestedFeatures,
  * メモリプロパティ(DeviceLocal, HostVisible, ÒCoherentなど)
  * @param size バイト単位のバッファサイズ
  * @param buffer バッファハンドルへのポインタ
- * @param memory メモリハンドルへのポインタ
+ * @param allocation バッファにバインドしたメモリの割り当て
  * @param data 生成後にバッファをコピーする必要があるデータへのポインタ
+ * @param strategy (オプションです。) ブロック内の割り当て方法(一時的なステージングバッファはLinearにします。)
  * @return バッファハンドルとメモリが生成された場合、VK_SUCCESSを返します。
  */
 VkResult Device::CreateBuffer(VkBufferUsageFlags bufferUsageFlags,
                               VkMemoryPropertyFlags memoryPropertyFlags,
                               const void *data, VkDeviceSize size,
-                              VkBuffer &buffer, VkDeviceMemory &memory) const {
+                              VkBuffer &buffer, Allocation &allocation,
+                              AllocationStrategy strategy) const {
   // バッファハンドルを生成します。
   VkBufferCreateInfo bufferCreateInfo =
       Initializer::BufferCreateInfo(bufferUsageFlags, size);
   VK_CHECK_RESULT(
       vkCreateBuffer(logicalDevice, &bufferCreateInfo, nullptr, &buffer));
 
-  // バッファハンドルをバックアップするメモリを生成します。
-  VkMemoryRequirements memoryRequirements{};
-  vkGetBufferMemoryRequirements(logicalDevice, buffer, &memoryRequirements);
-  VkMemoryAllocateInfo memoryAllocateInfo = Initializer::MemoryAllocateInfo();
-  memoryAllocateInfo.allocationSize = memoryRequirements.size;
-
-  // バッファのプロパティに適合するメモリタイプのインデックスを見つけます。
-  memoryAllocateInfo.memoryTypeIndex =
-      FindMemoryType(memoryRequirements.memoryTypeBits, memoryPropertyFlags);
-
-  // バッファにVK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BITが設定されている場合は、メモリ割り当て中に適切なフラグも有効にする必要があります。
-  VkMemoryAllocateFlagsInfoKHR allocateFlagsInfo{};
-  if (bufferUsageFlags & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) {
-    allocateFlagsInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO_KHR;
-    allocateFlagsInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT_KHR;
-    memoryAllocateInfo.pNext = &allocateFlagsInfo;
-  }
-  VK_CHECK_RESULT(
-      vkAllocateMemory(logicalDevice, &memoryAllocateInfo, nullptr, &memory));
+  // バッファハンドルをバックアップするメモリを割り当ててバインドします。
+  AllocationCreateInfo allocationCreateInfo{};
+  allocationCreateInfo.memoryPropertyFlags = memoryPropertyFlags;
+  allocationCreateInfo.strategy = strategy;
+  allocationCreateInfo.deviceAddress =
+      (bufferUsageFlags & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) != 0;
+  VK_CHECK_RESULT(allocator->AllocateBufferMemory(
+      *this, buffer, allocationCreateInfo, allocation));
 
-  // バッファデータへのポインタが渡された場合は、バッファをマップしてデータをコピーします。
+  // バッファデータへのポインタが渡された場合は、マップされた領域にデータをコピーします。
   if (data != nullptr) {
-    void *mapped;
-    VK_CHECK_RESULT(vkMapMemory(logicalDevice, memory, 0, size, 0, &mapped));
-    std::memcpy(mapped, data, size);
+    BOOST_ASSERT_MSG(allocation.mapped != nullptr,
+                     "Buffer memory is not host visible!");
+    std::memcpy(allocation.mapped, data, size);
 
     // ホストの一貫性(Coherency)がリクエストされていない場合は、手動でフラッシュして書き込みを表示します。
-    if ((memoryPropertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) == 0) {
-      VkMappedMemoryRange mappedMemoryRange = Initializer::MappedMemoryRange();
-      mappedMemoryRange.memory = memory;
-      mappedMemoryRange.offset = 0;
-      mappedMemoryRange.size = size;
-      VK_CHECK_RESULT(
-          vkFlushMappedMemoryRanges(logicalDevice, 1, &mappedMemoryRange));
-    }
-    vkUnmapMemory(logicalDevice, memory);
+    VK_CHECK_RESULT(allocator->Flush(*this, allocation, 0, size));
   }
-  // メモリをバッファオブジェクトにアタッチします。
-  VK_CHECK_RESULT(vkBindBufferMemory(logicalDevice, buffer, memory, 0));
   return VK_SUCCESS;
 }
 
@@ -342,16 +401,30 @@ VkResult Device::CreateBuffer(VkBufferUsageFlags bufferUsageFlags,
  * メモリプロパティ(DeviceLocal, HostVisible, ÒCoherentなど)
  * @param size バイト単位のバッファサイズ
  * @param buffer バッファハンドルへのポインタ
- * @param memory メモリハンドルへのポインタ
+ * @param allocation バッファにバインドしたメモリの割り当て
+ * @param strategy (オプションです。) ブロック内の割り当て方法
  * @return バッファハンドルとメモリが生成された場合、VK_SUCCESSを返します。
  */
 VkResult Device::CreateBuffer(VkBufferUsageFlags bufferUsageFlags,
                               VkMemoryPropertyFlags memoryPropertyFlags,
                               VkDeviceSize size, VkBuffer &buffer,
-                              VkDeviceMemory &memory) const {
+                              Allocation &allocation,
+                              AllocationStrategy strategy) const {
   return CreateBuffer(bufferUsageFlags, memoryPropertyFlags, nullptr, size,
-                      buffer, memory);
+                      buffer, allocation, strategy);
 }
+
+/**
+ * @brief CreateBufferで生成したバッファとそのメモリを解放します。
+ */
+void Device::DestroyBuffer(VkBuffer buffer,
+                           const Allocation &allocation) const {
+  if (buffer != VK_NULL_HANDLE) {
+    vkDestroyBuffer(logicalDevice, buffer, nullptr);
+  }
+  allocator->Free(*this, allocation);
+}
+
 /**
  * @brief アロケートコマンドバッファ用のコマンドプールを生成します。
  * @param queueFamilyIndex
@@ -6,10 +6,13 @@
 
 #include <vulkan/vulkan.h>
 
+#include <memory>
 #include <optional>
 #include <string>
 #include <vector>
 
+#include "VK/Allocator.h"
+
 struct Device {
 public:
   void Init(VkPhysicalDevice physicalDevice);
@@ -25,15 +28,17 @@ public:
                     VkCommandPoolCreateFlags createFlags =
                         VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT) const;
 
-  [[nodiscard]] VkResult CreateBuffer(VkBufferUsageFlags bufferUsageFlags,
-                                      VkMemoryPropertyFlags memoryPropertyFlags,
-                                      const void *data, VkDeviceSize size,
-                                      VkBuffer &buffer,
-                                      VkDeviceMemory &memory) const;
+  [[nodiscard]] VkResult CreateBuffer(
+      VkBufferUsageFlags bufferUsageFlags,
+      VkMemoryPropertyFlags memoryPropertyFlags, const void *data,
+      VkDeviceSize size, VkBuffer &buffer, Allocation &allocation,
+      AllocationStrategy strategy = AllocationStrategy::Buddy) const;
   [[nodiscard]] [[maybe_unused]] VkResult
   CreateBuffer(VkBufferUsageFlags bufferUsageFlags,
                VkMemoryPropertyFlags memoryPropertyFlags, VkDeviceSize size,
-               VkBuffer &buffer, VkDeviceMemory &memory) const;
+               VkBuffer &buffer, Allocation &allocation,
+               AllocationStrategy strategy = AllocationStrategy::Buddy) const;
+  void DestroyBuffer(VkBuffer buffer, const Allocation &allocation) const;
 
   [[nodiscard]] VkCommandBuffer CreateCommandBuffer(
       VkCommandPool pool,
@@ -49,11 +54,17 @@ public:
 
   [[nodiscard]] uint32_t FindMemoryType(uint32_t memoryType,
                                         VkMemoryPropertyFlags flags) const;
+  [[nodiscard]] bool HasMemoryType(uint32_t typeBits,
+                                   VkMemoryPropertyFlags flags) const;
   [[nodiscard]] uint32_t
   FindQueueFamilyIndex(VkQueueFlagBits queueFlagBits) const;
   [[nodiscard]] VkFormat
   FindSupportedDepthFormat(bool checkSamplingSupport = false) const;
+  [[nodiscard]] VkFormat
+  FindSupportedTextureFormat(const std::vector<VkFormat> &candidates) const;
   [[nodiscard]] bool IsSupportedExtension(const std::string &extension) const;
+  [[nodiscard]] bool GetDeviceLocalBudget(VkDeviceSize &budget,
+                                          VkDeviceSize &usage) const;
 
   operator VkDevice() const noexcept { return logicalDevice; }
 
@@ -79,6 +90,11 @@ public:
   /** @brief
    * グラフィックキューファミリーインデックスのデフォルトのコマンドプール */
   VkCommandPool commandPool = VK_NULL_HANDLE;
+  /** @brief バッファとイメージのメモリのサブアロケータ */
+  std::unique_ptr<Allocator> allocator{};
+  /** @brief ヒープの予算を取得する関数(VK_EXT_memory_budgetが有効な場合のみ設定します。) */
+  PFN_vkGetPhysicalDeviceMemoryProperties2KHR
+      vkGetPhysicalDeviceMemoryProperties2KHR = nullptr;
   /** @brief キューファミリーインデックス */
   struct {
     uint32_t graphics;
@@ -18,8 +18,8 @@ void Framebuffer::Destroy(const Device &device) const {
   vkDestroySampler(device, sampler, nullptr);
   for (const auto &attachment : attachments) {
     vkDestroyImageView(device, attachment.view, nullptr);
-    vkFreeMemory(device, attachment.memory, nullptr);
     vkDestroyImage(device, attachment.image, nullptr);
+    device.allocator->Free(device, attachment.allocation);
   }
 }
 
@@ -46,11 +46,17 @@ Framebuffer::AddAttachment(const Device &device,
   }
   BOOST_ASSERT(aspectMask > 0);
 
+  // 一時的なアタッチメントは遅延割り当てのメモリ(タイルメモリのみ)を希望します。
+  // イメージのmemoryTypeBitsに該当するものが無ければ、CreateImageが通常のメモリにします。
+  VkMemoryPropertyFlags memoryFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+  if (attachmentCreateInfo.usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT) {
+    memoryFlags |= VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+  }
   VK_CHECK_RESULT(CreateImage(
-      device, framebufferAttachment.image, framebufferAttachment.memory,
+      device, framebufferAttachment.image, framebufferAttachment.allocation,
       attachmentCreateInfo.format, VK_IMAGE_TYPE_2D, attachmentCreateInfo.width,
       attachmentCreateInfo.height, 1, 1, attachmentCreateInfo.layerCount,
-      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, attachmentCreateInfo.usage,
+      memoryFlags, attachmentCreateInfo.usage,
       VK_IMAGE_TILING_OPTIMAL, attachmentCreateInfo.imageSampleCount));
 
   framebufferAttachment.subresourceRange = {};
@@ -9,6 +9,8 @@
 #include <algorithm>
 #include <vector>
 
+#include "VK/Allocator.h"
+
 struct Device;
 
 /**
@@ -48,7 +50,7 @@ struct FramebufferAttachment {
   [[nodiscard]] bool IsDepthStencil() const { return HasDepth() || HasStencil(); }
 
   VkImage image = VK_NULL_HANDLE;
-  VkDeviceMemory memory = VK_NULL_HANDLE;
+  Allocation allocation{};
   VkImageView view = VK_NULL_HANDLE;
   VkFormat format = VK_FORMAT_UNDEFINED;
   VkImageSubresourceRange subresourceRange{};
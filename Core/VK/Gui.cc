@@ -11,7 +11,11 @@
 
 #include <algorithm>
 #include <boost/assert.hpp>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
 
+#include "VK/AssetArchive.h"
 #include "VK/Common.h"
 #include "VK/Device.h"
 #include "VK/Initializer.h"
@@ -28,7 +32,9 @@
 //#define UI_OVERLAY_FONT_PATH "./Assets/Fonts/Cica/Cica-Regular.ttf"
 
 void Gui::OnInit(GLFWwindow *window, const Device &device, VkQueue queue,
-                 VkPipelineCache pipelineCache, VkRenderPass renderPass) {
+                 VkPipelineCache pipelineCache, VkRenderPass renderPass,
+                 uint32_t frameCount) {
+  frames.resize(frameCount);
 
   InitImGui(window);
   SetupResources(device, queue);
@@ -42,10 +48,12 @@ void Gui::OnDestroy(const Device &device) const {
   vkDestroyDescriptorPool(device, descriptorPool, nullptr);
   vkDestroySampler(device, sampler, nullptr);
   vkDestroyImageView(device, font.view, nullptr);
-  vkFreeMemory(device, font.memory, nullptr);
   vkDestroyImage(device, font.image, nullptr);
-  indexBuffer.Destroy(device);
-  vertexBuffer.Destroy(device);
+  device.allocator->Free(device, font.allocation);
+  for (const auto &frame : frames) {
+    frame.indexBuffer.Destroy(device);
+    frame.vertexBuffer.Destroy(device);
+  }
   ImGui_ImplGlfw_Shutdown();
   ImGui::DestroyContext();
 }
@@ -57,12 +65,16 @@ void Gui::OnResize(uint32_t width, uint32_t height) {
 }
 
 /**
- * @brief 必要に応じてImGuiの頂点とインデックスバッファを更新します。
+ * @brief ImGuiの頂点とインデックスをフレームのアリーナに書き込みます。
+ * @param device デバイスオブジェクト
+ * @param frame 描画するフレームのインデックス
+ * @note
+ * フレームのフェンスを待機した後に呼び出すため、GPUが読み込み中のバッファを書き換えることはありません。
  */
-bool Gui::Update(const Device &device) {
+void Gui::Update(const Device &device, uint32_t frame) {
   ImDrawData *imDrawData = ImGui::GetDrawData();
   if (imDrawData == nullptr) {
-    return false;
+    return;
   }
 
   VkDeviceSize vertexBufferSize =
@@ -70,41 +82,18 @@ bool Gui::Update(const Device &device) {
   VkDeviceSize indexBufferSize = imDrawData->TotalIdxCount * sizeof(ImDrawIdx);
 
   if (vertexBufferSize == 0 || indexBufferSize == 0) {
-    return false;
-  }
-
-  bool updateCmdBuffers = false;
-  // 頂点バッファ
-  if ((vertexBuffer.buffer == VK_NULL_HANDLE) ||
-      (vertexCount != static_cast<uint32_t>(imDrawData->TotalVtxCount))) {
-    vertexBuffer.Unmap(device);
-    vertexBuffer.Destroy(device);
-
-    VK_CHECK_RESULT(vertexBuffer.Create(
-        device, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, vertexBufferSize));
-
-    vertexCount = imDrawData->TotalVtxCount;
-    VK_CHECK_RESULT(vertexBuffer.Map(device));
-    updateCmdBuffers = true;
+    return;
   }
 
-  // インデックスバッファ
-  if ((indexBuffer.buffer == VK_NULL_HANDLE) ||
-      (indexCount < static_cast<uint32_t>(imDrawData->TotalIdxCount))) {
-    indexBuffer.Unmap(device);
-    indexBuffer.Destroy(device);
-    VK_CHECK_RESULT(indexBuffer.Create(device, VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-                                       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
-                                       indexBufferSize));
-    indexCount = imDrawData->TotalIdxCount;
-    VK_CHECK_RESULT(indexBuffer.Map(device));
-    updateCmdBuffers = true;
-  }
+  auto &arena = frames[frame];
+  Reserve(device, arena.vertexBuffer, arena.vertexCapacity, vertexBufferSize,
+          VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+  Reserve(device, arena.indexBuffer, arena.indexCapacity, indexBufferSize,
+          VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
 
   // データをアップロードします。
-  auto *vtxDst = static_cast<ImDrawVert *>(vertexBuffer.mapped);
-  auto *idxDst = static_cast<ImDrawIdx *>(indexBuffer.mapped);
+  auto *vtxDst = static_cast<ImDrawVert *>(arena.vertexBuffer.mapped);
+  auto *idxDst = static_cast<ImDrawIdx *>(arena.indexBuffer.mapped);
   for (int i = 0; i < imDrawData->CmdListsCount; i++) {
     const ImDrawList *cmdList = imDrawData->CmdLists[i];
     std::memcpy(vtxDst, cmdList->VtxBuffer.Data,
@@ -114,15 +103,34 @@ bool Gui::Update(const Device &device) {
     vtxDst += cmdList->VtxBuffer.Size;
     idxDst += cmdList->IdxBuffer.Size;
   }
+}
 
-  // 書き込みをGPUに表示するためにフラッシュします。
-  // VK_CHECK_RESULT(vertexBuffer.Flush(device));
-  // VK_CHECK_RESULT(indexBuffer.Flush(device));
+/**
+ * @brief バッファの容量が足りなければ、2倍ずつ拡張して作り直します。
+ * @note 容量は縮小しないため、UIの頂点数が変化するたびにバッファを作り直すことはありません。
+ */
+void Gui::Reserve(const Device &device, Buffer &buffer, VkDeviceSize &capacity,
+                  VkDeviceSize size, VkBufferUsageFlags usage) const {
+  if (buffer.buffer != VK_NULL_HANDLE && size <= capacity) {
+    return;
+  }
+  VkDeviceSize newCapacity = std::max(capacity, minArenaSize);
+  while (newCapacity < size) {
+    newCapacity *= 2;
+  }
 
-  return updateCmdBuffers;
+  buffer.Unmap(device);
+  buffer.Destroy(device);
+  buffer = {};
+  VK_CHECK_RESULT(buffer.Create(device, usage,
+                                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                    VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                newCapacity));
+  VK_CHECK_RESULT(buffer.Map(device));
+  capacity = newCapacity;
 }
 
-void Gui::Draw(VkCommandBuffer commandBuffer) {
+void Gui::Draw(VkCommandBuffer commandBuffer, uint32_t frame) {
   ImDrawData *imDrawData = ImGui::GetDrawData();
   if ((imDrawData == nullptr) || (imDrawData->CmdListsCount == 0)) {
     return;
@@ -139,8 +147,13 @@ void Gui::Draw(VkCommandBuffer commandBuffer) {
                      0, sizeof(PushConst), &pushConst);
 
   VkDeviceSize offsets[1] = {0};
-  vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer.buffer, offsets);
-  vkCmdBindIndexBuffer(commandBuffer, indexBuffer.buffer, 0,
+  const auto &arena = frames[frame];
+  if (arena.vertexBuffer.buffer == VK_NULL_HANDLE) {
+    return;
+  }
+  vkCmdBindVertexBuffers(commandBuffer, 0, 1, &arena.vertexBuffer.buffer,
+                         offsets);
+  vkCmdBindIndexBuffer(commandBuffer, arena.indexBuffer.buffer, 0,
                        VK_INDEX_TYPE_UINT16);
 
   int32_t vertexOffset = 0;
@@ -167,7 +180,7 @@ void Gui::Draw(VkCommandBuffer commandBuffer) {
 // ImGui
 //*-----------------------------------------------------------------------------
 
-void Gui::InitImGui(GLFWwindow *window) const {
+void Gui::InitImGui(GLFWwindow *window) {
   ImGui::CreateContext();
   ImGui_ImplGlfw_InitForVulkan(window, true);
 
@@ -178,11 +191,25 @@ void Gui::InitImGui(GLFWwindow *window) const {
   ImGui::StyleColorsClassic();
 
   // 英語フォントと日本語フォントを混在させます。
-  ImFontConfig config;
-  config.MergeMode = true;
-  io.Fonts->AddFontFromFileTTF(UI_OVERLAY_FONT_EN_PATH, 16.0f);
-  io.Fonts->AddFontFromFileTTF(UI_OVERLAY_FONT_JP_PATH, 20.0f, &config,
-                               io.Fonts->GetGlyphRangesJapanese());
+  // フォントファイルはマップしたまま渡し、アトラスにはコピーさせません。
+  const auto addFont = [this, &io](const char *filepath, float size,
+                                   bool merge, const ImWchar *ranges) {
+    auto file = AssetArchive::Get().Read(filepath);
+    if (!file) {
+      BOOST_ASSERT_MSG(file, "Failed to load font!");
+      return;
+    }
+    ImFontConfig config;
+    config.MergeMode = merge;
+    config.FontDataOwnedByAtlas = false;
+    io.Fonts->AddFontFromMemoryTTF(const_cast<uint8_t *>(file.data),
+                                   static_cast<int>(file.size), size, &config,
+                                   ranges);
+    font.files.emplace_back(std::move(file));
+  };
+  addFont(UI_OVERLAY_FONT_EN_PATH, 16.0f, false, nullptr);
+  addFont(UI_OVERLAY_FONT_JP_PATH, 20.0f, true,
+          io.Fonts->GetGlyphRangesJapanese());
   io.FontGlobalScale = scale;
 }
 
@@ -221,15 +248,12 @@ void Gui::SetupResources(const Device &device, VkQueue queue) {
   imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
   VK_CHECK_RESULT(
       vkCreateImage(device, &imageCreateInfo, nullptr, &font.image));
-  VkMemoryRequirements memoryRequirements{};
-  vkGetImageMemoryRequirements(device, font.image, &memoryRequirements);
-  VkMemoryAllocateInfo memoryAllocateInfo = Initializer::MemoryAllocateInfo();
-  memoryAllocateInfo.allocationSize = memoryRequirements.size;
-  memoryAllocateInfo.memoryTypeIndex = device.FindMemoryType(
-      memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-  VK_CHECK_RESULT(
-      vkAllocateMemory(device, &memoryAllocateInfo, nullptr, &font.memory));
-  VK_CHECK_RESULT(vkBindImageMemory(device, font.image, font.memory, 0));
+  AllocationCreateInfo allocationCreateInfo{};
+  allocationCreateInfo.memoryPropertyFlags =
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+  allocationCreateInfo.optimalTiling = true;
+  VK_CHECK_RESULT(device.allocator->AllocateImageMemory(
+      device, font.image, allocationCreateInfo, font.allocation));
 
   // イメージビュー
   VkImageViewCreateInfo imageViewCreateInfo =
@@ -452,11 +476,7 @@ bool Gui::Header(const char *label) const {
 }
 
 bool Gui::Checkbox(const char *label, bool *v) {
-  const bool res = ImGui::Checkbox(label, v);
-  if (res) {
-    updated = true;
-  }
-  return res;
+  return ImGui::Checkbox(label, v);
 }
 
 bool Gui::Combo(const char *label, int32_t *v,
@@ -469,25 +489,46 @@ bool Gui::Combo(const char *label, int32_t *v,
                  std::back_inserter(transformed),
                  [](const std::string &s) { return s.c_str(); });
   const auto itemSize = static_cast<uint32_t>(transformed.size());
-  const bool res = ImGui::Combo(label, v, transformed.data(), itemSize, itemSize);
-  if (res) {
-    updated = true;
-  }
-  return res;
+  return ImGui::Combo(label, v, transformed.data(), itemSize, itemSize);
 }
 
 bool Gui::SliderFloat(const char *label, float *v, float vmin, float vmax) {
-  const bool res = ImGui::SliderFloat(label, v, vmin, vmax);
-  if (res) {
-    updated = true;
-  }
-  return res;
+  return ImGui::SliderFloat(label, v, vmin, vmax);
 }
 
 bool Gui::ColorEdit3(const char *label, glm::vec3 *color) {
-  const bool res = ImGui::ColorEdit3(label, reinterpret_cast<float *>(color));
-  if (res) {
-    updated = true;
+  return ImGui::ColorEdit3(label, reinterpret_cast<float *>(color));
+}
+
+/**
+ * @brief printfの書式で文字列を表示します。
+ */
+void Gui::Text(const char *format, ...) const {
+  va_list args;
+  va_start(args, format);
+  ImGui::TextV(format, args);
+  va_end(args);
+}
+
+/**
+ * @brief 値を最大値に対する割合で横棒グラフとして表示します。
+ * @param labels 各棒のラベル
+ * @param values 各棒の値(labelsと同じ数)
+ * @param unit 棒の上に値と並べて表示する単位
+ */
+void Gui::BarChart(const std::vector<std::string> &labels,
+                   const std::vector<float> &values, const char *unit) const {
+  BOOST_ASSERT_MSG(labels.size() == values.size(),
+                   "BarChart labels and values must have the same size!");
+  const float maxValue =
+      values.empty() ? 0.0f : *std::max_element(values.begin(), values.end());
+
+  char overlay[32];
+  for (size_t i = 0; i < values.size(); i++) {
+    snprintf(overlay, sizeof(overlay), "%.3f %s", values[i], unit);
+    ImGui::ProgressBar(maxValue > 0.0f ? values[i] / maxValue : 0.0f,
+                       ImVec2(160.0f * scale, 0.0f), overlay);
+    ImGui::SameLine();
+    ImGui::TextUnformatted(labels[i].c_str());
   }
-  return res;
 }
@@ -7,6 +7,10 @@
 #include <glm/glm.hpp>
 #include <vulkan/vulkan.h>
 
+#include <string>
+#include <vector>
+
+#include "VK/AssetArchive.h"
 #include "VK/Buffer.h"
 
 struct Device;
@@ -15,10 +19,11 @@ struct GLFWwindow;
 struct Gui {
 public:
   void OnInit(GLFWwindow *window, const Device &device, VkQueue queue,
-              VkPipelineCache pipelineCache, VkRenderPass renderPass);
+              VkPipelineCache pipelineCache, VkRenderPass renderPass,
+              uint32_t frameCount);
   void OnDestroy(const Device &device) const;
-  bool Update(const Device &device);
-  void Draw(VkCommandBuffer commandBuffer);
+  void Update(const Device &device, uint32_t frame);
+  void Draw(VkCommandBuffer commandBuffer, uint32_t frame);
   static void OnResize(uint32_t width, uint32_t height);
 
   bool Header(const char *label) const;
@@ -27,13 +32,25 @@ public:
                 const std::vector<std::string> &items);
   bool SliderFloat(const char *label, float *v, float vmin, float vmax);
   bool ColorEdit3(const char *label, glm::vec3 *color);
+  void Text(const char *format, ...) const;
+  void BarChart(const std::vector<std::string> &labels,
+                const std::vector<float> &values, const char *unit) const;
 
   uint32_t subpass = 0;
 
-  Buffer vertexBuffer{};
-  uint32_t vertexCount = 0;
-  Buffer indexBuffer{};
-  uint32_t indexCount = 0;
+  /**
+   * @brief フレームごとの頂点とインデックスのアリーナ
+   * @note 処理中のフレームが参照しているバッファを書き換えないように、フレームごとに用意します。
+   */
+  struct FrameBuffers {
+    Buffer vertexBuffer{};
+    VkDeviceSize vertexCapacity = 0;
+    Buffer indexBuffer{};
+    VkDeviceSize indexCapacity = 0;
+  };
+  std::vector<FrameBuffers> frames{};
+  /** @brief アリーナの最小のバイト数(足りなくなると2倍ずつ拡張します。) */
+  VkDeviceSize minArenaSize = 64ull * 1024;
 
   VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
   VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
@@ -42,9 +59,11 @@ public:
   VkPipeline pipeline = VK_NULL_HANDLE;
 
   struct {
-    VkDeviceMemory memory = VK_NULL_HANDLE;
+    Allocation allocation{};
     VkImage image = VK_NULL_HANDLE;
     VkImageView view = VK_NULL_HANDLE;
+    /** @brief ImGuiのフォントアトラスが参照するフォントファイル */
+    std::vector<AssetData> files{};
   } font;
   VkSampler sampler = VK_NULL_HANDLE;
 
@@ -54,10 +73,11 @@ public:
   } pushConst;
 
   float scale = 1.0f;
-  bool updated = false;
 
 private:
-  void InitImGui(GLFWwindow *window) const;
+  void Reserve(const Device &device, Buffer &buffer, VkDeviceSize &capacity,
+               VkDeviceSize size, VkBufferUsageFlags usage) const;
+  void InitImGui(GLFWwindow *window);
   void SetupResources(const Device &device, VkQueue queue);
   void SetupPipeline(const Device &device, VkPipelineCache pipelineCache,
                      VkRenderPass renderPass);
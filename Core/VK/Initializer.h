@@ -61,6 +61,18 @@ CommandBufferAllocateInfo(VkCommandPool cmdPool, VkCommandBufferLevel level,
   return commandBufferBeginInfo;
 }
 
+[[maybe_unused]] inline VkCommandBufferInheritanceInfo
+CommandBufferInheritanceInfo(VkRenderPass renderPass, uint32_t subpass,
+                             VkFramebuffer framebuffer) {
+  VkCommandBufferInheritanceInfo commandBufferInheritanceInfo{};
+  commandBufferInheritanceInfo.sType =
+      VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+  commandBufferInheritanceInfo.renderPass = renderPass;
+  commandBufferInheritanceInfo.subpass = subpass;
+  commandBufferInheritanceInfo.framebuffer = framebuffer;
+  return commandBufferInheritanceInfo;
+}
+
 [[maybe_unused]] inline VkRenderPassBeginInfo RenderPassBeginInfo() {
   VkRenderPassBeginInfo renderPassBeginInfo{};
   renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
@@ -146,6 +158,15 @@ FenceCreateInfo(VkFenceCreateFlags flags = 0) {
   return submit;
 }
 
+[[maybe_unused]] inline VkQueryPoolCreateInfo
+QueryPoolCreateInfo(VkQueryType queryType, uint32_t queryCount) {
+  VkQueryPoolCreateInfo queryPoolCreateInfo{};
+  queryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  queryPoolCreateInfo.queryType = queryType;
+  queryPoolCreateInfo.queryCount = queryCount;
+  return queryPoolCreateInfo;
+}
+
 [[maybe_unused]] inline VkViewport Viewport(float width, float height,
                                             float minDepth, float maxDepth) {
   VkViewport viewport{};
@@ -525,6 +546,19 @@ GraphicsPipelineCreateInfo() {
   return pipelineCreateInfo;
 }
 
+[[maybe_unused]] inline VkComputePipelineCreateInfo
+ComputePipelineCreateInfo(VkPipelineLayout layout,
+                          VkPipelineCreateFlags flags = 0) {
+  VkComputePipelineCreateInfo computePipelineCreateInfo{};
+  computePipelineCreateInfo.sType =
+      VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  computePipelineCreateInfo.layout = layout;
+  computePipelineCreateInfo.flags = flags;
+  computePipelineCreateInfo.basePipelineIndex = -1;
+  computePipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
+  return computePipelineCreateInfo;
+}
+
 [[maybe_unused]] inline VkPushConstantRange
 PushConstantRange(VkShaderStageFlags stageFlags, uint32_t size,
                   uint32_t offset) {
@@ -0,0 +1,400 @@
+/**
+ * @brief 同じメッシュの描画をインスタンス描画にまとめ、GPUで選別した引数で間接描画します。
+ */
+
+#include "VK/InstanceBatches.h"
+
+#include <algorithm>
+#include <array>
+#include <boost/assert.hpp>
+
+#include "VK/Common.h"
+#include "VK/Device.h"
+#include "VK/Initializer.h"
+#include "VK/Model.h"
+#include "VK/UploadManager.h"
+#include "VK/Utils.h"
+
+#include "View/Frustum.h"
+
+/** @brief 選別のワークグループの大きさ(シェーダーのlocal_size_xと一致させます。) */
+static constexpr uint32_t kCullGroupSize = 64;
+
+/**
+ * @brief モデルの境界球を量子化した頂点の空間で求めます。
+ * @note
+ * 変換にはDequantizeMatrixを掛けたモデル行列を渡すため、境界もメッシュのバウンディングボックスと同じ空間で表します。
+ */
+static glm::vec4 BoundingSphere(const Model &model) {
+  AABB bounds{};
+  for (const auto &mesh : model.meshes) {
+    bounds.Merge(mesh.bounds);
+  }
+  if (bounds.IsEmpty()) {
+    return glm::vec4(0.0f);
+  }
+  return glm::vec4(bounds.Center(), glm::length(bounds.Extent()));
+}
+
+/**
+ * @brief インスタンス描画で使う機能を、デバイスが対応していれば有効にします。
+ * @note
+ * drawIndirectFirstInstanceが無い場合はプッシュ定数で先頭のインスタンスを渡し、
+ * multiDrawIndirectが無い場合は間接描画を1つずつ記録します。
+ */
+void InstanceBatches::RequestFeatures(const Device &device,
+                                      VkPhysicalDeviceFeatures &features) {
+  features.multiDrawIndirect = device.features.multiDrawIndirect;
+  features.drawIndirectFirstInstance =
+      device.features.drawIndirectFirstInstance;
+}
+
+/**
+ * @brief 1回のvkCmdDrawIndexedIndirectで記録できる描画の数を返します。
+ */
+uint32_t InstanceBatches::MaxDrawIndirectCount(const Device &device) {
+  if (device.enabledFeatures.multiDrawIndirect == VK_FALSE) {
+    return 1;
+  }
+  return std::max(device.properties.limits.maxDrawIndirectCount, 1u);
+}
+
+/**
+ * @brief インスタンスを加えます。
+ * @param model モデル(同じモデルのインスタンスは1つのバッチにまとめます。)
+ * @param transform DequantizeMatrixを掛けたモデル行列
+ * @param material シェーダーに渡すマテリアルの番号
+ * @return バッチの番号
+ * @note Prepareの前に呼び出してください。
+ */
+uint32_t InstanceBatches::Add(const Model &model, const glm::mat4 &transform,
+                              uint32_t material, uint32_t flags) {
+  BOOST_ASSERT_MSG(pipeline_ == VK_NULL_HANDLE,
+                   "Instances must be added before Prepare!");
+  auto it =
+      std::find_if(batches_.begin(), batches_.end(),
+                   [&](const Batch &batch) { return batch.model == &model; });
+  if (it == batches_.end()) {
+    it = batches_.insert(batches_.end(), Batch{&model, 0, 0});
+  }
+  it->instanceCount++;
+
+  Instance instance{};
+  instance.model = transform;
+  instance.sphere = BoundingSphere(model);
+  instance.material = material;
+  instance.batch = static_cast<uint32_t>(it - batches_.begin());
+  instance.flags = flags;
+  pending_.emplace_back(instance);
+  return instance.batch;
+}
+
+/**
+ * @brief インスタンスをバッチの順に並べて転送し、選別のパイプラインを作成します。
+ * @param cullShader 選別のコンピュートシェーダーのパス
+ * @note
+ * 転送はuploaderに記録するだけなので、描画の前にSubmitしてください。<br>
+ * 引数と見えるインスタンスの番号は、ユニフォームリングと同じ数のパーティションに分けます。
+ */
+void InstanceBatches::Prepare(const Device &device, UploadManager &uploader,
+                              UniformRing &uniformRing,
+                              VkPipelineCache pipelineCache,
+                              const std::string &cullShader) {
+  BOOST_ASSERT_MSG(!pending_.empty(), "No instances to prepare!");
+  firstInstance_ = device.enabledFeatures.drawIndirectFirstInstance == VK_TRUE;
+
+  // バッチの先頭を決め、インスタンスを追加した順を保ったままバッチの順に並べます。
+  uint32_t first = 0;
+  for (auto &batch : batches_) {
+    batch.firstInstance = first;
+    first += batch.instanceCount;
+  }
+  instances_.resize(pending_.size());
+  std::vector<uint32_t> heads(batches_.size(), 0);
+  for (const auto &instance : pending_) {
+    const Batch &batch = batches_[instance.batch];
+    auto &dst = instances_[batch.firstInstance + heads[instance.batch]++];
+    dst = instance;
+    dst.batchFirstInstance = batch.firstInstance;
+  }
+  pending_.clear();
+
+  std::vector<VkDrawIndexedIndirectCommand> drawCommands(batches_.size());
+  for (size_t i = 0; i < batches_.size(); i++) {
+    drawCommands[i].indexCount = batches_[i].model->indexCount;
+    drawCommands[i].firstInstance =
+        IndirectFirstInstance(static_cast<uint32_t>(i));
+  }
+
+  const VkDeviceSize alignment = std::max<VkDeviceSize>(
+      device.properties.limits.minStorageBufferOffsetAlignment, 4);
+  const auto align = [&](VkDeviceSize size) {
+    return (size + alignment - 1) / alignment * alignment;
+  };
+  const uint32_t partitionCount = uniformRing.GetPartitionCount();
+  const VkDeviceSize instancesSize = instances_.size() * sizeof(Instance);
+  const VkDeviceSize visibleSize = instances_.size() * sizeof(uint32_t);
+  const VkDeviceSize commandsSize =
+      drawCommands.size() * sizeof(VkDrawIndexedIndirectCommand);
+  visibleStride = align(visibleSize);
+  commandsStride = align(commandsSize);
+
+  VK_CHECK_RESULT(instances.Create(device,
+                                   VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                       VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                   instancesSize));
+  instances.SetupDescriptor();
+  uploader.UploadBuffer(device, instances.buffer, instances_.data(),
+                        instancesSize);
+
+  VK_CHECK_RESULT(templates.Create(device,
+                                   VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+                                       VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                   commandsSize));
+  uploader.UploadBuffer(device, templates.buffer, drawCommands.data(),
+                        commandsSize);
+
+  VK_CHECK_RESULT(visible.Create(device, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                 visibleStride * partitionCount));
+  visible.SetupDescriptor(visibleSize);
+  VK_CHECK_RESULT(commands.Create(
+      device,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+          VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+          VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, commandsStride * partitionCount));
+  commands.SetupDescriptor(commandsSize);
+
+  SetupPipeline(device, uniformRing, pipelineCache, cullShader);
+}
+
+/**
+ * @brief バッチのすべてのインスタンスのフラグを立てる、または下ろします。
+ * @param batch バッチの番号
+ * @param flag 変更するフラグ(Flags)
+ * @param enabled フラグを立てるか？
+ * @note
+ * Prepareの後に呼び出します。変更したインスタンスの転送はuploaderに記録するだけなので、
+ * 処理中のフレームの完了を待ってから呼び出し、描画の前にSubmitしてください。
+ */
+void InstanceBatches::SetFlag(const Device &device, UploadManager &uploader,
+                              uint32_t batch, uint32_t flag, bool enabled) {
+  BOOST_ASSERT_MSG(pipeline_ != VK_NULL_HANDLE,
+                   "Flags must be changed after Prepare!");
+  const Batch &b = batches_[batch];
+  for (uint32_t i = 0; i < b.instanceCount; i++) {
+    auto &instance = instances_[b.firstInstance + i];
+    instance.flags = enabled ? instance.flags | flag : instance.flags & ~flag;
+  }
+  uploader.UploadBuffer(device, instances.buffer,
+                        &instances_[b.firstInstance],
+                        b.instanceCount * sizeof(Instance),
+                        b.firstInstance * sizeof(Instance));
+}
+
+void InstanceBatches::Destroy(const Device &device) const {
+  vkDestroyPipeline(device, pipeline_, nullptr);
+  vkDestroyPipelineLayout(device, pipelineLayout_, nullptr);
+  vkDestroyDescriptorSetLayout(device, descriptorSetLayout_, nullptr);
+  vkDestroyDescriptorPool(device, descriptorPool_, nullptr);
+  templates.Destroy(device);
+  commands.Destroy(device);
+  visible.Destroy(device);
+  instances.Destroy(device);
+}
+
+/**
+ * @brief 選別に使う視錐台の平面を書き込みます。
+ */
+void InstanceBatches::SetFrustum(UniformRing &uniformRing,
+                                 const glm::mat4 &viewProj) const {
+  const auto planes = ::Frustum::ExtractPlanes(viewProj);
+  Frustum frustum{};
+  std::copy(planes.begin(), planes.end(), frustum.planes);
+  uniformRing.Write(frustum_, &frustum, sizeof(frustum));
+}
+
+/**
+ * @brief インスタンスを選別し、パーティションの間接描画の引数を書き込むコマンドを記録します。
+ * @note レンダーパスの外で、インスタンスを描画するレンダーパスの前に記録してください。
+ */
+void InstanceBatches::RecordCulling(VkCommandBuffer commandBuffer,
+                                    uint32_t partition,
+                                    const UniformRing &uniformRing) const {
+  // 前回このコマンドバッファで行った間接描画と頂点シェーダーの読み込みを待ちます。
+  VkMemoryBarrier memoryBarrier = Initializer::MemoryBarrier();
+  memoryBarrier.srcAccessMask =
+      VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+  memoryBarrier.dstAccessMask =
+      VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  vkCmdPipelineBarrier(commandBuffer,
+                       VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+                           VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT |
+                           VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+  // インスタンスの数を0に戻してから、シェーダーで見えるインスタンスの分を加算します。
+  const VkDeviceSize commandsOffset = commandsStride * partition;
+  VkBufferCopy region{};
+  region.dstOffset = commandsOffset;
+  region.size = commands.descriptor.range;
+  vkCmdCopyBuffer(commandBuffer, templates.buffer, commands.buffer, 1,
+                  &region);
+  memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  memoryBarrier.dstAccessMask =
+      VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+                       &memoryBarrier, 0, nullptr, 0, nullptr);
+
+  // 動的オフセットはバインディングの順(見えるインスタンス、引数、視錐台)に並べます。
+  const std::array<uint32_t, 3> dynamicOffsets = {
+      GetVisibleOffset(partition),
+      static_cast<uint32_t>(commandsOffset),
+      uniformRing.GetDynamicOffset(frustum_, partition),
+  };
+  const CullPushConstants pushConsts{
+      static_cast<uint32_t>(instances_.size())};
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_);
+  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                          pipelineLayout_, 0, 1, &descriptorSet_,
+                          static_cast<uint32_t>(dynamicOffsets.size()),
+                          dynamicOffsets.data());
+  vkCmdPushConstants(commandBuffer, pipelineLayout_,
+                     VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConsts),
+                     &pushConsts);
+  vkCmdDispatch(commandBuffer,
+                (pushConsts.instanceCount + kCullGroupSize - 1) /
+                    kCullGroupSize,
+                1, 1);
+
+  // 間接描画と頂点シェーダーから結果を読めるようにします。
+  memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  memoryBarrier.dstAccessMask =
+      VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+                           VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+                       0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+}
+
+/**
+ * @brief バッチをGPUが書き込んだ引数で間接描画するメッシュを返します。
+ */
+RenderQueue::Mesh InstanceBatches::MeshOf(uint32_t batch) const {
+  RenderQueue::Mesh mesh = RenderQueue::MeshOf(*batches_.at(batch).model);
+  mesh.indirectBuffer = commands.buffer;
+  mesh.indirectOffset = batch * sizeof(VkDrawIndexedIndirectCommand);
+  mesh.indirectPartitionStride = commandsStride;
+  return mesh;
+}
+
+/**
+ * @brief 頂点シェーダーがgl_InstanceIndexに足すインスタンスの番号を返します。
+ * @note 引数のfirstInstanceを使えない場合のみ、バッチの先頭を返します。
+ */
+uint32_t InstanceBatches::BaseInstance(uint32_t batch) const {
+  return firstInstance_ ? 0 : batches_.at(batch).firstInstance;
+}
+
+/**
+ * @brief 間接描画の引数のfirstInstanceを返します。
+ */
+uint32_t InstanceBatches::IndirectFirstInstance(uint32_t batch) const {
+  return firstInstance_ ? batches_.at(batch).firstInstance : 0;
+}
+
+uint32_t InstanceBatches::BatchOf(const Model &model) const {
+  const auto it =
+      std::find_if(batches_.begin(), batches_.end(),
+                   [&](const Batch &batch) { return batch.model == &model; });
+  BOOST_ASSERT_MSG(it != batches_.end(), "Model has no instances!");
+  return static_cast<uint32_t>(it - batches_.begin());
+}
+
+/**
+ * @brief 選別の記述子セットとコンピュートパイプラインを作成します。
+ */
+void InstanceBatches::SetupPipeline(const Device &device,
+                                    UniformRing &uniformRing,
+                                    VkPipelineCache pipelineCache,
+                                    const std::string &cullShader) {
+  frustum_ = uniformRing.Allocate(sizeof(Frustum));
+
+  std::vector<VkDescriptorPoolSize> poolSizes = {
+      Initializer::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1),
+      Initializer::DescriptorPoolSize(
+          VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 2),
+      Initializer::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+                                      1),
+  };
+  VkDescriptorPoolCreateInfo descriptorPoolCreateInfo =
+      Initializer::DescriptorPoolCreateInfo(poolSizes, 1);
+  VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolCreateInfo,
+                                         nullptr, &descriptorPool_));
+
+  // 出力と視錐台はコマンドバッファごとの領域を動的オフセットで指定します。
+  std::vector<VkDescriptorSetLayoutBinding> descriptorSetLayoutBindings = {
+      Initializer::DescriptorSetLayoutBinding(
+          VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+      Initializer::DescriptorSetLayoutBinding(
+          VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+          VK_SHADER_STAGE_COMPUTE_BIT, 1),
+      Initializer::DescriptorSetLayoutBinding(
+          VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+          VK_SHADER_STAGE_COMPUTE_BIT, 2),
+      Initializer::DescriptorSetLayoutBinding(
+          VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+          VK_SHADER_STAGE_COMPUTE_BIT, 3),
+  };
+  VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo =
+      Initializer::DescriptorSetLayoutCreateInfo(descriptorSetLayoutBindings);
+  VK_CHECK_RESULT(vkCreateDescriptorSetLayout(
+      device, &descriptorSetLayoutCreateInfo, nullptr, &descriptorSetLayout_));
+
+  VkPushConstantRange pushConstantRange = Initializer::PushConstantRange(
+      VK_SHADER_STAGE_COMPUTE_BIT, sizeof(CullPushConstants), 0);
+  VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo =
+      Initializer::PipelineLayoutCreateInfo(&descriptorSetLayout_);
+  pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+  pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+  VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo,
+                                         nullptr, &pipelineLayout_));
+
+  VkDescriptorSetAllocateInfo descriptorSetAllocateInfo =
+      Initializer::DescriptorSetAllocateInfo(descriptorPool_,
+                                             &descriptorSetLayout_, 1);
+  VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocateInfo,
+                                           &descriptorSet_));
+  std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+      Initializer::WriteDescriptorSet(descriptorSet_,
+                                      VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0,
+                                      &instances.descriptor),
+      Initializer::WriteDescriptorSet(
+          descriptorSet_, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1,
+          &visible.descriptor),
+      Initializer::WriteDescriptorSet(
+          descriptorSet_, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 2,
+          &commands.descriptor),
+      Initializer::WriteDescriptorSet(
+          descriptorSet_, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 3,
+          &frustum_.descriptor),
+  };
+  vkUpdateDescriptorSets(device,
+                         static_cast<uint32_t>(writeDescriptorSets.size()),
+                         writeDescriptorSets.data(), 0, nullptr);
+
+  VkComputePipelineCreateInfo computePipelineCreateInfo =
+      Initializer::ComputePipelineCreateInfo(pipelineLayout_);
+  computePipelineCreateInfo.stage =
+      CreateShader(device, cullShader, VK_SHADER_STAGE_COMPUTE_BIT);
+  VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1,
+                                           &computePipelineCreateInfo, nullptr,
+                                           &pipeline_));
+  vkDestroyShaderModule(device, computePipelineCreateInfo.stage.module,
+                        nullptr);
+}
@@ -0,0 +1,126 @@
+/**
+ * @brief 同じメッシュの描画をインスタンス描画にまとめ、GPUで選別した引数で間接描画します。
+ */
+
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.h>
+
+#include <boost/noncopyable.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "VK/Buffer.h"
+#include "VK/RenderQueue.h"
+#include "VK/UniformRing.h"
+
+struct Device;
+struct Model;
+class UploadManager;
+
+/**
+ * @brief モデルごとにインスタンスをまとめたバッチ
+ * @note
+ * インスタンスの変換とマテリアルはストレージバッファに置き、頂点シェーダーでgl_InstanceIndexから引きます。<br>
+ * コンピュートシェーダーがインスタンスを視錐台で選別し、見えるインスタンスの番号と
+ * vkCmdDrawIndexedIndirectの引数(インスタンスの数)をパーティションごとの領域に書き込みます。
+ */
+class InstanceBatches : private boost::noncopyable {
+public:
+  /** @brief インスタンスのデータ(シェーダーのstd430のInstanceと一致させます。) */
+  struct Instance {
+    glm::mat4 model = glm::mat4(1.0f);
+    /** @brief 量子化した頂点の空間の境界球(xyzは中心、wは半径です。) */
+    glm::vec4 sphere = glm::vec4(0.0f);
+    uint32_t material = 0;
+    uint32_t batch = 0;
+    uint32_t flags = 0;
+    /** @brief バッチの先頭のインスタンスの番号 */
+    uint32_t batchFirstInstance = 0;
+  };
+  static_assert(sizeof(Instance) == 96, "Instance must match std430 layout");
+
+  enum Flags : uint32_t {
+    /** @brief 視錐台で選別せず、常に描画します。(クラスター単位で選別するモデルなど) */
+    kNoCull = 1u << 0,
+  };
+
+  /** @brief 同じモデルのインスタンスの範囲 */
+  struct Batch {
+    const Model *model = nullptr;
+    uint32_t firstInstance = 0;
+    uint32_t instanceCount = 0;
+  };
+
+  static void RequestFeatures(const Device &device,
+                              VkPhysicalDeviceFeatures &features);
+  [[nodiscard]] static uint32_t MaxDrawIndirectCount(const Device &device);
+
+  uint32_t Add(const Model &model, const glm::mat4 &transform,
+               uint32_t material, uint32_t flags = 0);
+  void Prepare(const Device &device, UploadManager &uploader,
+               UniformRing &uniformRing, VkPipelineCache pipelineCache,
+               const std::string &cullShader);
+  void Destroy(const Device &device) const;
+  void SetFlag(const Device &device, UploadManager &uploader, uint32_t batch,
+               uint32_t flag, bool enabled);
+
+  void SetFrustum(UniformRing &uniformRing, const glm::mat4 &viewProj) const;
+  void RecordCulling(VkCommandBuffer commandBuffer, uint32_t partition,
+                     const UniformRing &uniformRing) const;
+
+  [[nodiscard]] RenderQueue::Mesh MeshOf(uint32_t batch) const;
+  [[nodiscard]] uint32_t BaseInstance(uint32_t batch) const;
+  [[nodiscard]] uint32_t IndirectFirstInstance(uint32_t batch) const;
+  [[nodiscard]] uint32_t BatchOf(const Model &model) const;
+  [[nodiscard]] uint32_t GetVisibleOffset(uint32_t partition) const {
+    return static_cast<uint32_t>(visibleStride * partition);
+  }
+
+  [[nodiscard]] const std::vector<Batch> &GetBatches() const {
+    return batches_;
+  }
+  [[nodiscard]] const std::vector<Instance> &GetInstances() const {
+    return instances_;
+  }
+
+  /** @brief すべてのインスタンス(頂点シェーダーとコンピュートシェーダーが読みます。) */
+  Buffer instances{};
+  /** @brief 見えるインスタンスの番号(バッチごとに先頭から詰めます。) */
+  Buffer visible{};
+  /** @brief パーティションごとの間接描画の引数 */
+  Buffer commands{};
+  /** @brief 選別の前にcommandsへコピーする引数(インスタンスの数は0です。) */
+  Buffer templates{};
+  VkDeviceSize visibleStride = 0;
+  VkDeviceSize commandsStride = 0;
+
+private:
+  struct CullPushConstants {
+    uint32_t instanceCount;
+  };
+
+  /** @brief ワールド空間の視錐台の平面(xyzは内向きの単位法線です。) */
+  struct Frustum {
+    alignas(16) glm::vec4 planes[6];
+  };
+
+  void SetupPipeline(const Device &device, UniformRing &uniformRing,
+                     VkPipelineCache pipelineCache,
+                     const std::string &cullShader);
+
+  std::vector<Batch> batches_{};
+  std::vector<Instance> instances_{};
+  /** @brief 追加した順のインスタンス(Prepareでバッチの順に並べ替えます。) */
+  std::vector<Instance> pending_{};
+  bool firstInstance_ = false;
+
+  UniformAllocation frustum_{};
+  VkDescriptorPool descriptorPool_ = VK_NULL_HANDLE;
+  VkDescriptorSetLayout descriptorSetLayout_ = VK_NULL_HANDLE;
+  VkDescriptorSet descriptorSet_ = VK_NULL_HANDLE;
+  VkPipelineLayout pipelineLayout_ = VK_NULL_HANDLE;
+  VkPipeline pipeline_ = VK_NULL_HANDLE;
+};
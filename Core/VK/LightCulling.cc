@@ -0,0 +1,274 @@
+/**
+ * @brief 画面をタイルに分け、各タイルに影響するライトの番号をGPUで求めます。
+ */
+
+#include "VK/LightCulling.h"
+
+#include <algorithm>
+#include <array>
+#include <boost/assert.hpp>
+#include <spdlog/spdlog.h>
+
+#include "VK/Common.h"
+#include "VK/Device.h"
+#include "VK/Initializer.h"
+#include "VK/UploadManager.h"
+#include "VK/Utils.h"
+
+/**
+ * @brief ライトをストレージバッファに転送し、タイルのリストと選別のパイプラインを作成します。
+ * @param sceneLights シーンのすべてのライト
+ * @param width, height 選別するG-Bufferの大きさ
+ * @param positionImage ワールド空間の位置のG-Buffer(wが0の画素は背景として扱います。)<br>
+ * nullptrの場合は深度の範囲を求めず、タイルの側面の平面のみで選別します。
+ * @param cullShader 選別のコンピュートシェーダーのパス
+ * @note
+ * 転送はuploaderに記録するだけなので、描画の前にSubmitしてください。<br>
+ * タイルのリストは、ユニフォームリングと同じ数のパーティションに分けます。
+ */
+void LightCulling::Prepare(const Device &device, UploadManager &uploader,
+                           UniformRing &uniformRing,
+                           VkPipelineCache pipelineCache,
+                           const std::vector<Light> &sceneLights,
+                           uint32_t width, uint32_t height,
+                           const VkDescriptorImageInfo *positionImage,
+                           const std::string &cullShader) {
+  BOOST_ASSERT_MSG(width > 0 && height > 0, "Invalid G-Buffer size!");
+  lightCount_ = static_cast<uint32_t>(sceneLights.size());
+  depthBounds_ = positionImage != nullptr;
+  width_ = width;
+  height_ = height;
+  tileCountX_ = (width + kTileSize - 1) / kTileSize;
+  tileCountY_ = (height + kTileSize - 1) / kTileSize;
+
+  // ライトが無い場合も記述子が有効になるよう、1つ分の領域を確保します。
+  const VkDeviceSize lightsSize =
+      std::max<size_t>(sceneLights.size(), 1) * sizeof(Light);
+  VK_CHECK_RESULT(lights.Create(device,
+                                VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                    VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                lightsSize));
+  lights.SetupDescriptor();
+  if (!sceneLights.empty()) {
+    uploader.UploadBuffer(device, lights.buffer, sceneLights.data(),
+                          sceneLights.size() * sizeof(Light));
+  }
+
+  // タイルごとに先頭のライトの数と、最大数のライトの番号を並べます。
+  const VkDeviceSize alignment = std::max<VkDeviceSize>(
+      device.properties.limits.minStorageBufferOffsetAlignment, 4);
+  const VkDeviceSize tilesSize = static_cast<VkDeviceSize>(tileCountX_) *
+                                 tileCountY_ * (kMaxLightsPerTile + 1) *
+                                 sizeof(uint32_t);
+  tilesStride = (tilesSize + alignment - 1) / alignment * alignment;
+  VK_CHECK_RESULT(tiles.Create(
+      device, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      tilesStride * uniformRing.GetPartitionCount()));
+  tiles.SetupDescriptor(tilesSize);
+
+  // タイルのライトの数の最大値は、すべてのパーティションで共有して最大値のみを残します。
+  VK_CHECK_RESULT(maxTileLights_.Create(
+      device, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+      sizeof(uint32_t)));
+  VK_CHECK_RESULT(maxTileLights_.Map(device));
+  *static_cast<uint32_t *>(maxTileLights_.mapped) = 0;
+  maxTileLights_.SetupDescriptor();
+  overflowReported_ = false;
+
+  // シェーダーは位置を読みませんが、静的に使用する記述子は有効である必要があります。
+  if (!depthBounds_) {
+    std::array<uint8_t, 4> texel{};
+    placeholder_.FromBuffer(device, texel.data(), texel.size(),
+                            VK_FORMAT_R8G8B8A8_UNORM, 1, 1, uploader,
+                            VK_FILTER_NEAREST, VK_IMAGE_USAGE_SAMPLED_BIT,
+                            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false);
+  }
+
+  SetupPipeline(device, uniformRing, pipelineCache,
+                depthBounds_ ? *positionImage : placeholder_.descriptor,
+                cullShader);
+}
+
+void LightCulling::Destroy(const Device &device) const {
+  vkDestroyPipeline(device, pipeline_, nullptr);
+  vkDestroyPipelineLayout(device, pipelineLayout_, nullptr);
+  vkDestroyDescriptorSetLayout(device, descriptorSetLayout_, nullptr);
+  vkDestroyDescriptorPool(device, descriptorPool_, nullptr);
+  maxTileLights_.Destroy(device);
+  tiles.Destroy(device);
+  lights.Destroy(device);
+  if (!depthBounds_) {
+    placeholder_.Destroy(device);
+  }
+}
+
+/**
+ * @brief 選別に使うカメラの行列を書き込みます。
+ * @note タイルの視錐台は射影行列の逆行列から、ビュー空間で求めます。
+ */
+void LightCulling::SetCamera(UniformRing &uniformRing, const glm::mat4 &view,
+                             const glm::mat4 &proj) const {
+  Camera camera{};
+  camera.view = view;
+  camera.invProj = glm::inverse(proj);
+  camera.screenSize = glm::uvec2(width_, height_);
+  camera.lightCount = lightCount_;
+  camera.tileCountX = tileCountX_;
+  camera.depthBounds = depthBounds_ ? 1 : 0;
+  uniformRing.Write(camera_, &camera, sizeof(camera));
+}
+
+/**
+ * @brief パーティションのタイルのリストを書き込むコマンドを記録します。
+ * @note
+ * G-Bufferを描画するレンダーパスの後、レンダーパスの外に記録してください。
+ * 深度の範囲を使わない場合は、G-Bufferを描画するレンダーパスの前に記録できます。<br>
+ * リストを読む合成のパスは、同じキューでこのコマンドより後に送信する必要があります。
+ */
+void LightCulling::RecordCulling(VkCommandBuffer commandBuffer,
+                                 uint32_t partition,
+                                 const UniformRing &uniformRing) const {
+  // G-Bufferの書き込みと、前回このパーティションのリストを読んだ合成のパスを待ちます。
+  // BOTTOM_OF_PIPEはレンダーパスの終了の依存関係と連鎖させ、最終レイアウトへの移行を待つためです。
+  VkMemoryBarrier memoryBarrier = Initializer::MemoryBarrier();
+  memoryBarrier.srcAccessMask =
+      VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT;
+  memoryBarrier.dstAccessMask =
+      VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  vkCmdPipelineBarrier(commandBuffer,
+                       VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                           VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+                           VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+                       &memoryBarrier, 0, nullptr, 0, nullptr);
+
+  // 動的オフセットはバインディングの順(カメラ、タイルのリスト)に並べます。
+  const std::array<uint32_t, 2> dynamicOffsets = {
+      uniformRing.GetDynamicOffset(camera_, partition),
+      GetTileOffset(partition),
+  };
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_);
+  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                          pipelineLayout_, 0, 1, &descriptorSet_,
+                          static_cast<uint32_t>(dynamicOffsets.size()),
+                          dynamicOffsets.data());
+  vkCmdDispatch(commandBuffer, tileCountX_, tileCountY_, 1);
+
+  // 後に送信される合成のフラグメントシェーダーから結果を読めるようにします。
+  memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 1,
+                       &memoryBarrier, 0, nullptr, 0, nullptr);
+}
+
+/**
+ * @brief タイルのライトが最大数を超えていれば、一度だけ警告を出力します。
+ * @note
+ * 超えたタイルは最大数までのライトのみを計算し、ヒートマップでは白く表示されます。<br>
+ * 値はGPUが書き込んだ後に読むため、数フレーム遅れて報告されることがあります。
+ */
+void LightCulling::CheckOverflow() {
+  if (overflowReported_) {
+    return;
+  }
+  const uint32_t maxLights =
+      *static_cast<const uint32_t *>(maxTileLights_.mapped);
+  if (maxLights > kMaxLightsPerTile) {
+    spdlog::warn("{} lights touch one tile, but only {} are shaded per tile.",
+                 maxLights, kMaxLightsPerTile);
+    overflowReported_ = true;
+  }
+}
+
+/**
+ * @brief 選別の記述子セットとコンピュートパイプラインを作成します。
+ */
+void LightCulling::SetupPipeline(const Device &device,
+                                 UniformRing &uniformRing,
+                                 VkPipelineCache pipelineCache,
+                                 const VkDescriptorImageInfo &positionImage,
+                                 const std::string &cullShader) {
+  camera_ = uniformRing.Allocate(sizeof(Camera));
+  VkDescriptorImageInfo positionDesc = positionImage;
+
+  std::vector<VkDescriptorPoolSize> poolSizes = {
+      Initializer::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+                                      1),
+      Initializer::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                      1),
+      Initializer::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2),
+      Initializer::DescriptorPoolSize(
+          VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1),
+  };
+  VkDescriptorPoolCreateInfo descriptorPoolCreateInfo =
+      Initializer::DescriptorPoolCreateInfo(poolSizes, 1);
+  VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolCreateInfo,
+                                         nullptr, &descriptorPool_));
+
+  // カメラとタイルのリストはコマンドバッファごとの領域を動的オフセットで指定します。
+  std::vector<VkDescriptorSetLayoutBinding> descriptorSetLayoutBindings = {
+      Initializer::DescriptorSetLayoutBinding(
+          VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+          VK_SHADER_STAGE_COMPUTE_BIT, 0),
+      Initializer::DescriptorSetLayoutBinding(
+          VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+          VK_SHADER_STAGE_COMPUTE_BIT, 1),
+      Initializer::DescriptorSetLayoutBinding(
+          VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 2),
+      Initializer::DescriptorSetLayoutBinding(
+          VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+          VK_SHADER_STAGE_COMPUTE_BIT, 3),
+      Initializer::DescriptorSetLayoutBinding(
+          VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 4),
+  };
+  VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo =
+      Initializer::DescriptorSetLayoutCreateInfo(descriptorSetLayoutBindings);
+  VK_CHECK_RESULT(vkCreateDescriptorSetLayout(
+      device, &descriptorSetLayoutCreateInfo, nullptr, &descriptorSetLayout_));
+
+  VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo =
+      Initializer::PipelineLayoutCreateInfo(&descriptorSetLayout_);
+  VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo,
+                                         nullptr, &pipelineLayout_));
+
+  VkDescriptorSetAllocateInfo descriptorSetAllocateInfo =
+      Initializer::DescriptorSetAllocateInfo(descriptorPool_,
+                                             &descriptorSetLayout_, 1);
+  VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocateInfo,
+                                           &descriptorSet_));
+  std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+      Initializer::WriteDescriptorSet(
+          descriptorSet_, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 0,
+          &camera_.descriptor),
+      Initializer::WriteDescriptorSet(descriptorSet_,
+                                      VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                      1, &positionDesc),
+      Initializer::WriteDescriptorSet(descriptorSet_,
+                                      VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2,
+                                      &lights.descriptor),
+      Initializer::WriteDescriptorSet(
+          descriptorSet_, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 3,
+          &tiles.descriptor),
+      Initializer::WriteDescriptorSet(descriptorSet_,
+                                      VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4,
+                                      &maxTileLights_.descriptor),
+  };
+  vkUpdateDescriptorSets(device,
+                         static_cast<uint32_t>(writeDescriptorSets.size()),
+                         writeDescriptorSets.data(), 0, nullptr);
+
+  VkComputePipelineCreateInfo computePipelineCreateInfo =
+      Initializer::ComputePipelineCreateInfo(pipelineLayout_);
+  computePipelineCreateInfo.stage =
+      CreateShader(device, cullShader, VK_SHADER_STAGE_COMPUTE_BIT);
+  VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1,
+                                           &computePipelineCreateInfo, nullptr,
+                                           &pipeline_));
+  vkDestroyShaderModule(device, computePipelineCreateInfo.stage.module,
+                        nullptr);
+}
@@ -0,0 +1,133 @@
+/**
+ * @brief 画面をタイルに分け、各タイルに影響するライトの番号をGPUで求めます。
+ */
+
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.h>
+
+#include <boost/noncopyable.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "VK/Buffer.h"
+#include "VK/Texture.h"
+#include "VK/UniformRing.h"
+
+struct Device;
+class UploadManager;
+
+/**
+ * @brief コンピュートシェーダーによるタイルベースのライトカリング
+ * @note
+ * ライトはストレージバッファに置き、ワークグループが1つのタイルのG-Bufferの位置から
+ * ビュー空間の深度の最小と最大を求めて、タイルの視錐台に触れるライトの番号を書き込みます。<br>
+ * タイルのリストは先頭にライトの数、続けてライトの番号を並べ、パーティションごとの領域に置きます。<br>
+ * 最大数を超えたタイルは最大数で打ち切り、数の最上位ビット(kTileOverflow)を立てます。<br>
+ * 合成のフラグメントシェーダーは自身のタイルのリストのライトのみを計算するため、
+ * 負荷はライトの総数ではなく、その場所に影響するライトの数に比例します。<br>
+ * G-Bufferを読めない場合(サブパスで合成する一時的なG-Bufferなど)は、深度の範囲を使わずに
+ * タイルの側面の平面のみで選別します。
+ */
+class LightCulling : private boost::noncopyable {
+public:
+  enum Type : uint32_t {
+    kPoint = 0,
+    kSpot = 1,
+  };
+
+  /** @brief ライトのデータ(シェーダーのstd430のLightと一致させます。) */
+  struct Light {
+    /** @brief ワールド空間の位置(wが0の場合は距離で減衰しません。) */
+    glm::vec4 position = glm::vec4(0.0f);
+    glm::vec3 color = glm::vec3(1.0f);
+    /** @brief 減衰の強さ */
+    float radius = 1.0f;
+    /** @brief スポットライトの向き(ワールド空間の単位ベクトル) */
+    glm::vec3 direction = glm::vec3(0.0f, -1.0f, 0.0f);
+    /** @brief 影響する距離(0の場合はすべてのタイルに影響します。) */
+    float range = 0.0f;
+    /** @brief スポットライトの内側と外側の角度の余弦 */
+    float cosInner = 1.0f;
+    float cosOuter = 0.0f;
+    uint32_t type = kPoint;
+    float padding = 0.0f;
+  };
+  static_assert(sizeof(Light) == 64, "Light must match std430 layout");
+
+  /** @brief タイルの大きさ(シェーダーのTILE_SIZEと一致させます。) */
+  static constexpr uint32_t kTileSize = 16;
+  /** @brief タイルに入れるライトの最大数(シェーダーのMAX_LIGHTS_PER_TILEと一致させます。) */
+  static constexpr uint32_t kMaxLightsPerTile = 255;
+  /** @brief ライトが最大数を超えたタイルで、リストの先頭の数に立てるビット(シェーダーのTILE_OVERFLOWと一致させます。) */
+  static constexpr uint32_t kTileOverflow = 0x80000000u;
+
+  void Prepare(const Device &device, UploadManager &uploader,
+               UniformRing &uniformRing, VkPipelineCache pipelineCache,
+               const std::vector<Light> &sceneLights, uint32_t width,
+               uint32_t height, const VkDescriptorImageInfo *positionImage,
+               const std::string &cullShader);
+  void Destroy(const Device &device) const;
+
+  void SetCamera(UniformRing &uniformRing, const glm::mat4 &view,
+                 const glm::mat4 &proj) const;
+  void RecordCulling(VkCommandBuffer commandBuffer, uint32_t partition,
+                     const UniformRing &uniformRing) const;
+  void CheckOverflow();
+
+  [[nodiscard]] uint32_t GetTileOffset(uint32_t partition) const {
+    return static_cast<uint32_t>(tilesStride * partition);
+  }
+  [[nodiscard]] uint32_t GetLightCount() const { return lightCount_; }
+  [[nodiscard]] uint32_t GetTileCountX() const { return tileCountX_; }
+  [[nodiscard]] uint32_t GetTileCountY() const { return tileCountY_; }
+  /** @brief 画面のUVをタイルの番号に変換する倍率(画面の大きさが変わっても同じタイルを引けます。) */
+  [[nodiscard]] glm::vec2 GetTileScale() const {
+    return glm::vec2(width_, height_) / static_cast<float>(kTileSize);
+  }
+  [[nodiscard]] bool HasDepthBounds() const { return depthBounds_; }
+
+  /** @brief すべてのライト(コンピュートシェーダーとフラグメントシェーダーが読みます。) */
+  Buffer lights{};
+  /** @brief パーティションごとのタイルのライトのリスト */
+  Buffer tiles{};
+  VkDeviceSize tilesStride = 0;
+
+private:
+  /** @brief 選別に使うカメラ(シェーダーのUniformBufferObjectと一致させます。) */
+  struct Camera {
+    alignas(16) glm::mat4 view;
+    alignas(16) glm::mat4 invProj;
+    alignas(8) glm::uvec2 screenSize;
+    uint32_t lightCount;
+    uint32_t tileCountX;
+    uint32_t depthBounds;
+  };
+
+  void SetupPipeline(const Device &device, UniformRing &uniformRing,
+                     VkPipelineCache pipelineCache,
+                     const VkDescriptorImageInfo &positionImage,
+                     const std::string &cullShader);
+
+  uint32_t lightCount_ = 0;
+  bool depthBounds_ = true;
+  /** @brief 最大数を超えたことを一度だけ報告するためのフラグ */
+  bool overflowReported_ = false;
+  uint32_t width_ = 0;
+  uint32_t height_ = 0;
+  uint32_t tileCountX_ = 0;
+  uint32_t tileCountY_ = 0;
+
+  UniformAllocation camera_{};
+  /** @brief 1つのタイルに触れたライトの数の最大値(ホストから読みます。) */
+  Buffer maxTileLights_{};
+  /** @brief G-Bufferを読まない場合に、位置の記述子を埋める1x1のテクスチャ */
+  Texture2D placeholder_{};
+  VkDescriptorPool descriptorPool_ = VK_NULL_HANDLE;
+  VkDescriptorSetLayout descriptorSetLayout_ = VK_NULL_HANDLE;
+  VkDescriptorSet descriptorSet_ = VK_NULL_HANDLE;
+  VkPipelineLayout pipelineLayout_ = VK_NULL_HANDLE;
+  VkPipeline pipeline_ = VK_NULL_HANDLE;
+};
@@ -0,0 +1,37 @@
+/**
+ * @brief ファイルを読み込み専用でメモリにマップします。
+ */
+
+#pragma once
+
+#include <boost/noncopyable.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief 読み込み専用のメモリマップドファイル
+ * @note
+ * ページは参照されたときに読み込まれるため、ファイル全体をバッファに読み込むよりも速く開けます。
+ */
+class MappedFile : private boost::noncopyable {
+public:
+  MappedFile() = default;
+  explicit MappedFile(const std::string &path) { Open(path); }
+  ~MappedFile() { Close(); }
+
+  bool Open(const std::string &path);
+  void Close();
+
+  [[nodiscard]] bool IsOpen() const { return data_ != nullptr; }
+  [[nodiscard]] const uint8_t *Data() const { return data_; }
+  [[nodiscard]] size_t Size() const { return size_; }
+
+private:
+  const uint8_t *data_ = nullptr;
+  size_t size_ = 0;
+#ifdef _WIN32
+  void *file_ = nullptr;
+  void *mapping_ = nullptr;
+#endif
+};
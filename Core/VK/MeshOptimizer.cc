@@ -0,0 +1,601 @@
+/**
+ * #brief 頂点キャッシュ、オーバードロー、頂点フェッチのためにメッシュを並べ替えます。
+ * @note
+ * 頂点キャッシュの最適化はTipsify(Sander et al. 2007, "Fast Triangle
+ * Reordering for Vertex Locality and Reduced Overdraw")に従います。
+ */
+
+#include "VK/MeshOptimizer.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <string_view>
+#include <unordered_map>
+
+namespace MeshOptimizer {
+
+static constexpr uint32_t kInvalid = std::numeric_limits<uint32_t>::max();
+
+//*-----------------------------------------------------------------------------
+// Analyze
+//*-----------------------------------------------------------------------------
+
+/**
+ * @brief FIFOの頂点キャッシュをシミュレーションして、ACMRとATVRを求めます。
+ * @param indices 三角形リストのインデックス
+ * @param vertexCount 頂点の数(ATVRには参照されている頂点のみを数えます。)
+ * @param cacheSize 頂点キャッシュの大きさ
+ */
+CacheStatistics AnalyzeVertexCache(const std::vector<uint32_t> &indices,
+                                   uint32_t vertexCount, uint32_t cacheSize) {
+  CacheStatistics statistics{};
+  statistics.triangleCount = indices.size() / 3;
+
+  // 頂点が入ったときの時刻を記録し、その後のミスの回数でキャッシュから追い出されたかを判定します。
+  std::vector<uint32_t> cacheTime(vertexCount, 0);
+  std::vector<bool> referenced(vertexCount, false);
+  uint32_t time = cacheSize + 1;
+  for (const auto index : indices) {
+    if (time - cacheTime[index] > cacheSize) {
+      cacheTime[index] = time++;
+      statistics.misses++;
+    }
+    if (!referenced[index]) {
+      referenced[index] = true;
+      statistics.vertexCount++;
+    }
+  }
+  return statistics;
+}
+
+//*-----------------------------------------------------------------------------
+// Optimize
+//*-----------------------------------------------------------------------------
+
+/**
+ * @brief 全く同じ内容の頂点を1つにまとめます。
+ * @param vertices 頂点データ(float単位で詰められています。)
+ * @param stride 頂点あたりのfloatの数
+ * @param indices 三角形リストのインデックス(まとめた頂点を指すように書き換えます。)
+ * @return まとめた後の頂点の数
+ * @note ビット列が一致する頂点のみをまとめるため、見た目は変わりません。
+ */
+uint32_t DeduplicateVertices(std::vector<float> &vertices, uint32_t stride,
+                             std::vector<uint32_t> &indices) {
+  const auto vertexCount = static_cast<uint32_t>(vertices.size() / stride);
+  const size_t vertexSize = size_t{stride} * sizeof(float);
+
+  std::vector<uint32_t> remap(vertexCount);
+  std::vector<float> unique;
+  unique.reserve(vertices.size());
+  {
+    // キーは元の頂点データを指すため、置き換える前にマップを破棄します。
+    std::unordered_map<std::string_view, uint32_t> lookup;
+    lookup.reserve(vertexCount);
+    for (uint32_t v = 0; v < vertexCount; v++) {
+      const float *vertex = vertices.data() + size_t{v} * stride;
+      const std::string_view key(reinterpret_cast<const char *>(vertex),
+                                 vertexSize);
+      const auto [it, inserted] = lookup.try_emplace(
+          key, static_cast<uint32_t>(unique.size() / stride));
+      if (inserted) {
+        unique.insert(unique.end(), vertex, vertex + stride);
+      }
+      remap[v] = it->second;
+    }
+  }
+
+  for (auto &index : indices) {
+    index = remap[index];
+  }
+  vertices.swap(unique);
+  return static_cast<uint32_t>(vertices.size() / stride);
+}
+
+/**
+ * @brief 頂点変換後のキャッシュに頂点が残っているうちに再利用されるように、三角形を並べ替えます。
+ * @param indices 三角形リストのインデックス
+ * @param vertexCount 頂点の数
+ * @param cacheSize 想定する頂点キャッシュの大きさ
+ * @note
+ * 頂点を中心に周りの三角形を扇状に出力し、次の中心にはキャッシュに残っている頂点を選びます。
+ */
+void OptimizeVertexCache(std::vector<uint32_t> &indices, uint32_t vertexCount,
+                         uint32_t cacheSize) {
+  const auto triangleCount = static_cast<uint32_t>(indices.size() / 3);
+  if (triangleCount == 0) {
+    return;
+  }
+
+  // 頂点ごとに、その頂点を使う三角形の一覧を作ります。
+  std::vector<uint32_t> liveCount(vertexCount, 0);
+  for (const auto index : indices) {
+    liveCount[index]++;
+  }
+  std::vector<uint32_t> offsets(vertexCount + 1, 0);
+  for (uint32_t v = 0; v < vertexCount; v++) {
+    offsets[v + 1] = offsets[v] + liveCount[v];
+  }
+  std::vector<uint32_t> adjacency(indices.size());
+  {
+    std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+    for (uint32_t t = 0; t < triangleCount; t++) {
+      for (uint32_t k = 0; k < 3; k++) {
+        adjacency[cursor[indices[t * 3 + k]]++] = t;
+      }
+    }
+  }
+
+  std::vector<uint32_t> cacheTime(vertexCount, 0);
+  std::vector<bool> emitted(triangleCount, false);
+  std::vector<uint32_t> deadEnd;
+  deadEnd.reserve(indices.size());
+  std::vector<uint32_t> candidates;
+  std::vector<uint32_t> result;
+  result.reserve(indices.size());
+
+  uint32_t time = cacheSize + 1;
+  uint32_t cursor = 0;
+  uint32_t fanning = 0;
+  while (fanning != kInvalid) {
+    candidates.clear();
+    for (uint32_t a = offsets[fanning]; a < offsets[fanning + 1]; a++) {
+      const uint32_t t = adjacency[a];
+      if (emitted[t]) {
+        continue;
+      }
+      for (uint32_t k = 0; k < 3; k++) {
+        const uint32_t v = indices[t * 3 + k];
+        result.emplace_back(v);
+        deadEnd.emplace_back(v);
+        candidates.emplace_back(v);
+        liveCount[v]--;
+        if (time - cacheTime[v] > cacheSize) {
+          cacheTime[v] = time++;
+        }
+      }
+      emitted[t] = true;
+    }
+
+    // 扇を出力し終えてもキャッシュに残る頂点のうち、最も古いものを次の中心にします。
+    fanning = kInvalid;
+    int64_t bestPriority = -1;
+    for (const auto v : candidates) {
+      if (liveCount[v] == 0) {
+        continue;
+      }
+      int64_t priority = 0;
+      if (time - cacheTime[v] + 2 * liveCount[v] <= cacheSize) {
+        priority = time - cacheTime[v];
+      }
+      if (priority > bestPriority) {
+        bestPriority = priority;
+        fanning = v;
+      }
+    }
+    // 行き止まりの場合は、最近出力した頂点から三角形が残っているものを探します。
+    while (fanning == kInvalid && !deadEnd.empty()) {
+      const uint32_t v = deadEnd.back();
+      deadEnd.pop_back();
+      if (liveCount[v] > 0) {
+        fanning = v;
+      }
+    }
+    while (fanning == kInvalid && cursor < vertexCount) {
+      if (liveCount[cursor] > 0) {
+        fanning = cursor;
+      }
+      cursor++;
+    }
+  }
+
+  indices.swap(result);
+}
+
+/**
+ * @brief 頂点キャッシュの効率をほぼ保ったまま、外側を向いた三角形の塊が先に描画されるように並べ替えます。
+ * @param indices 頂点キャッシュの最適化を済ませた三角形リストのインデックス
+ * @param vertices 頂点データ(float単位で詰められています。)
+ * @param stride 頂点あたりのfloatの数
+ * @param positionOffset 頂点の中の位置のfloat単位のオフセット
+ * @param threshold 塊に分けることで許容するACMRの悪化の割合(1.05は5%)
+ * @param cacheSize 想定する頂点キャッシュの大きさ
+ * @note
+ * 手前の面が先に深度を書き込むと、奥の面はEarly-Zで棄却されるため、フラグメントシェーダーの実行が減ります。
+ */
+void OptimizeOverdraw(std::vector<uint32_t> &indices,
+                      const std::vector<float> &vertices, uint32_t stride,
+                      uint32_t positionOffset, float threshold,
+                      uint32_t cacheSize) {
+  const auto triangleCount = static_cast<uint32_t>(indices.size() / 3);
+  const auto vertexCount = static_cast<uint32_t>(vertices.size() / stride);
+  if (triangleCount == 0) {
+    return;
+  }
+
+  std::vector<uint32_t> cacheTime(vertexCount, 0);
+  uint32_t time = cacheSize + 1;
+  const auto simulate = [&](uint32_t t) {
+    uint32_t misses = 0;
+    for (uint32_t k = 0; k < 3; k++) {
+      const uint32_t v = indices[t * 3 + k];
+      if (time - cacheTime[v] > cacheSize) {
+        cacheTime[v] = time++;
+        misses++;
+      }
+    }
+    return misses;
+  };
+  // 時刻を進めて、すべての頂点をキャッシュから追い出します。
+  const auto flush = [&] { time += cacheSize + 1; };
+
+  // 3頂点ともミスする三角形では、キャッシュが空になっているので区切っても効率は落ちません。
+  std::vector<uint32_t> hardClusters;
+  for (uint32_t t = 0; t < triangleCount; t++) {
+    if (simulate(t) == 3 || t == 0) {
+      hardClusters.emplace_back(t);
+    }
+  }
+  hardClusters.emplace_back(triangleCount);
+
+  // 塊の途中でも、そこまでのACMRが塊全体のACMRに近ければ区切ります。
+  std::vector<uint32_t> clusters;
+  for (size_t c = 0; c + 1 < hardClusters.size(); c++) {
+    const uint32_t begin = hardClusters[c];
+    const uint32_t end = hardClusters[c + 1];
+
+    flush();
+    uint32_t misses = 0;
+    for (uint32_t t = begin; t < end; t++) {
+      misses += simulate(t);
+    }
+    const float limit =
+        static_cast<float>(misses) / static_cast<float>(end - begin) *
+        threshold;
+
+    flush();
+    clusters.emplace_back(begin);
+    uint32_t softBegin = begin;
+    uint32_t softMisses = 0;
+    for (uint32_t t = begin; t < end; t++) {
+      softMisses += simulate(t);
+      if (t + 1 < end && static_cast<float>(softMisses) /
+                                 static_cast<float>(t + 1 - softBegin) <=
+                             limit) {
+        clusters.emplace_back(t + 1);
+        softBegin = t + 1;
+        softMisses = 0;
+        flush();
+      }
+    }
+  }
+  clusters.emplace_back(triangleCount);
+
+  const auto position = [&](uint32_t v) {
+    const float *p = vertices.data() + size_t{v} * stride + positionOffset;
+    return glm::vec3(p[0], p[1], p[2]);
+  };
+
+  // 塊ごとに面積で重み付けした重心と法線を求めます。
+  const size_t clusterCount = clusters.size() - 1;
+  std::vector<glm::vec3> centroids(clusterCount, glm::vec3(0.0f));
+  std::vector<glm::vec3> normals(clusterCount, glm::vec3(0.0f));
+  std::vector<float> areas(clusterCount, 0.0f);
+  glm::vec3 meshCentroid(0.0f);
+  float meshArea = 0.0f;
+  for (size_t c = 0; c < clusterCount; c++) {
+    for (uint32_t t = clusters[c]; t < clusters[c + 1]; t++) {
+      const glm::vec3 p0 = position(indices[t * 3 + 0]);
+      const glm::vec3 p1 = position(indices[t * 3 + 1]);
+      const glm::vec3 p2 = position(indices[t * 3 + 2]);
+      const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+      const float area = glm::length(normal);
+      const glm::vec3 centroid = (p0 + p1 + p2) / 3.0f;
+      centroids[c] += centroid * area;
+      normals[c] += normal;
+      areas[c] += area;
+    }
+    meshCentroid += centroids[c];
+    meshArea += areas[c];
+  }
+  if (meshArea <= 0.0f) {
+    return;
+  }
+  meshCentroid /= meshArea;
+
+  std::vector<float> keys(clusterCount, 0.0f);
+  float orientation = 0.0f;
+  for (size_t c = 0; c < clusterCount; c++) {
+    if (areas[c] <= 0.0f) {
+      continue;
+    }
+    const glm::vec3 offset = centroids[c] / areas[c] - meshCentroid;
+    orientation += glm::dot(offset, normals[c]);
+    const float length = glm::length(normals[c]);
+    keys[c] = length > 0.0f ? glm::dot(offset, normals[c] / length) : 0.0f;
+  }
+  // 巻き順が逆のメッシュでは法線が内側を向くため、全体の向きから符号を揃えます。
+  if (orientation < 0.0f) {
+    for (auto &key : keys) {
+      key = -key;
+    }
+  }
+
+  std::vector<uint32_t> order(clusterCount);
+  for (uint32_t c = 0; c < clusterCount; c++) {
+    order[c] = c;
+  }
+  std::stable_sort(order.begin(), order.end(),
+                   [&](uint32_t a, uint32_t b) { return keys[a] > keys[b]; });
+
+  std::vector<uint32_t> result;
+  result.reserve(indices.size());
+  for (const auto c : order) {
+    result.insert(result.end(), indices.begin() + clusters[c] * 3,
+                  indices.begin() + clusters[c + 1] * 3);
+  }
+  indices.swap(result);
+}
+
+/**
+ * @brief 頂点を最初に参照される順に並べ替え、頂点フェッチのメモリアクセスを連続させます。
+ * @param vertices 頂点データ(float単位で詰められています。)
+ * @param stride 頂点あたりのfloatの数
+ * @param indices 三角形リストのインデックス(並べ替えた頂点を指すように書き換えます。)
+ * @return 並べ替えた後の頂点の数(参照されない頂点は取り除きます。)
+ */
+uint32_t OptimizeVertexFetch(std::vector<float> &vertices, uint32_t stride,
+                             std::vector<uint32_t> &indices) {
+  const auto vertexCount = static_cast<uint32_t>(vertices.size() / stride);
+
+  std::vector<uint32_t> remap(vertexCount, kInvalid);
+  std::vector<float> result;
+  result.reserve(vertices.size());
+  uint32_t next = 0;
+  for (auto &index : indices) {
+    if (remap[index] == kInvalid) {
+      remap[index] = next++;
+      const auto first = vertices.begin() + size_t{index} * stride;
+      result.insert(result.end(), first, first + stride);
+    }
+    index = remap[index];
+  }
+  vertices.swap(result);
+  return next;
+}
+
+//*-----------------------------------------------------------------------------
+// Cluster
+//*-----------------------------------------------------------------------------
+
+/**
+ * @brief 三角形を、頂点と三角形の数が上限に収まる隣接した塊(メッシュレット)に分けます。
+ * @param indices 三角形リストのインデックス(クラスターごとに連続するように並べ替えます。)
+ * @param vertices 頂点データ(float単位で詰められています。)
+ * @param stride 頂点あたりのfloatの数
+ * @param positionOffset 頂点の中の位置のfloat単位のオフセット
+ * @param maxVertices クラスターあたりの頂点の最大数
+ * @param maxTriangles クラスターあたりの三角形の最大数
+ * @return インデックスの順に並んだクラスター
+ * @note
+ * 新しい頂点が最も少ない隣接三角形を、同数の場合はクラスターの重心に近いものを貪欲に加えます。<br>
+ * 種には入力の順番で残っている最初の三角形を使い、クラスターの中の三角形は頂点キャッシュのために並べ替えます。
+ */
+std::vector<Meshlet> BuildMeshlets(std::vector<uint32_t> &indices,
+                                   const std::vector<float> &vertices,
+                                   uint32_t stride, uint32_t positionOffset,
+                                   uint32_t maxVertices,
+                                   uint32_t maxTriangles) {
+  const auto triangleCount = static_cast<uint32_t>(indices.size() / 3);
+  const auto vertexCount = static_cast<uint32_t>(vertices.size() / stride);
+  std::vector<Meshlet> meshlets;
+  if (triangleCount == 0 || maxVertices < 3 || maxTriangles == 0) {
+    return meshlets;
+  }
+
+  const auto position = [&](uint32_t v) {
+    const float *p = vertices.data() + size_t{v} * stride + positionOffset;
+    return glm::vec3(p[0], p[1], p[2]);
+  };
+
+  // 三角形ごとの単位法線と重心、メッシュ全体の面積で重み付けした重心を求めます。
+  std::vector<glm::vec3> normals(triangleCount);
+  std::vector<glm::vec3> centroids(triangleCount);
+  std::vector<float> areas(triangleCount);
+  glm::vec3 meshCentroid(0.0f);
+  float meshArea = 0.0f;
+  for (uint32_t t = 0; t < triangleCount; t++) {
+    const glm::vec3 p0 = position(indices[t * 3 + 0]);
+    const glm::vec3 p1 = position(indices[t * 3 + 1]);
+    const glm::vec3 p2 = position(indices[t * 3 + 2]);
+    const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+    areas[t] = glm::length(normal);
+    normals[t] = areas[t] > 0.0f ? normal / areas[t] : glm::vec3(0.0f);
+    centroids[t] = (p0 + p1 + p2) / 3.0f;
+    meshCentroid += centroids[t] * areas[t];
+    meshArea += areas[t];
+  }
+  // 巻き順が逆のメッシュでは法線が内側を向くため、全体の向きから符号を揃えます。
+  if (meshArea > 0.0f) {
+    meshCentroid /= meshArea;
+    float orientation = 0.0f;
+    for (uint32_t t = 0; t < triangleCount; t++) {
+      orientation +=
+          glm::dot(centroids[t] - meshCentroid, normals[t]) * areas[t];
+    }
+    if (orientation < 0.0f) {
+      for (auto &normal : normals) {
+        normal = -normal;
+      }
+    }
+  }
+
+  // 頂点ごとに、その頂点を使う三角形の一覧を作ります。
+  std::vector<uint32_t> offsets(vertexCount + 1, 0);
+  for (const auto index : indices) {
+    offsets[index + 1]++;
+  }
+  for (uint32_t v = 0; v < vertexCount; v++) {
+    offsets[v + 1] += offsets[v];
+  }
+  std::vector<uint32_t> adjacency(indices.size());
+  {
+    std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+    for (uint32_t t = 0; t < triangleCount; t++) {
+      for (uint32_t k = 0; k < 3; k++) {
+        adjacency[cursor[indices[t * 3 + k]]++] = t;
+      }
+    }
+  }
+
+  std::vector<bool> emitted(triangleCount, false);
+  // 頂点を含んでいるクラスターの番号(現在のクラスターに含まれるかの判定に使います。)
+  std::vector<uint32_t> owner(vertexCount, kInvalid);
+  std::vector<uint32_t> result;
+  result.reserve(indices.size());
+  std::vector<uint32_t> clusterVertices;
+  std::vector<uint32_t> clusterTriangles;
+  std::vector<uint32_t> candidates;
+
+  uint32_t cursor = 0;
+  while (true) {
+    while (cursor < triangleCount && emitted[cursor]) {
+      cursor++;
+    }
+    if (cursor == triangleCount) {
+      break;
+    }
+
+    const auto id = static_cast<uint32_t>(meshlets.size());
+    clusterVertices.clear();
+    clusterTriangles.clear();
+    candidates.clear();
+    glm::vec3 centroidSum(0.0f);
+    const auto newVertexCount = [&](uint32_t t) {
+      uint32_t count = 0;
+      for (uint32_t k = 0; k < 3; k++) {
+        count += owner[indices[t * 3 + k]] != id ? 1 : 0;
+      }
+      return count;
+    };
+    const auto add = [&](uint32_t t) {
+      for (uint32_t k = 0; k < 3; k++) {
+        const uint32_t v = indices[t * 3 + k];
+        if (owner[v] != id) {
+          owner[v] = id;
+          clusterVertices.emplace_back(v);
+          candidates.insert(candidates.end(), adjacency.begin() + offsets[v],
+                            adjacency.begin() + offsets[v + 1]);
+        }
+      }
+      emitted[t] = true;
+      clusterTriangles.emplace_back(t);
+      centroidSum += centroids[t];
+    };
+
+    add(cursor);
+    while (clusterTriangles.size() < maxTriangles) {
+      const glm::vec3 clusterCentroid =
+          centroidSum / static_cast<float>(clusterTriangles.size());
+      uint32_t best = kInvalid;
+      uint32_t bestNew = 4;
+      float bestDistance = std::numeric_limits<float>::max();
+      size_t live = 0;
+      for (size_t c = 0; c < candidates.size(); c++) {
+        const uint32_t t = candidates[c];
+        if (emitted[t]) {
+          continue;
+        }
+        candidates[live++] = t;
+        const uint32_t added = newVertexCount(t);
+        if (clusterVertices.size() + added > maxVertices) {
+          continue;
+        }
+        const glm::vec3 offset = centroids[t] - clusterCentroid;
+        const float distance = glm::dot(offset, offset);
+        if (added < bestNew || (added == bestNew && distance < bestDistance)) {
+          best = t;
+          bestNew = added;
+          bestDistance = distance;
+        }
+      }
+      candidates.resize(live);
+
+      // 隣接する三角形が残っていない場合は、入力の順番で次の三角形を加えます。
+      if (best == kInvalid && candidates.empty()) {
+        while (cursor < triangleCount && emitted[cursor]) {
+          cursor++;
+        }
+        if (cursor < triangleCount &&
+            clusterVertices.size() + newVertexCount(cursor) <= maxVertices) {
+          best = cursor;
+        }
+      }
+      if (best == kInvalid) {
+        break;
+      }
+      add(best);
+    }
+
+    Meshlet meshlet{};
+    meshlet.indexOffset = static_cast<uint32_t>(result.size());
+    meshlet.indexCount = static_cast<uint32_t>(clusterTriangles.size() * 3);
+    // クラスターの中でも頂点キャッシュのために三角形を並べ替えます。
+    std::vector<uint32_t> local;
+    local.reserve(meshlet.indexCount);
+    for (const auto t : clusterTriangles) {
+      for (uint32_t k = 0; k < 3; k++) {
+        const auto it = std::find(clusterVertices.begin(),
+                                  clusterVertices.end(), indices[t * 3 + k]);
+        local.emplace_back(
+            static_cast<uint32_t>(it - clusterVertices.begin()));
+      }
+    }
+    OptimizeVertexCache(local, static_cast<uint32_t>(clusterVertices.size()));
+    for (const auto index : local) {
+      result.emplace_back(clusterVertices[index]);
+    }
+
+    // 境界球はバウンディングボックスの中心から最も遠い頂点までの距離にします。
+    glm::vec3 min(std::numeric_limits<float>::max());
+    glm::vec3 max(std::numeric_limits<float>::lowest());
+    for (const auto v : clusterVertices) {
+      min = glm::min(min, position(v));
+      max = glm::max(max, position(v));
+    }
+    meshlet.center = (min + max) * 0.5f;
+    for (const auto v : clusterVertices) {
+      meshlet.radius =
+          std::max(meshlet.radius, glm::length(position(v) - meshlet.center));
+    }
+
+    // 法線の平均を軸とし、軸から最も離れた法線で円錐の開き角を決めます。
+    glm::vec3 axis(0.0f);
+    for (const auto t : clusterTriangles) {
+      axis += normals[t];
+    }
+    const float axisLength = glm::length(axis);
+    if (axisLength > 0.0f) {
+      axis /= axisLength;
+      float minDot = 1.0f;
+      for (const auto t : clusterTriangles) {
+        if (areas[t] > 0.0f) {
+          minDot = std::min(minDot, glm::dot(normals[t], axis));
+        }
+      }
+      meshlet.coneAxis = axis;
+      // 開き角が90度を超える場合は、どの方向から見ても表の三角形があります。
+      meshlet.coneCutoff =
+          minDot > 0.0f ? std::sqrt(1.0f - minDot * minDot) : 1.0f;
+    }
+    meshlets.emplace_back(meshlet);
+  }
+
+  indices.swap(result);
+  return meshlets;
+}
+
+} // namespace MeshOptimizer
@@ -0,0 +1,87 @@
+/**
+ * #brief 頂点キャッシュ、オーバードロー、頂点フェッチのためにメッシュを並べ替えます。
+ */
+
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace MeshOptimizer {
+
+/** @brief 評価と最適化に使うFIFOの頂点キャッシュの大きさ */
+constexpr uint32_t kCacheSize = 16;
+/** @brief クラスター(メッシュレット)あたりの頂点と三角形の最大数 */
+constexpr uint32_t kMeshletMaxVertices = 64;
+constexpr uint32_t kMeshletMaxTriangles = 124;
+
+/**
+ * @brief FIFOの頂点キャッシュをシミュレーションした結果
+ */
+struct CacheStatistics {
+  uint64_t misses = 0;
+  uint64_t triangleCount = 0;
+  uint64_t vertexCount = 0;
+
+  /** @brief 三角形あたりのキャッシュミスの平均(Average Cache Miss Ratio) */
+  [[nodiscard]] float Acmr() const {
+    return triangleCount > 0 ? static_cast<float>(misses) /
+                                   static_cast<float>(triangleCount)
+                             : 0.0f;
+  }
+  /** @brief 頂点あたりの変換回数の平均(Average Transformed Vertex Ratio) */
+  [[nodiscard]] float Atvr() const {
+    return vertexCount > 0 ? static_cast<float>(misses) /
+                                 static_cast<float>(vertexCount)
+                           : 0.0f;
+  }
+  CacheStatistics &operator+=(const CacheStatistics &rhs) {
+    misses += rhs.misses;
+    triangleCount += rhs.triangleCount;
+    vertexCount += rhs.vertexCount;
+    return *this;
+  }
+};
+
+/**
+ * @brief 隣接する三角形をまとめたクラスターと、カリングに使う境界
+ * @note
+ * 視点をcameraとすると、dot(center - camera, coneAxis) >= coneCutoff *
+ * length(center - camera) + radiusが成り立つクラスターはすべての三角形が裏を向いています。
+ */
+struct Meshlet {
+  /** @brief 並べ替えたインデックスの中の先頭と数 */
+  uint32_t indexOffset = 0;
+  uint32_t indexCount = 0;
+  /** @brief 頂点を囲む球 */
+  glm::vec3 center = glm::vec3(0.0f);
+  float radius = 0.0f;
+  /** @brief 三角形の法線を囲む円錐の軸とsin(開き角)(1の場合は裏向きを判定できません。) */
+  glm::vec3 coneAxis = glm::vec3(0.0f);
+  float coneCutoff = 1.0f;
+};
+
+[[nodiscard]] CacheStatistics
+AnalyzeVertexCache(const std::vector<uint32_t> &indices, uint32_t vertexCount,
+                   uint32_t cacheSize = kCacheSize);
+
+uint32_t DeduplicateVertices(std::vector<float> &vertices, uint32_t stride,
+                             std::vector<uint32_t> &indices);
+void OptimizeVertexCache(std::vector<uint32_t> &indices, uint32_t vertexCount,
+                         uint32_t cacheSize = kCacheSize);
+void OptimizeOverdraw(std::vector<uint32_t> &indices,
+                      const std::vector<float> &vertices, uint32_t stride,
+                      uint32_t positionOffset, float threshold,
+                      uint32_t cacheSize = kCacheSize);
+uint32_t OptimizeVertexFetch(std::vector<float> &vertices, uint32_t stride,
+                             std::vector<uint32_t> &indices);
+[[nodiscard]] std::vector<Meshlet>
+BuildMeshlets(std::vector<uint32_t> &indices,
+              const std::vector<float> &vertices, uint32_t stride,
+              uint32_t positionOffset,
+              uint32_t maxVertices = kMeshletMaxVertices,
+              uint32_t maxTriangles = kMeshletMaxTriangles);
+
+} // namespace MeshOptimizer
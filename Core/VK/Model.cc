@@ -7,24 +7,266 @@
 #include <assimp/Importer.hpp>
 #include <assimp/cimport.h>
 #include <assimp/scene.h>
+#include <glm/gtc/packing.hpp>
 
 #include <algorithm>
+#include <array>
 #include <boost/assert.hpp>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <spdlog/spdlog.h>
+#include <sstream>
 
+#include "VK/AssetArchive.h"
 #include "VK/Common.h"
 #include "VK/Device.h"
+#include "VK/MeshOptimizer.h"
+#include "VK/UploadManager.h"
 
 static constexpr uint32_t defaultFlags =
     aiProcess_FlipWindingOrder | aiProcess_Triangulate |
     aiProcess_PreTransformVertices | aiProcess_CalcTangentSpace |
     aiProcess_GenSmoothNormals;
 
+//*-----------------------------------------------------------------------------
+// Mesh cache
+//*-----------------------------------------------------------------------------
+
+/** @brief キャッシュファイルのマジックナンバー("RVMC") */
+static constexpr uint32_t kMeshCacheMagic = 0x434d5652;
+/** @brief 変換の処理やファイルの形式を変更したときに上げます。 */
+static constexpr uint32_t kMeshCacheVersion = 6;
+
+/**
+ * @brief キャッシュファイルの先頭に置くヘッダ
+ * @note ヘッダの後にMesh、Cluster、頂点データ、インデックスデータの順に続きます。
+ */
+struct MeshCacheHeader {
+  uint32_t magic = kMeshCacheMagic;
+  uint32_t version = kMeshCacheVersion;
+  uint64_t key = 0;
+  uint32_t vertexCount = 0;
+  uint32_t indexCount = 0;
+  uint32_t meshCount = 0;
+  uint32_t clusterCount = 0;
+  uint32_t stride = 0;
+  uint64_t vertexDataSize = 0;
+  uint32_t indexType = VK_INDEX_TYPE_UINT32;
+  float quantizationScale = 1.0f;
+  std::array<float, 3> quantizationOffset{};
+  std::array<float, 3> dimMin{};
+  std::array<float, 3> dimMax{};
+};
+
+/**
+ * @brief インデックスの型のバイト数を返します。
+ */
+static uint32_t IndexSize(VkIndexType indexType) {
+  return indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t)
+                                           : sizeof(uint32_t);
+}
+
+/**
+ * @brief FNV-1aでバイト列をハッシュに加えます。
+ */
+static void HashBytes(uint64_t &hash, const void *data, size_t size) {
+  const auto *bytes = static_cast<const uint8_t *>(data);
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ull;
+  }
+}
+
+template <typename T> static void HashValue(uint64_t &hash, const T &value) {
+  HashBytes(hash, &value, sizeof(value));
+}
+
+/**
+ * @brief 元のファイルの内容と変換の設定からキャッシュのキーを求めます。
+ * @note
+ * キーはファイル名とヘッダの両方に入れ、名前が衝突したキャッシュや別の入力から書かれたキャッシュを読み込まないようにします。
+ */
+static uint64_t MeshCacheKey(const AssetData &source,
+                             const VertexLayout &vertexLayout,
+                             const ModelCreateInfo &modelCreateInfo) {
+  uint64_t key = 0xcbf29ce484222325ull;
+  HashValue(key, kMeshCacheVersion);
+  HashValue(key, defaultFlags);
+  HashBytes(key, source.data, source.size);
+  for (const auto &component : vertexLayout.components) {
+    HashValue(key, static_cast<int32_t>(component));
+  }
+  HashValue(key, modelCreateInfo.center);
+  HashValue(key, modelCreateInfo.scale);
+  HashValue(key, modelCreateInfo.uvscale);
+  HashValue(key, modelCreateInfo.color.has_value());
+  HashValue(key, modelCreateInfo.color.value_or(glm::vec3(0.0f)));
+  HashValue(key, modelCreateInfo.optimize);
+  HashValue(key, modelCreateInfo.overdrawThreshold);
+  HashValue(key, modelCreateInfo.clusters);
+  return key;
+}
+
+/**
+ * @brief キャッシュのキーからキャッシュファイルのパスを求めます。
+ * @return キャッシュファイルのパス(キャッシュしない場合は空です。)
+ */
+static std::string MeshCachePath(const std::string &filepath, uint64_t key,
+                                 const ModelCreateInfo &modelCreateInfo) {
+  if (modelCreateInfo.cacheDirectory.empty()) {
+    return {};
+  }
+
+  std::ostringstream name;
+  name << std::filesystem::path(filepath).stem().string() << '-' << std::hex
+       << std::setw(16) << std::setfill('0') << key << ".mesh";
+  return (std::filesystem::path(modelCreateInfo.cacheDirectory) / name.str())
+      .string();
+}
+
+//*-----------------------------------------------------------------------------
+// Vertex packing
+//*-----------------------------------------------------------------------------
+
+/**
+ * @brief 量子化するコンポーネントを、読み込み時に並べるfloatのコンポーネントに置き換えます。
+ */
+static VertexLayoutComponent Unpacked(VertexLayoutComponent component) {
+  switch (component) {
+  case VertexLayoutComponent::PositionHalf:
+    return VertexLayoutComponent::Position;
+  case VertexLayoutComponent::NormalOct:
+    return VertexLayoutComponent::Normal;
+  case VertexLayoutComponent::TangentOct:
+    return VertexLayoutComponent::Tangent;
+  case VertexLayoutComponent::BitangentOct:
+    return VertexLayoutComponent::Bitangent;
+  case VertexLayoutComponent::ColorUnorm8:
+    return VertexLayoutComponent::Color;
+  case VertexLayoutComponent::UVHalf:
+    return VertexLayoutComponent::UV;
+  default:
+    return component;
+  }
+}
+
+/**
+ * @brief 量子化する前のfloatだけのレイアウトを返します。(最適化はこのレイアウトで行います。)
+ */
+static VertexLayout UnpackedLayout(const VertexLayout &vertexLayout) {
+  std::vector<VertexLayoutComponent> components;
+  for (const auto &component : vertexLayout.components) {
+    components.emplace_back(Unpacked(component));
+  }
+  return VertexLayout(std::move(components));
+}
+
+/**
+ * @brief 単位ベクトルを八面体に写像し、[-1, 1]の2次元に符号化します。
+ */
+static glm::vec2 OctEncode(const glm::vec3 &v) {
+  const float norm = std::abs(v.x) + std::abs(v.y) + std::abs(v.z);
+  if (norm <= 0.0f) {
+    return glm::vec2(0.0f);
+  }
+  const glm::vec3 n = v / norm;
+  if (n.z >= 0.0f) {
+    return glm::vec2(n.x, n.y);
+  }
+  // 下半球は対角線で折り返して、正方形の角に写します。
+  return glm::vec2((1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f),
+                   (1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f));
+}
+
+//*-----------------------------------------------------------------------------
+// Load
+//*-----------------------------------------------------------------------------
+
+/**
+ * @brief モデルを読み込み、頂点とインデックスをデバイスのローカルメモリに転送します。
+ */
 bool Model::LoadFromFile(const Device &device, const std::string &filepath,
-                         VkQueue copyQueue, const VertexLayout &vertexLayout,
+                         UploadManager &uploader,
+                         const VertexLayout &vertexLayout,
                          const ModelCreateInfo &modelCreateInfo) {
+  if (!Decode(filepath, vertexLayout, modelCreateInfo)) {
+    return false;
+  }
+  Upload(device, uploader, modelCreateInfo);
+  return true;
+}
+
+/**
+ * @brief モデルを読み込み、転送する頂点とインデックスを用意します。
+ * @note
+ * デバイスを使用しないため、ワーカースレッドから呼び出せます。<br>
+ * 変換済みのデータがキャッシュにあれば、Assimpを使わずにマップしたファイルをそのまま参照します。
+ */
+bool Model::Decode(const std::string &filepath,
+                   const VertexLayout &vertexLayout,
+                   const ModelCreateInfo &modelCreateInfo) {
+  decoded_ = {};
+  clusters.clear();
+  const auto source = AssetArchive::Get().Read(filepath);
+  if (!source) {
+    std::cerr << "Failed to open file: " << filepath << std::endl;
+    BOOST_ASSERT_MSG(source, "Filed to load model!");
+    return false;
+  }
+  const uint64_t cacheKey =
+      modelCreateInfo.cacheDirectory.empty()
+          ? 0
+          : MeshCacheKey(source, vertexLayout, modelCreateInfo);
+  const auto cachePath = MeshCachePath(filepath, cacheKey, modelCreateInfo);
+  if (!cachePath.empty() &&
+      DecodeFromCache(cachePath, cacheKey, vertexLayout)) {
+    return true;
+  }
+
+  std::vector<float> vertexBuffer;
+  std::vector<uint32_t> indexBuffer;
+  if (!Import(filepath, source, vertexLayout, modelCreateInfo, vertexBuffer,
+              indexBuffer)) {
+    return false;
+  }
+  if (modelCreateInfo.optimize) {
+    Optimize(filepath, vertexLayout, modelCreateInfo, vertexBuffer,
+             indexBuffer);
+  }
+  if (modelCreateInfo.clusters) {
+    BuildClusters(filepath, vertexLayout, vertexBuffer, indexBuffer);
+  }
+  Pack(vertexLayout, vertexBuffer, indexBuffer);
+  if (!cachePath.empty()) {
+    SaveToCache(cachePath, cacheKey);
+  }
+
+  decoded_.vertexData = decoded_.vertices.data();
+  decoded_.vertexDataSize = decoded_.vertices.size();
+  decoded_.indexData = decoded_.indices.data();
+  decoded_.indexDataSize = decoded_.indices.size();
+  return true;
+}
+
+/**
+ * @brief Assimpでモデルを読み込み、頂点レイアウトに従って頂点を並べます。
+ * @param source ファイルの内容(拡張子から形式を判定します。)
+ * @note 量子化するコンポーネントもここではfloatのまま並べ、Packで詰めます。
+ */
+bool Model::Import(const std::string &filepath, const AssetData &source,
+                   const VertexLayout &vertexLayout,
+                   const ModelCreateInfo &modelCreateInfo,
+                   std::vector<float> &vertexBuffer,
+                   std::vector<uint32_t> &indexBuffer) {
   Assimp::Importer importer;
-  const aiScene *scene = importer.ReadFile(filepath, defaultFlags);
+  const auto hint = std::filesystem::path(filepath).extension().string();
+  const aiScene *scene = importer.ReadFileFromMemory(
+      source.data, source.size, defaultFlags,
+      hint.empty() ? "" : hint.c_str() + 1);
   if (scene == nullptr) {
     std::cerr << importer.GetErrorString() << std::endl;
     BOOST_ASSERT_MSG(scene != nullptr, "Filed to load model!");
@@ -38,9 +280,7 @@ bool Model::LoadFromFile(const Device &device, const std::string &filepath,
   meshes.clear();
   meshes.resize(scene->mNumMeshes);
 
-  std::vector<float> vertexBuffer;
   vertexCount = 0;
-  std::vector<uint32_t> indexBuffer;
   indexCount = 0;
   for (uint32_t i = 0; i < scene->mNumMeshes; i++) {
     const aiMesh *mesh = scene->mMeshes[i];
@@ -73,7 +313,7 @@ bool Model::LoadFromFile(const Device &device, const std::string &filepath,
           (mesh->HasTangentsAndBitangents()) ? mesh->mBitangents[j] : zero3D;
 
       for (const auto &component : vertexLayout.components) {
-        switch (component) {
+        switch (Unpacked(component)) {
         case VertexLayoutComponent::Position:
           vertexBuffer.emplace_back(pos.x * scale.x + center.x);
           vertexBuffer.emplace_back(pos.y * scale.y + center.y);
@@ -112,8 +352,14 @@ bool Model::LoadFromFile(const Device &device, const std::string &filepath,
           vertexBuffer.emplace_back(0.0f);
           vertexBuffer.emplace_back(0.0f);
           break;
+        default:
+          break;
         }
       }
+      meshes[i].bounds.Merge(pos.x * scale.x + center.x,
+                             pos.y * scale.y + center.y,
+                             pos.z * scale.z + center.z);
+
       dim.min.x = std::min(pos.x, dim.min.x);
       dim.min.y = std::min(pos.y, dim.min.y);
       dim.min.z = std::min(pos.z, dim.min.z);
@@ -124,70 +370,411 @@ bool Model::LoadFromFile(const Device &device, const std::string &filepath,
     }
     meshes[i].vertexCount = mesh->mNumVertices;
 
-    const auto indexBase = static_cast<uint32_t>(indexBuffer.size());
+    // インデックスはモデル全体の頂点バッファを指すように、メッシュの頂点のベースを加えます。
+    const uint32_t vertexBase = meshes[i].vertexBase;
     for (uint32_t j = 0; j < mesh->mNumFaces; j++) {
       const aiFace &face = mesh->mFaces[j];
       if (face.mNumIndices != 3) {
         continue;
       }
-      indexBuffer.emplace_back(indexBase + face.mIndices[0]);
-      indexBuffer.emplace_back(indexBase + face.mIndices[1]);
-      indexBuffer.emplace_back(indexBase + face.mIndices[2]);
+      indexBuffer.emplace_back(vertexBase + face.mIndices[0]);
+      indexBuffer.emplace_back(vertexBase + face.mIndices[1]);
+      indexBuffer.emplace_back(vertexBase + face.mIndices[2]);
       meshes[i].indexCount += 3;
       indexCount += 3;
     }
   }
 
-  const auto vtxBufSize =
-      static_cast<uint32_t>(vertexBuffer.size()) * sizeof(float);
-  const auto idxBufSize =
-      static_cast<uint32_t>(indexBuffer.size()) * sizeof(uint32_t);
+  return true;
+}
+
+/**
+ * @brief メッシュごとに頂点の重複を取り除き、三角形と頂点を並べ替えます。
+ * @note
+ * 頂点キャッシュ、オーバードロー、頂点フェッチの順に最適化し、前後のACMRとATVRをログに出力します。
+ */
+void Model::Optimize(const std::string &filepath,
+                     const VertexLayout &vertexLayout,
+                     const ModelCreateInfo &modelCreateInfo,
+                     std::vector<float> &vertexBuffer,
+                     std::vector<uint32_t> &indexBuffer) {
+  const auto unpackedLayout = UnpackedLayout(vertexLayout);
+  const uint32_t stride = unpackedLayout.Stride() / sizeof(float);
+  const auto positionOffset =
+      unpackedLayout.Offset(VertexLayoutComponent::Position);
+
+  std::vector<float> optimizedVertices;
+  optimizedVertices.reserve(vertexBuffer.size());
+  std::vector<uint32_t> optimizedIndices;
+  optimizedIndices.reserve(indexBuffer.size());
+  MeshOptimizer::CacheStatistics before{};
+  MeshOptimizer::CacheStatistics after{};
+  const uint32_t originalVertexCount = vertexCount;
+
+  vertexCount = 0;
+  for (auto &mesh : meshes) {
+    std::vector<float> vertices(
+        vertexBuffer.begin() + size_t{mesh.vertexBase} * stride,
+        vertexBuffer.begin() +
+            size_t{mesh.vertexBase + mesh.vertexCount} * stride);
+    std::vector<uint32_t> indices(
+        indexBuffer.begin() + mesh.indexBase,
+        indexBuffer.begin() + mesh.indexBase + mesh.indexCount);
+    for (auto &index : indices) {
+      index -= mesh.vertexBase;
+    }
+    before += MeshOptimizer::AnalyzeVertexCache(indices, mesh.vertexCount);
+
+    uint32_t count =
+        MeshOptimizer::DeduplicateVertices(vertices, stride, indices);
+    MeshOptimizer::OptimizeVertexCache(indices, count);
+    if (positionOffset.has_value()) {
+      MeshOptimizer::OptimizeOverdraw(
+          indices, vertices, stride, *positionOffset / sizeof(float),
+          modelCreateInfo.overdrawThreshold);
+    }
+    count = MeshOptimizer::OptimizeVertexFetch(vertices, stride, indices);
+    after += MeshOptimizer::AnalyzeVertexCache(indices, count);
+
+    mesh.vertexBase = vertexCount;
+    mesh.vertexCount = count;
+    mesh.indexBase = static_cast<uint32_t>(optimizedIndices.size());
+    for (const auto index : indices) {
+      optimizedIndices.emplace_back(mesh.vertexBase + index);
+    }
+    optimizedVertices.insert(optimizedVertices.end(), vertices.begin(),
+                             vertices.end());
+    vertexCount += count;
+  }
+
+  vertexBuffer.swap(optimizedVertices);
+  indexBuffer.swap(optimizedIndices);
+  spdlog::info("Optimized {}: vertices {} -> {}, ACMR {:.3f} -> {:.3f}, "
+               "ATVR {:.3f} -> {:.3f}",
+               filepath, originalVertexCount, vertexCount, before.Acmr(),
+               after.Acmr(), before.Atvr(), after.Atvr());
+}
+
+/**
+ * @brief メッシュごとに三角形をクラスターに分け、クラスターの境界と法線の円錐を求めます。
+ * @note 境界はPackで量子化した頂点と同じ空間に移します。
+ */
+void Model::BuildClusters(const std::string &filepath,
+                          const VertexLayout &vertexLayout,
+                          const std::vector<float> &vertexBuffer,
+                          std::vector<uint32_t> &indexBuffer) {
+  const auto unpackedLayout = UnpackedLayout(vertexLayout);
+  const uint32_t stride = unpackedLayout.Stride() / sizeof(float);
+  const auto positionOffset =
+      unpackedLayout.Offset(VertexLayoutComponent::Position);
+  if (!positionOffset.has_value()) {
+    spdlog::warn("{} has no position; clusters are not built.", filepath);
+    return;
+  }
+
+  for (const auto &mesh : meshes) {
+    std::vector<float> vertices(
+        vertexBuffer.begin() + size_t{mesh.vertexBase} * stride,
+        vertexBuffer.begin() +
+            size_t{mesh.vertexBase + mesh.vertexCount} * stride);
+    std::vector<uint32_t> indices(
+        indexBuffer.begin() + mesh.indexBase,
+        indexBuffer.begin() + mesh.indexBase + mesh.indexCount);
+    for (auto &index : indices) {
+      index -= mesh.vertexBase;
+    }
+
+    const auto meshlets = MeshOptimizer::BuildMeshlets(
+        indices, vertices, stride, *positionOffset / sizeof(float));
+    for (const auto &meshlet : meshlets) {
+      Cluster cluster{};
+      cluster.center = meshlet.center;
+      cluster.radius = meshlet.radius;
+      cluster.coneAxis = meshlet.coneAxis;
+      cluster.coneCutoff = meshlet.coneCutoff;
+      cluster.firstIndex = mesh.indexBase + meshlet.indexOffset;
+      cluster.indexCount = meshlet.indexCount;
+      clusters.emplace_back(cluster);
+    }
+    for (uint32_t i = 0; i < mesh.indexCount; i++) {
+      indexBuffer[mesh.indexBase + i] = mesh.vertexBase + indices[i];
+    }
+  }
+
+  spdlog::info("Built {} clusters for {}: {:.1f} triangles per cluster",
+               clusters.size(), filepath,
+               clusters.empty() ? 0.0
+                                : static_cast<double>(indexCount) / 3.0 /
+                                      static_cast<double>(clusters.size()));
+}
+
+/**
+ * @brief floatで並べた頂点をレイアウトの形式に詰め、インデックスの型を決めます。
+ * @note
+ * 半精度の位置はモデル全体のバウンディングボックスを[-1, 1]に収めてから変換し、戻す変換をquantizationに記録します。
+ */
+void Model::Pack(const VertexLayout &vertexLayout,
+                 const std::vector<float> &vertexBuffer,
+                 const std::vector<uint32_t> &indexBuffer) {
+  const auto unpackedLayout = UnpackedLayout(vertexLayout);
+  const uint32_t unpackedStride = unpackedLayout.Stride() / sizeof(float);
+  const uint32_t stride = vertexLayout.Stride();
+  const auto positionOffset =
+      unpackedLayout.Offset(VertexLayoutComponent::Position);
 
-  // ステージングバッファを使用して、頂点バッファとインデックスバッファをデバイスのローカルメモリに移動します。
-  Buffer vertexStaging;
-  VK_CHECK_RESULT(vertexStaging.Create(device, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                                       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                                           VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                                       vtxBufSize, vertexBuffer.data()));
-  Buffer indexStaging;
-  VK_CHECK_RESULT(indexStaging.Create(device, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                                      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                                          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                                      idxBufSize, indexBuffer.data()));
+  quantization = {};
+  if (vertexLayout.Offset(VertexLayoutComponent::PositionHalf).has_value() &&
+      positionOffset.has_value() && vertexCount > 0) {
+    glm::vec3 min(std::numeric_limits<float>::max());
+    glm::vec3 max(std::numeric_limits<float>::lowest());
+    for (uint32_t v = 0; v < vertexCount; v++) {
+      const float *p = vertexBuffer.data() + size_t{v} * unpackedStride +
+                       *positionOffset / sizeof(float);
+      min = glm::min(min, glm::vec3(p[0], p[1], p[2]));
+      max = glm::max(max, glm::vec3(p[0], p[1], p[2]));
+    }
+    const glm::vec3 extent = (max - min) * 0.5f;
+    quantization.offset = (min + max) * 0.5f;
+    quantization.scale = std::max({extent.x, extent.y, extent.z});
+    if (quantization.scale <= 0.0f) {
+      quantization.scale = 1.0f;
+    }
+  }
+  for (auto &cluster : clusters) {
+    cluster.center = (cluster.center - quantization.offset) /
+                     quantization.scale;
+    cluster.radius /= quantization.scale;
+  }
+  for (auto &mesh : meshes) {
+    if (!mesh.bounds.IsEmpty()) {
+      mesh.bounds.mini =
+          (mesh.bounds.mini - quantization.offset) / quantization.scale;
+      mesh.bounds.maxi =
+          (mesh.bounds.maxi - quantization.offset) / quantization.scale;
+    }
+  }
 
+  decoded_.vertices.resize(size_t{vertexCount} * stride);
+  const float *src = vertexBuffer.data();
+  uint8_t *dst = decoded_.vertices.data();
+  for (uint32_t v = 0; v < vertexCount; v++) {
+    for (const auto &component : vertexLayout.components) {
+      const uint32_t floatCount =
+          VertexLayout::Size(Unpacked(component)) / sizeof(float);
+      switch (component) {
+      case VertexLayoutComponent::PositionHalf: {
+        const glm::vec3 q =
+            (glm::vec3(src[0], src[1], src[2]) - quantization.offset) /
+            quantization.scale;
+        const uint64_t packed = glm::packHalf4x16(glm::vec4(q, 1.0f));
+        std::memcpy(dst, &packed, sizeof(packed));
+        break;
+      }
+      case VertexLayoutComponent::NormalOct:
+      case VertexLayoutComponent::TangentOct:
+      case VertexLayoutComponent::BitangentOct: {
+        const uint32_t packed = glm::packSnorm2x16(
+            OctEncode(glm::vec3(src[0], src[1], src[2])));
+        std::memcpy(dst, &packed, sizeof(packed));
+        break;
+      }
+      case VertexLayoutComponent::ColorUnorm8: {
+        const uint32_t packed =
+            glm::packUnorm4x8(glm::vec4(src[0], src[1], src[2], 1.0f));
+        std::memcpy(dst, &packed, sizeof(packed));
+        break;
+      }
+      case VertexLayoutComponent::UVHalf: {
+        const uint32_t packed = glm::packHalf2x16(glm::vec2(src[0], src[1]));
+        std::memcpy(dst, &packed, sizeof(packed));
+        break;
+      }
+      default:
+        std::memcpy(dst, src, floatCount * sizeof(float));
+        break;
+      }
+      src += floatCount;
+      dst += VertexLayout::Size(component);
+    }
+  }
+
+  // すべてのインデックスが16bitに収まる場合は、インデックスの帯域も半分にします。
+  indexType = vertexCount < 0x10000 ? VK_INDEX_TYPE_UINT16
+                                    : VK_INDEX_TYPE_UINT32;
+  decoded_.indices.resize(indexBuffer.size() * IndexSize(indexType));
+  if (indexType == VK_INDEX_TYPE_UINT16) {
+    auto *indices16 = reinterpret_cast<uint16_t *>(decoded_.indices.data());
+    for (size_t i = 0; i < indexBuffer.size(); i++) {
+      indices16[i] = static_cast<uint16_t>(indexBuffer[i]);
+    }
+  } else {
+    std::memcpy(decoded_.indices.data(), indexBuffer.data(),
+                decoded_.indices.size());
+  }
+}
+
+/**
+ * @brief キャッシュファイル(アーカイブにあればその項目)をマップし、内容が正しければ頂点とインデックスとして参照します。
+ * @return キャッシュから読み込めたか？
+ */
+bool Model::DecodeFromCache(const std::string &cachePath, uint64_t key,
+                            const VertexLayout &vertexLayout) {
+  auto cache = AssetArchive::Get().Read(cachePath);
+  if (!cache) {
+    return false;
+  }
+
+  MeshCacheHeader header{};
+  if (cache.size < sizeof(header)) {
+    spdlog::warn("Mesh cache {} is corrupted; reimporting.", cachePath);
+    return false;
+  }
+  std::memcpy(&header, cache.data, sizeof(header));
+  const size_t meshesSize = size_t{header.meshCount} * sizeof(Mesh);
+  const size_t clustersSize = size_t{header.clusterCount} * sizeof(Cluster);
+  const auto cacheIndexType = static_cast<VkIndexType>(header.indexType);
+  const size_t indexDataSize =
+      size_t{header.indexCount} * IndexSize(cacheIndexType);
+  if (header.magic != kMeshCacheMagic ||
+      header.version != kMeshCacheVersion || header.key != key ||
+      (cacheIndexType != VK_INDEX_TYPE_UINT16 &&
+       cacheIndexType != VK_INDEX_TYPE_UINT32) ||
+      header.stride != vertexLayout.Stride() ||
+      header.vertexDataSize !=
+          uint64_t{header.vertexCount} * vertexLayout.Stride() ||
+      cache.size != sizeof(header) + meshesSize + clustersSize +
+                           header.vertexDataSize + indexDataSize) {
+    spdlog::warn("Mesh cache {} is corrupted; reimporting.", cachePath);
+    return false;
+  }
+
+  const uint8_t *data = cache.data + sizeof(header);
+  meshes.resize(header.meshCount);
+  std::memcpy(meshes.data(), data, meshesSize);
+  data += meshesSize;
+  clusters.resize(header.clusterCount);
+  std::memcpy(clusters.data(), data, clustersSize);
+  data += clustersSize;
+  vertexCount = header.vertexCount;
+  indexCount = header.indexCount;
+  indexType = cacheIndexType;
+  quantization.offset =
+      glm::vec3(header.quantizationOffset[0], header.quantizationOffset[1],
+                header.quantizationOffset[2]);
+  quantization.scale = header.quantizationScale;
+  dim.min = glm::vec3(header.dimMin[0], header.dimMin[1], header.dimMin[2]);
+  dim.max = glm::vec3(header.dimMax[0], header.dimMax[1], header.dimMax[2]);
+
+  // 転送時にマップしたページからステージングリングへ直接コピーします。
+  decoded_.vertexData = data;
+  decoded_.vertexDataSize = header.vertexDataSize;
+  decoded_.indexData = data + header.vertexDataSize;
+  decoded_.indexDataSize = indexDataSize;
+  decoded_.cache = std::move(cache.owner);
+  return true;
+}
+
+/**
+ * @brief 変換済みの頂点とインデックスをキャッシュファイルに書き込みます。
+ * @note
+ * 一時ファイルに書き込んでから置き換えるため、書き込み中に終了しても壊れたキャッシュは残りません。
+ */
+void Model::SaveToCache(const std::string &cachePath, uint64_t key) const {
+  MeshCacheHeader header{};
+  header.key = key;
+  header.vertexCount = vertexCount;
+  header.indexCount = indexCount;
+  header.meshCount = static_cast<uint32_t>(meshes.size());
+  header.clusterCount = static_cast<uint32_t>(clusters.size());
+  header.stride = vertexCount > 0
+                      ? static_cast<uint32_t>(decoded_.vertices.size() /
+                                              vertexCount)
+                      : 0;
+  header.vertexDataSize = decoded_.vertices.size();
+  header.indexType = indexType;
+  header.quantizationScale = quantization.scale;
+  header.quantizationOffset = {quantization.offset.x, quantization.offset.y,
+                               quantization.offset.z};
+  header.dimMin = {dim.min.x, dim.min.y, dim.min.z};
+  header.dimMax = {dim.max.x, dim.max.y, dim.max.z};
+
+  const std::filesystem::path target(cachePath);
+  std::error_code ec;
+  std::filesystem::create_directories(target.parent_path(), ec);
+  // 同じキャッシュを複数のスレッドが同時に書き込んでも衝突しないようにします。
+  auto temporary = target;
+  temporary += ".tmp" + std::to_string(reinterpret_cast<uintptr_t>(this));
+  {
+    std::ofstream ofs(temporary, std::ios::binary | std::ios::trunc);
+    ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    ofs.write(reinterpret_cast<const char *>(meshes.data()),
+              static_cast<std::streamsize>(meshes.size() * sizeof(Mesh)));
+    ofs.write(reinterpret_cast<const char *>(clusters.data()),
+              static_cast<std::streamsize>(clusters.size() * sizeof(Cluster)));
+    ofs.write(reinterpret_cast<const char *>(decoded_.vertices.data()),
+              static_cast<std::streamsize>(decoded_.vertices.size()));
+    ofs.write(reinterpret_cast<const char *>(decoded_.indices.data()),
+              static_cast<std::streamsize>(decoded_.indices.size()));
+    if (!ofs.flush()) {
+      spdlog::warn("Failed to write mesh cache {}", temporary.string());
+      return;
+    }
+  }
+
+  std::filesystem::rename(temporary, target, ec);
+  if (ec) {
+    spdlog::warn("Failed to replace mesh cache {}: {}", cachePath,
+                 ec.message());
+    std::filesystem::remove(temporary, ec);
+    return;
+  }
+  spdlog::info("Mesh cache written to {}", cachePath);
+}
+
+/**
+ * @brief デバイスのローカルバッファを生成し、Decodeで用意した頂点とインデックスを転送します。
+ * @note 転送を記録した後は、用意したデータを解放します。
+ */
+void Model::Upload(const Device &device, UploadManager &uploader,
+                   const ModelCreateInfo &modelCreateInfo) {
   // デバイスのローカルターゲットバッファを生成します。
   VK_CHECK_RESULT(vertices.Create(
       device,
       VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
       VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | modelCreateInfo.memoryPropertyFlags,
-      vtxBufSize));
+      decoded_.vertexDataSize));
+  // クラスターを選別するコンピュートシェーダーは、インデックスを32bit単位で読みます。
+  VkBufferUsageFlags indexUsageFlags =
+      VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  if (!clusters.empty()) {
+    indexUsageFlags |= VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+  }
   VK_CHECK_RESULT(indices.Create(
-      device,
-      VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      device, indexUsageFlags,
       VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | modelCreateInfo.memoryPropertyFlags,
-      idxBufSize));
-
-  // ステージングバッファからコピーします。
-  VkCommandBuffer copyCmd = device.CreateCommandBuffer();
-  VkBufferCopy copyRegion{};
-
-  copyRegion.size = vtxBufSize;
-  vkCmdCopyBuffer(copyCmd, vertexStaging.buffer, vertices.buffer, 1,
-                  &copyRegion);
-
-  copyRegion.size = idxBufSize;
-  vkCmdCopyBuffer(copyCmd, indexStaging.buffer, indices.buffer, 1, &copyRegion);
+      (decoded_.indexDataSize + 3) & ~VkDeviceSize{3}));
 
-  device.FlushCommandBuffer(copyCmd, copyQueue);
-
-  // ステージングリソースを解放します。
-  indexStaging.Destroy(device);
-  vertexStaging.Destroy(device);
-
-  return true;
+  // ステージングリングを経由して、頂点バッファとインデックスバッファをデバイスのローカルメモリに転送します。
+  uploader.UploadBuffer(device, vertices.buffer, decoded_.vertexData,
+                        decoded_.vertexDataSize);
+  uploader.UploadBuffer(device, indices.buffer, decoded_.indexData,
+                        decoded_.indexDataSize);
+  if (!clusters.empty()) {
+    const VkDeviceSize clustersSize = clusters.size() * sizeof(Cluster);
+    VK_CHECK_RESULT(clusterBuffer.Create(
+        device,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT |
+            modelCreateInfo.memoryPropertyFlags,
+        clustersSize));
+    uploader.UploadBuffer(device, clusterBuffer.buffer, clusters.data(),
+                          clustersSize);
+  }
+  decoded_ = {};
 }
 
 void Model::Destroy(const Device &device) const {
+  clusterBuffer.Destroy(device);
   indices.Destroy(device);
   vertices.Destroy(device);
 }
@@ -13,13 +13,20 @@
 #include <assimp/postprocess.h>
 
 #include <map>
+#include <memory>
 #include <string>
+#include <type_traits>
 #include <vector>
 #include <optional>
 
 #include "VK/Buffer.h"
 #include "VK/Device.h"
 
+#include "Geometry/AABB.h"
+
+struct AssetData;
+class UploadManager;
+
 enum struct VertexLayoutComponent {
   Position = 0x00,
   Normal = 0x01,
@@ -29,6 +36,16 @@ enum struct VertexLayoutComponent {
   Bitangent = 0x05,
   DummyFloat = 0x06,
   DummyVec4 = 0x07,
+  /** @brief 半精度の位置(Model::DequantizeMatrixで元の座標に戻します。) */
+  PositionHalf = 0x08,
+  /** @brief 八面体に写像した16bitの法線(シェーダーで復号します。) */
+  NormalOct = 0x09,
+  TangentOct = 0x0a,
+  BitangentOct = 0x0b,
+  /** @brief 8bitの正規化された色 */
+  ColorUnorm8 = 0x0c,
+  /** @brief 半精度のテクスチャ座標 */
+  UVHalf = 0x0d,
 };
 
 /**
@@ -39,20 +56,81 @@ struct VertexLayout {
       std::vector<VertexLayoutComponent> &&vertexLayoutComponents)
       : components(std::move(vertexLayoutComponents)) {}
 
-  [[nodiscard]] uint32_t Stride() const {
+  [[nodiscard]] static uint32_t Size(VertexLayoutComponent component) {
     static const std::map<VertexLayoutComponent, uint32_t> c2s = {
         {VertexLayoutComponent::UV, 2 * sizeof(float)},
         {VertexLayoutComponent::DummyFloat, sizeof(float)},
         {VertexLayoutComponent::DummyVec4, 4 * sizeof(float)},
+        {VertexLayoutComponent::PositionHalf, 4 * sizeof(uint16_t)},
+        {VertexLayoutComponent::NormalOct, 2 * sizeof(int16_t)},
+        {VertexLayoutComponent::TangentOct, 2 * sizeof(int16_t)},
+        {VertexLayoutComponent::BitangentOct, 2 * sizeof(int16_t)},
+        {VertexLayoutComponent::ColorUnorm8, 4 * sizeof(uint8_t)},
+        {VertexLayoutComponent::UVHalf, 2 * sizeof(uint16_t)},
     };
 
+    if (c2s.contains(component)) {
+      return c2s.at(component);
+    }
+    return 3 * sizeof(float);
+  }
+
+  [[nodiscard]] static VkFormat Format(VertexLayoutComponent component) {
+    static const std::map<VertexLayoutComponent, VkFormat> c2f = {
+        {VertexLayoutComponent::UV, VK_FORMAT_R32G32_SFLOAT},
+        {VertexLayoutComponent::DummyFloat, VK_FORMAT_R32_SFLOAT},
+        {VertexLayoutComponent::DummyVec4, VK_FORMAT_R32G32B32A32_SFLOAT},
+        {VertexLayoutComponent::PositionHalf, VK_FORMAT_R16G16B16A16_SFLOAT},
+        {VertexLayoutComponent::NormalOct, VK_FORMAT_R16G16_SNORM},
+        {VertexLayoutComponent::TangentOct, VK_FORMAT_R16G16_SNORM},
+        {VertexLayoutComponent::BitangentOct, VK_FORMAT_R16G16_SNORM},
+        {VertexLayoutComponent::ColorUnorm8, VK_FORMAT_R8G8B8A8_UNORM},
+        {VertexLayoutComponent::UVHalf, VK_FORMAT_R16G16_SFLOAT},
+    };
+
+    if (c2f.contains(component)) {
+      return c2f.at(component);
+    }
+    return VK_FORMAT_R32G32B32_SFLOAT;
+  }
+
+  [[nodiscard]] uint32_t Stride() const {
     uint32_t res = 0;
     for (const auto &component : components) {
-      if (c2s.contains(component)) {
-        res += c2s.at(component);
-      } else {
-        res += 3 * sizeof(float);
+      res += Size(component);
+    }
+    return res;
+  }
+
+  /**
+   * @brief 頂点の先頭からコンポーネントまでのバイト数を返します。
+   * @return オフセット(レイアウトに含まれない場合はnullopt)
+   */
+  [[nodiscard]] std::optional<uint32_t>
+  Offset(VertexLayoutComponent component) const {
+    uint32_t res = 0;
+    for (const auto &c : components) {
+      if (c == component) {
+        return res;
       }
+      res += Size(c);
+    }
+    return std::nullopt;
+  }
+
+  /**
+   * @brief レイアウトに一致する頂点入力属性を生成します。
+   * @param binding 頂点バッファのバインディング番号
+   * @note シェーダーのlocationはコンポーネントの順番です。
+   */
+  [[nodiscard]] std::vector<VkVertexInputAttributeDescription>
+  Attributes(uint32_t binding) const {
+    std::vector<VkVertexInputAttributeDescription> res;
+    uint32_t offset = 0;
+    for (const auto &component : components) {
+      res.push_back({static_cast<uint32_t>(res.size()), binding,
+                     Format(component), offset});
+      offset += Size(component);
     }
     return res;
   }
@@ -65,18 +143,55 @@ struct ModelCreateInfo {
   glm::vec2 uvscale = glm::vec2(1.0f);
   std::optional<glm::vec3> color = std::nullopt;
   VkMemoryPropertyFlags memoryPropertyFlags = 0;
+  /** @brief 変換済みの頂点とインデックスを保存するディレクトリ(空の場合はキャッシュしません。) */
+  std::string cacheDirectory = "./MeshCache";
+  /**
+   * @brief 読み込んだ後に頂点の重複を取り除き、頂点キャッシュ、オーバードロー、頂点フェッチのために並べ替えるか
+   * @note 最適化した結果もキャッシュするため、変換の時間がかかるのは初回のみです。
+   */
+  bool optimize = false;
+  /** @brief オーバードローの最適化で許容するACMRの悪化の割合(1.05は5%) */
+  float overdrawThreshold = 1.05f;
+  /**
+   * @brief 三角形をクラスターに分け、GPUでカリングするための境界を求めるか
+   * @note インデックスはクラスターごとに連続するように並べ替えます。
+   */
+  bool clusters = false;
 };
 
 struct Model {
   bool LoadFromFile(const Device &device, const std::string &filepath,
-                    VkQueue copyQueue, const VertexLayout &vertexLayout,
+                    UploadManager &uploader, const VertexLayout &vertexLayout,
                     const ModelCreateInfo &modelCreateInfo = {});
+  bool Decode(const std::string &filepath, const VertexLayout &vertexLayout,
+              const ModelCreateInfo &modelCreateInfo = {});
+  void Upload(const Device &device, UploadManager &uploader,
+              const ModelCreateInfo &modelCreateInfo = {});
   void Destroy(const Device &device) const;
 
   Buffer vertices{};
   uint32_t vertexCount = 0;
   Buffer indices{};
   uint32_t indexCount = 0;
+  /** @brief 頂点が65536個未満の場合は16bitのインデックスを使います。 */
+  VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+  /**
+   * @brief 半精度の位置を元の座標に戻す変換(位置 = offset + scale * 頂点の位置)
+   * @note レイアウトにPositionHalfを含まない場合は恒等変換です。
+   */
+  struct Quantization {
+    glm::vec3 offset = glm::vec3(0.0f);
+    float scale = 1.0f;
+  } quantization;
+
+  /**
+   * @brief 量子化した位置を元の座標に戻す行列を返します。(モデル行列に右から掛けます。)
+   * @note 一様なスケールなので、法線は正規化すればモデル行列でそのまま変換できます。
+   */
+  [[nodiscard]] glm::mat4 DequantizeMatrix() const {
+    return glm::scale(glm::translate(glm::mat4(1.0f), quantization.offset),
+                      glm::vec3(quantization.scale));
+  }
   /**
    * @brief モデルの各部分の頂点とインデックスのベースとカウントを格納します。
    */
@@ -85,11 +200,68 @@ struct Model {
     uint32_t vertexCount = 0;
     uint32_t indexBase = 0;
     uint32_t indexCount = 0;
+    /** @brief 量子化した頂点と同じ空間のバウンディングボックス(モデル行列で変換して視錐台と判定します。) */
+    AABB bounds{};
   };
+  static_assert(std::is_trivially_copyable_v<Mesh>,
+                "Mesh is written to the mesh cache as is");
   std::vector<Mesh> meshes{};
 
+  /**
+   * @brief GPUでカリングする三角形の塊(シェーダーからstd430のストレージバッファとして読みます。)
+   * @note
+   * 境界は量子化した頂点と同じ空間で表し、インデックスはモデル全体のインデックスバッファを指します。
+   */
+  struct Cluster {
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = 0.0f;
+    glm::vec3 coneAxis = glm::vec3(0.0f);
+    /** @brief 裏向きの判定に使うsin(法線の円錐の開き角)(1の場合は判定しません。) */
+    float coneCutoff = 1.0f;
+    uint32_t firstIndex = 0;
+    uint32_t indexCount = 0;
+    uint32_t padding[2] = {};
+  };
+  static_assert(sizeof(Cluster) == 48, "Cluster must match the std430 layout");
+  std::vector<Cluster> clusters{};
+  /** @brief clustersを転送したストレージバッファ(クラスターが無い場合は生成しません。) */
+  Buffer clusterBuffer{};
+
   struct Dimension {
     glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
     glm::vec3 max = glm::vec3(std::numeric_limits<float>::lowest());
   } dim;
+
+private:
+  bool Import(const std::string &filepath, const AssetData &source,
+              const VertexLayout &vertexLayout,
+              const ModelCreateInfo &modelCreateInfo,
+              std::vector<float> &vertexBuffer,
+              std::vector<uint32_t> &indexBuffer);
+  void Optimize(const std::string &filepath, const VertexLayout &vertexLayout,
+                const ModelCreateInfo &modelCreateInfo,
+                std::vector<float> &vertexBuffer,
+                std::vector<uint32_t> &indexBuffer);
+  void BuildClusters(const std::string &filepath,
+                     const VertexLayout &vertexLayout,
+                     const std::vector<float> &vertexBuffer,
+                     std::vector<uint32_t> &indexBuffer);
+  void Pack(const VertexLayout &vertexLayout,
+            const std::vector<float> &vertexBuffer,
+            const std::vector<uint32_t> &indexBuffer);
+  bool DecodeFromCache(const std::string &cachePath, uint64_t key,
+                       const VertexLayout &vertexLayout);
+  void SaveToCache(const std::string &cachePath, uint64_t key) const;
+
+  /** @brief Decodeで用意し、Uploadで転送するまでの頂点とインデックス */
+  struct Decoded {
+    std::vector<uint8_t> vertices{};
+    std::vector<uint8_t> indices{};
+    /** @brief キャッシュから読み込んだ場合は、データはこのマップ(アーカイブ、またはファイル)を指します。 */
+    std::shared_ptr<const void> cache{};
+    const void *vertexData = nullptr;
+    VkDeviceSize vertexDataSize = 0;
+    const void *indexData = nullptr;
+    VkDeviceSize indexDataSize = 0;
+  } decoded_;
 };
@@ -0,0 +1,159 @@
+/**
+ * @brief パイプラインキャッシュのデータをファイルに保存し、次回の起動時に再利用します。
+ */
+
+#include "VK/PipelineCache.h"
+
+#include <array>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <spdlog/spdlog.h>
+
+#include "VK/Common.h"
+#include "VK/Device.h"
+
+/** @brief キャッシュファイルのマジックナンバー("RVPC") */
+static constexpr uint32_t kPipelineCacheMagic = 0x43505652;
+static constexpr uint32_t kPipelineCacheFileVersion = 1;
+
+/**
+ * @brief キャッシュファイルの先頭に置くヘッダ
+ * @note
+ * Vulkanのキャッシュヘッダにはドライバのバージョンが含まれないため、独自のヘッダで検証します。
+ */
+struct PipelineCacheFileHeader {
+  uint32_t magic = kPipelineCacheMagic;
+  uint32_t version = kPipelineCacheFileVersion;
+  uint32_t vendorID = 0;
+  uint32_t deviceID = 0;
+  uint32_t driverVersion = 0;
+  std::array<uint8_t, VK_UUID_SIZE> pipelineCacheUUID{};
+  uint64_t dataSize = 0;
+};
+
+static PipelineCacheFileHeader MakeHeader(const Device &device,
+                                          uint64_t dataSize) {
+  PipelineCacheFileHeader header{};
+  header.vendorID = device.properties.vendorID;
+  header.deviceID = device.properties.deviceID;
+  header.driverVersion = device.properties.driverVersion;
+  std::memcpy(header.pipelineCacheUUID.data(),
+              device.properties.pipelineCacheUUID, VK_UUID_SIZE);
+  header.dataSize = dataSize;
+  return header;
+}
+
+/**
+ * @brief vkGetPipelineCacheDataが返すヘッダ(VK_PIPELINE_CACHE_HEADER_VERSION_ONE)を検証します。
+ */
+static bool IsCompatibleCacheData(const Device &device,
+                                  const std::vector<char> &data) {
+  constexpr size_t kHeaderSize = sizeof(uint32_t) * 4 + VK_UUID_SIZE;
+  if (data.size() < kHeaderSize) {
+    return false;
+  }
+  std::array<uint32_t, 4> fields{};
+  std::memcpy(fields.data(), data.data(), sizeof(fields));
+  const auto &[headerSize, headerVersion, vendorID, deviceID] = fields;
+  return headerSize >= kHeaderSize && headerSize <= data.size() &&
+         headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+         vendorID == device.properties.vendorID &&
+         deviceID == device.properties.deviceID &&
+         std::memcmp(data.data() + sizeof(fields),
+                     device.properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+/**
+ * @brief キャッシュファイルを読み込み、現在のデバイスとドライバで使用できるデータを返します。
+ * @param device デバイスオブジェクト
+ * @param path キャッシュファイルのパス
+ * @return キャッシュデータ(ファイルが無い、または互換性がない場合は空です。)
+ */
+std::vector<char> LoadPipelineCacheData(const Device &device,
+                                        const std::string &path) {
+  std::ifstream ifs(path, std::ios::binary | std::ios::ate);
+  if (!ifs) {
+    return {};
+  }
+  const auto fileSize = static_cast<uint64_t>(ifs.tellg());
+  ifs.seekg(0);
+
+  PipelineCacheFileHeader header{};
+  ifs.read(reinterpret_cast<char *>(&header), sizeof(header));
+  const auto expected = MakeHeader(device, header.dataSize);
+  if (!ifs || header.magic != expected.magic ||
+      header.version != expected.version ||
+      header.vendorID != expected.vendorID ||
+      header.deviceID != expected.deviceID ||
+      header.driverVersion != expected.driverVersion ||
+      header.pipelineCacheUUID != expected.pipelineCacheUUID) {
+    spdlog::info("Pipeline cache {} is stale; rebuilding.", path);
+    return {};
+  }
+
+  // 壊れたヘッダのサイズで確保しないように、ファイルの残りのサイズと一致することを先に確認します。
+  if (header.dataSize != fileSize - sizeof(header)) {
+    spdlog::warn("Pipeline cache {} is corrupted; rebuilding.", path);
+    return {};
+  }
+
+  std::vector<char> data(header.dataSize);
+  ifs.read(data.data(), static_cast<std::streamsize>(data.size()));
+  if (!ifs || !IsCompatibleCacheData(device, data)) {
+    spdlog::warn("Pipeline cache {} is corrupted; rebuilding.", path);
+    return {};
+  }
+  return data;
+}
+
+/**
+ * @brief パイプラインキャッシュのデータをファイルに書き込みます。
+ * @note
+ * 一時ファイルに書き込んでから置き換えるため、書き込み中に終了しても既存のキャッシュが壊れることはありません。
+ * @param device デバイスオブジェクト
+ * @param pipelineCache 保存するパイプラインキャッシュ
+ * @param path キャッシュファイルのパス
+ */
+void SavePipelineCacheData(const Device &device, VkPipelineCache pipelineCache,
+                           const std::string &path) {
+  size_t size = 0;
+  VK_CHECK_RESULT(
+      vkGetPipelineCacheData(device, pipelineCache, &size, nullptr));
+  std::vector<char> data(size);
+  VK_CHECK_RESULT(
+      vkGetPipelineCacheData(device, pipelineCache, &size, data.data()));
+  data.resize(size);
+  if (!IsCompatibleCacheData(device, data)) {
+    spdlog::warn("Driver returned an unexpected pipeline cache header; "
+                 "the cache is not saved.");
+    return;
+  }
+
+  const std::filesystem::path target(path);
+  if (target.has_parent_path()) {
+    std::filesystem::create_directories(target.parent_path());
+  }
+  auto temporary = target;
+  temporary += ".tmp";
+  {
+    const auto header = MakeHeader(device, data.size());
+    std::ofstream ofs(temporary, std::ios::binary | std::ios::trunc);
+    ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    ofs.write(data.data(), static_cast<std::streamsize>(data.size()));
+    if (!ofs.flush()) {
+      spdlog::warn("Failed to write pipeline cache {}", temporary.string());
+      return;
+    }
+  }
+
+  std::error_code ec;
+  std::filesystem::rename(temporary, target, ec);
+  if (ec) {
+    spdlog::warn("Failed to replace pipeline cache {}: {}", path,
+                 ec.message());
+    std::filesystem::remove(temporary, ec);
+    return;
+  }
+  spdlog::info("Pipeline cache written to {} ({} bytes)", path, data.size());
+}
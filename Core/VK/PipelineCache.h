@@ -0,0 +1,17 @@
+/**
+ * @brief パイプラインキャッシュのデータをファイルに保存し、次回の起動時に再利用します。
+ */
+
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <string>
+#include <vector>
+
+struct Device;
+
+[[nodiscard]] std::vector<char> LoadPipelineCacheData(const Device &device,
+                                                      const std::string &path);
+void SavePipelineCacheData(const Device &device, VkPipelineCache pipelineCache,
+                           const std::string &path);
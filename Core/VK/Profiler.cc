@@ -0,0 +1,264 @@
+/**
+ * @brief タイムスタンプクエリを用いてパスごとのGPU時間を計測します。
+ */
+
+#include "VK/Profiler.h"
+
+#include <algorithm>
+#include <boost/assert.hpp>
+#include <filesystem>
+#include <fstream>
+#include <spdlog/spdlog.h>
+
+#include "VK/Common.h"
+#include "VK/Device.h"
+#include "VK/Gui.h"
+#include "VK/Initializer.h"
+
+//*-----------------------------------------------------------------------------
+// Init & Deinit
+//*-----------------------------------------------------------------------------
+
+/**
+ * @brief シーン設定の"Profiler"からパラメータを読み込み、クエリプールを生成します。
+ * @param device デバイスオブジェクト
+ * @param config シーン設定
+ * @param poolCount クエリプールの数(記録するコマンドバッファの数)
+ */
+void Profiler::Init(const Device &device, const nlohmann::json &config,
+                    uint32_t poolCount) {
+  if (config.contains("Profiler")) {
+    const auto &profiler = config["Profiler"];
+    maxScopes = profiler.value("MaxScopes", maxScopes);
+    window = profiler.value("Window", window);
+    historyLength = profiler.value("HistoryLength", historyLength);
+    output = profiler.value("Output", output);
+  }
+  BOOST_ASSERT_MSG(maxScopes > 0, "Profiler MaxScopes must be positive!");
+  BOOST_ASSERT_MSG(window > 0, "Profiler Window must be positive!");
+
+  const auto &queueFamily =
+      device.queueFamilyProperties[device.queueFamilyIndices.graphics];
+  if (queueFamily.timestampValidBits == 0) {
+    spdlog::warn("Timestamp queries are not supported on the graphics queue; "
+                 "the GPU profiler is disabled.");
+    return;
+  }
+  timestampMask = queueFamily.timestampValidBits >= 64
+                      ? ~0ull
+                      : (1ull << queueFamily.timestampValidBits) - 1;
+  timestampPeriod =
+      static_cast<double>(device.properties.limits.timestampPeriod);
+
+  CreateQueryPools(device, poolCount);
+}
+
+void Profiler::Destroy(const Device &device) {
+  DestroyQueryPools(device);
+}
+
+/**
+ * @brief クエリプールの数を変更します。
+ * @note
+ * スワップチェーンの再生成でイメージ数が変わった場合に呼び出します。デバイスがアイドル状態である必要があります。
+ */
+void Profiler::Resize(const Device &device, uint32_t poolCount) {
+  if (!IsEnabled() || queryPools.size() == poolCount) {
+    return;
+  }
+  DestroyQueryPools(device);
+  CreateQueryPools(device, poolCount);
+}
+
+void Profiler::CreateQueryPools(const Device &device, uint32_t poolCount) {
+  VkQueryPoolCreateInfo queryPoolCreateInfo = Initializer::QueryPoolCreateInfo(
+      VK_QUERY_TYPE_TIMESTAMP, maxScopes * 2);
+  queryPools.resize(poolCount);
+  for (auto &queryPool : queryPools) {
+    VK_CHECK_RESULT(
+        vkCreateQueryPool(device, &queryPoolCreateInfo, nullptr, &queryPool));
+  }
+  recordedScopes.assign(poolCount, {});
+}
+
+void Profiler::DestroyQueryPools(const Device &device) {
+  for (auto &queryPool : queryPools) {
+    vkDestroyQueryPool(device, queryPool, nullptr);
+  }
+  queryPools.clear();
+  recordedScopes.clear();
+}
+
+//*-----------------------------------------------------------------------------
+// Record
+//*-----------------------------------------------------------------------------
+
+/**
+ * @brief クエリプールをリセットします。
+ * @note コマンドバッファの先頭(レンダーパスの外)で呼び出してください。
+ * @param commandBuffer 記録中のコマンドバッファ
+ * @param pool クエリプールのインデックス
+ */
+void Profiler::Reset(VkCommandBuffer commandBuffer, uint32_t pool) {
+  if (!IsEnabled()) {
+    return;
+  }
+  vkCmdResetQueryPool(commandBuffer, queryPools[pool], 0, maxScopes * 2);
+  recordedScopes[pool].clear();
+}
+
+/**
+ * @brief スコープの開始タイムスタンプを書き込みます。
+ * @param commandBuffer 記録中のコマンドバッファ
+ * @param pool クエリプールのインデックス
+ * @param name スコープ名(同じ名前のスコープは同じ項目として集計します。)
+ * @return Endに渡すクエリのインデックス
+ * @note プロファイラが無効な場合は何も記録しません。(End も同様です。)
+ */
+uint32_t Profiler::Begin(VkCommandBuffer commandBuffer, uint32_t pool,
+                         const std::string &name) {
+  if (!IsEnabled()) {
+    return 0;
+  }
+  auto &scopes = recordedScopes[pool];
+  BOOST_ASSERT_MSG(scopes.size() < maxScopes, "Too many profiler scopes!");
+
+  const auto it = std::find(names.begin(), names.end(), name);
+  const auto id = static_cast<uint32_t>(std::distance(names.begin(), it));
+  if (it == names.end()) {
+    names.emplace_back(name);
+    averages.emplace_back(0.0f);
+    rolling.push_back({std::vector<float>(window, 0.0f), 0, 0.0f});
+  }
+
+  const auto query = static_cast<uint32_t>(scopes.size()) * 2;
+  scopes.emplace_back(id);
+  vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                      queryPools[pool], query);
+  return query;
+}
+
+/**
+ * @brief スコープの終了タイムスタンプを書き込みます。
+ * @param commandBuffer 記録中のコマンドバッファ
+ * @param pool クエリプールのインデックス
+ * @param query Beginが返したクエリのインデックス
+ */
+void Profiler::End(VkCommandBuffer commandBuffer, uint32_t pool,
+                   uint32_t query) {
+  if (!IsEnabled()) {
+    return;
+  }
+  vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                      queryPools[pool], query + 1);
+}
+
+//*-----------------------------------------------------------------------------
+// Readback
+//*-----------------------------------------------------------------------------
+
+/**
+ * @brief 前回の送信で書き込まれたタイムスタンプを読み戻して集計します。
+ * @note
+ * コマンドバッファの完了を待機した後に呼び出します。結果がまだ利用できない場合はGPUを待たずにスキップします。
+ * @param device デバイスオブジェクト
+ * @param pool クエリプールのインデックス
+ */
+void Profiler::Collect(const Device &device, uint32_t pool) {
+  if (!IsEnabled() || recordedScopes[pool].empty()) {
+    return;
+  }
+
+  const auto &scopes = recordedScopes[pool];
+  std::vector<uint64_t> timestamps(scopes.size() * 2);
+  const VkResult result = vkGetQueryPoolResults(
+      device, queryPools[pool], 0, static_cast<uint32_t>(timestamps.size()),
+      timestamps.size() * sizeof(uint64_t), timestamps.data(),
+      sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+  if (result == VK_NOT_READY) {
+    return;
+  }
+  VK_CHECK_RESULT(result);
+
+  nlohmann::json passes = nlohmann::json::object();
+  for (size_t i = 0; i < scopes.size(); i++) {
+    const uint64_t ticks =
+        (timestamps[i * 2 + 1] - timestamps[i * 2]) & timestampMask;
+    const auto ms =
+        static_cast<float>(static_cast<double>(ticks) * timestampPeriod /
+                           1000000.0);
+
+    auto &r = rolling[scopes[i]];
+    r.sum += ms - r.samples[r.next];
+    r.samples[r.next] = ms;
+    r.next = (r.next + 1) % r.samples.size();
+    passes[names[scopes[i]]] = ms;
+  }
+
+  // 表示する値が毎フレーム変わらないように、移動平均はwindowフレームごとに更新します。
+  frameIndex++;
+  if (frameIndex % window == 0) {
+    for (size_t i = 0; i < rolling.size(); i++) {
+      averages[i] = rolling[i].sum / static_cast<float>(window);
+    }
+  }
+
+  // 出力する結果はhistoryLengthフレームに限ります。(移動平均のwindowとは独立しています。)
+  if (!output.empty()) {
+    if (historyLength > 0 && history.size() >= historyLength) {
+      history.pop_front();
+    }
+    history.push_back({{"Frame", frameIndex}, {"Passes", passes}});
+  }
+}
+
+//*-----------------------------------------------------------------------------
+// Report
+//*-----------------------------------------------------------------------------
+
+/**
+ * @brief パスごとのGPU時間の移動平均を棒グラフで表示します。
+ */
+void Profiler::OnUpdateUIOverlay(Gui &gui) const {
+  if (!IsEnabled() || names.empty()) {
+    return;
+  }
+  if (gui.Header("GPU Profiler")) {
+    gui.BarChart(names, averages, "ms");
+  }
+}
+
+/**
+ * @brief 計測したフレーム(historyLengthが0でない場合は直近のhistoryLengthフレーム)の結果をJSONとして出力します。
+ */
+void Profiler::WriteJson() const {
+  if (output.empty() || history.empty()) {
+    return;
+  }
+
+  nlohmann::json report;
+  report["Window"] = window;
+  report["HistoryLength"] = historyLength;
+  report["Frames"] = history;
+
+  const std::filesystem::path path(output);
+  if (path.has_parent_path()) {
+    std::filesystem::create_directories(path.parent_path());
+  }
+  std::ofstream ofs(path);
+  BOOST_ASSERT_MSG(ofs, "Failed to open profiler output!");
+  ofs << report.dump(4) << std::endl;
+
+  spdlog::info("Profiler results written to {}", output);
+}
+
+//*-----------------------------------------------------------------------------
+// ProfileScope
+//*-----------------------------------------------------------------------------
+
+ProfileScope::ProfileScope(Profiler &profiler, VkCommandBuffer commandBuffer,
+                           uint32_t pool, const std::string &name)
+    : profiler_(profiler), commandBuffer_(commandBuffer), pool_(pool),
+      query_(profiler.Begin(commandBuffer, pool, name)) {}
+
+ProfileScope::~ProfileScope() { profiler_.End(commandBuffer_, pool_, query_); }
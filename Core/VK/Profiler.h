@@ -0,0 +1,85 @@
+/**
+ * @brief タイムスタンプクエリを用いてパスごとのGPU時間を計測します。
+ */
+
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <boost/noncopyable.hpp>
+#include <deque>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+struct Device;
+struct Gui;
+
+struct Profiler {
+  void Init(const Device &device, const nlohmann::json &config,
+            uint32_t poolCount);
+  void Destroy(const Device &device);
+  void Resize(const Device &device, uint32_t poolCount);
+
+  void Reset(VkCommandBuffer commandBuffer, uint32_t pool);
+  [[nodiscard]] uint32_t Begin(VkCommandBuffer commandBuffer, uint32_t pool,
+                               const std::string &name);
+  void End(VkCommandBuffer commandBuffer, uint32_t pool, uint32_t query);
+  void Collect(const Device &device, uint32_t pool);
+
+  void OnUpdateUIOverlay(Gui &gui) const;
+  void WriteJson() const;
+
+  [[nodiscard]] bool IsEnabled() const { return !queryPools.empty(); }
+
+  /** @brief 1つのコマンドバッファに記録できるスコープの最大数 */
+  uint32_t maxScopes = 32;
+  /** @brief 移動平均を求めるフレーム数 */
+  uint32_t window = 60;
+  /** @brief 出力するフレーム数(0の場合は計測したすべてのフレームを出力します。) */
+  uint32_t historyLength = 0;
+  /** @brief フレームごとの計測結果の出力先(空の場合は出力しません。) */
+  std::string output{};
+
+  /** @brief コマンドバッファ(スワップチェーンイメージ)ごとのクエリプール */
+  std::vector<VkQueryPool> queryPools{};
+  /** @brief プールごとに記録されたスコープのID(クエリの順) */
+  std::vector<std::vector<uint32_t>> recordedScopes{};
+
+  /** @brief スコープ名(IDはこの配列のインデックス) */
+  std::vector<std::string> names{};
+  /** @brief 表示用の移動平均(ミリ秒、windowフレームごとに更新します。) */
+  std::vector<float> averages{};
+
+private:
+  void CreateQueryPools(const Device &device, uint32_t poolCount);
+  void DestroyQueryPools(const Device &device);
+
+  struct RollingWindow {
+    std::vector<float> samples{};
+    size_t next = 0;
+    float sum = 0.0f;
+  };
+  std::vector<RollingWindow> rolling{};
+  /** @brief 出力するフレームごとの計測結果 */
+  std::deque<nlohmann::json> history{};
+  uint64_t frameIndex = 0;
+  double timestampPeriod = 1.0;
+  uint64_t timestampMask = ~0ull;
+};
+
+/**
+ * @brief スコープの開始と終了でタイムスタンプを書き込みます。
+ */
+class ProfileScope : private boost::noncopyable {
+public:
+  ProfileScope(Profiler &profiler, VkCommandBuffer commandBuffer,
+               uint32_t pool, const std::string &name);
+  ~ProfileScope();
+
+private:
+  Profiler &profiler_;
+  VkCommandBuffer commandBuffer_;
+  uint32_t pool_;
+  uint32_t query_ = 0;
+};
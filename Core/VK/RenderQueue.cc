@@ -0,0 +1,321 @@
+/**
+ * @brief 描画をソートキーで並べ替え、重複する状態の変更を省いて記録します。
+ */
+
+#include "VK/RenderQueue.h"
+
+#include <algorithm>
+#include <boost/assert.hpp>
+#include <cmath>
+#include <cstring>
+
+#include "VK/Model.h"
+
+/** @brief キーの各フィールドのビット数(上位から) */
+static constexpr uint32_t kPassBits = 4;
+static constexpr uint32_t kPipelineBits = 12;
+static constexpr uint32_t kMaterialBits = 16;
+static constexpr uint32_t kMeshBits = 16;
+static constexpr uint32_t kDepthBits = 16;
+static_assert(kPassBits + kPipelineBits + kMaterialBits + kMeshBits +
+                      kDepthBits ==
+                  64,
+              "Sort key must fill 64 bits!");
+
+/**
+ * @brief ハンドルを整数として取り出します。
+ * @note 非ディスパッチャブルなハンドルは32bit環境ではuint64_tです。
+ */
+template <typename T> static uint64_t HandleValue(T handle) {
+  uint64_t value = 0;
+  std::memcpy(&value, &handle, sizeof(handle));
+  return value;
+}
+
+static uint64_t HashCombine(uint64_t seed, uint64_t value) {
+  return seed ^ (value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2));
+}
+
+/**
+ * @brief モデル全体を描画するメッシュを返します。
+ */
+RenderQueue::Mesh RenderQueue::MeshOf(const Model &model) {
+  Mesh mesh{};
+  mesh.vertexBuffer = model.vertices.buffer;
+  mesh.indexBuffer = model.indices.buffer;
+  mesh.indexType = model.indexType;
+  mesh.indexCount = model.indexCount;
+  return mesh;
+}
+
+void RenderQueue::Clear() {
+  entries_.clear();
+  pushData_.clear();
+}
+
+/**
+ * @brief 描画項目と、キーに詰める番号をすべて破棄します。
+ * @note
+ * Clearは番号を保つため、作り直したパイプラインや記述子セットの番号が増え続けます。<br>
+ * リサイズなどでハンドルが変わる場合は、キューを作り直す前にこちらを呼び出してください。
+ */
+void RenderQueue::Reset() {
+  Clear();
+  pipelineIds_.clear();
+  materialIds_.clear();
+  meshIds_.clear();
+}
+
+/**
+ * @brief 描画項目を加えます。
+ * @note プッシュ定数はキューにコピーするため、呼び出し後に破棄して構いません。
+ */
+void RenderQueue::Push(const DrawItem &item) {
+  BOOST_ASSERT_MSG(item.mesh.indexBuffer != VK_NULL_HANDLE,
+                   "Render queue only records indexed draws!");
+  Entry entry{};
+  entry.key = MakeKey(item);
+  entry.item = item;
+  entry.item.pushConstants = nullptr;
+  entry.pushOffset = pushData_.size();
+  if (item.pushConstantsSize > 0) {
+    const auto *bytes = static_cast<const uint8_t *>(item.pushConstants);
+    pushData_.insert(pushData_.end(), bytes, bytes + item.pushConstantsSize);
+  }
+  entries_.emplace_back(entry);
+}
+
+/**
+ * @brief キーの順に並べ替えます。(キーが等しい描画は加えた順を保ちます。)
+ */
+void RenderQueue::Sort() {
+  std::stable_sort(
+      entries_.begin(), entries_.end(),
+      [](const Entry &a, const Entry &b) { return a.key < b.key; });
+}
+
+/**
+ * @brief 並べ替えた描画の[first, first + count)を記録します。
+ * @param commandBuffer 記録するコマンドバッファ(ビューポートとシザーは設定済みであること)
+ * @param partition パーティション(メッシュのpartitionStrideに掛けます。)
+ * @param dynamicOffsets 記述子セットに渡す動的オフセット(先頭から各項目のdynamicOffsetCount個を使います。)
+ * @note
+ * 直前の描画と同じパイプライン、記述子セット、頂点バッファ、インデックスバッファ、プッシュ定数は設定しません。
+ */
+void RenderQueue::Record(VkCommandBuffer commandBuffer, uint32_t partition,
+                         uint32_t first, uint32_t count,
+                         const std::vector<uint32_t> &dynamicOffsets) const {
+  BOOST_ASSERT_MSG(first + count <= entries_.size(),
+                   "Render queue range is out of bounds!");
+  Stats stats{};
+  uint32_t naive = 0;
+
+  VkPipeline pipeline = VK_NULL_HANDLE;
+  VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+  VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+  VkBuffer vertexBuffer = VK_NULL_HANDLE;
+  VkBuffer indexBuffer = VK_NULL_HANDLE;
+  VkDeviceSize indexOffset = 0;
+  VkIndexType indexType = VK_INDEX_TYPE_MAX_ENUM;
+  const Entry *pushed = nullptr;
+
+  for (uint32_t i = first; i < first + count; i++) {
+    const Entry &entry = entries_[i];
+    const DrawItem &item = entry.item;
+    const Mesh &mesh = item.mesh;
+    naive += 3 + (item.descriptorSet != VK_NULL_HANDLE ? 1 : 0) +
+             (item.pushConstantsSize > 0 ? 1 : 0);
+
+    if (item.pipeline != pipeline) {
+      vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                        item.pipeline);
+      pipeline = item.pipeline;
+      stats.pipelineBinds++;
+    }
+    // レイアウトが変わると記述子セットとプッシュ定数が引き継がれないため、設定し直します。
+    if (item.pipelineLayout != pipelineLayout) {
+      pipelineLayout = item.pipelineLayout;
+      descriptorSet = VK_NULL_HANDLE;
+      pushed = nullptr;
+    }
+    const VkDescriptorSet itemSet =
+        item.partitionDescriptorSets != nullptr
+            ? item.partitionDescriptorSets[partition]
+            : item.descriptorSet;
+    if (itemSet != VK_NULL_HANDLE && itemSet != descriptorSet) {
+      BOOST_ASSERT_MSG(item.dynamicOffsetCount <= dynamicOffsets.size(),
+                       "Too few dynamic offsets!");
+      vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                              pipelineLayout, 0, 1, &itemSet,
+                              item.dynamicOffsetCount, dynamicOffsets.data());
+      descriptorSet = itemSet;
+      stats.descriptorSetBinds++;
+    }
+
+    if (mesh.vertexBuffer != vertexBuffer) {
+      const VkDeviceSize offset = 0;
+      vkCmdBindVertexBuffers(commandBuffer, 0, 1, &mesh.vertexBuffer, &offset);
+      vertexBuffer = mesh.vertexBuffer;
+      stats.vertexBufferBinds++;
+    }
+    const VkDeviceSize meshIndexOffset =
+        mesh.indexOffset + mesh.indexPartitionStride * partition;
+    if (mesh.indexBuffer != indexBuffer || meshIndexOffset != indexOffset ||
+        mesh.indexType != indexType) {
+      vkCmdBindIndexBuffer(commandBuffer, mesh.indexBuffer, meshIndexOffset,
+                           mesh.indexType);
+      indexBuffer = mesh.indexBuffer;
+      indexOffset = meshIndexOffset;
+      indexType = mesh.indexType;
+      stats.indexBufferBinds++;
+    }
+
+    if (item.pushConstantsSize > 0) {
+      const uint8_t *data = pushData_.data() + entry.pushOffset;
+      if (pushed == nullptr ||
+          pushed->item.pushConstantsSize != item.pushConstantsSize ||
+          pushed->item.pushConstantStages != item.pushConstantStages ||
+          std::memcmp(pushData_.data() + pushed->pushOffset, data,
+                      item.pushConstantsSize) != 0) {
+        vkCmdPushConstants(commandBuffer, pipelineLayout,
+                           item.pushConstantStages, 0, item.pushConstantsSize,
+                           data);
+        pushed = &entry;
+        stats.pushConstants++;
+      }
+    }
+
+    if (mesh.indirectBuffer != VK_NULL_HANDLE) {
+      // 続く描画の状態が同じで引数が連続していれば、1回の間接描画にまとめます。
+      uint32_t drawCount = 1;
+      while (drawCount < maxDrawIndirectCount_ &&
+             i + drawCount < first + count &&
+             CanMergeIndirect(entries_[i + drawCount - 1],
+                              entries_[i + drawCount])) {
+        const DrawItem &merged = entries_[i + drawCount].item;
+        naive += 3 + (merged.descriptorSet != VK_NULL_HANDLE ? 1 : 0) +
+                 (merged.pushConstantsSize > 0 ? 1 : 0);
+        drawCount++;
+      }
+      vkCmdDrawIndexedIndirect(
+          commandBuffer, mesh.indirectBuffer,
+          mesh.indirectOffset + mesh.indirectPartitionStride * partition,
+          drawCount, sizeof(VkDrawIndexedIndirectCommand));
+      i += drawCount - 1;
+    } else {
+      vkCmdDrawIndexed(commandBuffer, mesh.indexCount, 1, mesh.firstIndex,
+                       mesh.vertexOffset, 0);
+    }
+    stats.draws++;
+  }
+
+  draws_ += stats.draws;
+  pipelineBinds_ += stats.pipelineBinds;
+  descriptorSetBinds_ += stats.descriptorSetBinds;
+  vertexBufferBinds_ += stats.vertexBufferBinds;
+  indexBufferBinds_ += stats.indexBufferBinds;
+  pushConstants_ += stats.pushConstants;
+  saved_ += naive - stats.StateChanges();
+}
+
+/**
+ * @brief ResetStatsからRecordで記録した状態の変更の数を返します。
+ */
+RenderQueue::Stats RenderQueue::GetStats() const {
+  Stats stats{};
+  stats.draws = draws_;
+  stats.pipelineBinds = pipelineBinds_;
+  stats.descriptorSetBinds = descriptorSetBinds_;
+  stats.vertexBufferBinds = vertexBufferBinds_;
+  stats.indexBufferBinds = indexBufferBinds_;
+  stats.pushConstants = pushConstants_;
+  stats.saved = saved_;
+  return stats;
+}
+
+void RenderQueue::ResetStats() {
+  draws_ = 0;
+  pipelineBinds_ = 0;
+  descriptorSetBinds_ = 0;
+  vertexBufferBinds_ = 0;
+  indexBufferBinds_ = 0;
+  pushConstants_ = 0;
+  saved_ = 0;
+}
+
+/**
+ * @brief 2つの間接描画を1回のvkCmdDrawIndexedIndirectにまとめられるか？
+ * @note 状態とプッシュ定数がすべて同じで、nextの引数がprevの直後にある必要があります。
+ */
+bool RenderQueue::CanMergeIndirect(const Entry &prev, const Entry &next) const {
+  const DrawItem &a = prev.item;
+  const DrawItem &b = next.item;
+  if (a.pipeline != b.pipeline || a.pipelineLayout != b.pipelineLayout ||
+      a.descriptorSet != b.descriptorSet ||
+      a.partitionDescriptorSets != b.partitionDescriptorSets ||
+      a.mesh.vertexBuffer != b.mesh.vertexBuffer ||
+      a.mesh.indexBuffer != b.mesh.indexBuffer ||
+      a.mesh.indexOffset != b.mesh.indexOffset ||
+      a.mesh.indexType != b.mesh.indexType ||
+      a.mesh.indexPartitionStride != b.mesh.indexPartitionStride ||
+      a.mesh.indirectBuffer != b.mesh.indirectBuffer ||
+      a.mesh.indirectPartitionStride != b.mesh.indirectPartitionStride ||
+      b.mesh.indirectOffset !=
+          a.mesh.indirectOffset + sizeof(VkDrawIndexedIndirectCommand)) {
+    return false;
+  }
+  if (a.pushConstantsSize != b.pushConstantsSize ||
+      a.pushConstantStages != b.pushConstantStages) {
+    return false;
+  }
+  return a.pushConstantsSize == 0 ||
+         std::memcmp(pushData_.data() + prev.pushOffset,
+                     pushData_.data() + next.pushOffset,
+                     a.pushConstantsSize) == 0;
+}
+
+/**
+ * @brief 描画項目のソートキーを作ります。
+ * @note パイプライン、マテリアル、メッシュは最初に現れた順に番号を振ります。
+ */
+uint64_t RenderQueue::MakeKey(const DrawItem &item) {
+  const uint64_t pass =
+      std::min<uint64_t>(item.pass, (1ull << kPassBits) - 1);
+  const uint64_t pipeline = Intern(
+      pipelineIds_, HandleValue(item.pipeline), 1u << kPipelineBits);
+  const uint64_t material = Intern(
+      materialIds_,
+      HashCombine(HandleValue(item.descriptorSet), item.material),
+      1u << kMaterialBits);
+  const Mesh &mesh = item.mesh;
+  uint64_t meshHash = HandleValue(mesh.vertexBuffer);
+  meshHash = HashCombine(meshHash, HandleValue(mesh.indexBuffer));
+  meshHash = HashCombine(meshHash, mesh.indexOffset);
+  meshHash = HashCombine(meshHash, HandleValue(mesh.indirectBuffer));
+  const uint64_t meshId = Intern(meshIds_, meshHash, 1u << kMeshBits);
+  const float depth = std::clamp(item.depth, 0.0f, 1.0f);
+  const auto quantized = static_cast<uint64_t>(
+      std::lround(depth * static_cast<float>((1u << kDepthBits) - 1)));
+
+  uint64_t key = pass;
+  key = (key << kPipelineBits) | pipeline;
+  key = (key << kMaterialBits) | material;
+  key = (key << kMeshBits) | meshId;
+  key = (key << kDepthBits) | quantized;
+  return key;
+}
+
+/**
+ * @brief 値に番号を振ります。
+ * @return 番号(limitを超える場合は最後の番号を共有します。)
+ */
+uint32_t RenderQueue::Intern(std::unordered_map<uint64_t, uint32_t> &ids,
+                             uint64_t value, uint32_t limit) {
+  const auto it = ids.find(value);
+  if (it != ids.end()) {
+    return it->second;
+  }
+  const auto id = std::min(static_cast<uint32_t>(ids.size()), limit - 1);
+  ids.emplace(value, id);
+  return id;
+}
@@ -0,0 +1,146 @@
+/**
+ * @brief 描画をソートキーで並べ替え、重複する状態の変更を省いて記録します。
+ */
+
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <atomic>
+#include <boost/noncopyable.hpp>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+struct Model;
+
+/**
+ * @brief 描画項目を集め、64bitのソートキーの順に記録するキュー
+ * @note
+ * キーは上位からパス(4bit)、パイプライン(12bit)、マテリアル(16bit)、メッシュ(16bit)、深度(16bit)です。<br>
+ * Recordは複数のワーカースレッドから同時に呼び出せますが、PushとSortは記録中に呼び出さないでください。
+ */
+class RenderQueue : private boost::noncopyable {
+public:
+  /**
+   * @brief 描画するメッシュ
+   * @note
+   * indirectBufferを指定すると間接描画します。<br>
+   * partitionStrideはパーティション(記録するコマンドバッファ)ごとにインデックスと引数の位置をずらすバイト数です。
+   */
+  struct Mesh {
+    VkBuffer vertexBuffer = VK_NULL_HANDLE;
+    VkBuffer indexBuffer = VK_NULL_HANDLE;
+    VkDeviceSize indexOffset = 0;
+    VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+    uint32_t indexCount = 0;
+    uint32_t firstIndex = 0;
+    int32_t vertexOffset = 0;
+    VkBuffer indirectBuffer = VK_NULL_HANDLE;
+    VkDeviceSize indirectOffset = 0;
+    VkDeviceSize indexPartitionStride = 0;
+    VkDeviceSize indirectPartitionStride = 0;
+  };
+
+  /** @brief 描画項目 */
+  struct DrawItem {
+    /** @brief 同じキューで記録する描画の段階(小さい順に記録します。) */
+    uint32_t pass = 0;
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    /** @brief セット0にバインドする記述子セット */
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+    /** @brief パーティションごとの記述子セット(指定した場合はdescriptorSetの代わりにバインドします。) */
+    const VkDescriptorSet *partitionDescriptorSets = nullptr;
+    /** @brief 記述子セットが使う動的オフセットの数(値はRecordで渡します。) */
+    uint32_t dynamicOffsetCount = 0;
+    /** @brief 記述子セットの中で描画を区別する値(テクスチャのインデックスなど) */
+    uint32_t material = 0;
+    Mesh mesh{};
+    /** @brief カメラからの距離を[0, 1]に正規化した値(同じ状態の描画を手前から記録します。) */
+    float depth = 0.0f;
+    /** @brief プッシュ定数(Pushでキューにコピーします。) */
+    const void *pushConstants = nullptr;
+    uint32_t pushConstantsSize = 0;
+    VkShaderStageFlags pushConstantStages = 0;
+  };
+
+  /**
+   * @brief 記録した状態の変更の数
+   * @note
+   * drawsは記録した描画コマンドの数です。(まとめた間接描画は1回と数えます。)<br>
+   * savedは描画ごとにすべての状態を設定した場合から省いた数です。
+   */
+  struct Stats {
+    uint32_t draws = 0;
+    uint32_t pipelineBinds = 0;
+    uint32_t descriptorSetBinds = 0;
+    uint32_t vertexBufferBinds = 0;
+    uint32_t indexBufferBinds = 0;
+    uint32_t pushConstants = 0;
+    uint32_t saved = 0;
+
+    [[nodiscard]] uint32_t StateChanges() const {
+      return pipelineBinds + descriptorSetBinds + vertexBufferBinds +
+             indexBufferBinds + pushConstants;
+    }
+  };
+
+  [[nodiscard]] static Mesh MeshOf(const Model &model);
+
+  void Clear();
+  void Reset();
+  void Push(const DrawItem &item);
+  void Sort();
+  void Record(VkCommandBuffer commandBuffer, uint32_t partition,
+              uint32_t first, uint32_t count,
+              const std::vector<uint32_t> &dynamicOffsets = {}) const;
+
+  /**
+   * @brief 1回の間接描画で記録できる描画の数を設定します。
+   * @note 2以上の場合、状態が同じで引数が連続する間接描画をまとめて記録します。
+   */
+  void SetMaxDrawIndirectCount(uint32_t count) {
+    maxDrawIndirectCount_ = std::max(count, 1u);
+  }
+
+  [[nodiscard]] uint32_t Size() const {
+    return static_cast<uint32_t>(entries_.size());
+  }
+  [[nodiscard]] Stats GetStats() const;
+  void ResetStats();
+
+private:
+  struct Entry {
+    uint64_t key = 0;
+    DrawItem item{};
+    /** @brief pushData_の中のプッシュ定数の位置 */
+    size_t pushOffset = 0;
+  };
+
+  [[nodiscard]] uint64_t MakeKey(const DrawItem &item);
+  [[nodiscard]] bool CanMergeIndirect(const Entry &prev,
+                                      const Entry &next) const;
+  [[nodiscard]] static uint32_t
+  Intern(std::unordered_map<uint64_t, uint32_t> &ids, uint64_t value,
+         uint32_t limit);
+
+  std::vector<Entry> entries_{};
+  std::vector<uint8_t> pushData_{};
+  uint32_t maxDrawIndirectCount_ = 1;
+
+  /** @brief ハンドルからキーに詰める番号への対応(キューを作り直しても順序を保ちます。) */
+  std::unordered_map<uint64_t, uint32_t> pipelineIds_{};
+  std::unordered_map<uint64_t, uint32_t> materialIds_{};
+  std::unordered_map<uint64_t, uint32_t> meshIds_{};
+
+  /** @brief Recordは並列に呼び出されるため、記録した数は原子的に加算します。 */
+  mutable std::atomic<uint32_t> draws_{0};
+  mutable std::atomic<uint32_t> pipelineBinds_{0};
+  mutable std::atomic<uint32_t> descriptorSetBinds_{0};
+  mutable std::atomic<uint32_t> vertexBufferBinds_{0};
+  mutable std::atomic<uint32_t> indexBufferBinds_{0};
+  mutable std::atomic<uint32_t> pushConstants_{0};
+  mutable std::atomic<uint32_t> saved_{0};
+};
@@ -10,6 +10,7 @@
 #include "VK/Common.h"
 #include "VK/Device.h"
 #include "VK/Initializer.h"
+#include "VK/Utils.h"
 
 static VkSurfaceFormatKHR
 FindSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR> &available) {
@@ -253,15 +254,61 @@ void Swapchain::Create(const Device &device, int width, int height,
   }
 }
 
+/**
+ * @brief
+ * サーフェイスの代わりに、カラーアタッチメントとして使用するオフスクリーンイメージのリングを生成します。
+ * @note ヘッドレスで実行する場合に使用します。プレゼンテーションは行いません。
+ * @param device デバイスオブジェクト
+ * @param width イメージの幅
+ * @param height イメージの高さ
+ * @param imageCount リングに含まれるイメージの数
+ */
+void Swapchain::CreateOffscreen(const Device &device, int width, int height,
+                                uint32_t imageCount) {
+  offscreen = true;
+  format = VK_FORMAT_B8G8R8A8_UNORM;
+  extent.width = static_cast<uint32_t>(width);
+  extent.height = static_cast<uint32_t>(height);
+
+  images.resize(imageCount);
+  allocations.resize(imageCount);
+  views.resize(imageCount);
+  for (uint32_t i = 0; i < imageCount; i++) {
+    VK_CHECK_RESULT(CreateImage(
+        device, images[i], allocations[i], format, VK_IMAGE_TYPE_2D,
+        extent.width, extent.height, 1, 1, 1,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+        VK_IMAGE_TILING_OPTIMAL));
+    VK_CHECK_RESULT(CreateImageView(device, views[i], images[i],
+                                    VK_IMAGE_VIEW_TYPE_2D, format));
+  }
+}
+
+/**
+ * @brief レンダーパスの終了時にスワップチェーンイメージが遷移すべきレイアウトを取得します。
+ */
+VkImageLayout Swapchain::GetFinalLayout() const {
+  return offscreen ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+                   : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+}
+
 /**
  * @brief スワップチェーンの破棄
  * @param instance Vulkanインスタンス
  * @param device 論理デバイス
  */
-void Swapchain::Destroy(VkInstance instance, VkDevice device) {
+void Swapchain::Destroy(VkInstance instance, const Device &device) {
   for (auto &view : views) {
     vkDestroyImageView(device, view, nullptr);
   }
+  if (offscreen) {
+    for (size_t i = 0; i < images.size(); i++) {
+      vkDestroyImage(device, images[i], nullptr);
+      device.allocator->Free(device, allocations[i]);
+    }
+    return;
+  }
   vkDestroySwapchainKHR(device, handle, nullptr);
   vkDestroySurfaceKHR(instance, surface, nullptr);
 }
@@ -277,6 +324,12 @@ void Swapchain::Destroy(VkInstance instance, VkDevice device) {
 VkResult Swapchain::AcquiredNextImage(VkDevice device,
                                       VkSemaphore presentCompleteSemaphore,
                                       uint32_t *pImageIndex) const {
+  // オフスクリーンの場合はリングを順に使用します。
+  // セマフォのシグナルは呼び出し側で行う必要があります。
+  if (offscreen) {
+    *pImageIndex = (*pImageIndex + 1) % static_cast<uint32_t>(images.size());
+    return VK_SUCCESS;
+  }
   return vkAcquireNextImageKHR(
       device, handle, std::numeric_limits<uint64_t>::max(),
       presentCompleteSemaphore, VK_NULL_HANDLE, pImageIndex);
@@ -292,6 +345,9 @@ VkResult Swapchain::AcquiredNextImage(VkDevice device,
  */
 VkResult Swapchain::QueuePresent(VkQueue queue, uint32_t imageIndex,
                                  VkSemaphore waitSemaphore) const {
+  if (offscreen) {
+    return VK_SUCCESS;
+  }
   VkPresentInfoKHR presentInfo{};
   presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
   presentInfo.swapchainCount = 1;
@@ -10,6 +10,8 @@
 #include <limits>
 #include <vector>
 
+#include "VK/Allocator.h"
+
 struct Device;
 
 struct Swapchain {
@@ -17,14 +19,22 @@ struct Swapchain {
   VkSurfaceKHR surface = VK_NULL_HANDLE;
   std::vector<VkImage> images;
   std::vector<VkImageView> views;
+  /** @brief オフスクリーンイメージリングのメモリ(ヘッドレス時のみ使用します。) */
+  std::vector<Allocation> allocations;
   VkFormat format;
   VkExtent2D extent;
   uint32_t queueFamilyIndex = std::numeric_limits<uint32_t>::max();
+  /** @brief サーフェイスを持たず、オフスクリーンイメージリングに描画するか？ */
+  bool offscreen = false;
 
   void Init(VkInstance instance, GLFWwindow *window,
             VkPhysicalDevice physicalDevice);
-  void Destroy(VkInstance instance, VkDevice device);
+  void Destroy(VkInstance instance, const Device &device);
   void Create(const Device &device, int width, int height, bool vsync = false);
+  void CreateOffscreen(const Device &device, int width, int height,
+                       uint32_t imageCount);
+
+  [[nodiscard]] VkImageLayout GetFinalLayout() const;
 
   VkResult AcquiredNextImage(VkDevice device,
                              VkSemaphore presentCompleteSemaphore,
@@ -4,67 +4,551 @@
 
 #include "Texture.h"
 
+#include <algorithm>
+#include <array>
 #include <boost/assert.hpp>
+#include <cctype>
 #include <cmath>
+#include <chrono>
 #include <cstdlib>
+#include <cstring>
 #include <filesystem>
 #include <gli/gli.hpp>
+#include <iomanip>
 #include <iostream>
-
+#include <optional>
+#include <spdlog/spdlog.h>
+#include <sstream>
+
+#define STB_IMAGE_IMPLEMENTATION
+#define STBI_ONLY_PNG
+#define STBI_ONLY_JPEG
+#include <stb/stb_image.h>
+
+#include "VK/AssetArchive.h"
+#include "VK/AssetLoader.h"
+#include "VK/BlockCompression.h"
 #include "VK/Common.h"
 #include "VK/Device.h"
 #include "VK/Initializer.h"
+#include "VK/UploadManager.h"
 #include "VK/Utils.h"
 
+//*-----------------------------------------------------------------------------
+// Mipmaps
+//*-----------------------------------------------------------------------------
+
+/**
+ * @brief 1x1まで半分にしていくミップチェーンのレベル数を返します。
+ */
+static uint32_t MipLevelCount(uint32_t width, uint32_t height) {
+  uint32_t levels = 1;
+  while ((std::max(width, height) >> levels) > 0) {
+    levels++;
+  }
+  return levels;
+}
+
+/**
+ * @brief 形式が線形フィルタでのブリットの転送元と転送先に使えるか？
+ */
+static bool SupportsLinearBlit(const Device &device, VkFormat format) {
+  VkFormatProperties formatProperties;
+  vkGetPhysicalDeviceFormatProperties(device.physicalDevice, format,
+                                      &formatProperties);
+  constexpr VkFormatFeatureFlags required =
+      VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT |
+      VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+  return (formatProperties.optimalTilingFeatures & required) == required;
+}
+
+static bool IsRgba8(VkFormat format) {
+  return format == VK_FORMAT_R8G8B8A8_UNORM ||
+         format == VK_FORMAT_R8G8B8A8_SRGB ||
+         format == VK_FORMAT_B8G8R8A8_UNORM ||
+         format == VK_FORMAT_B8G8R8A8_SRGB;
+}
+
+static bool IsSrgb(VkFormat format) {
+  return format == VK_FORMAT_R8G8B8A8_SRGB ||
+         format == VK_FORMAT_B8G8R8A8_SRGB ||
+         format == VK_FORMAT_BC1_RGB_SRGB_BLOCK ||
+         format == VK_FORMAT_BC3_SRGB_BLOCK ||
+         format == VK_FORMAT_BC7_SRGB_BLOCK;
+}
+
+/**
+ * @brief 8bitの4チャンネルの画像を2x2の平均で縮小し、すべてのレベルを連結したデータを作成します。
+ * @note
+ * ブロック圧縮はレベルごとにCPUで圧縮するため、その前の縮小もCPUで行います。<br>
+ * sRGB形式の色は線形の値に戻してから平均し、アルファはそのまま平均します。
+ */
+static std::vector<uint8_t>
+BuildMipChain(const uint8_t *pixels, uint32_t width, uint32_t height,
+              uint32_t mipLevels, bool srgb,
+              std::vector<VkBufferImageCopy> &regions) {
+  std::array<float, 256> toLinear{};
+  for (uint32_t i = 0; i < toLinear.size(); i++) {
+    const float c = static_cast<float>(i) / 255.0f;
+    toLinear[i] = srgb ? (c <= 0.04045f ? c / 12.92f
+                                        : std::pow((c + 0.055f) / 1.055f, 2.4f))
+                       : c;
+  }
+  const auto fromLinear = [srgb](float c) {
+    if (srgb) {
+      c = c <= 0.0031308f ? c * 12.92f
+                          : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+    }
+    return static_cast<uint8_t>(std::clamp(c, 0.0f, 1.0f) * 255.0f + 0.5f);
+  };
+
+  std::vector<uint8_t> chain(pixels, pixels + size_t{width} * height * 4);
+  size_t srcOffset = 0;
+  for (uint32_t level = 0; level < mipLevels; level++) {
+    const uint32_t w = std::max(width >> level, 1u);
+    const uint32_t h = std::max(height >> level, 1u);
+
+    VkBufferImageCopy region{};
+    region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1};
+    region.imageExtent = {w, h, 1};
+    region.bufferOffset = chain.size() - size_t{w} * h * 4;
+    regions.emplace_back(region);
+    if (level + 1 == mipLevels) {
+      break;
+    }
+
+    const uint32_t dw = std::max(w >> 1, 1u);
+    const uint32_t dh = std::max(h >> 1, 1u);
+    const size_t dstOffset = chain.size();
+    chain.resize(dstOffset + size_t{dw} * dh * 4);
+    for (uint32_t y = 0; y < dh; y++) {
+      for (uint32_t x = 0; x < dw; x++) {
+        // 奇数の大きさでは端の画素を重ねて読みます。
+        const std::array<uint32_t, 2> xs = {std::min(x * 2, w - 1),
+                                            std::min(x * 2 + 1, w - 1)};
+        const std::array<uint32_t, 2> ys = {std::min(y * 2, h - 1),
+                                            std::min(y * 2 + 1, h - 1)};
+        for (uint32_t c = 0; c < 4; c++) {
+          float sum = 0.0f;
+          for (const auto sy : ys) {
+            for (const auto sx : xs) {
+              const uint8_t v =
+                  chain[srcOffset + (size_t{sy} * w + sx) * 4 + c];
+              sum += c < 3 ? toLinear[v] : static_cast<float>(v) / 255.0f;
+            }
+          }
+          const float average = sum * 0.25f;
+          chain[dstOffset + (size_t{y} * dw + x) * 4 + c] =
+              c < 3 ? fromLinear(average)
+                    : static_cast<uint8_t>(average * 255.0f + 0.5f);
+        }
+      }
+    }
+    srcOffset = dstOffset;
+  }
+  return chain;
+}
+
+//*-----------------------------------------------------------------------------
+// Block compression
+//*-----------------------------------------------------------------------------
+
+/** @brief 圧縮したテクスチャのキャッシュの形式のバージョン(エンコーダーを変えたら上げます。) */
+static constexpr uint32_t kCompressedCacheVersion = 1;
+
+/**
+ * @brief 形式を圧縮するブロック圧縮の形式を返します。
+ * @return ブロック圧縮の形式(エンコーダーが対応していない形式の場合は空です。)
+ */
+static std::optional<BlockCompression::Format>
+ToBlockCompression(VkFormat format) {
+  switch (format) {
+  case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+  case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+    return BlockCompression::Format::BC1;
+  case VK_FORMAT_BC3_UNORM_BLOCK:
+  case VK_FORMAT_BC3_SRGB_BLOCK:
+    return BlockCompression::Format::BC3;
+  case VK_FORMAT_BC4_UNORM_BLOCK:
+    return BlockCompression::Format::BC4;
+  case VK_FORMAT_BC5_UNORM_BLOCK:
+    return BlockCompression::Format::BC5;
+  case VK_FORMAT_BC7_UNORM_BLOCK:
+  case VK_FORMAT_BC7_SRGB_BLOCK:
+    return BlockCompression::Format::BC7;
+  default:
+    return std::nullopt;
+  }
+}
+
+static gli::format ToGliFormat(VkFormat format) {
+  switch (format) {
+  case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+    return gli::FORMAT_RGB_DXT1_UNORM_BLOCK8;
+  case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+    return gli::FORMAT_RGB_DXT1_SRGB_BLOCK8;
+  case VK_FORMAT_BC3_UNORM_BLOCK:
+    return gli::FORMAT_RGBA_DXT5_UNORM_BLOCK16;
+  case VK_FORMAT_BC3_SRGB_BLOCK:
+    return gli::FORMAT_RGBA_DXT5_SRGB_BLOCK16;
+  case VK_FORMAT_BC4_UNORM_BLOCK:
+    return gli::FORMAT_R_ATI1N_UNORM_BLOCK8;
+  case VK_FORMAT_BC5_UNORM_BLOCK:
+    return gli::FORMAT_RG_ATI2N_UNORM_BLOCK16;
+  case VK_FORMAT_BC7_UNORM_BLOCK:
+    return gli::FORMAT_RGBA_BP_UNORM_BLOCK16;
+  case VK_FORMAT_BC7_SRGB_BLOCK:
+    return gli::FORMAT_RGBA_BP_SRGB_BLOCK16;
+  default:
+    return gli::FORMAT_UNDEFINED;
+  }
+}
+
+/**
+ * @brief 元の画像の内容と圧縮する形式から、画像の隣に置くキャッシュファイルのパスを求めます。
+ * @return キャッシュファイルのパス
+ */
+static std::string CompressedCachePath(const std::string &filepath,
+                                       const AssetData &source,
+                                       VkFormat format) {
+  // FNV-1a
+  uint64_t key = 0xcbf29ce484222325ull;
+  const auto hash = [&key](const void *data, size_t size) {
+    const auto *bytes = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < size; i++) {
+      key ^= bytes[i];
+      key *= 0x100000001b3ull;
+    }
+  };
+  hash(&kCompressedCacheVersion, sizeof(kCompressedCacheVersion));
+  hash(&format, sizeof(format));
+  hash(source.data, source.size);
+
+  const std::filesystem::path path(filepath);
+  std::ostringstream name;
+  name << path.stem().string() << '-' << std::hex << std::setw(16)
+       << std::setfill('0') << key << ".ktx";
+  return (path.parent_path() / name.str()).string();
+}
+
+/**
+ * @brief 画像(PNG/JPEG)のミップチェーンを生成し、すべてのレベルをブロック圧縮します。
+ * @param filepath 画像ファイルのパス
+ * @param source 画像ファイルの内容
+ * @param format 圧縮後の形式
+ * @param compression エンコーダーの形式
+ * @return 圧縮したテクスチャ(読み込めない場合はnullptrです。)
+ * @note
+ * 圧縮した結果は画像の隣に内容のハッシュを付けたKTXとして保存し、次回からはそれを読み込みます。<br>
+ * ブロックはワーカースレッドで分担して圧縮します。
+ */
+static std::shared_ptr<gli::texture2d>
+CompressImage(const std::string &filepath, const AssetData &source,
+              VkFormat format, BlockCompression::Format compression) {
+  const auto cachePath = CompressedCachePath(filepath, source, format);
+  if (const auto cache = AssetArchive::Get().Read(cachePath)) {
+    auto cached = std::make_shared<gli::texture2d>(gli::load(
+        reinterpret_cast<const char *>(cache.data), cache.size));
+    if (!cached->empty() && cached->format() == ToGliFormat(format)) {
+      return cached;
+    }
+    spdlog::warn("Compressed texture cache {} is corrupted; recompressing.",
+                 cachePath);
+  }
+
+  int32_t w = 0;
+  int32_t h = 0;
+  int32_t channels = 0;
+  stbi_uc *data =
+      stbi_load_from_memory(source.data, static_cast<int>(source.size), &w,
+                            &h, &channels, 4);
+  if (data == nullptr) {
+    spdlog::error("Failed to load texture from {}: {}", filepath,
+                  stbi_failure_reason());
+    return nullptr;
+  }
+  const auto width = static_cast<uint32_t>(w);
+  const auto height = static_cast<uint32_t>(h);
+  const uint32_t mipLevels = MipLevelCount(width, height);
+  std::vector<VkBufferImageCopy> regions{};
+  const auto chain = BuildMipChain(data, width, height, mipLevels,
+                                   IsSrgb(format), regions);
+  stbi_image_free(data);
+
+  const auto start = std::chrono::steady_clock::now();
+  auto texture = std::make_shared<gli::texture2d>(
+      ToGliFormat(format), gli::texture2d::extent_type(w, h), mipLevels);
+  for (uint32_t level = 0; level < mipLevels; level++) {
+    const auto &extent = regions[level].imageExtent;
+    // ローダーのワーカーが並列に読み込んでいる場合は、スレッドを増やさずにこのスレッドで圧縮します。
+    const auto blocks = BlockCompression::Compress(
+        compression, chain.data() + regions[level].bufferOffset,
+        extent.width, extent.height,
+        AssetLoader::IsParallelWorker() ? 1u : 0u);
+    BOOST_ASSERT_MSG(blocks.size() == (*texture)[level].size(),
+                     "Compressed level size mismatch!");
+    std::memcpy((*texture)[level].data(), blocks.data(), blocks.size());
+  }
+  const std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  spdlog::info("Compressed {} ({}x{}, {} levels) in {:.1f} ms", filepath,
+               width, height, mipLevels, elapsed.count());
+
+  if (!gli::save_ktx(*texture, cachePath.c_str())) {
+    spdlog::warn("Failed to write compressed texture cache {}", cachePath);
+  }
+  return texture;
+}
+
+//*-----------------------------------------------------------------------------
+// Mapped KTX
+//*-----------------------------------------------------------------------------
+
+/** @brief KTX(バージョン1)のヘッダー */
+struct KtxHeader {
+  uint8_t identifier[12];
+  uint32_t endianness;
+  uint32_t glType;
+  uint32_t glTypeSize;
+  uint32_t glFormat;
+  uint32_t glInternalFormat;
+  uint32_t glBaseInternalFormat;
+  uint32_t pixelWidth;
+  uint32_t pixelHeight;
+  uint32_t pixelDepth;
+  uint32_t numberOfArrayElements;
+  uint32_t numberOfFaces;
+  uint32_t numberOfMipmapLevels;
+  uint32_t bytesOfKeyValueData;
+};
+static_assert(sizeof(KtxHeader) == 64, "KTX header layout mismatch!");
+
+/**
+ * @brief マップしたKTXのレベルを、ステージングリングへ直接コピーするための領域
+ * @note 各レベルの前にあるimageSizeは、領域のオフセットで読み飛ばします。
+ */
+struct MappedKtx {
+  AssetData source{};
+  /** @brief レベル0の先頭から最後のレベルの末尾まで */
+  const uint8_t *data = nullptr;
+  size_t size = 0;
+  size_t level0Size = 0;
+  uint32_t width = 0;
+  uint32_t height = 0;
+  std::vector<VkBufferImageCopy> regions{};
+};
+
+/**
+ * @brief 形式のブロック(非圧縮の場合は1画素)の辺の画素数とバイト数を返します。
+ * @return ブロック(マップしたまま転送しない形式の場合は空です。)
+ */
+static std::optional<std::pair<uint32_t, uint32_t>>
+TexelBlock(VkFormat format) {
+  if (IsRgba8(format)) {
+    return std::make_pair(1u, 4u);
+  }
+  if (const auto compression = ToBlockCompression(format)) {
+    return std::make_pair(4u, BlockCompression::BlockBytes(*compression));
+  }
+  return std::nullopt;
+}
+
+/**
+ * @brief マップしたKTXのヘッダーを検証し、各レベルのコピー領域を求めます。
+ * @param source KTXファイルの内容
+ * @param format Uploadで生成するイメージの形式
+ * @return
+ * コピー領域(2Dでない場合や、レベルの位置がbufferOffsetの制約を満たさない場合は空です。)
+ * @note
+ * ブロック圧縮の形式はimageSizeでレベルの位置が4バイトずれるため、ほとんどの場合gliで読み込みます。
+ */
+static std::shared_ptr<MappedKtx> MapKtx(const AssetData &source,
+                                         VkFormat format) {
+  static constexpr uint8_t kIdentifier[12] = {
+      0xab, 'K', 'T', 'X', ' ', '1', '1', 0xbb, '\r', '\n', 0x1a, '\n',
+  };
+  const auto block = TexelBlock(format);
+  KtxHeader header{};
+  if (!block || source.size < sizeof(header)) {
+    return nullptr;
+  }
+  std::memcpy(&header, source.data, sizeof(header));
+  if (std::memcmp(header.identifier, kIdentifier, sizeof(kIdentifier)) != 0 ||
+      header.endianness != 0x04030201 || header.pixelWidth == 0 ||
+      header.pixelHeight == 0 || header.pixelDepth != 0 ||
+      header.numberOfArrayElements != 0 || header.numberOfFaces != 1 ||
+      header.numberOfMipmapLevels == 0) {
+    return nullptr;
+  }
+
+  const auto [blockSize, blockBytes] = *block;
+  const size_t alignment = std::max<size_t>(4, blockBytes);
+  auto mapped = std::make_shared<MappedKtx>();
+  mapped->width = header.pixelWidth;
+  mapped->height = header.pixelHeight;
+  size_t offset = sizeof(header) + header.bytesOfKeyValueData;
+  size_t first = 0;
+  for (uint32_t level = 0; level < header.numberOfMipmapLevels; level++) {
+    const uint32_t w = std::max(header.pixelWidth >> level, 1u);
+    const uint32_t h = std::max(header.pixelHeight >> level, 1u);
+    uint32_t imageSize = 0;
+    if (offset + sizeof(imageSize) > source.size) {
+      return nullptr;
+    }
+    std::memcpy(&imageSize, source.data + offset, sizeof(imageSize));
+    offset += sizeof(imageSize);
+    if (level == 0) {
+      first = offset;
+      mapped->level0Size = imageSize;
+    }
+    // 行の詰め物がなく、コピー元のオフセットがブロックの倍数になる場合のみ直接転送します。
+    const size_t expected = size_t{(w + blockSize - 1) / blockSize} *
+                            ((h + blockSize - 1) / blockSize) * blockBytes;
+    if (imageSize != expected || offset + imageSize > source.size ||
+        (offset - first) % alignment != 0) {
+      return nullptr;
+    }
+
+    VkBufferImageCopy region{};
+    region.bufferOffset = offset - first;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = level;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent = {w, h, 1};
+    mapped->regions.emplace_back(region);
+    offset += (imageSize + 3) & ~size_t{3};
+  }
+
+  mapped->data = source.data + first;
+  mapped->size = std::min(offset, source.size) - first;
+  mapped->source = source;
+  return mapped;
+}
+
+//*-----------------------------------------------------------------------------
+// Texture
+//*-----------------------------------------------------------------------------
+
 void Texture::Destroy(const Device &device) const {
   if (sampler != nullptr) {
     vkDestroySampler(device, sampler, nullptr);
   }
   vkDestroyImageView(device, view, nullptr);
   vkDestroyImage(device, image, nullptr);
-  vkFreeMemory(device, memory, nullptr);
+  device.allocator->Free(device, allocation);
 }
 
+/**
+ * @brief ファイルから2Dテクスチャを読み込み、デバイスのローカルメモリに転送します。
+ */
 void Texture2D::Load(const Device &device, const std::string &filepath,
-                     VkQueue copyQueue, VkFormat format,
+                     UploadManager &uploader, VkFormat format,
                      VkImageUsageFlags imageUsageFlags,
                      VkImageLayout imageLayout, bool useStaging) {
-  std::error_code ec;
-  if (!std::filesystem::exists(filepath, ec)) {
-    std::cerr << "Failed to load texture from " << filepath << std::endl;
-    std::cerr << ec.value() << ": " << ec.message() << std::endl;
-    BOOST_ASSERT_MSG(ec, "Failed to load texture!");
+  if (!Decode(filepath, format)) {
     return;
   }
+  Upload(device, uploader, format, imageUsageFlags, imageLayout, useStaging);
+}
 
-  gli::texture2d tex2d(gli::load(filepath.c_str()));
-  BOOST_ASSERT_MSG(!tex2d.empty(), "Failed to load texture!");
-  width = static_cast<uint32_t>(tex2d[0].extent().x);
-  height = static_cast<uint32_t>(tex2d[0].extent().y);
-  mipLevels = static_cast<uint32_t>(tex2d.levels());
-
-  // 要求されたテクスチャ形式のデバイスプロパティを取得します。
-  VkFormatProperties formatProperties;
-  vkGetPhysicalDeviceFormatProperties(device.physicalDevice, format,
-                                      &formatProperties);
+/**
+ * @brief テクスチャファイル(KTX/DDS/PNG/JPEG)を読み込み、転送するデータを用意します。
+ * @param filepath テクスチャファイルのパス
+ * @param format Uploadで生成するイメージの形式(BCn形式の場合、PNG/JPEGはブロック圧縮します。)
+ * @note デバイスを使用しないため、ワーカースレッドから呼び出せます。
+ */
+bool Texture2D::Decode(const std::string &filepath, VkFormat format) {
+  const auto source = AssetArchive::Get().Read(filepath);
+  if (!source) {
+    std::cerr << "Failed to load texture from " << filepath << std::endl;
+    BOOST_ASSERT_MSG(source, "Failed to load texture!");
+    return false;
+  }
 
-  // テクスチャの読み込みに別のコマンドバッファを使用します。
-  VkCommandBuffer copyCommand =
-      device.CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+  auto extension = std::filesystem::path(filepath).extension().string();
+  std::transform(extension.begin(), extension.end(), extension.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  if (extension == ".png" || extension == ".jpg" || extension == ".jpeg") {
+    if (const auto compression = ToBlockCompression(format)) {
+      decoded_ = CompressImage(filepath, source, format, *compression);
+      BOOST_ASSERT_MSG(decoded_ != nullptr, "Failed to load texture!");
+      return decoded_ != nullptr;
+    }
 
-  if (useStaging) {
-    // 生の画像データを含むホストに表示されるステージングバッファを生成します。
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingMemory;
+    int32_t w = 0;
+    int32_t h = 0;
+    int32_t channels = 0;
+    stbi_uc *data =
+        stbi_load_from_memory(source.data, static_cast<int>(source.size), &w,
+                              &h, &channels, 4);
+    if (data == nullptr) {
+      spdlog::error("Failed to load texture from {}: {}", filepath,
+                    stbi_failure_reason());
+      BOOST_ASSERT_MSG(data != nullptr, "Failed to load texture!");
+      return false;
+    }
+    pixels_ = std::make_shared<Pixels>();
+    pixels_->data.assign(data, data + size_t(w) * size_t(h) * 4);
+    pixels_->width = static_cast<uint32_t>(w);
+    pixels_->height = static_cast<uint32_t>(h);
+    stbi_image_free(data);
+    return true;
+  }
 
-    VK_CHECK_RESULT(device.CreateBuffer(
-        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        tex2d.data(), tex2d.size(), stagingBuffer, stagingMemory));
+  // KTXのレベルをそのまま転送できる場合は、gliでコピーせずにマップを参照します。
+  if (extension == ".ktx") {
+    mapped_ = MapKtx(source, format);
+    if (mapped_ != nullptr) {
+      return true;
+    }
+  }
+  decoded_ = std::make_shared<gli::texture2d>(
+      gli::load(reinterpret_cast<const char *>(source.data), source.size));
+  BOOST_ASSERT_MSG(!decoded_->empty(), "Failed to load texture!");
+  return !decoded_->empty();
+}
 
-    // バッファコピー領域を設定します。
-    std::vector<VkBufferImageCopy> bufferImageCopyRegions{};
+/**
+ * @brief イメージを生成し、Decodeで用意したデータを転送します。
+ * @note 転送を記録した後は、用意したデータを解放します。
+ */
+void Texture2D::Upload(const Device &device, UploadManager &uploader,
+                       VkFormat format, VkImageUsageFlags imageUsageFlags,
+                       VkImageLayout imageLayout, bool useStaging) {
+  if (pixels_ != nullptr) {
+    // 画像はステージングを経由してGPUでミップマップを生成します。
+    const auto pixels = std::move(pixels_);
+    FromBuffer(device, pixels->data.data(), pixels->data.size(), format,
+               pixels->width, pixels->height, uploader, VK_FILTER_LINEAR,
+               imageUsageFlags, imageLayout, true);
+    return;
+  }
+  BOOST_ASSERT_MSG(decoded_ != nullptr || mapped_ != nullptr,
+                   "Texture is not decoded!");
+  const auto decoded = std::move(decoded_);
+  const auto mapped = std::move(mapped_);
+
+  // 転送元のデータとバッファコピー領域を設定します。(オフセットはテクスチャデータの先頭からです。)
+  const void *data = nullptr;
+  VkDeviceSize dataSize = 0;
+  VkDeviceSize level0Size = 0;
+  std::vector<VkBufferImageCopy> bufferImageCopyRegions{};
+  if (mapped != nullptr) {
+    width = mapped->width;
+    height = mapped->height;
+    mipLevels = static_cast<uint32_t>(mapped->regions.size());
+    data = mapped->data;
+    dataSize = mapped->size;
+    level0Size = mapped->level0Size;
+    bufferImageCopyRegions = mapped->regions;
+  } else {
+    const gli::texture2d &tex2d = *decoded;
+    width = static_cast<uint32_t>(tex2d[0].extent().x);
+    height = static_cast<uint32_t>(tex2d[0].extent().y);
+    mipLevels = static_cast<uint32_t>(tex2d.levels());
+    data = tex2d.data();
+    dataSize = tex2d.size();
+    level0Size = tex2d[0].size();
     uint32_t offset = 0;
     for (uint32_t i = 0; i < mipLevels; i++) {
       VkBufferImageCopy bufferImageCopyRegion{};
@@ -82,7 +566,14 @@ void Texture2D::Load(const Device &device, const std::string &filepath,
       bufferImageCopyRegions.emplace_back(bufferImageCopyRegion);
       offset += static_cast<uint32_t>(tex2d[i].size());
     }
+  }
+
+  // 要求されたテクスチャ形式のデバイスプロパティを取得します。
+  VkFormatProperties formatProperties;
+  vkGetPhysicalDeviceFormatProperties(device.physicalDevice, format,
+                                      &formatProperties);
 
+  if (useStaging) {
     // 最適なタイルターゲット画像を生成します。
     VkImageCreateInfo imageCreateInfo = Initializer::ImageCreateInfo();
     imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -100,15 +591,12 @@ void Texture2D::Load(const Device &device, const std::string &filepath,
     }
     VK_CHECK_RESULT(vkCreateImage(device, &imageCreateInfo, nullptr, &image));
 
-    VkMemoryRequirements memoryRequirements{};
-    vkGetImageMemoryRequirements(device, image, &memoryRequirements);
-    VkMemoryAllocateInfo memoryAllocateInfo = Initializer::MemoryAllocateInfo();
-    memoryAllocateInfo.allocationSize = memoryRequirements.size;
-    memoryAllocateInfo.memoryTypeIndex = device.FindMemoryType(
-        memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-    VK_CHECK_RESULT(
-        vkAllocateMemory(device, &memoryAllocateInfo, nullptr, &memory));
-    VK_CHECK_RESULT(vkBindImageMemory(device, image, memory, 0));
+    AllocationCreateInfo allocationCreateInfo{};
+    allocationCreateInfo.memoryPropertyFlags =
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    allocationCreateInfo.optimalTiling = true;
+    VK_CHECK_RESULT(device.allocator->AllocateImageMemory(
+        device, image, allocationCreateInfo, allocation));
 
     VkImageSubresourceRange imageSubresourceRange{};
     imageSubresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -116,25 +604,10 @@ void Texture2D::Load(const Device &device, const std::string &filepath,
     imageSubresourceRange.levelCount = mipLevels;
     imageSubresourceRange.layerCount = 1;
 
-    // イメージレイアウト遷移を実行するパイプラインステージにメモリ依存を挿入します。
-    TransitionImageLayout(copyCommand, image, imageSubresourceRange,
-                          VK_IMAGE_LAYOUT_UNDEFINED,
-                          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-
-    // ステージングバッファからコピーします。
-    vkCmdCopyBufferToImage(copyCommand, stagingBuffer, image,
-                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                           static_cast<uint32_t>(bufferImageCopyRegions.size()),
-                           bufferImageCopyRegions.data());
-
-    // すべてコピーされた後、テクスチャのイメージレイアウトを変更します。
-    TransitionImageLayout(copyCommand, image, imageSubresourceRange,
-                          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, imageLayout);
-    device.FlushCommandBuffer(copyCommand, copyQueue);
-
-    // ステージングリソースを破棄します。
-    vkFreeMemory(device, stagingMemory, nullptr);
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
+    // ステージングリングへコピーし、転送とイメージレイアウトの遷移を記録します。
+    // 転送はアップロードマネージャーの送信時にまとめて実行されます。
+    uploader.UploadImage(device, image, imageSubresourceRange, data, dataSize,
+                         std::move(bufferImageCopyRegions), imageLayout);
   } else {
     BOOST_ASSERT_MSG(formatProperties.linearTilingFeatures &
                          VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT,
@@ -154,17 +627,12 @@ void Texture2D::Load(const Device &device, const std::string &filepath,
     VK_CHECK_RESULT(vkCreateImage(device, &imageCreateInfo, nullptr, &image));
 
     // このイメージのメモリ要件を取得し、ホストメモリを割り当てます。
-    VkMemoryRequirements memoryRequirements{};
-    vkGetImageMemoryRequirements(device, image, &memoryRequirements);
-    VkMemoryAllocateInfo memoryAllocateInfo = Initializer::MemoryAllocateInfo();
-    memoryAllocateInfo.allocationSize = memoryRequirements.size;
-    memoryAllocateInfo.memoryTypeIndex =
-        device.FindMemoryType(memoryRequirements.memoryTypeBits,
-                              VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                                  VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-    VK_CHECK_RESULT(
-        vkAllocateMemory(device, &memoryAllocateInfo, nullptr, &memory));
-    VK_CHECK_RESULT(vkBindImageMemory(device, image, memory, 0));
+    AllocationCreateInfo allocationCreateInfo{};
+    allocationCreateInfo.memoryPropertyFlags =
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    VK_CHECK_RESULT(device.allocator->AllocateImageMemory(
+        device, image, allocationCreateInfo, allocation));
 
     // サブリソースのレイアウトを取得します。
     VkImageSubresource imageSubresource{};
@@ -174,17 +642,16 @@ void Texture2D::Load(const Device &device, const std::string &filepath,
     vkGetImageSubresourceLayout(device, image, &imageSubresource,
                                 &subresourceLayout);
 
-    // イメージメモリをマップし、イメージデータをメモリにコピーします。
-    void *data;
-    VK_CHECK_RESULT(
-        vkMapMemory(device, memory, 0, memoryRequirements.size, 0, &data));
-    std::memcpy(data, tex2d[0].data(), tex2d[0].size());
-    vkUnmapMemory(device, memory);
+    // 永続的にマップされたイメージメモリにイメージデータをコピーします。
+    std::memcpy(allocation.mapped, data, level0Size);
 
     // 画像のメモリバリアを設定します。
-    TransitionImageLayout(copyCommand, image, VK_IMAGE_ASPECT_COLOR_BIT,
-                          VK_IMAGE_LAYOUT_UNDEFINED, imageLayout);
-    device.FlushCommandBuffer(copyCommand, copyQueue);
+    VkImageSubresourceRange imageSubresourceRange{};
+    imageSubresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    imageSubresourceRange.levelCount = 1;
+    imageSubresourceRange.layerCount = 1;
+    uploader.TransitionImage(device, image, imageSubresourceRange,
+                             imageLayout);
   }
 
   // デフォルトのサンプラーを生成します。
@@ -240,59 +707,43 @@ void Texture2D::Load(const Device &device, const std::string &filepath,
 
 /**
  * @brief バッファから2Dテクスチャを生成します。
- * @param device
- * @param buffer
- * @param bufferSize
- * @param format
- * @param texWidth
- * @param texHeight
- * @param copyQueue
- * @param filter
- * @param imageUsageFlags
- * @param imageLayout
+ * @param device デバイスオブジェクト
+ * @param buffer レベル0の画素
+ * @param bufferSize 画素のバイト数
+ * @param format イメージの形式
+ * @param texWidth 幅
+ * @param texHeight 高さ
+ * @param uploader 転送を記録するアップロードマネージャー
+ * @param filter サンプラーのフィルタ
+ * @param imageUsageFlags イメージの用途
+ * @param imageLayout 転送後のイメージレイアウト
+ * @param generateMipmaps 1x1までのミップチェーンを生成するか
+ * @note
+ * ミップマップは線形フィルタのブリットで生成します。<br>
+ * 形式がブリットに対応していない場合は、8bitのRGBAとBGRAの形式に限りコンピュートシェーダーで生成します。
+ * シェーダーはRGBA8のストレージイメージに書き込むため、それ以外の形式(浮動小数点数など)は1つのレベルのみになります。
  */
 void Texture2D::FromBuffer(const Device &device, void *buffer,
                            VkDeviceSize bufferSize, VkFormat format,
                            uint32_t texWidth, uint32_t texHeight,
-                           VkQueue copyQueue, VkFilter filter,
+                           UploadManager &uploader, VkFilter filter,
                            VkImageUsageFlags imageUsageFlags,
-                           VkImageLayout imageLayout) {
+                           VkImageLayout imageLayout, bool generateMipmaps) {
   BOOST_ASSERT(buffer);
 
   width = texWidth;
   height = texHeight;
-  mipLevels = 1;
-
-  VkCommandBuffer copyCmd = device.CreateCommandBuffer();
-
-  // 生の画像データを含むホストに表示されるステージングバッファを生成します。
-  VkBufferCreateInfo bufferCreateInfo = Initializer::BufferCreateInfo(
-      VK_BUFFER_USAGE_TRANSFER_SRC_BIT, bufferSize);
-  VkBuffer stagingBuffer;
-  VK_CHECK_RESULT(
-      vkCreateBuffer(device, &bufferCreateInfo, nullptr, &stagingBuffer));
-
-  // ステージングバッファのメモリ要件を取得します。
-  VkMemoryRequirements memoryRequirements;
-  vkGetBufferMemoryRequirements(device, stagingBuffer, &memoryRequirements);
-
-  VkMemoryAllocateInfo memoryAllocateInfo = Initializer::MemoryAllocateInfo();
-  memoryAllocateInfo.allocationSize = memoryRequirements.size;
-  memoryAllocateInfo.memoryTypeIndex =
-      device.FindMemoryType(memoryRequirements.memoryTypeBits,
-                            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                                VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-  VkDeviceMemory stagingMemory;
-  VK_CHECK_RESULT(
-      vkAllocateMemory(device, &memoryAllocateInfo, nullptr, &stagingMemory));
-  VK_CHECK_RESULT(vkBindBufferMemory(device, stagingBuffer, stagingMemory, 0));
-
-  // ステージングバッファへテクスチャのデータをコピーします。
-  std::byte *data;
-  VK_CHECK_RESULT(vkMapMemory(device, stagingMemory, 0, memoryRequirements.size,
-                              0, reinterpret_cast<void **>(&data)));
-  std::memcpy(data, buffer, bufferSize);
-  vkUnmapMemory(device, stagingMemory);
+  mipLevels = generateMipmaps ? MipLevelCount(width, height) : 1;
+
+  const bool blit = mipLevels > 1 && SupportsLinearBlit(device, format);
+  const bool compute = mipLevels > 1 && !blit && IsRgba8(format) &&
+                       mipLevels <= UploadManager::kMaxComputeMipLevels;
+  if (mipLevels > 1 && !blit && !compute) {
+    spdlog::warn("Format {} supports neither linear blits nor the RGBA8 "
+                 "compute downsampler; mipmaps are not generated.",
+                 static_cast<int32_t>(format));
+    mipLevels = 1;
+  }
 
   VkBufferImageCopy bufferCopyRegion{};
   bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -303,12 +754,17 @@ void Texture2D::FromBuffer(const Device &device, void *buffer,
   bufferCopyRegion.imageExtent.height = height;
   bufferCopyRegion.imageExtent.depth = 1;
   bufferCopyRegion.bufferOffset = 0;
+  std::vector<VkBufferImageCopy> bufferCopyRegions{bufferCopyRegion};
 
   // 最適なタイルターゲット画像を生成します。
-  CreateImage(device, image, memory, format, VK_IMAGE_TYPE_2D, width, height, 1,
-              mipLevels, 1, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-              imageUsageFlags | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
-              VK_IMAGE_TILING_OPTIMAL);
+  // ブリットやコンピュートで縮小する場合は、レベルを転送元にも使います。
+  VkImageUsageFlags usage = imageUsageFlags | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+  if (blit || compute) {
+    usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+  }
+  CreateImage(device, image, allocation, format, VK_IMAGE_TYPE_2D, width,
+              height, 1, mipLevels, 1, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+              usage, VK_IMAGE_TILING_OPTIMAL);
 
   // イメージバリア
   VkImageSubresourceRange imageSubresourceRange{};
@@ -316,29 +772,37 @@ void Texture2D::FromBuffer(const Device &device, void *buffer,
   imageSubresourceRange.baseMipLevel = 0;
   imageSubresourceRange.levelCount = mipLevels;
   imageSubresourceRange.layerCount = 1;
-  TransitionImageLayout(copyCmd, image, imageSubresourceRange,
-                        VK_IMAGE_LAYOUT_UNDEFINED,
-                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-
-  // ステージングバッファからミップレベルをコピーします。
-  vkCmdCopyBufferToImage(copyCmd, stagingBuffer, image,
-                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
-                         &bufferCopyRegion);
-
-  // すべてのミップレベルがコピーされた後、テクスチャのイメージレイアウトをシェーダー読み取りに変更します。
-  TransitionImageLayout(copyCmd, image, imageSubresourceRange,
-                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, imageLayout);
-  device.FlushCommandBuffer(copyCmd, copyQueue);
-
-  // ステージングリソースを破棄します。
-  vkFreeMemory(device, stagingMemory, nullptr);
-  vkDestroyBuffer(device, stagingBuffer, nullptr);
+  if (blit || compute) {
+    // レベル0を転送し、縮小元として残りのレベルをGPUで生成します。
+    imageSubresourceRange.levelCount = 1;
+    uploader.UploadImage(device, image, imageSubresourceRange, buffer,
+                         bufferSize, std::move(bufferCopyRegions),
+                         VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+    if (blit) {
+      uploader.GenerateMipmaps(device, image, width, height, mipLevels,
+                               imageLayout);
+    } else {
+      uploader.GenerateMipmapsCompute(device, image, width, height,
+                                      mipLevels, IsSrgb(format), imageLayout);
+    }
+  } else {
+    // テクスチャのデータをステージングリングにコピーし、転送を記録します。
+    uploader.UploadImage(device, image, imageSubresourceRange, buffer,
+                         bufferSize, std::move(bufferCopyRegions),
+                         imageLayout);
+  }
 
-  // サンプラーの生成を行います。
-  CreateSampler(device, sampler, filter, filter, VK_FALSE, VK_COMPARE_OP_NEVER);
+  // サンプラーの生成を行います。(すべてのミップレベルを参照できるようにします。)
+  CreateSampler(device, sampler, filter, filter, VK_FALSE, VK_COMPARE_OP_NEVER,
+                VK_SAMPLER_ADDRESS_MODE_REPEAT, VK_SAMPLER_ADDRESS_MODE_REPEAT,
+                VK_SAMPLER_ADDRESS_MODE_REPEAT,
+                filter == VK_FILTER_NEAREST ? VK_SAMPLER_MIPMAP_MODE_NEAREST
+                                            : VK_SAMPLER_MIPMAP_MODE_LINEAR,
+                0.0f, static_cast<float>(mipLevels));
 
   // イメージビューの生成を行います。
-  CreateImageView(device, view, image, VK_IMAGE_VIEW_TYPE_2D, format);
+  CreateImageView(device, view, image, VK_IMAGE_VIEW_TYPE_2D, format,
+                  VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels);
 
   // 記述子セットの設定に使用する情報の更新を行います。
   descriptor.sampler = sampler;
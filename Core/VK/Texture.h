@@ -5,16 +5,25 @@
 
 #include <vulkan/vulkan.h>
 
+#include <memory>
 #include <string>
+#include <vector>
 
+#include "VK/Allocator.h"
+
+namespace gli {
+class texture2d;
+}
 struct Device;
+struct MappedKtx;
+class UploadManager;
 
 struct Texture {
   void Destroy(const Device &device) const;
 
   VkImage image = VK_NULL_HANDLE;
   VkImageView view = VK_NULL_HANDLE;
-  VkDeviceMemory memory = VK_NULL_HANDLE;
+  Allocation allocation{};
   VkSampler sampler = VK_NULL_HANDLE;
 
   VkDescriptorImageInfo descriptor{};
@@ -27,16 +36,43 @@ struct Texture {
 
 struct Texture2D : public Texture {
   void
-  Load(const Device &device, const std::string &filepath, VkQueue copyQueue,
+  Load(const Device &device, const std::string &filepath,
+       UploadManager &uploader,
        VkFormat format = VK_FORMAT_R8G8B8A8_UNORM,
        VkImageUsageFlags imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT,
        VkImageLayout imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
        bool useStaging = true);
+  bool Decode(const std::string &filepath,
+              VkFormat format = VK_FORMAT_UNDEFINED);
+  void
+  Upload(const Device &device, UploadManager &uploader,
+         VkFormat format = VK_FORMAT_R8G8B8A8_UNORM,
+         VkImageUsageFlags imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT,
+         VkImageLayout imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+         bool useStaging = true);
 
   void FromBuffer(
       const Device &device, void *buffer, VkDeviceSize bufferSize,
-      VkFormat format, uint32_t texWidth, uint32_t texHeight, VkQueue copyQueue,
+      VkFormat format, uint32_t texWidth, uint32_t texHeight,
+      UploadManager &uploader,
       VkFilter filter = VK_FILTER_LINEAR,
       VkImageUsageFlags imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT,
-      VkImageLayout imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+      VkImageLayout imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+      bool generateMipmaps = true);
+
+private:
+  /** @brief Decodeで読み込み、Uploadで転送するまでのテクスチャ(KTX/DDS、ブロック圧縮した画像) */
+  std::shared_ptr<gli::texture2d> decoded_{};
+  /** @brief Decodeでマップしたファイルのレベルを直接指すテクスチャ(KTX) */
+  std::shared_ptr<MappedKtx> mapped_{};
+  /**
+   * @brief Decodeで読み込んだ画像(PNG/JPEG)のRGBA8の画素
+   * @note 画像はミップマップを持たないため、UploadでGPUで生成します。
+   */
+  struct Pixels {
+    std::vector<uint8_t> data{};
+    uint32_t width = 0;
+    uint32_t height = 0;
+  };
+  std::shared_ptr<Pixels> pixels_{};
 };
@@ -0,0 +1,449 @@
+/**
+ * @brief TextureStreamer
+ */
+
+#include "TextureStreamer.h"
+
+#include <algorithm>
+#include <boost/assert.hpp>
+#include <gli/gli.hpp>
+#include <limits>
+#include <spdlog/spdlog.h>
+
+#include "VK/AssetArchive.h"
+#include "VK/Common.h"
+#include "VK/Device.h"
+#include "VK/Initializer.h"
+#include "VK/Texture.h"
+#include "VK/UploadManager.h"
+
+/**
+ * @brief 記述子を書き直すパーティションの数を設定します。
+ * @param partitionCount ユニフォームリングのパーティションの数
+ */
+void TextureStreamer::Init(uint32_t partitionCount) {
+  partitionGenerations_.assign(partitionCount, generation_);
+}
+
+void TextureStreamer::Destroy(const Device &device) {
+  ReleaseRetired(device, std::numeric_limits<uint64_t>::max());
+  entries_.clear();
+}
+
+/**
+ * @brief テクスチャファイル(KTX/DDS)のミップテールを転送し、ストリーミングするテクスチャに加えます。
+ * @param device デバイスオブジェクト
+ * @param uploader 転送を記録するアップロードマネージャー
+ * @param texture 生成するテクスチャ(Updateでビューと記述子を差し替えるため、ストリーマーより長く生存させてください。)
+ * @param filepath テクスチャファイルのパス
+ * @param format イメージの形式
+ * @param imageUsageFlags イメージの使用方法
+ * @param imageLayout 転送後のイメージレイアウト
+ * @return テクスチャを読み込めたか？
+ */
+bool TextureStreamer::Add(const Device &device, UploadManager &uploader,
+                          Texture2D &texture, const std::string &filepath,
+                          VkFormat format, VkImageUsageFlags imageUsageFlags,
+                          VkImageLayout imageLayout) {
+  const auto file = AssetArchive::Get().Read(filepath);
+  auto source = std::make_shared<gli::texture2d>(
+      file ? gli::load(reinterpret_cast<const char *>(file.data), file.size)
+           : gli::texture());
+  if (source->empty()) {
+    spdlog::error("Failed to load texture from {}", filepath);
+    BOOST_ASSERT_MSG(!source->empty(), "Failed to load texture!");
+    return false;
+  }
+
+  Entry entry{};
+  entry.texture = &texture;
+  entry.source = std::move(source);
+  entry.format = format;
+  entry.imageUsageFlags = imageUsageFlags;
+  entry.imageLayout = imageLayout;
+
+  // 幅と高さがtailSize以下の最も細かいレベルまでを最初に転送します。
+  const gli::texture2d &tex2d = *entry.source;
+  const auto levelCount = static_cast<uint32_t>(tex2d.levels());
+  entry.residentLevel = levelCount - 1;
+  while (entry.residentLevel > 0) {
+    const auto extent = tex2d[entry.residentLevel - 1].extent();
+    if (static_cast<uint32_t>(std::max(extent.x, extent.y)) > tailSize) {
+      break;
+    }
+    entry.residentLevel--;
+  }
+  CreateImage(device, uploader, entry);
+
+  // ビューが参照するレベルを制限するため、サンプラーはすべてのレベルを対象にします。
+  VkSamplerCreateInfo samplerCreateInfo = Initializer::SamplerCreateInfo();
+  samplerCreateInfo.magFilter = VK_FILTER_LINEAR;
+  samplerCreateInfo.minFilter = VK_FILTER_LINEAR;
+  samplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+  samplerCreateInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  samplerCreateInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  samplerCreateInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  samplerCreateInfo.mipLodBias = 0.0f;
+  samplerCreateInfo.compareOp = VK_COMPARE_OP_NEVER;
+  samplerCreateInfo.minLod = 0.0f;
+  samplerCreateInfo.maxLod = static_cast<float>(levelCount);
+  samplerCreateInfo.maxAnisotropy =
+      device.enabledFeatures.samplerAnisotropy
+          ? device.properties.limits.maxSamplerAnisotropy
+          : 1.0f;
+  samplerCreateInfo.anisotropyEnable = device.enabledFeatures.samplerAnisotropy;
+  samplerCreateInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+  VK_CHECK_RESULT(
+      vkCreateSampler(device, &samplerCreateInfo, nullptr, &texture.sampler));
+
+  CreateView(device, entry);
+  texture.descriptor.sampler = texture.sampler;
+  texture.descriptor.imageLayout = imageLayout;
+
+  spdlog::info("Streaming {} ({} levels, {} resident)", filepath, levelCount,
+               levelCount - entry.residentLevel);
+  entries_.emplace_back(std::move(entry));
+  return true;
+}
+
+/**
+ * @brief 予算の範囲で次に細かいミップレベルの転送を記録します。
+ * @note
+ * 転送はアップロードマネージャーの送信でフレームの描画より先にキューへ送信されるため、転送したレベルはそのフレームから参照できます。<br>
+ * ビューを差し替えた場合は世代を進め、すべてのパーティションをIsStaleにします。
+ * 古いビューは、すべてのパーティションがMarkUpdatedを呼び出すまで破棄しません。
+ */
+void TextureStreamer::Update(const Device &device, UploadManager &uploader) {
+  const VkDeviceSize budget = GetMemoryBudget(device);
+  bool changed = Evict(device, uploader, budget);
+  if (!changed) {
+    changed = Restore(device, uploader, budget);
+  }
+
+  // すべてのテクスチャの粗いレベルが揃うように、次のレベルが最も小さいテクスチャから転送します。
+  VkDeviceSize remaining = bytesPerFrame;
+  bool isFirst = true;
+  while (true) {
+    Entry *next = nullptr;
+    VkDeviceSize nextSize = std::numeric_limits<VkDeviceSize>::max();
+    for (auto &entry : entries_) {
+      if (entry.residentLevel == entry.baseLevel) {
+        continue;
+      }
+      const auto size = static_cast<VkDeviceSize>(
+          (*entry.source)[entry.residentLevel - 1].size());
+      if (size < nextSize) {
+        next = &entry;
+        nextSize = size;
+      }
+    }
+    if (next == nullptr || (!isFirst && nextSize > remaining)) {
+      break;
+    }
+
+    UploadLevels(device, uploader, *next, next->residentLevel - 1, 1);
+    next->residentLevel--;
+    retired_.push_back({next->texture->view, VK_NULL_HANDLE, {},
+                        generation_ + 1});
+    CreateView(device, *next);
+    remaining -= std::min(nextSize, remaining);
+    isFirst = false;
+    changed = true;
+  }
+  if (changed) {
+    generation_++;
+  }
+}
+
+/**
+ * @brief パーティションの記述子が古いビューを参照しているか？
+ */
+bool TextureStreamer::IsStale(uint32_t partition) const {
+  return partitionGenerations_[partition] != generation_;
+}
+
+/**
+ * @brief パーティションの記述子を書き直したことを記録し、どのパーティションからも参照されないリソースを破棄します。
+ * @note
+ * パーティションを参照する送信がすべて完了してから、記述子を書き直して呼び出してください。<br>
+ * 他のパーティションの記述子は古いビューを参照したままのため、それらが書き直されるまで破棄しません。
+ */
+void TextureStreamer::MarkUpdated(const Device &device, uint32_t partition) {
+  partitionGenerations_[partition] = generation_;
+  ReleaseRetired(device, *std::min_element(partitionGenerations_.begin(),
+                                           partitionGenerations_.end()));
+}
+
+/**
+ * @brief ストリーミングするテクスチャに割り当てたイメージのバイト数を取得します。
+ * @note 転送元のレベルの大きさの合計で、メモリのアライメントは含みません。
+ */
+VkDeviceSize TextureStreamer::GetAllocatedBytes() const {
+  VkDeviceSize bytes = 0;
+  for (const auto &entry : entries_) {
+    const gli::texture2d &tex2d = *entry.source;
+    for (auto level = entry.baseLevel; level < tex2d.levels(); level++) {
+      bytes += static_cast<VkDeviceSize>(tex2d[level].size());
+    }
+  }
+  return bytes;
+}
+
+bool TextureStreamer::IsStreaming() const {
+  return std::any_of(entries_.begin(), entries_.end(), [](const Entry &e) {
+    return e.residentLevel > e.baseLevel;
+  });
+}
+
+//*-----------------------------------------------------------------------------
+// Private
+//*-----------------------------------------------------------------------------
+
+/**
+ * @brief 転送元のbaseLevel以降のレベルを持つイメージを生成し、residentLevel以降のレベルを転送します。
+ */
+void TextureStreamer::CreateImage(const Device &device,
+                                  UploadManager &uploader, Entry &entry) {
+  const gli::texture2d &tex2d = *entry.source;
+  Texture2D &texture = *entry.texture;
+  texture.width = static_cast<uint32_t>(tex2d[entry.baseLevel].extent().x);
+  texture.height = static_cast<uint32_t>(tex2d[entry.baseLevel].extent().y);
+  texture.mipLevels = static_cast<uint32_t>(tex2d.levels()) - entry.baseLevel;
+
+  VkImageCreateInfo imageCreateInfo = Initializer::ImageCreateInfo();
+  imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+  imageCreateInfo.format = entry.format;
+  imageCreateInfo.mipLevels = texture.mipLevels;
+  imageCreateInfo.arrayLayers = 1;
+  imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+  imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+  imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  imageCreateInfo.extent = {texture.width, texture.height, 1};
+  imageCreateInfo.usage =
+      entry.imageUsageFlags | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+  VK_CHECK_RESULT(
+      vkCreateImage(device, &imageCreateInfo, nullptr, &texture.image));
+
+  AllocationCreateInfo allocationCreateInfo{};
+  allocationCreateInfo.memoryPropertyFlags =
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+  allocationCreateInfo.optimalTiling = true;
+  VK_CHECK_RESULT(device.allocator->AllocateImageMemory(
+      device, texture.image, allocationCreateInfo, texture.allocation));
+
+  UploadLevels(device, uploader, entry, entry.residentLevel,
+               static_cast<uint32_t>(tex2d.levels()) - entry.residentLevel);
+}
+
+/**
+ * @brief residentLevel以降のレベルを参照するビューを生成し、記述子に設定します。
+ */
+void TextureStreamer::CreateView(const Device &device, Entry &entry) {
+  Texture2D &texture = *entry.texture;
+  VkImageViewCreateInfo imageViewCreateInfo =
+      Initializer::ImageViewCreateInfo();
+  imageViewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  imageViewCreateInfo.format = entry.format;
+  imageViewCreateInfo.components = {
+      VK_COMPONENT_SWIZZLE_R,
+      VK_COMPONENT_SWIZZLE_G,
+      VK_COMPONENT_SWIZZLE_B,
+      VK_COMPONENT_SWIZZLE_A,
+  };
+  // 転送していないレベルはレイアウトが未定義のため、ビューの範囲に含めません。
+  const auto baseMipLevel = entry.residentLevel - entry.baseLevel;
+  imageViewCreateInfo.subresourceRange = {
+      VK_IMAGE_ASPECT_COLOR_BIT, baseMipLevel,
+      texture.mipLevels - baseMipLevel, 0, 1,
+  };
+  imageViewCreateInfo.image = texture.image;
+  VK_CHECK_RESULT(
+      vkCreateImageView(device, &imageViewCreateInfo, nullptr, &texture.view));
+  texture.descriptor.imageView = texture.view;
+}
+
+/**
+ * @brief 転送元の連続したレベルの転送を記録します。
+ * @param level 転送する最初の転送元のレベル
+ * @param levelCount 転送するレベルの数
+ */
+void TextureStreamer::UploadLevels(const Device &device,
+                                   UploadManager &uploader,
+                                   const Entry &entry, uint32_t level,
+                                   uint32_t levelCount) {
+  const gli::texture2d &tex2d = *entry.source;
+  std::vector<VkBufferImageCopy> bufferImageCopyRegions{};
+  VkDeviceSize offset = 0;
+  for (uint32_t i = level; i < level + levelCount; i++) {
+    VkBufferImageCopy bufferImageCopyRegion{};
+    bufferImageCopyRegion.imageSubresource.aspectMask =
+        VK_IMAGE_ASPECT_COLOR_BIT;
+    bufferImageCopyRegion.imageSubresource.mipLevel = i - entry.baseLevel;
+    bufferImageCopyRegion.imageSubresource.baseArrayLayer = 0;
+    bufferImageCopyRegion.imageSubresource.layerCount = 1;
+    bufferImageCopyRegion.imageExtent.width =
+        static_cast<uint32_t>(tex2d[i].extent().x);
+    bufferImageCopyRegion.imageExtent.height =
+        static_cast<uint32_t>(tex2d[i].extent().y);
+    bufferImageCopyRegion.imageExtent.depth = 1;
+    bufferImageCopyRegion.bufferOffset = offset;
+    bufferImageCopyRegions.emplace_back(bufferImageCopyRegion);
+    offset += static_cast<VkDeviceSize>(tex2d[i].size());
+  }
+
+  // 1層のテクスチャのレベルは転送元のストレージに連続して並んでいます。
+  VkImageSubresourceRange imageSubresourceRange{};
+  imageSubresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  imageSubresourceRange.baseMipLevel = level - entry.baseLevel;
+  imageSubresourceRange.levelCount = levelCount;
+  imageSubresourceRange.layerCount = 1;
+  uploader.UploadImage(device, entry.texture->image, imageSubresourceRange,
+                       tex2d[level].data(), offset,
+                       std::move(bufferImageCopyRegions), entry.imageLayout);
+}
+
+/**
+ * @brief 転送元のbaseLevel以降のレベルを持つイメージに作り直し、参照できるレベルを転送し直します。
+ * @note イメージのメモリは部分的に解放も拡張もできないため、レベルの数を変えるときはイメージごと作り直します。
+ */
+void TextureStreamer::Recreate(const Device &device, UploadManager &uploader,
+                               Entry &entry, uint32_t baseLevel) {
+  Texture2D &texture = *entry.texture;
+  retired_.push_back(
+      {texture.view, texture.image, texture.allocation, generation_ + 1});
+  entry.baseLevel = baseLevel;
+  entry.residentLevel = std::max(entry.residentLevel, entry.baseLevel);
+  CreateImage(device, uploader, entry);
+  CreateView(device, entry);
+}
+
+/**
+ * @brief ストリーミングするテクスチャに使えるバイト数を求めます。
+ * @return 予算(制限しない場合はVkDeviceSizeの最大値)
+ * @note
+ * memoryBudgetが0の場合は、デバイスローカルヒープの予算の空きにストリーミングしているテクスチャの分を加えます。<br>
+ * アロケータのブロックの空き領域はヒープの使用量に含まれるため、空きとして数えます。
+ * 破棄を待っているイメージはまだメモリを使っているため、空きには数えず予算に対して数えます。(GetRetiredBytes)
+ */
+VkDeviceSize TextureStreamer::GetMemoryBudget(const Device &device) const {
+  if (memoryBudget != 0) {
+    return memoryBudget;
+  }
+  VkDeviceSize heapBudget = 0;
+  VkDeviceSize heapUsage = 0;
+  if (!device.GetDeviceLocalBudget(heapBudget, heapUsage)) {
+    return std::numeric_limits<VkDeviceSize>::max();
+  }
+
+  VkDeviceSize available = heapBudget - std::min(heapUsage, heapBudget);
+  available += device.allocator->GetStats().freeBytes;
+  const VkDeviceSize budget = GetAllocatedBytes() + available;
+  return budget - std::min(budget, budgetReserve);
+}
+
+/**
+ * @brief メモリの予算を超えている間、最も大きなテクスチャの最も細かいレベルを追い出します。
+ * @return 作り直したテクスチャがあるか？
+ * @note
+ * 追い出したレベルは、予算に空きができるとRestoreで再びストリーミングします。<br>
+ * 作り直す間は古いイメージと新しいイメージが両方メモリを使うため、1回のUpdateで追い出すのはテクスチャごとに1レベルまでです。
+ * 破棄を待っているイメージのうち、このUpdateより前に差し替えたものは予算に対して数えます。
+ */
+bool TextureStreamer::Evict(const Device &device, UploadManager &uploader,
+                            VkDeviceSize budget) {
+  const VkDeviceSize retiredBytes = GetRetiredBytes();
+  std::vector<const Entry *> evicted{};
+  while (GetAllocatedBytes() + retiredBytes > budget) {
+    Entry *largest = nullptr;
+    size_t largestSize = 0;
+    for (auto &entry : entries_) {
+      const gli::texture2d &tex2d = *entry.source;
+      if (entry.baseLevel + 1 >= tex2d.levels() ||
+          std::find(evicted.begin(), evicted.end(), &entry) !=
+              evicted.end()) {
+        continue;
+      }
+      if (tex2d[entry.baseLevel].size() > largestSize) {
+        largest = &entry;
+        largestSize = tex2d[entry.baseLevel].size();
+      }
+    }
+    if (largest == nullptr) {
+      break;
+    }
+
+    Recreate(device, uploader, *largest, largest->baseLevel + 1);
+    const Texture2D &texture = *largest->texture;
+    spdlog::info("Evicted texture level (now {}x{}, {} levels)",
+                 texture.width, texture.height, texture.mipLevels);
+    evicted.push_back(largest);
+  }
+  return !evicted.empty();
+}
+
+/**
+ * @brief 予算に空きがあれば、追い出したレベルが最も小さいテクスチャを1レベル大きく作り直します。
+ * @return 作り直したテクスチャがあるか？
+ * @note
+ * 戻したレベルはUpdateで他のレベルと同じように転送します。<br>
+ * 追い出しと戻しを繰り返さないように、戻した後もbudgetReserveの空きが残る場合のみ戻します。
+ */
+bool TextureStreamer::Restore(const Device &device, UploadManager &uploader,
+                              VkDeviceSize budget) {
+  Entry *smallest = nullptr;
+  VkDeviceSize smallestSize = std::numeric_limits<VkDeviceSize>::max();
+  for (auto &entry : entries_) {
+    if (entry.baseLevel == 0) {
+      continue;
+    }
+    const auto size = static_cast<VkDeviceSize>(
+        (*entry.source)[entry.baseLevel - 1].size());
+    if (size < smallestSize) {
+      smallest = &entry;
+      smallestSize = size;
+    }
+  }
+  // 破棄を待っているイメージが解放されるまでは、その分の空きを使いません。
+  const VkDeviceSize allocated = GetAllocatedBytes() + GetRetiredBytes();
+  if (smallest == nullptr || budget <= allocated ||
+      budget - allocated < smallestSize + budgetReserve) {
+    return false;
+  }
+
+  Recreate(device, uploader, *smallest, smallest->baseLevel - 1);
+  const Texture2D &texture = *smallest->texture;
+  spdlog::info("Restored texture level (now {}x{}, {} levels)", texture.width,
+               texture.height, texture.mipLevels);
+  return true;
+}
+
+/**
+ * @brief 差し替えて破棄を待っているイメージのバイト数を取得します。
+ */
+VkDeviceSize TextureStreamer::GetRetiredBytes() const {
+  VkDeviceSize bytes = 0;
+  for (const auto &retired : retired_) {
+    bytes += retired.allocation.size;
+  }
+  return bytes;
+}
+
+/**
+ * @brief 指定した世代までに差し替えたビューとイメージを破棄します。
+ * @param generation すべてのパーティションの記述子が書き直された世代
+ */
+void TextureStreamer::ReleaseRetired(const Device &device,
+                                     uint64_t generation) {
+  const auto released = std::stable_partition(
+      retired_.begin(), retired_.end(),
+      [generation](const Retired &r) { return r.generation > generation; });
+  for (auto it = released; it != retired_.end(); ++it) {
+    vkDestroyImageView(device, it->view, nullptr);
+    if (it->image != VK_NULL_HANDLE) {
+      vkDestroyImage(device, it->image, nullptr);
+      device.allocator->Free(device, it->allocation);
+    }
+  }
+  retired_.erase(released, retired_.end());
+}
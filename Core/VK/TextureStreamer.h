@@ -0,0 +1,105 @@
+/**
+ * @brief 大きなテクスチャのミップレベルを小さいものから段階的に転送します。
+ */
+
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <boost/noncopyable.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "VK/Allocator.h"
+
+namespace gli {
+class texture2d;
+}
+struct Device;
+struct Texture2D;
+class UploadManager;
+
+/**
+ * @brief テクスチャのミップレベルのストリーミング
+ * @note
+ * Addでは小さいミップレベル(ミップテール)のみを転送し、細かいレベルはUpdateで1フレームあたりの予算の範囲で転送します。<br>
+ * 参照できるレベルはイメージビューのbaseMipLevelで制限するため、参照するレベルが変わるとテクスチャのビューと記述子が変わります。<br>
+ * 記述子はパーティションごとに書き直します。(IsStaleのパーティションを参照する送信の完了後に書き直し、MarkUpdatedを呼び出します。)<br>
+ * メモリの予算を超えた場合は、最も大きなテクスチャの最も細かいレベルを持たない小さなイメージに作り直します。
+ * 予算に空きができると、追い出したレベルを持つイメージに作り直して再びストリーミングします。
+ */
+class TextureStreamer : private boost::noncopyable {
+public:
+  void Init(uint32_t partitionCount);
+  void Destroy(const Device &device);
+
+  bool
+  Add(const Device &device, UploadManager &uploader, Texture2D &texture,
+      const std::string &filepath,
+      VkFormat format = VK_FORMAT_R8G8B8A8_UNORM,
+      VkImageUsageFlags imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT,
+      VkImageLayout imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+  void Update(const Device &device, UploadManager &uploader);
+  [[nodiscard]] bool IsStale(uint32_t partition) const;
+  void MarkUpdated(const Device &device, uint32_t partition);
+
+  [[nodiscard]] VkDeviceSize GetAllocatedBytes() const;
+  /** @brief 転送していないミップレベルを持つテクスチャがあるか？ */
+  [[nodiscard]] bool IsStreaming() const;
+
+  /** @brief 1フレームで転送するバイト数(1レベルがこれを超える場合も、1フレームに1レベルは転送します。) */
+  VkDeviceSize bytesPerFrame = 4ull * 1024 * 1024;
+  /** @brief ストリーミングするテクスチャのメモリの予算(0の場合はVK_EXT_memory_budgetのヒープの予算から求めます。) */
+  VkDeviceSize memoryBudget = 0;
+  /** @brief ヒープの予算から他のリソースのために残すバイト数(追い出したレベルは、この2倍の空きで戻します。) */
+  VkDeviceSize budgetReserve = 64ull * 1024 * 1024;
+  /** @brief Addで転送するミップテールの大きさ(幅と高さがこれ以下のレベルを転送します。) */
+  uint32_t tailSize = 128;
+
+private:
+  struct Entry {
+    Texture2D *texture = nullptr;
+    /** @brief 転送元のミップチェーン(細かいレベルの転送と、イメージの作り直しに使います。) */
+    std::shared_ptr<gli::texture2d> source{};
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    VkImageUsageFlags imageUsageFlags = 0;
+    VkImageLayout imageLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    /** @brief イメージのレベル0に対応する転送元のレベル */
+    uint32_t baseLevel = 0;
+    /** @brief 転送済みで参照できる最も細かい転送元のレベル */
+    uint32_t residentLevel = 0;
+  };
+  /**
+   * @brief 差し替えたリソース(処理中のフレームの完了後に破棄します。)
+   */
+  struct Retired {
+    VkImageView view = VK_NULL_HANDLE;
+    VkImage image = VK_NULL_HANDLE;
+    Allocation allocation{};
+    /** @brief 差し替えた後の世代(すべてのパーティションがこの世代に更新されると破棄します。) */
+    uint64_t generation = 0;
+  };
+
+  void CreateImage(const Device &device, UploadManager &uploader,
+                   Entry &entry);
+  void CreateView(const Device &device, Entry &entry);
+  void UploadLevels(const Device &device, UploadManager &uploader,
+                    const Entry &entry, uint32_t level, uint32_t levelCount);
+  void Recreate(const Device &device, UploadManager &uploader, Entry &entry,
+                uint32_t baseLevel);
+  [[nodiscard]] VkDeviceSize GetMemoryBudget(const Device &device) const;
+  [[nodiscard]] VkDeviceSize GetRetiredBytes() const;
+  bool Evict(const Device &device, UploadManager &uploader,
+             VkDeviceSize budget);
+  bool Restore(const Device &device, UploadManager &uploader,
+               VkDeviceSize budget);
+  void ReleaseRetired(const Device &device, uint64_t generation);
+
+  std::vector<Entry> entries_{};
+  std::vector<Retired> retired_{};
+  /** @brief ビューを差し替えるたびに進める世代 */
+  uint64_t generation_ = 0;
+  /** @brief パーティションごとの記述子を書き直した世代 */
+  std::vector<uint64_t> partitionGenerations_{};
+};
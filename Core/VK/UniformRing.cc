@@ -0,0 +1,116 @@
+/**
+ * @brief フレームごとに分割したユニフォームバッファから定数の領域を割り当てます。
+ */
+
+#include "VK/UniformRing.h"
+
+#include <algorithm>
+#include <boost/assert.hpp>
+#include <cstring>
+
+#include "VK/Common.h"
+#include "VK/Device.h"
+
+static VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+//*-----------------------------------------------------------------------------
+// Init & Deinit
+//*-----------------------------------------------------------------------------
+
+/**
+ * @brief パーティションの数だけユニフォームバッファを確保します。
+ * @param device デバイスオブジェクト
+ * @param partitionCount パーティションの数
+ * @note
+ * コマンドバッファはスワップチェーンイメージごとに事前に記録され、動的オフセットもそのときに決まるため、パーティションはイメージごとに用意します。<br>
+ * イメージの取得後に前回の送信の完了を待ってから書き込むため、GPUが読み込み中の領域を書き換えることはありません。<br>
+ * スワップチェーンの再生成でイメージが増えた場合は、GetPartitionで複数のイメージが同じパーティションを共有します。
+ */
+void UniformRing::Init(const Device &device, uint32_t partitionCount) {
+  BOOST_ASSERT_MSG(partitionCount > 0, "Uniform ring needs a partition!");
+  partitionCount_ = partitionCount;
+  alignment_ = std::max<VkDeviceSize>(
+      device.properties.limits.minUniformBufferOffsetAlignment, 1);
+  stride_ = AlignUp(partitionSize, alignment_);
+  head_ = 0;
+  shadow_.assign(partitionSize, 0);
+
+  VK_CHECK_RESULT(device.CreateBuffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                                      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                      stride_ * partitionCount_, buffer_,
+                                      allocation_));
+  BOOST_ASSERT_MSG(allocation_.mapped != nullptr,
+                   "Uniform ring is not host visible!");
+}
+
+void UniformRing::Destroy(const Device &device) {
+  if (buffer_ == VK_NULL_HANDLE) {
+    return;
+  }
+  device.DestroyBuffer(buffer_, allocation_);
+  buffer_ = VK_NULL_HANDLE;
+  allocation_ = {};
+  shadow_.clear();
+}
+
+//*-----------------------------------------------------------------------------
+// Allocate & Write
+//*-----------------------------------------------------------------------------
+
+/**
+ * @brief すべてのパーティションの同じ位置に領域を割り当てます。
+ * @param size 定数のバイト数
+ */
+UniformAllocation UniformRing::Allocate(VkDeviceSize size) {
+  const VkDeviceSize offset = AlignUp(head_, alignment_);
+  BOOST_ASSERT_MSG(offset + size <= partitionSize,
+                   "Uniform ring partition is full!");
+  head_ = offset + size;
+
+  UniformAllocation allocation{};
+  allocation.offset = offset;
+  allocation.size = size;
+  allocation.descriptor.buffer = buffer_;
+  allocation.descriptor.offset = 0;
+  allocation.descriptor.range = size;
+  return allocation;
+}
+
+/**
+ * @brief 定数を書き込みます。
+ * @note 書き込んだ定数は次のFlushで描画するパーティションにコピーされます。
+ */
+void UniformRing::Write(const UniformAllocation &allocation, const void *data,
+                        VkDeviceSize size) {
+  BOOST_ASSERT_MSG(size <= allocation.size,
+                   "Uniform data exceeds the allocation!");
+  std::memcpy(shadow_.data() + allocation.offset, data, size);
+}
+
+/**
+ * @brief これまでに書き込んだ定数をパーティションにコピーします。
+ * @param device デバイスオブジェクト
+ * @param partition 描画するスワップチェーンイメージのインデックス
+ */
+void UniformRing::Flush(const Device &device, uint32_t partition) const {
+  BOOST_ASSERT(partition < partitionCount_);
+  if (head_ == 0) {
+    return;
+  }
+  const VkDeviceSize offset = stride_ * partition;
+  std::memcpy(static_cast<char *>(allocation_.mapped) + offset,
+              shadow_.data(), head_);
+  VK_CHECK_RESULT(device.allocator->Flush(device, allocation_, offset, head_));
+}
+
+/**
+ * @brief 記述子セットをバインドするときの動的オフセットを返します。
+ */
+uint32_t UniformRing::GetDynamicOffset(const UniformAllocation &allocation,
+                                       uint32_t partition) const {
+  BOOST_ASSERT(partition < partitionCount_);
+  return static_cast<uint32_t>(stride_ * partition + allocation.offset);
+}
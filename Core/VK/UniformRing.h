@@ -0,0 +1,60 @@
+/**
+ * @brief フレームごとに分割したユニフォームバッファから定数の領域を割り当てます。
+ */
+
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <boost/noncopyable.hpp>
+#include <vector>
+
+#include "VK/Allocator.h"
+
+struct Device;
+
+/**
+ * @brief リングの各パーティションに確保された同じ位置の領域
+ * @note VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMICの記述子として使用します。
+ */
+struct UniformAllocation {
+  /** @brief パーティションの先頭からのオフセット */
+  VkDeviceSize offset = 0;
+  VkDeviceSize size = 0;
+  /** @brief 記述子の情報(オフセットは動的オフセットで指定します。) */
+  VkDescriptorBufferInfo descriptor{};
+};
+
+class UniformRing : private boost::noncopyable {
+public:
+  void Init(const Device &device, uint32_t partitionCount);
+  void Destroy(const Device &device);
+
+  [[nodiscard]] UniformAllocation Allocate(VkDeviceSize size);
+  void Write(const UniformAllocation &allocation, const void *data,
+             VkDeviceSize size);
+  void Flush(const Device &device, uint32_t partition) const;
+
+  [[nodiscard]] uint32_t GetDynamicOffset(const UniformAllocation &allocation,
+                                          uint32_t partition) const;
+  [[nodiscard]] uint32_t GetPartitionCount() const { return partitionCount_; }
+  /** @brief スワップチェーンイメージが使用するパーティションを返します。 */
+  [[nodiscard]] uint32_t GetPartition(uint32_t image) const {
+    return image % partitionCount_;
+  }
+
+  /** @brief 1つのパーティションのバイト数 */
+  VkDeviceSize partitionSize = 64ull * 1024;
+
+private:
+  VkBuffer buffer_ = VK_NULL_HANDLE;
+  Allocation allocation_{};
+  /** @brief minUniformBufferOffsetAlignmentに揃えたパーティションの間隔 */
+  VkDeviceSize stride_ = 0;
+  VkDeviceSize alignment_ = 256;
+  uint32_t partitionCount_ = 0;
+  /** @brief 割り当て済みのバイト数 */
+  VkDeviceSize head_ = 0;
+  /** @brief 次に描画するパーティションへコピーする定数 */
+  std::vector<char> shadow_{};
+};
@@ -0,0 +1,809 @@
+/**
+ * @brief テクスチャやメッシュの転送をまとめて1回のキュー送信で行います。
+ */
+
+#include "VK/UploadManager.h"
+
+#include <algorithm>
+#include <boost/assert.hpp>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <spdlog/spdlog.h>
+
+#include "VK/Common.h"
+#include "VK/Device.h"
+#include "VK/Initializer.h"
+#include "VK/Utils.h"
+
+#define MIPMAP_COMPUTE_SHADER_PATH                                             \
+  "./Assets/Shaders/GLSL/SPIR-V/Texture/Downsample.cs.spv"
+
+/** @brief ミップマップの1つのワークグループが担当する縮小元の画素の幅(シェーダーと一致させます。) */
+static constexpr uint32_t kMipTileSize = 64;
+
+/** @brief ミップマップのシェーダーのプッシュ定数(シェーダーのPushConstantsと一致させます。) */
+struct MipPushConstants {
+  int32_t width;
+  int32_t height;
+  int32_t levelCount;
+  uint32_t groupCount;
+};
+
+static VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+//*-----------------------------------------------------------------------------
+// Init & Deinit
+//*-----------------------------------------------------------------------------
+
+/**
+ * @brief ステージングリングとコマンドプールを生成します。
+ * @param device デバイスオブジェクト
+ * @param graphicsQueue 所有権の取得とレイアウト遷移を送信するグラフィックスキュー
+ */
+void UploadManager::Init(const Device &device, VkQueue graphicsQueue) {
+  graphicsQueue_ = graphicsQueue;
+  graphicsFamily_ = device.queueFamilyIndices.graphics;
+  transferFamily_ = device.queueFamilyIndices.transfer;
+  if (IsDedicatedTransfer()) {
+    vkGetDeviceQueue(device, transferFamily_, 0, &transferQueue_);
+    graphicsPool_ = device.CreateCommandPool(graphicsFamily_);
+  } else {
+    transferQueue_ = graphicsQueue_;
+  }
+  transferPool_ = device.CreateCommandPool(transferFamily_);
+
+  // イメージへのコピー元オフセットはテクセルブロックのサイズ(1〜32バイト)の倍数である必要があるため、それらの最小公倍数に揃えます。
+  const VkDeviceSize optimal = std::max<VkDeviceSize>(
+      device.properties.limits.optimalBufferCopyOffsetAlignment, 1);
+  bufferAlignment_ = std::lcm(bufferAlignment_, optimal);
+  imageAlignment_ = std::lcm(imageAlignment_, optimal);
+
+  VK_CHECK_RESULT(device.CreateBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                      stagingSize, staging_,
+                                      stagingAllocation_));
+  BOOST_ASSERT_MSG(stagingAllocation_.mapped != nullptr,
+                   "Staging ring is not host visible!");
+  head_ = 0;
+  tail_ = 0;
+
+  spdlog::info("Upload manager: {} MiB staging ring, {} transfer queue",
+               stagingSize >> 20,
+               IsDedicatedTransfer() ? "dedicated" : "shared");
+}
+
+/**
+ * @brief 未送信の転送を送信し、すべての完了を待ってからリソースを破棄します。
+ */
+void UploadManager::Destroy(const Device &device) {
+  if (transferPool_ == VK_NULL_HANDLE) {
+    return;
+  }
+  Wait(device, Submit(device));
+
+  for (const auto pipeline : mipPipelines_) {
+    vkDestroyPipeline(device, pipeline, nullptr);
+  }
+  mipPipelines_ = {};
+  vkDestroyPipelineLayout(device, mipPipelineLayout_, nullptr);
+  mipPipelineLayout_ = VK_NULL_HANDLE;
+  vkDestroyDescriptorSetLayout(device, mipSetLayout_, nullptr);
+  mipSetLayout_ = VK_NULL_HANDLE;
+  if (mipCounter_ != VK_NULL_HANDLE) {
+    device.DestroyBuffer(mipCounter_, mipCounterAllocation_);
+    mipCounter_ = VK_NULL_HANDLE;
+    mipCounterAllocation_ = {};
+  }
+
+  for (const auto &batch : free_) {
+    if (batch->semaphore != VK_NULL_HANDLE) {
+      vkDestroySemaphore(device, batch->semaphore, nullptr);
+    }
+    vkDestroyFence(device, batch->fence, nullptr);
+  }
+  free_.clear();
+
+  device.DestroyBuffer(staging_, stagingAllocation_);
+  staging_ = VK_NULL_HANDLE;
+  stagingAllocation_ = {};
+
+  // コマンドバッファはプールと一緒に解放されます。
+  if (graphicsPool_ != VK_NULL_HANDLE) {
+    vkDestroyCommandPool(device, graphicsPool_, nullptr);
+    graphicsPool_ = VK_NULL_HANDLE;
+  }
+  vkDestroyCommandPool(device, transferPool_, nullptr);
+  transferPool_ = VK_NULL_HANDLE;
+}
+
+//*-----------------------------------------------------------------------------
+// Record
+//*-----------------------------------------------------------------------------
+
+/**
+ * @brief バッファへの転送を記録します。
+ * @note
+ * データはステージングリングにコピーされるため、呼び出し後すぐに解放して構いません。
+ * @param device デバイスオブジェクト
+ * @param buffer 転送先のバッファ(VK_BUFFER_USAGE_TRANSFER_DST_BITが必要です。)
+ * @param data 転送するデータ
+ * @param size 転送するバイト数
+ * @param dstOffset 転送先のオフセット
+ */
+void UploadManager::UploadBuffer(const Device &device, VkBuffer buffer,
+                                 const void *data, VkDeviceSize size,
+                                 VkDeviceSize dstOffset) {
+  const auto [src, srcOffset] = Stage(device, data, size, bufferAlignment_);
+  Batch &batch = Record(device);
+
+  VkBufferCopy region{};
+  region.srcOffset = srcOffset;
+  region.dstOffset = dstOffset;
+  region.size = size;
+  vkCmdCopyBuffer(batch.transfer, src, buffer, 1, &region);
+
+  VkBufferMemoryBarrier barrier = Initializer::BufferMemoryBarrier();
+  barrier.buffer = buffer;
+  barrier.offset = dstOffset;
+  barrier.size = size;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+  if (IsDedicatedTransfer()) {
+    // 転送キューで所有権を解放し、グラフィックスキューで取得します。
+    barrier.srcQueueFamilyIndex = transferFamily_;
+    barrier.dstQueueFamilyIndex = graphicsFamily_;
+    barrier.dstAccessMask = 0;
+    vkCmdPipelineBarrier(batch.transfer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr,
+                         1, &barrier, 0, nullptr);
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+    vkCmdPipelineBarrier(batch.acquire, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                         VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 1,
+                         &barrier, 0, nullptr);
+  } else {
+    vkCmdPipelineBarrier(batch.transfer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 1,
+                         &barrier, 0, nullptr);
+  }
+
+  batch.copyCount++;
+  batch.bytes += size;
+}
+
+/**
+ * @brief イメージへの転送を記録します。
+ * @param device デバイスオブジェクト
+ * @param image 転送先のイメージ(VK_IMAGE_USAGE_TRANSFER_DST_BITが必要です。)
+ * @param subresourceRange 遷移させるサブリソースの範囲
+ * @param data 転送するデータ
+ * @param size 転送するバイト数
+ * @param regions コピー領域(bufferOffsetはdataの先頭からのオフセットです。)
+ * @param imageLayout 転送後のイメージレイアウト
+ */
+void UploadManager::UploadImage(const Device &device, VkImage image,
+                                const VkImageSubresourceRange &subresourceRange,
+                                const void *data, VkDeviceSize size,
+                                std::vector<VkBufferImageCopy> regions,
+                                VkImageLayout imageLayout) {
+  const auto [src, srcOffset] = Stage(device, data, size, imageAlignment_);
+  Batch &batch = Record(device);
+
+  VkImageMemoryBarrier barrier = Initializer::ImageMemoryBarrier();
+  barrier.image = image;
+  barrier.subresourceRange = subresourceRange;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.srcAccessMask = 0;
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  vkCmdPipelineBarrier(batch.transfer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                       nullptr, 1, &barrier);
+
+  for (auto &region : regions) {
+    region.bufferOffset += srcOffset;
+  }
+  vkCmdCopyBufferToImage(batch.transfer, src, image,
+                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                         static_cast<uint32_t>(regions.size()), regions.data());
+
+  barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.newLayout = imageLayout;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+  if (IsDedicatedTransfer()) {
+    // 所有権の解放と取得には同じレイアウト遷移を記録する必要があります。
+    barrier.srcQueueFamilyIndex = transferFamily_;
+    barrier.dstQueueFamilyIndex = graphicsFamily_;
+    barrier.dstAccessMask = 0;
+    vkCmdPipelineBarrier(batch.transfer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr,
+                         0, nullptr, 1, &barrier);
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+    vkCmdPipelineBarrier(batch.acquire, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                         VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0,
+                         nullptr, 1, &barrier);
+  } else {
+    vkCmdPipelineBarrier(batch.transfer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0,
+                         nullptr, 1, &barrier);
+  }
+
+  batch.copyCount++;
+  batch.bytes += size;
+}
+
+/**
+ * @brief 転送を伴わないイメージレイアウトの遷移を記録します。(UNDEFINEDから遷移します。)
+ */
+void UploadManager::TransitionImage(
+    const Device &device, VkImage image,
+    const VkImageSubresourceRange &subresourceRange,
+    VkImageLayout imageLayout) {
+  VkImageMemoryBarrier barrier = Initializer::ImageMemoryBarrier();
+  barrier.image = image;
+  barrier.subresourceRange = subresourceRange;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  barrier.newLayout = imageLayout;
+  barrier.srcAccessMask = VK_ACCESS_HOST_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+  vkCmdPipelineBarrier(GetGraphicsCommandBuffer(device),
+                       VK_PIPELINE_STAGE_HOST_BIT,
+                       VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0,
+                       nullptr, 1, &barrier);
+}
+
+/**
+ * @brief レベル0から1段ずつvkCmdBlitImageで縮小し、ミップマップを生成します。
+ * @param device デバイスオブジェクト
+ * @param image 対象のイメージ(VK_IMAGE_USAGE_TRANSFER_SRC_BITが必要です。)
+ * @param width レベル0の幅
+ * @param height レベル0の高さ
+ * @param mipLevels イメージのミップレベルの数
+ * @param imageLayout 生成後のイメージレイアウト(すべてのレベルをこのレイアウトにします。)
+ * @note
+ * レベル0はUploadImageでTRANSFER_SRC_OPTIMALに遷移させておく必要があります。<br>
+ * ブリットはグラフィックスキューでのみ実行できるため、グラフィックスキューファミリーのコマンドバッファに記録します。<br>
+ * sRGB形式のイメージは線形の値に変換してからフィルタリングされます。
+ */
+void UploadManager::GenerateMipmaps(const Device &device, VkImage image,
+                                    uint32_t width, uint32_t height,
+                                    uint32_t mipLevels,
+                                    VkImageLayout imageLayout) {
+  VkCommandBuffer commandBuffer = GetGraphicsCommandBuffer(device);
+
+  // レベル1以降を転送先にします。
+  VkImageMemoryBarrier barrier = Initializer::ImageMemoryBarrier();
+  barrier.image = image;
+  barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  barrier.subresourceRange.baseMipLevel = 1;
+  barrier.subresourceRange.levelCount = mipLevels - 1;
+  barrier.subresourceRange.baseArrayLayer = 0;
+  barrier.subresourceRange.layerCount = 1;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.srcAccessMask = 0;
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                       nullptr, 1, &barrier);
+
+  for (uint32_t i = 1; i < mipLevels; i++) {
+    VkImageBlit blit{};
+    blit.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, i - 1, 0, 1};
+    blit.srcOffsets[1] = {static_cast<int32_t>(std::max(width >> (i - 1), 1u)),
+                          static_cast<int32_t>(std::max(height >> (i - 1), 1u)),
+                          1};
+    blit.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1};
+    blit.dstOffsets[1] = {static_cast<int32_t>(std::max(width >> i, 1u)),
+                          static_cast<int32_t>(std::max(height >> i, 1u)), 1};
+    vkCmdBlitImage(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                   image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit,
+                   VK_FILTER_LINEAR);
+
+    // 書き込んだレベルを次の縮小元にします。
+    barrier.subresourceRange.baseMipLevel = i;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                         nullptr, 1, &barrier);
+  }
+
+  // すべてのレベルを最終のレイアウトに遷移させます。
+  barrier.subresourceRange.baseMipLevel = 0;
+  barrier.subresourceRange.levelCount = mipLevels;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  barrier.newLayout = imageLayout;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0,
+                       nullptr, 1, &barrier);
+}
+
+/**
+ * @brief 1回のディスパッチのコンピュートシェーダーで縮小し、ミップマップを生成します。
+ * @param device デバイスオブジェクト
+ * @param image 対象のイメージ(8bitのRGBAまたはBGRAの形式で、VK_IMAGE_USAGE_TRANSFER_SRC_BITが必要です。)
+ * @param width レベル0の幅
+ * @param height レベル0の高さ
+ * @param mipLevels イメージのミップレベルの数(kMaxComputeMipLevels以下)
+ * @param srgb sRGB形式か(シェーダーで線形の値に戻してから平均します。)
+ * @param imageLayout 生成後のイメージレイアウト(すべてのレベルをこのレイアウトにします。)
+ * @note
+ * 線形フィルタのブリットに対応していない形式のためのものです。<br>
+ * sRGBとBGRAの形式はストレージイメージに対応しているとは限らないため、RGBA8_UNORMの一時的なイメージに
+ * レベル0をコピーして縮小し、生成したレベルを対象のイメージにコピーします。
+ * (どちらも32bitの形式なので、チャンネルの順と色空間を変えずにコピーできます。)<br>
+ * レベル0はUploadImageでTRANSFER_SRC_OPTIMALに遷移させておく必要があります。
+ */
+void UploadManager::GenerateMipmapsCompute(const Device &device,
+                                           VkImage image, uint32_t width,
+                                           uint32_t height,
+                                           uint32_t mipLevels, bool srgb,
+                                           VkImageLayout imageLayout) {
+  BOOST_ASSERT_MSG(mipLevels > 1 && mipLevels <= kMaxComputeMipLevels,
+                   "Too many mip levels for the compute downsampler!");
+  BOOST_ASSERT_MSG(mipPipelines_[0] != VK_NULL_HANDLE,
+                   "SetupPipelines has not been called!");
+  VkCommandBuffer commandBuffer = GetGraphicsCommandBuffer(device);
+
+  MipScratch scratch{};
+  VK_CHECK_RESULT(CreateImage(
+      device, scratch.image, scratch.allocation, VK_FORMAT_R8G8B8A8_UNORM,
+      VK_IMAGE_TYPE_2D, width, height, 1, mipLevels, 1,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+          VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+      VK_IMAGE_TILING_OPTIMAL));
+
+  // レベルごとのビューを作り、使わない要素は最後のレベルのビューで埋めます。
+  std::array<VkDescriptorImageInfo, kMaxComputeMipLevels> levelInfos{};
+  for (uint32_t level = 0; level < mipLevels; level++) {
+    VkImageView view = VK_NULL_HANDLE;
+    VK_CHECK_RESULT(CreateImageView(
+        device, view, scratch.image, VK_IMAGE_VIEW_TYPE_2D,
+        VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT, level, 1));
+    scratch.views.emplace_back(view);
+  }
+  for (uint32_t level = 0; level < kMaxComputeMipLevels; level++) {
+    levelInfos[level] = Initializer::DescriptorImageInfo(
+        VK_NULL_HANDLE, scratch.views[std::min(level, mipLevels - 1)],
+        VK_IMAGE_LAYOUT_GENERAL);
+  }
+
+  std::vector<VkDescriptorPoolSize> poolSizes = {
+      Initializer::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                                      kMaxComputeMipLevels),
+      Initializer::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1),
+  };
+  VkDescriptorPoolCreateInfo descriptorPoolCreateInfo =
+      Initializer::DescriptorPoolCreateInfo(poolSizes, 1);
+  VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolCreateInfo,
+                                         nullptr, &scratch.descriptorPool));
+  VkDescriptorSetAllocateInfo descriptorSetAllocateInfo =
+      Initializer::DescriptorSetAllocateInfo(scratch.descriptorPool,
+                                             &mipSetLayout_, 1);
+  VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+  VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocateInfo,
+                                           &descriptorSet));
+  VkDescriptorBufferInfo counterInfo{mipCounter_, 0, sizeof(uint32_t)};
+  std::array<VkWriteDescriptorSet, 2> writeDescriptorSets = {
+      Initializer::WriteDescriptorSet(
+          descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 0,
+          levelInfos.data(), kMaxComputeMipLevels),
+      Initializer::WriteDescriptorSet(
+          descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &counterInfo),
+  };
+  vkUpdateDescriptorSets(device,
+                         static_cast<uint32_t>(writeDescriptorSets.size()),
+                         writeDescriptorSets.data(), 0, nullptr);
+
+  // レベル0を一時的なイメージにコピーします。
+  VkImageMemoryBarrier barrier = Initializer::ImageMemoryBarrier();
+  barrier.image = scratch.image;
+  barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+  barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.srcAccessMask = 0;
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                       nullptr, 1, &barrier);
+  VkImageCopy level0{};
+  level0.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+  level0.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+  level0.extent = {width, height, 1};
+  vkCmdCopyImage(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                 scratch.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
+                 &level0);
+
+  // すべてのレベルをGENERALにし、前のディスパッチのカウンターの書き込みも待ちます。
+  std::array<VkImageMemoryBarrier, 2> barriers = {barrier, barrier};
+  barriers[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barriers[0].newLayout = VK_IMAGE_LAYOUT_GENERAL;
+  barriers[0].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  barriers[1].subresourceRange.baseMipLevel = 1;
+  barriers[1].subresourceRange.levelCount = mipLevels - 1;
+  barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  barriers[1].newLayout = VK_IMAGE_LAYOUT_GENERAL;
+  barriers[1].srcAccessMask = 0;
+  barriers[1].dstAccessMask =
+      VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  VkMemoryBarrier counterBarrier = Initializer::MemoryBarrier();
+  counterBarrier.srcAccessMask =
+      VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+  counterBarrier.dstAccessMask =
+      VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  vkCmdPipelineBarrier(
+      commandBuffer,
+      VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &counterBarrier, 0, nullptr,
+      static_cast<uint32_t>(barriers.size()), barriers.data());
+
+  const uint32_t groupsX = (width + kMipTileSize - 1) / kMipTileSize;
+  const uint32_t groupsY = (height + kMipTileSize - 1) / kMipTileSize;
+  const MipPushConstants pushConstants = {
+      static_cast<int32_t>(width),
+      static_cast<int32_t>(height),
+      static_cast<int32_t>(mipLevels),
+      groupsX * groupsY,
+  };
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                    mipPipelines_[srgb ? 1 : 0]);
+  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                          mipPipelineLayout_, 0, 1, &descriptorSet, 0,
+                          nullptr);
+  vkCmdPushConstants(commandBuffer, mipPipelineLayout_,
+                     VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants),
+                     &pushConstants);
+  vkCmdDispatch(commandBuffer, groupsX, groupsY, 1);
+
+  // 生成したレベルを対象のイメージにコピーします。
+  barriers[0].image = scratch.image;
+  barriers[0].subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 1,
+                                  mipLevels - 1, 0, 1};
+  barriers[0].oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+  barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  barriers[0].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barriers[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+  barriers[1].image = image;
+  barriers[1].subresourceRange = barriers[0].subresourceRange;
+  barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barriers[1].srcAccessMask = 0;
+  barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                       nullptr, static_cast<uint32_t>(barriers.size()),
+                       barriers.data());
+  std::vector<VkImageCopy> regions{};
+  for (uint32_t level = 1; level < mipLevels; level++) {
+    VkImageCopy region{};
+    region.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1};
+    region.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1};
+    region.extent = {std::max(width >> level, 1u),
+                     std::max(height >> level, 1u), 1};
+    regions.emplace_back(region);
+  }
+  vkCmdCopyImage(commandBuffer, scratch.image,
+                 VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image,
+                 VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                 static_cast<uint32_t>(regions.size()), regions.data());
+
+  // すべてのレベルを最終のレイアウトに遷移させます。
+  barriers[0].image = image;
+  barriers[0].subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+  barriers[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  barriers[0].newLayout = imageLayout;
+  barriers[0].srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+  barriers[0].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+  barriers[1].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barriers[1].newLayout = imageLayout;
+  barriers[1].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barriers[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0,
+                       nullptr, static_cast<uint32_t>(barriers.size()),
+                       barriers.data());
+
+  // 一時的なリソースは、この転送の完了後にRetireで破棄します。
+  Record(device).mipScratches.emplace_back(std::move(scratch));
+}
+
+//*-----------------------------------------------------------------------------
+// Submit & Wait
+//*-----------------------------------------------------------------------------
+
+/**
+ * @brief 記録した転送を1回の送信にまとめてキューに送信します。
+ * @note
+ * 転送キューが異なる場合は、セマフォで待機するグラフィックスキューへの送信で所有権を取得します。<br>
+ * グラフィックスキューへの描画の送信はこれより後に行われるため、描画前に完了を待つ必要はありません。
+ * @return 送信した転送のID(記録された転送が無い場合は直前に送信したID)
+ */
+UploadTicket UploadManager::Submit(const Device &device) {
+  if (!recording_) {
+    return submitted_;
+  }
+  auto batch = std::move(recording_);
+  batch->ticket = ++submitted_;
+  batch->ringHead = head_;
+
+  VK_CHECK_RESULT(vkEndCommandBuffer(batch->transfer));
+  VkSubmitInfo submitInfo = Initializer::SubmitInfo();
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &batch->transfer;
+  if (IsDedicatedTransfer()) {
+    VK_CHECK_RESULT(vkEndCommandBuffer(batch->acquire));
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &batch->semaphore;
+    VK_CHECK_RESULT(
+        vkQueueSubmit(transferQueue_, 1, &submitInfo, VK_NULL_HANDLE));
+
+    const VkPipelineStageFlags waitStageMask =
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    VkSubmitInfo acquireInfo = Initializer::SubmitInfo();
+    acquireInfo.waitSemaphoreCount = 1;
+    acquireInfo.pWaitSemaphores = &batch->semaphore;
+    acquireInfo.pWaitDstStageMask = &waitStageMask;
+    acquireInfo.commandBufferCount = 1;
+    acquireInfo.pCommandBuffers = &batch->acquire;
+    VK_CHECK_RESULT(
+        vkQueueSubmit(graphicsQueue_, 1, &acquireInfo, batch->fence));
+  } else {
+    VK_CHECK_RESULT(
+        vkQueueSubmit(graphicsQueue_, 1, &submitInfo, batch->fence));
+  }
+
+  spdlog::debug("Upload batch {}: {} copies, {} bytes", batch->ticket,
+                batch->copyCount, batch->bytes);
+  inFlight_.emplace_back(std::move(batch));
+  return submitted_;
+}
+
+/**
+ * @brief 転送が完了しているか確認します。(待機しません。)
+ */
+bool UploadManager::IsComplete(const Device &device, UploadTicket ticket) {
+  Retire(device, false);
+  return ticket <= completed_;
+}
+
+/**
+ * @brief 転送の完了をフェンスで待機します。
+ */
+void UploadManager::Wait(const Device &device, UploadTicket ticket) {
+  BOOST_ASSERT_MSG(ticket <= submitted_, "Upload ticket is not submitted!");
+  while (completed_ < ticket) {
+    Retire(device, true);
+  }
+}
+
+//*-----------------------------------------------------------------------------
+// Private
+//*-----------------------------------------------------------------------------
+
+/**
+ * @brief 記録中の転送を返します。(無ければ記録を開始します。)
+ */
+UploadManager::Batch &UploadManager::Record(const Device &device) {
+  if (recording_) {
+    return *recording_;
+  }
+
+  if (!free_.empty()) {
+    recording_ = std::move(free_.back());
+    free_.pop_back();
+  } else {
+    recording_ = std::make_unique<Batch>();
+    recording_->transfer = device.CreateCommandBuffer(
+        transferPool_, VK_COMMAND_BUFFER_LEVEL_PRIMARY, false);
+    if (IsDedicatedTransfer()) {
+      recording_->acquire = device.CreateCommandBuffer(
+          graphicsPool_, VK_COMMAND_BUFFER_LEVEL_PRIMARY, false);
+      VkSemaphoreCreateInfo semaphoreCreateInfo =
+          Initializer::SemaphoreCreateInfo();
+      VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr,
+                                        &recording_->semaphore));
+    }
+    VkFenceCreateInfo fenceCreateInfo = Initializer::FenceCreateInfo();
+    VK_CHECK_RESULT(
+        vkCreateFence(device, &fenceCreateInfo, nullptr, &recording_->fence));
+  }
+  recording_->copyCount = 0;
+  recording_->bytes = 0;
+
+  VkCommandBufferBeginInfo beginInfo = Initializer::CommandBufferBeginInfo();
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  VK_CHECK_RESULT(vkBeginCommandBuffer(recording_->transfer, &beginInfo));
+  if (recording_->acquire != VK_NULL_HANDLE) {
+    VK_CHECK_RESULT(vkBeginCommandBuffer(recording_->acquire, &beginInfo));
+  }
+  return *recording_;
+}
+
+/**
+ * @brief データをステージングリングにコピーします。
+ * @note
+ * リングに空きが無い場合は記録中の転送を送信し、古い転送の完了を待って領域を再利用します。<br>
+ * リングより大きなデータには個別のステージングバッファを確保し、転送の完了後に解放します。
+ * @return コピー元のバッファとオフセット
+ */
+std::pair<VkBuffer, VkDeviceSize>
+UploadManager::Stage(const Device &device, const void *data, VkDeviceSize size,
+                     VkDeviceSize alignment) {
+  if (size > stagingSize) {
+    VkBuffer buffer;
+    Allocation allocation;
+    VK_CHECK_RESULT(device.CreateBuffer(
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        data, size, buffer, allocation, AllocationStrategy::Linear));
+    Record(device).oversized.emplace_back(buffer, allocation);
+    return {buffer, 0};
+  }
+
+  for (;;) {
+    // 転送中のものが無ければリングの先頭から使い直します。
+    if (!recording_ && inFlight_.empty()) {
+      head_ = tail_ = AlignUp(head_, stagingSize);
+    }
+
+    VkDeviceSize offset = AlignUp(head_, alignment);
+    // リングの末尾をまたぐ場合は次の周回の先頭に配置します。
+    if (offset % stagingSize + size > stagingSize) {
+      offset = AlignUp(offset, stagingSize);
+    }
+    if (offset + size - tail_ <= stagingSize) {
+      head_ = offset + size;
+      offset %= stagingSize;
+      std::memcpy(static_cast<char *>(stagingAllocation_.mapped) + offset,
+                  data, size);
+      VK_CHECK_RESULT(
+          device.allocator->Flush(device, stagingAllocation_, offset, size));
+      return {staging_, offset};
+    }
+
+    static_cast<void>(Submit(device));
+    Retire(device, true);
+  }
+}
+
+/**
+ * @brief グラフィックスキューファミリーで実行するコマンドバッファを返します。
+ */
+VkCommandBuffer UploadManager::GetGraphicsCommandBuffer(const Device &device) {
+  Batch &batch = Record(device);
+  return IsDedicatedTransfer() ? batch.acquire : batch.transfer;
+}
+
+/**
+ * @brief ミップマップを生成するコンピュートパイプラインを作成します。
+ * @param device デバイスオブジェクト
+ * @param pipelineCache パイプラインキャッシュ(プリウォームで保存されるように、アプリと同じものを渡します。)
+ * @note
+ * 線形とsRGBのパイプラインは、同じシェーダーを特殊化定数で切り替えます。<br>
+ * カウンターを0で埋めるコマンドは、最初の転送と一緒に送信されます。
+ */
+void UploadManager::SetupPipelines(const Device &device,
+                                   VkPipelineCache pipelineCache) {
+  BOOST_ASSERT_MSG(mipPipelines_[0] == VK_NULL_HANDLE,
+                   "Mip pipelines are already created!");
+
+  // 最後のワークグループが0に戻すため、作成時のみ0で埋めます。
+  VK_CHECK_RESULT(device.CreateBuffer(
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, sizeof(uint32_t), mipCounter_,
+      mipCounterAllocation_));
+  vkCmdFillBuffer(GetGraphicsCommandBuffer(device), mipCounter_, 0,
+                  sizeof(uint32_t), 0);
+
+  std::vector<VkDescriptorSetLayoutBinding> descriptorSetLayoutBindings = {
+      Initializer::DescriptorSetLayoutBinding(
+          VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+          kMaxComputeMipLevels),
+      Initializer::DescriptorSetLayoutBinding(
+          VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+  };
+  VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo =
+      Initializer::DescriptorSetLayoutCreateInfo(descriptorSetLayoutBindings);
+  VK_CHECK_RESULT(vkCreateDescriptorSetLayout(
+      device, &descriptorSetLayoutCreateInfo, nullptr, &mipSetLayout_));
+
+  const VkPushConstantRange pushConstantRange =
+      Initializer::PushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT,
+                                     sizeof(MipPushConstants), 0);
+  VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo =
+      Initializer::PipelineLayoutCreateInfo(&mipSetLayout_);
+  pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+  pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+  VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo,
+                                         nullptr, &mipPipelineLayout_));
+
+  struct SpecializationData {
+    int32_t srgb = 0;
+  } specializationData;
+  std::vector<VkSpecializationMapEntry> specializationMapEntries{
+      Initializer::SpecializationMapEntry(0,
+                                          offsetof(SpecializationData, srgb),
+                                          sizeof(SpecializationData::srgb)),
+  };
+  VkSpecializationInfo specializationInfo = Initializer::SpecializationInfo(
+      specializationMapEntries, sizeof(specializationData),
+      &specializationData);
+  VkComputePipelineCreateInfo computePipelineCreateInfo =
+      Initializer::ComputePipelineCreateInfo(mipPipelineLayout_);
+  computePipelineCreateInfo.stage =
+      CreateShader(device, MIPMAP_COMPUTE_SHADER_PATH,
+                   VK_SHADER_STAGE_COMPUTE_BIT, &specializationInfo);
+  for (uint32_t i = 0; i < mipPipelines_.size(); i++) {
+    specializationData.srgb = static_cast<int32_t>(i);
+    VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1,
+                                             &computePipelineCreateInfo,
+                                             nullptr, &mipPipelines_[i]));
+  }
+  vkDestroyShaderModule(device, computePipelineCreateInfo.stage.module,
+                        nullptr);
+}
+
+/**
+ * @brief コンピュートでミップマップを生成するための一時的なリソースを破棄します。
+ */
+void UploadManager::DestroyMipScratch(const Device &device,
+                                      const MipScratch &scratch) {
+  vkDestroyDescriptorPool(device, scratch.descriptorPool, nullptr);
+  for (const auto view : scratch.views) {
+    vkDestroyImageView(device, view, nullptr);
+  }
+  vkDestroyImage(device, scratch.image, nullptr);
+  device.allocator->Free(device, scratch.allocation);
+}
+
+/**
+ * @brief 完了した転送のステージング領域とコマンドバッファを回収します。
+ * @param device デバイスオブジェクト
+ * @param wait trueの場合、最も古い転送の完了を待機します。
+ */
+void UploadManager::Retire(const Device &device, bool wait) {
+  while (!inFlight_.empty()) {
+    Batch &batch = *inFlight_.front();
+    if (wait) {
+      VK_CHECK_RESULT(vkWaitForFences(device, 1, &batch.fence, VK_TRUE,
+                                      std::numeric_limits<uint64_t>::max()));
+      wait = false;
+    } else if (vkGetFenceStatus(device, batch.fence) != VK_SUCCESS) {
+      break;
+    }
+
+    tail_ = batch.ringHead;
+    completed_ = batch.ticket;
+    for (const auto &[buffer, allocation] : batch.oversized) {
+      device.DestroyBuffer(buffer, allocation);
+    }
+    batch.oversized.clear();
+    for (const auto &scratch : batch.mipScratches) {
+      DestroyMipScratch(device, scratch);
+    }
+    batch.mipScratches.clear();
+
+    VK_CHECK_RESULT(vkResetFences(device, 1, &batch.fence));
+    VK_CHECK_RESULT(vkResetCommandBuffer(batch.transfer, 0));
+    if (batch.acquire != VK_NULL_HANDLE) {
+      VK_CHECK_RESULT(vkResetCommandBuffer(batch.acquire, 0));
+    }
+    free_.emplace_back(std::move(inFlight_.front()));
+    inFlight_.pop_front();
+  }
+}
@@ -0,0 +1,138 @@
+/**
+ * @brief テクスチャやメッシュの転送をまとめて1回のキュー送信で行います。
+ */
+
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <boost/noncopyable.hpp>
+#include <deque>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "VK/Allocator.h"
+
+struct Device;
+
+/**
+ * @brief 送信した転送のID(Waitなどで完了を確認するために使用します。)
+ * @note 0は転送が無いことを表し、常に完了しているものとして扱います。
+ */
+using UploadTicket = uint64_t;
+
+class UploadManager : private boost::noncopyable {
+public:
+  void Init(const Device &device, VkQueue graphicsQueue);
+  void SetupPipelines(const Device &device, VkPipelineCache pipelineCache);
+  void Destroy(const Device &device);
+
+  void UploadBuffer(const Device &device, VkBuffer buffer, const void *data,
+                    VkDeviceSize size, VkDeviceSize dstOffset = 0);
+  void UploadImage(const Device &device, VkImage image,
+                   const VkImageSubresourceRange &subresourceRange,
+                   const void *data, VkDeviceSize size,
+                   std::vector<VkBufferImageCopy> regions,
+                   VkImageLayout imageLayout);
+  void TransitionImage(const Device &device, VkImage image,
+                       const VkImageSubresourceRange &subresourceRange,
+                       VkImageLayout imageLayout);
+  void GenerateMipmaps(const Device &device, VkImage image, uint32_t width,
+                       uint32_t height, uint32_t mipLevels,
+                       VkImageLayout imageLayout);
+  void GenerateMipmapsCompute(const Device &device, VkImage image,
+                              uint32_t width, uint32_t height,
+                              uint32_t mipLevels, bool srgb,
+                              VkImageLayout imageLayout);
+
+  [[nodiscard]] UploadTicket Submit(const Device &device);
+  [[nodiscard]] bool IsComplete(const Device &device, UploadTicket ticket);
+  void Wait(const Device &device, UploadTicket ticket);
+
+  /** @brief 記録済みで未送信の転送があるか？ */
+  [[nodiscard]] bool HasPending() const { return recording_ != nullptr; }
+  /** @brief 転送キューファミリーがグラフィックスと異なり、所有権の移動が必要か？ */
+  [[nodiscard]] bool IsDedicatedTransfer() const {
+    return transferFamily_ != graphicsFamily_;
+  }
+
+  /** @brief ステージングリングのバイト数 */
+  VkDeviceSize stagingSize = 32ull * 1024 * 1024;
+
+  /** @brief コンピュートで生成できるミップレベルの最大数(4096x4096まで) */
+  static constexpr uint32_t kMaxComputeMipLevels = 13;
+
+private:
+  /**
+   * @brief コンピュートでミップマップを生成する間だけ使う、RGBA8のストレージイメージと記述子
+   */
+  struct MipScratch {
+    VkImage image = VK_NULL_HANDLE;
+    Allocation allocation{};
+    std::vector<VkImageView> views{};
+    VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+  };
+
+  /**
+   * @brief 1回の送信にまとめられた転送
+   */
+  struct Batch {
+    /** @brief 転送キューファミリーで記録するコピー */
+    VkCommandBuffer transfer = VK_NULL_HANDLE;
+    /** @brief グラフィックスキューファミリーで記録する所有権の取得とレイアウト遷移 */
+    VkCommandBuffer acquire = VK_NULL_HANDLE;
+    VkSemaphore semaphore = VK_NULL_HANDLE;
+    VkFence fence = VK_NULL_HANDLE;
+    UploadTicket ticket = 0;
+    /** @brief 送信時のリングの先頭(完了後にここまで解放します。) */
+    VkDeviceSize ringHead = 0;
+    uint32_t copyCount = 0;
+    VkDeviceSize bytes = 0;
+    /** @brief リングに収まらない転送のために確保したステージングバッファ */
+    std::vector<std::pair<VkBuffer, Allocation>> oversized{};
+    /** @brief コンピュートでミップマップを生成するための一時的なリソース */
+    std::vector<MipScratch> mipScratches{};
+  };
+
+  Batch &Record(const Device &device);
+  [[nodiscard]] std::pair<VkBuffer, VkDeviceSize>
+  Stage(const Device &device, const void *data, VkDeviceSize size,
+        VkDeviceSize alignment);
+  [[nodiscard]] VkCommandBuffer
+  GetGraphicsCommandBuffer(const Device &device);
+  void Retire(const Device &device, bool wait);
+  static void DestroyMipScratch(const Device &device,
+                                const MipScratch &scratch);
+
+  VkQueue graphicsQueue_ = VK_NULL_HANDLE;
+  VkQueue transferQueue_ = VK_NULL_HANDLE;
+  uint32_t graphicsFamily_ = 0;
+  uint32_t transferFamily_ = 0;
+  VkCommandPool graphicsPool_ = VK_NULL_HANDLE;
+  VkCommandPool transferPool_ = VK_NULL_HANDLE;
+
+  /** @brief 永続的にマップされたステージングリング */
+  VkBuffer staging_ = VK_NULL_HANDLE;
+  Allocation stagingAllocation_{};
+  /** @brief バッファとイメージへのコピー元オフセットのアライメント */
+  VkDeviceSize bufferAlignment_ = 16;
+  VkDeviceSize imageAlignment_ = 96;
+  /** @brief リングの書き込み位置と解放済みの位置(単調増加し、剰余をオフセットとします。) */
+  VkDeviceSize head_ = 0;
+  VkDeviceSize tail_ = 0;
+
+  /** @brief ミップマップを生成するパイプライン(線形とsRGB)と、終わったワークグループのカウンター */
+  VkDescriptorSetLayout mipSetLayout_ = VK_NULL_HANDLE;
+  VkPipelineLayout mipPipelineLayout_ = VK_NULL_HANDLE;
+  std::array<VkPipeline, 2> mipPipelines_{};
+  VkBuffer mipCounter_ = VK_NULL_HANDLE;
+  Allocation mipCounterAllocation_{};
+
+  std::unique_ptr<Batch> recording_{};
+  std::deque<std::unique_ptr<Batch>> inFlight_{};
+  std::vector<std::unique_ptr<Batch>> free_{};
+  UploadTicket submitted_ = 0;
+  UploadTicket completed_ = 0;
+};
@@ -4,10 +4,9 @@
 #include <spdlog/spdlog.h>
 
 #include <boost/assert.hpp>
-#include <fstream>
 #include <iostream>
-#include <variant>
 
+#include "VK/AssetArchive.h"
 #include "VK/Common.h"
 #include "VK/Device.h"
 #include "VK/Initializer.h"
@@ -19,37 +18,21 @@
 
 #define SHADER_ENTRY_POINT "main"
 
-static std::variant<std::string, std::vector<char>>
-ReadFile(const std::string &filename) {
-  std::ifstream fin(filename, std::ios::ate | std::ios::binary);
-  if (!fin.is_open()) {
-    return "Failed to open file: " + filename;
-  }
-  const auto size = static_cast<size_t>(fin.tellg());
-  std::vector<char> buffer(size);
-  fin.seekg(0);
-  fin.read(buffer.data(), size);
-
-  fin.close();
-  return std::move(buffer);
-}
-
 VkPipelineShaderStageCreateInfo
 CreateShader(const Device &device, const std::string &filepath,
              VkShaderStageFlagBits stage,
              VkSpecializationInfo *specialization) {
-  const auto v = ReadFile(filepath);
-  if (std::holds_alternative<std::string>(v)) {
-    std::cerr << std::get<std::string>(v) << std::endl;
-    BOOST_ASSERT_MSG(!std::holds_alternative<std::string>(v),
-                     "Failed to create shader!");
+  // アーカイブ(またはマップしたファイル)のページを直接ドライバーに渡します。
+  const auto code = AssetArchive::Get().Read(filepath);
+  if (!code) {
+    std::cerr << "Failed to open file: " << filepath << std::endl;
+    BOOST_ASSERT_MSG(code, "Failed to create shader!");
   }
-  const auto code = std::get<std::vector<char>>(v);
 
   VkShaderModuleCreateInfo create{};
   create.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-  create.codeSize = code.size();
-  create.pCode = reinterpret_cast<const uint32_t *>(code.data());
+  create.codeSize = code.size;
+  create.pCode = reinterpret_cast<const uint32_t *>(code.data);
 
   VkShaderModule module;
   VK_CHECK_RESULT(vkCreateShaderModule(device, &create, nullptr, &module));
@@ -65,7 +48,7 @@ CreateShader(const Device &device, const std::string &filepath,
 }
 
 VkResult CreateImage(const Device &device, VkImage &image,
-                     VkDeviceMemory &memory, VkFormat format,
+                     Allocation &allocation, VkFormat format,
                      VkImageType imageType, uint32_t width, uint32_t height,
                      uint32_t depth, uint32_t mipLevels, uint32_t arrayLayers,
                      VkMemoryPropertyFlags memoryFlags,
@@ -90,19 +73,25 @@ VkResult CreateImage(const Device &device, VkImage &image,
 
   VK_CHECK_RESULT(vkCreateImage(device, &imageCreateInfo, nullptr, &image));
 
-  VkMemoryRequirements memoryRequirements{};
-  vkGetImageMemoryRequirements(device, image, &memoryRequirements);
-
-  VkMemoryAllocateInfo memoryAllocateInfo{};
-  memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  memoryAllocateInfo.allocationSize = memoryRequirements.size;
-  memoryAllocateInfo.memoryTypeIndex =
-      device.FindMemoryType(memoryRequirements.memoryTypeBits, memoryFlags);
-
-  VK_CHECK_RESULT(
-      vkAllocateMemory(device, &memoryAllocateInfo, nullptr, &memory));
+  // 遅延割り当ては希望として扱い、このイメージが使えるメモリタイプに無ければ外します。
+  if (memoryFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) {
+    VkMemoryRequirements memoryRequirements{};
+    vkGetImageMemoryRequirements(device, image, &memoryRequirements);
+    if (!device.HasMemoryType(memoryRequirements.memoryTypeBits,
+                              memoryFlags)) {
+      memoryFlags &= ~VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+    }
+  }
 
-  VK_CHECK_RESULT(vkBindImageMemory(device, image, memory, 0));
+  // アタッチメントとして使用するイメージは、大きければ専用の割り当てにします。
+  AllocationCreateInfo allocationCreateInfo{};
+  allocationCreateInfo.memoryPropertyFlags = memoryFlags;
+  allocationCreateInfo.optimalTiling = tiling == VK_IMAGE_TILING_OPTIMAL;
+  allocationCreateInfo.attachment =
+      (usage & (VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT)) != 0;
+  VK_CHECK_RESULT(device.allocator->AllocateImageMemory(
+      device, image, allocationCreateInfo, allocation));
 
   return VK_SUCCESS;
 }
@@ -299,8 +288,9 @@ float CalcDeviceScore(VkPhysicalDevice device,
   VkPhysicalDeviceFeatures feat{};
   vkGetPhysicalDeviceFeatures(device, &feat);
 
+  // ヘッドレスのCI環境ではCPU実装しか無い場合があるため、CPUも候補に含めます。
   std::map<VkPhysicalDeviceType, float> scores = {
-      {VK_PHYSICAL_DEVICE_TYPE_CPU, 0.0f},
+      {VK_PHYSICAL_DEVICE_TYPE_CPU, 0.1f},
       {VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU, 1000.0f}};
   float score = 0.0f;
   if (scores.count(prop.deviceType) > 0) {
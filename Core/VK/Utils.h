@@ -5,6 +5,8 @@
 #include <set>
 #include <vector>
 
+#include "VK/Allocator.h"
+
 struct Device;
 
 VkPipelineShaderStageCreateInfo
@@ -13,7 +15,7 @@ CreateShader(const Device &device, const std::string &filepath,
              VkSpecializationInfo *specialization = nullptr);
 
 VkResult CreateImage(
-    const Device &device, VkImage &image, VkDeviceMemory &memory,
+    const Device &device, VkImage &image, Allocation &allocation,
     VkFormat format, VkImageType imageType, uint32_t width, uint32_t height,
     uint32_t depth = 1, uint32_t mipLevels = 1, uint32_t arrayLayers = 1,
     VkMemoryPropertyFlags memoryFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
@@ -11,13 +11,16 @@
 #include "VkBase.h"
 
 #include <boost/assert.hpp>
+#include <chrono>
 #include <imgui.h>
 #include <imgui_impl_glfw.h>
 #include <map>
 #include <spdlog/spdlog.h>
 
+#include "VK/AssetArchive.h"
 #include "VK/Common.h"
 #include "VK/Initializer.h"
+#include "VK/PipelineCache.h"
 #include "VK/Utils.h"
 
 //*-----------------------------------------------------------------------------
@@ -35,14 +38,39 @@ void VkBase::OnInit(const nlohmann::json &conf, GLFWwindow *hwnd) {
   debugMessenger.Setup(instance);
 #endif
   VkPhysicalDevice physicalDevice = SelectPhysicalDevice();
-  swapchain.Init(instance, window, physicalDevice);
+  if (!IsHeadless()) {
+    swapchain.Init(instance, window, physicalDevice);
+  }
   device.Init(physicalDevice);
-  VK_CHECK_RESULT(device.CreateLogicalDevice(GetEnabledFeatures(),
-                                             GetEnabledDeviceExtensions()));
+
+  // ストリーミングの予算とベンチマークのデバイスメモリの使用量は、VK_EXT_memory_budgetから取得します。
+  auto extensions = GetEnabledDeviceExtensions();
+  const bool useMemoryBudget =
+      isEnabledProperties2_ &&
+      device.IsSupportedExtension(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+  if (useMemoryBudget) {
+    extensions.emplace_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+  }
+  VK_CHECK_RESULT(device.CreateLogicalDevice(
+      GetEnabledFeatures(), extensions,
+      VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_TRANSFER_BIT, !IsHeadless()));
+  if (IsHeadless()) {
+    swapchain.queueFamilyIndex = device.queueFamilyIndices.graphics;
+  }
+  if (useMemoryBudget) {
+    device.vkGetPhysicalDeviceMemoryProperties2KHR =
+        reinterpret_cast<PFN_vkGetPhysicalDeviceMemoryProperties2KHR>(
+            vkGetInstanceProcAddr(instance,
+                                  "vkGetPhysicalDeviceMemoryProperties2KHR"));
+  }
 
   // デバイスからグラフィックスキューを取得します。
   vkGetDeviceQueue(device, device.queueFamilyIndices.graphics, 0, &queue);
+  uploader.Init(device, queue);
   CreateSemaphores();
+  if (IsBenchmark()) {
+    benchmark.Init(device, config, maxFramesInFlight, useMemoryBudget);
+  }
 
   OnPostInit();
 }
@@ -51,18 +79,59 @@ void VkBase::OnPostInit() {
   const auto width = config["Width"].get<int>();
   const auto height = config["Height"].get<int>();
 
+  // シェーダーやアセットを読み込む前にアーカイブをマウントします。
+  if (config.contains("Archive")) {
+    AssetArchive::Get().Mount(config["Archive"]["Path"].get<std::string>());
+  }
+
   CreateSwapchain(width, height);
 
   CreateCommandPool();
   CreateCommandBuffers();
+  uint32_t recordThreads = 0;
+  if (config.contains("Recording")) {
+    const auto &recording = config["Recording"];
+    recordThreads = recording.value("Threads", 0u);
+    recorder.minDrawsPerThread =
+        recording.value("MinDrawsPerThread", recorder.minDrawsPerThread);
+  }
+  recorder.Init(device, recordThreads);
+  if (config.contains("Assets")) {
+    assets.threadCount = config["Assets"].value("Threads", 0u);
+  }
+  if (config.contains("Streaming")) {
+    const auto &streaming = config["Streaming"];
+    streamer.bytesPerFrame =
+        streaming.value("BytesPerFrame", streamer.bytesPerFrame);
+    streamer.memoryBudget =
+        streaming.value("MemoryBudget", streamer.memoryBudget);
+    streamer.budgetReserve =
+        streaming.value("BudgetReserve", streamer.budgetReserve);
+    streamer.tailSize = streaming.value("TailSize", streamer.tailSize);
+  }
   CreateFence();
+  uniformRing.Init(device, static_cast<uint32_t>(drawCmdBuffers.size()));
+  streamer.Init(uniformRing.GetPartitionCount());
   SetupDepthStencil();
   SetupRenderPass();
   CreatePipelineCache();
+  uploader.SetupPipelines(device, pipelineCache);
   SetupFramebuffers();
+  if (IsProfiling()) {
+    profiler.Init(device, config,
+                  static_cast<uint32_t>(drawCmdBuffers.size()));
+  }
 
   if (IsEnabledUIOverlay()) {
-    uiOverlay.OnInit(window, device, queue, pipelineCache, renderPass);
+    SetupUIRenderPass();
+    SetupUIFramebuffers();
+    uiCmdBuffers.resize(maxFramesInFlight);
+    for (auto &commandBuffer : uiCmdBuffers) {
+      commandBuffer = device.CreateCommandBuffer(
+          commandPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, false);
+    }
+    uiOverlay.OnInit(window, device, queue, pipelineCache, uiRenderPass,
+                     maxFramesInFlight);
   }
 }
 
@@ -73,6 +142,8 @@ void VkBase::OnDestroy() {
 
   if (IsEnabledUIOverlay()) {
     uiOverlay.OnDestroy(device);
+    DestroyUIFramebuffers();
+    vkDestroyRenderPass(device, uiRenderPass, nullptr);
   }
 
   swapchain.Destroy(instance, device);
@@ -87,9 +158,22 @@ void VkBase::OnDestroy() {
 
   DestroyDepthStencil();
 
+  if (const auto path = GetPipelineCachePath(); !path.empty()) {
+    SavePipelineCacheData(device, pipelineCache, path);
+  }
   vkDestroyPipelineCache(device, pipelineCache, nullptr);
+  recorder.Destroy(device);
   vkDestroyCommandPool(device, commandPool, nullptr);
   DestroySyncObjects();
+  uniformRing.Destroy(device);
+  streamer.Destroy(device);
+  uploader.Destroy(device);
+  AssetArchive::Get().Unmount();
+  if (IsBenchmark()) {
+    benchmark.Destroy(device);
+  }
+  profiler.WriteJson();
+  profiler.Destroy(device);
 
   device.Destroy();
 #if !defined(NDEBUG)
@@ -123,19 +207,26 @@ void VkBase::UpdateUIOverlay() {
                ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoResize |
                    ImGuiWindowFlags_NoMove);
   OnUpdateUIOverlay();
+  profiler.OnUpdateUIOverlay(uiOverlay);
   ImGui::End();
 
   ImGui::PopStyleVar();
   ImGui::Render();
 
-  if (uiOverlay.Update(device) || uiOverlay.updated) {
-    BuildCommandBuffers();
-    uiOverlay.updated = false;
-  }
+  // 頂点バッファへの書き込みとコマンドの記録は、次のフレームのPrepareFrameで行います。
 }
 
 void VkBase::OnUpdateUIOverlay() {}
 
+/**
+ * @brief ストリーミングしているテクスチャのビューが変わった後、パーティションを初めて使うときに呼び出されます。
+ * @param partition 記述子を書き直すユニフォームリングのパーティション
+ * @note
+ * パーティションを使うイメージの送信はすべて完了しています。
+ * パーティションの記述子セットのテクスチャを書き直し、そのイメージのコマンドバッファのみを記録し直してください。
+ */
+void VkBase::OnTexturesStreamed(uint32_t) {}
+
 //*-----------------------------------------------------------------------------
 // Render
 //*-----------------------------------------------------------------------------
@@ -143,28 +234,109 @@ void VkBase::OnUpdateUIOverlay() {}
 void VkBase::OnRender() { VkBase::RenderFrame(); }
 
 void VkBase::RenderFrame() {
-  VkBase::PrepareFrame();
-  submitInfo.commandBufferCount = 1;
-  submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
-  VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+  if (!VkBase::PrepareFrame()) {
+    return;
+  }
+  submitInfo.commandBufferCount =
+      static_cast<uint32_t>(frameCmdBuffers.size());
+  submitInfo.pCommandBuffers = frameCmdBuffers.data();
+  VK_CHECK_RESULT(
+      vkQueueSubmit(queue, 1, &submitInfo, waitFences[currentFrame]));
   VkBase::SubmitFrame();
 }
 
-void VkBase::PrepareFrame() {
+/**
+ * @brief 現在のフレームの同期オブジェクトを準備し、スワップチェーンの次のイメージを取得します。
+ * @note
+ * 派生クラスでOnRenderをオーバーライドする場合、フレームの最後のvkQueueSubmitにはwaitFences[currentFrame]を渡してください。<br>
+ * falseを返した場合はスワップチェーンを再生成したため、このフレームのコマンドを送信せずに戻ってください。
+ * @return このフレームを描画する場合はtrue、スキップする場合はfalse
+ */
+bool VkBase::PrepareFrame() {
+  // ストリーミングしているテクスチャの次のミップレベルの転送を記録します。
+  // ビューが変わった場合の記述子は、パーティションの送信の完了を待った後で書き直します。
+  streamer.Update(device, uploader);
+
+  // 送信されていない転送があれば、描画より先にキューへ送信します。
+  if (uploader.HasPending()) {
+    static_cast<void>(uploader.Submit(device));
+  }
+
+  // 同じフレームリソースを使用していた前回の送信の完了を待機します。
+  VK_CHECK_RESULT(vkWaitForFences(device, 1, &waitFences[currentFrame],
+                                  VK_TRUE, UINT64_MAX));
+  semaphores.presentComplete = frameSemaphores.presentComplete[currentFrame];
+  semaphores.renderComplete = frameSemaphores.renderComplete[currentFrame];
+
   // スワップチェーンの次の画像を取得します。(バック/フロントバッファ)
   VkResult result = swapchain.AcquiredNextImage(
       device, semaphores.presentComplete, &currentBuffer);
   if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
     ResizeWindow();
-    return;
-  } else {
-    VK_CHECK_RESULT(result);
+    if (result == VK_SUBOPTIMAL_KHR) {
+      // イメージの取得自体は成功しておりセマフォがシグナルされるため、
+      // 待機されないまま次のフレームで再利用しないように作り直します。
+      RecreatePresentSemaphore();
+    }
+    // フェンスはリセットしていないため、次のフレームは待機せずに開始できます。
+    return false;
   }
+  VK_CHECK_RESULT(result);
+
+  // コマンドバッファはスワップチェーンイメージごとに記録されているため、
+  // 取得したイメージを別のフレームが使用中であればその完了を待機します。
+  if (imagesInFlight[currentBuffer] != VK_NULL_HANDLE) {
+    VK_CHECK_RESULT(vkWaitForFences(device, 1, &imagesInFlight[currentBuffer],
+                                    VK_TRUE, UINT64_MAX));
+    // このイメージの前回の送信は完了しているため、GPUを待たずにタイムスタンプを読み戻せます。
+    profiler.Collect(device, currentBuffer);
+  }
+  // イメージの数がパーティションより多い場合は、同じパーティションを使う他のイメージの送信も待機します。
+  const uint32_t partition = uniformRing.GetPartition(currentBuffer);
+  for (size_t i = partition; i < imagesInFlight.size();
+       i += uniformRing.GetPartitionCount()) {
+    if (i != currentBuffer && imagesInFlight[i] != VK_NULL_HANDLE) {
+      VK_CHECK_RESULT(vkWaitForFences(device, 1, &imagesInFlight[i], VK_TRUE,
+                                      UINT64_MAX));
+    }
+  }
+  imagesInFlight[currentBuffer] = waitFences[currentFrame];
+  // このイメージのパーティションはGPUから参照されていないため、今回のフレームの定数を書き込みます。
+  uniformRing.Flush(device, partition);
+  // 同じ理由で、他のフレームを待たずにパーティションの記述子を書き直せます。
+  if (streamer.IsStale(partition)) {
+    OnTexturesStreamed(partition);
+    streamer.MarkUpdated(device, partition);
+  }
+  VK_CHECK_RESULT(vkResetFences(device, 1, &waitFences[currentFrame]));
+
+  // シーンのコマンドバッファは事前に記録されたものを使用し、UIオーバーレイのみ毎フレーム記録します。
+  frameCmdBuffers.assign(1, drawCmdBuffers[currentBuffer]);
+  if (IsEnabledUIOverlay()) {
+    RecordUIOverlay();
+    frameCmdBuffers.emplace_back(uiCmdBuffers[currentFrame]);
+  }
+
+  // ヘッドレス時はイメージの取得が無いため、開始タイムスタンプの送信でセマフォをシグナルします。
+  if (IsBenchmark()) {
+    benchmark.BeginFrame(device, queue, currentFrame,
+                         IsHeadless() ? semaphores.presentComplete
+                                      : VK_NULL_HANDLE);
+  }
+  return true;
 }
 
 void VkBase::SubmitFrame() {
+  // ヘッドレス時はプレゼンテーションの代わりに終了タイムスタンプの送信でセマフォを待機します。
+  if (IsBenchmark()) {
+    benchmark.EndFrame(device, queue, currentFrame,
+                       IsHeadless() ? semaphores.renderComplete
+                                    : VK_NULL_HANDLE);
+  }
+
   VkResult result =
       swapchain.QueuePresent(queue, currentBuffer, semaphores.renderComplete);
+  currentFrame = (currentFrame + 1) % maxFramesInFlight;
   if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR ||
       isFramebufferResized) {
     isFramebufferResized = false;
@@ -173,13 +345,30 @@ void VkBase::SubmitFrame() {
   } else {
     VK_CHECK_RESULT(result);
   }
-  VK_CHECK_RESULT(vkQueueWaitIdle(queue));
 }
 
-void VkBase::DrawUI(VkCommandBuffer commandBuffer) {
-  if (!IsEnabledUIOverlay()) {
-    return;
-  }
+/**
+ * @brief UIオーバーレイを今回のフレームのコマンドバッファに記録します。
+ * @note
+ * シーンのレンダーパスの後に、カラーアタッチメントを読み込む専用のレンダーパスで描画します。<br>
+ * UIの変更でシーンのコマンドバッファを記録し直す必要はありません。
+ */
+void VkBase::RecordUIOverlay() {
+  uiOverlay.Update(device, currentFrame);
+
+  VkCommandBuffer commandBuffer = uiCmdBuffers[currentFrame];
+  VkCommandBufferBeginInfo commandBufferBeginInfo =
+      Initializer::CommandBufferBeginInfo();
+  commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo));
+
+  VkRenderPassBeginInfo renderPassBeginInfo =
+      Initializer::RenderPassBeginInfo();
+  renderPassBeginInfo.renderPass = uiRenderPass;
+  renderPassBeginInfo.framebuffer = uiFramebuffers[currentBuffer];
+  renderPassBeginInfo.renderArea.extent = swapchain.extent;
+  vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo,
+                       VK_SUBPASS_CONTENTS_INLINE);
 
   const auto viewport = Initializer::Viewport(
       static_cast<float>(swapchain.extent.width),
@@ -189,7 +378,10 @@ void VkBase::DrawUI(VkCommandBuffer commandBuffer) {
   vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
   vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-  uiOverlay.Draw(commandBuffer);
+  uiOverlay.Draw(commandBuffer, currentFrame);
+
+  vkCmdEndRenderPass(commandBuffer);
+  VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
 }
 
 //*-----------------------------------------------------------------------------
@@ -200,6 +392,39 @@ void VkBase::OnFrameEnd() { UpdateUIOverlay(); }
 
 void VkBase::WaitIdle() const { VK_CHECK_RESULT(vkDeviceWaitIdle(device)); }
 
+/**
+ * @brief 固定のタイムステップで指定フレーム数だけ描画し、計測結果をレポートします。
+ * @note カメラパスが設定されている場合、毎フレームconfig["Camera"]を更新してViewChangedを呼び出します。
+ */
+void VkBase::RunBenchmark() {
+  for (uint32_t i = 0; i < benchmark.frameCount; i++) {
+    if (window != nullptr) {
+      glfwPollEvents();
+      if (glfwWindowShouldClose(window)) {
+        break;
+      }
+    }
+
+    const float t = static_cast<float>(i) * benchmark.timeStep;
+    const auto start = std::chrono::steady_clock::now();
+
+    if (benchmark.UpdateCamera(t, config["Camera"])) {
+      ViewChanged();
+    }
+    OnUpdate(t);
+    OnRender();
+    OnFrameEnd();
+
+    const auto end = std::chrono::steady_clock::now();
+    benchmark.RecordCpuTime(
+        std::chrono::duration<double, std::milli>(end - start).count());
+  }
+
+  WaitIdle();
+  benchmark.Finish(device);
+  benchmark.WriteReport(device, config);
+}
+
 //*-----------------------------------------------------------------------------
 // Resize window
 //*-----------------------------------------------------------------------------
@@ -224,6 +449,7 @@ void VkBase::ResizeWindow() {
 
   // Swap chain の再生成を行います。
   swapchain.Create(device, width, height);
+  imagesInFlight.assign(swapchain.images.size(), VK_NULL_HANDLE);
 
   // Frame buffers の再生成を行います。
   DestroyDepthStencil();
@@ -234,12 +460,22 @@ void VkBase::ResizeWindow() {
   SetupFramebuffers();
 
   if (IsEnabledUIOverlay()) {
+    DestroyUIFramebuffers();
+    SetupUIFramebuffers();
     Gui::OnResize(width, height);
   }
 
   // Frame buffersの再生成後にCommand buffersも再生成する必要があります。
   DestroyCommandBuffers();
   CreateCommandBuffers();
+  // 記述子セットがユニフォームリングのバッファを参照しているため、パーティションの数は変更できません。
+  // イメージが増えた場合は、PrepareFrameで待機しながら同じパーティションを共有します。
+  if (drawCmdBuffers.size() > uniformRing.GetPartitionCount()) {
+    spdlog::warn("Swapchain has {} images but the uniform ring has {} "
+                 "partitions; images will share partitions.",
+                 drawCmdBuffers.size(), uniformRing.GetPartitionCount());
+  }
+  profiler.Resize(device, static_cast<uint32_t>(drawCmdBuffers.size()));
   BuildCommandBuffers();
 
   vkDeviceWaitIdle(device);
@@ -264,11 +500,29 @@ void VkBase::CreateInstance(const char *appName) {
   create.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
   create.pApplicationInfo = &info;
 
-  uint32_t glfwExtensionCount = 0;
-  const char **glfwExtensions =
-      glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-  std::vector<const char *> extensions(glfwExtensions,
-                                       glfwExtensions + glfwExtensionCount);
+  // ヘッドレス時はサーフェイスを生成しないため、GLFWの拡張機能は不要です。
+  std::vector<const char *> extensions{};
+  if (!IsHeadless()) {
+    uint32_t glfwExtensionCount = 0;
+    const char **glfwExtensions =
+        glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+    extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+  }
+  // VK_EXT_memory_budgetに必要なため、使用できる場合は常に有効にします。
+  {
+    uint32_t count = 0;
+    vkEnumerateInstanceExtensionProperties(nullptr, &count, nullptr);
+    std::vector<VkExtensionProperties> available(count);
+    vkEnumerateInstanceExtensionProperties(nullptr, &count, available.data());
+    for (const auto &extension : available) {
+      if (std::string(extension.extensionName) ==
+          VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME) {
+        extensions.emplace_back(
+            VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+        isEnabledProperties2_ = true;
+      }
+    }
+  }
   if (isEnableValidationLayers_) {
     extensions.emplace_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
     spdlog::info("Required extensions:");
@@ -314,11 +568,27 @@ VkPhysicalDevice VkBase::SelectPhysicalDevice() const {
 // Vulkan Fixed functions
 //*-----------------------------------------------------------------------------
 
-void VkBase::CreateSwapchain(int w, int h) { swapchain.Create(device, w, h); }
+void VkBase::CreateSwapchain(int w, int h) {
+  if (IsHeadless()) {
+    swapchain.CreateOffscreen(device, w, h, maxFramesInFlight);
+  } else {
+    swapchain.Create(device, w, h);
+  }
+}
 
 void VkBase::CreatePipelineCache() {
+  std::vector<char> data{};
+  if (const auto path = GetPipelineCachePath(); !path.empty()) {
+    data = LoadPipelineCacheData(device, path);
+  }
+  if (!data.empty()) {
+    spdlog::info("Pipeline cache loaded ({} bytes)", data.size());
+  }
+
   VkPipelineCacheCreateInfo create{};
   create.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  create.initialDataSize = data.size();
+  create.pInitialData = data.empty() ? nullptr : data.data();
   VK_CHECK_RESULT(
       vkCreatePipelineCache(device, &create, nullptr, &pipelineCache));
 }
@@ -350,12 +620,23 @@ void VkBase::DestroyCommandBuffers() {
 }
 
 void VkBase::CreateSemaphores() {
+  if (config.contains("FramesInFlight")) {
+    maxFramesInFlight = config["FramesInFlight"].get<uint32_t>();
+  }
+  BOOST_ASSERT_MSG(maxFramesInFlight > 0, "FramesInFlight must be positive!");
+
   VkSemaphoreCreateInfo semaphoreCreateInfo =
       Initializer::SemaphoreCreateInfo();
-  VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr,
-                                    &semaphores.presentComplete));
-  VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr,
-                                    &semaphores.renderComplete));
+  frameSemaphores.presentComplete.resize(maxFramesInFlight);
+  frameSemaphores.renderComplete.resize(maxFramesInFlight);
+  for (uint32_t i = 0; i < maxFramesInFlight; i++) {
+    VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr,
+                                      &frameSemaphores.presentComplete[i]));
+    VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr,
+                                      &frameSemaphores.renderComplete[i]));
+  }
+  semaphores.presentComplete = frameSemaphores.presentComplete[currentFrame];
+  semaphores.renderComplete = frameSemaphores.renderComplete[currentFrame];
 
   submitInfo = Initializer::SubmitInfo();
   submitInfo.pWaitDstStageMask = &submitPipelineStages;
@@ -368,24 +649,53 @@ void VkBase::CreateSemaphores() {
 void VkBase::CreateFence() {
   VkFenceCreateInfo create =
       Initializer::FenceCreateInfo(VK_FENCE_CREATE_SIGNALED_BIT);
-  waitFences.resize(drawCmdBuffers.size());
+  waitFences.resize(maxFramesInFlight);
   for (auto &fence : waitFences) {
     VK_CHECK_RESULT(vkCreateFence(device, &create, nullptr, &fence));
   }
+  imagesInFlight.assign(swapchain.images.size(), VK_NULL_HANDLE);
+}
+
+/**
+ * @brief 現在のフレームのイメージ取得用セマフォを作り直します。
+ * @note デバイスがアイドル状態のときに呼び出してください。
+ */
+void VkBase::RecreatePresentSemaphore() {
+  VkSemaphore &semaphore = frameSemaphores.presentComplete[currentFrame];
+  vkDestroySemaphore(device, semaphore, nullptr);
+  VkSemaphoreCreateInfo semaphoreCreateInfo =
+      Initializer::SemaphoreCreateInfo();
+  VK_CHECK_RESULT(
+      vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &semaphore));
+  semaphores.presentComplete = semaphore;
 }
 
 void VkBase::DestroySyncObjects() {
   for (auto &fence : waitFences) {
     vkDestroyFence(device, fence, nullptr);
   }
-  vkDestroySemaphore(device, semaphores.renderComplete, nullptr);
-  vkDestroySemaphore(device, semaphores.presentComplete, nullptr);
+  for (auto &semaphore : frameSemaphores.renderComplete) {
+    vkDestroySemaphore(device, semaphore, nullptr);
+  }
+  for (auto &semaphore : frameSemaphores.presentComplete) {
+    vkDestroySemaphore(device, semaphore, nullptr);
+  }
+}
+
+/**
+ * @brief 処理中のすべてのフレームの完了を待機します。
+ * @note フレーム間で共有しているリソースを書き換える前に呼び出してください。
+ */
+void VkBase::WaitFramesInFlight() const {
+  VK_CHECK_RESULT(vkWaitForFences(device,
+                                  static_cast<uint32_t>(waitFences.size()),
+                                  waitFences.data(), VK_TRUE, UINT64_MAX));
 }
 
 void VkBase::DestroyDepthStencil() {
   vkDestroyImageView(device, depthStencil.view, nullptr);
   vkDestroyImage(device, depthStencil.image, nullptr);
-  vkFreeMemory(device, depthStencil.memory, nullptr);
+  device.allocator->Free(device, depthStencil.allocation);
 }
 
 //*-----------------------------------------------------------------------------
@@ -414,16 +724,14 @@ void VkBase::SetupDepthStencil() {
   VK_CHECK_RESULT(
       vkCreateImage(device, &imageCreateInfo, nullptr, &depthStencil.image));
 
-  VkMemoryRequirements memoryRequirements{};
-  vkGetImageMemoryRequirements(device, depthStencil.image, &memoryRequirements);
-  VkMemoryAllocateInfo alloc = Initializer::MemoryAllocateInfo();
-  alloc.allocationSize = memoryRequirements.size;
-  alloc.memoryTypeIndex = device.FindMemoryType(
-      memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-  VK_CHECK_RESULT(
-      vkAllocateMemory(device, &alloc, nullptr, &depthStencil.memory));
-  VK_CHECK_RESULT(
-      vkBindImageMemory(device, depthStencil.image, depthStencil.memory, 0));
+  AllocationCreateInfo allocationCreateInfo{};
+  allocationCreateInfo.memoryPropertyFlags =
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+  allocationCreateInfo.optimalTiling = true;
+  allocationCreateInfo.attachment = true;
+  VK_CHECK_RESULT(device.allocator->AllocateImageMemory(
+      device, depthStencil.image, allocationCreateInfo,
+      depthStencil.allocation));
 
   VkImageViewCreateInfo imageViewCreateInfo =
       Initializer::ImageViewCreateInfo();
@@ -488,7 +796,10 @@ void VkBase::SetupRenderPass() {
   color.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
   color.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
   color.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-  color.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  // UIオーバーレイを描画する場合は、UIのレンダーパスで最終レイアウトに遷移します。
+  color.finalLayout = IsEnabledUIOverlay()
+                          ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+                          : swapchain.GetFinalLayout();
 
   // デプスアタッチメント
   VkAttachmentDescription depth{};
@@ -567,6 +878,86 @@ void VkBase::SetupRenderPass() {
   VK_CHECK_RESULT(vkCreateRenderPass(device, &create, nullptr, &renderPass));
 }
 
+/**
+ * @brief UIオーバーレイ用のレンダーパスを生成します。
+ * @note
+ * シーンが描画したカラーアタッチメントを読み込み、その上にUIを描画して最終レイアウトに遷移します。
+ */
+void VkBase::SetupUIRenderPass() {
+  VkAttachmentDescription color{};
+  color.format = swapchain.format;
+  color.samples = VK_SAMPLE_COUNT_1_BIT;
+  color.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+  color.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  color.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  color.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  color.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  color.finalLayout = swapchain.GetFinalLayout();
+
+  VkAttachmentReference colorRef{};
+  colorRef.attachment = 0;
+  colorRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+  VkSubpassDescription subpass{};
+  subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+  subpass.colorAttachmentCount = 1;
+  subpass.pColorAttachments = &colorRef;
+
+  std::array<VkSubpassDependency, 2> dependencies{};
+
+  // シーンのレンダーパスによるカラーアタッチメントへの書き込みを待機します。
+  dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+  dependencies[0].dstSubpass = 0;
+  dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  dependencies[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
+                                  VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+  dependencies[1].srcSubpass = 0;
+  dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+  dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  dependencies[1].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+  dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
+                                  VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  dependencies[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+  dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+  VkRenderPassCreateInfo create = Initializer::RenderPassCreateInfo();
+  create.attachmentCount = 1;
+  create.pAttachments = &color;
+  create.subpassCount = 1;
+  create.pSubpasses = &subpass;
+  create.dependencyCount = static_cast<uint32_t>(dependencies.size());
+  create.pDependencies = dependencies.data();
+
+  VK_CHECK_RESULT(vkCreateRenderPass(device, &create, nullptr, &uiRenderPass));
+}
+
+void VkBase::SetupUIFramebuffers() {
+  VkFramebufferCreateInfo create = Initializer::FramebufferCreateInfo();
+  create.renderPass = uiRenderPass;
+  create.attachmentCount = 1;
+  create.width = swapchain.extent.width;
+  create.height = swapchain.extent.height;
+  create.layers = 1;
+
+  uiFramebuffers.resize(swapchain.views.size());
+  for (size_t i = 0; i < uiFramebuffers.size(); i++) {
+    create.pAttachments = &swapchain.views[i];
+    VK_CHECK_RESULT(
+        vkCreateFramebuffer(device, &create, nullptr, &uiFramebuffers[i]));
+  }
+}
+
+void VkBase::DestroyUIFramebuffers() {
+  for (auto &framebuffer : uiFramebuffers) {
+    vkDestroyFramebuffer(device, framebuffer, nullptr);
+  }
+  uiFramebuffers.clear();
+}
+
 void VkBase::BuildCommandBuffers() {}
 
 void VkBase::ViewChanged() {}
@@ -581,5 +972,47 @@ std::vector<const char *> VkBase::GetEnabledDeviceExtensions() const {
 }
 
 bool VkBase::IsEnabledUIOverlay() const {
-  return config.contains("UIOverlay") && config["UIOverlay"];
+  return !IsHeadless() && config.contains("UIOverlay") && config["UIOverlay"];
+}
+
+/**
+ * @brief ウィンドウとサーフェイスを持たず、オフスクリーンイメージに描画するか？
+ */
+bool VkBase::IsHeadless() const {
+  return config.contains("Headless") && config["Headless"].get<bool>();
+}
+
+/**
+ * @brief 固定フレーム数を描画して計測結果をレポートするか？(ヘッドレス時は常に有効です。)
+ */
+bool VkBase::IsBenchmark() const {
+  return IsHeadless() ||
+         (config.contains("Benchmark") &&
+          config["Benchmark"].value("Enabled", false));
+}
+
+/**
+ * @brief パスごとのGPU時間をタイムスタンプクエリで計測するか？
+ */
+bool VkBase::IsProfiling() const {
+  return config.contains("Profiler") &&
+         config["Profiler"].value("Enabled", false);
+}
+
+/**
+ * @brief パイプラインの構築だけを行い、パイプラインキャッシュを保存して終了するか？
+ */
+bool VkBase::IsPrewarm() const {
+  return config.contains("PipelineCache") &&
+         config["PipelineCache"].value("Prewarm", false);
+}
+
+/**
+ * @brief パイプラインキャッシュのファイルパスを返します。(空の場合は保存しません。)
+ */
+std::string VkBase::GetPipelineCachePath() const {
+  if (!config.contains("PipelineCache")) {
+    return {};
+  }
+  return config["PipelineCache"].value("Path", std::string{});
 }
@@ -10,14 +10,22 @@
 #include <boost/noncopyable.hpp>
 #include <nlohmann/json.hpp>
 #include <optional>
+#include <string>
 #include <vector>
 
 #include <GLFW/glfw3.h>
 
+#include "VK/AssetLoader.h"
+#include "VK/Benchmark.h"
+#include "VK/CommandRecorder.h"
 #include "VK/Debug.h"
 #include "VK/Device.h"
 #include "VK/Gui.h"
+#include "VK/Profiler.h"
 #include "VK/Swapchain.h"
+#include "VK/TextureStreamer.h"
+#include "VK/UniformRing.h"
+#include "VK/UploadManager.h"
 
 class VkBase : private boost::noncopyable {
 public:
@@ -31,6 +39,12 @@ public:
 
   void OnFrameEnd();
   void WaitIdle() const;
+  void RunBenchmark();
+
+  [[nodiscard]] bool IsHeadless() const;
+  [[nodiscard]] bool IsBenchmark() const;
+  [[nodiscard]] bool IsProfiling() const;
+  [[nodiscard]] bool IsPrewarm() const;
 
   static void OnResized(GLFWwindow *window, int width, int height);
 
@@ -41,25 +55,32 @@ protected:
   virtual void OnPreDestroy();
 
   virtual void OnUpdateUIOverlay();
+  virtual void OnTexturesStreamed(uint32_t partition);
   void UpdateUIOverlay();
-  void DrawUI(VkCommandBuffer commandBuffer);
+  void RecordUIOverlay();
 
   void CreateSwapchain(int width, int height);
   void CreatePipelineCache();
+  [[nodiscard]] std::string GetPipelineCachePath() const;
   void CreateCommandPool();
   void CreateCommandBuffers();
   void DestroyCommandBuffers();
 
   virtual void SetupRenderPass();
+  void SetupUIRenderPass();
+  void SetupUIFramebuffers();
+  void DestroyUIFramebuffers();
   virtual void SetupDepthStencil();
   virtual void SetupFramebuffers();
   virtual void BuildCommandBuffers();
 
   void CreateSemaphores();
   void CreateFence();
+  void RecreatePresentSemaphore();
   void DestroySyncObjects();
+  void WaitFramesInFlight() const;
 
-  void PrepareFrame();
+  [[nodiscard]] bool PrepareFrame();
   void RenderFrame();
   void SubmitFrame();
 
@@ -90,16 +111,36 @@ protected:
   std::vector<VkCommandBuffer> drawCmdBuffers{};
   /** @brief 使用可能なフレームバッファのリスト */
   std::vector<VkFramebuffer> framebuffers{};
+  /** @brief シーンの後にUIオーバーレイを描画するレンダーパス */
+  VkRenderPass uiRenderPass = VK_NULL_HANDLE;
+  /** @brief UIオーバーレイ用のフレームバッファ(スワップチェーンイメージごと) */
+  std::vector<VkFramebuffer> uiFramebuffers{};
+  /** @brief UIオーバーレイを記録するコマンドバッファ(フレームごとに毎回記録します。) */
+  std::vector<VkCommandBuffer> uiCmdBuffers{};
+  /** @brief 今回のフレームで送信するコマンドバッファ(シーンとUIオーバーレイ) */
+  std::vector<VkCommandBuffer> frameCmdBuffers{};
   /** @brief 現在使用しているフレームバッファのインデックス */
   uint32_t currentBuffer = 0;
-  /** @brief  同期セマフォ */
+  /** @brief 同時に処理中にできるフレームの最大数 */
+  uint32_t maxFramesInFlight = 2;
+  /** @brief 現在記録しているフレームのインデックス([0, maxFramesInFlight)) */
+  uint32_t currentFrame = 0;
+  /** @brief  同期セマフォ(現在のフレームのものを指します) */
   struct {
     /** @brief swap chain image presentation */
     VkSemaphore presentComplete = VK_NULL_HANDLE;
     /** @brief コマンドバッファの送信と実行に用います。 */
     VkSemaphore renderComplete = VK_NULL_HANDLE;
   } semaphores{};
+  /** @brief フレームごとの同期セマフォ */
+  struct {
+    std::vector<VkSemaphore> presentComplete{};
+    std::vector<VkSemaphore> renderComplete{};
+  } frameSemaphores{};
+  /** @brief フレームごとのフェンス(フレームの最後の送信でシグナルします) */
   std::vector<VkFence> waitFences{};
+  /** @brief スワップチェーンイメージごとに、それを使用中のフレームのフェンス */
+  std::vector<VkFence> imagesInFlight{};
   /** @brief キューに提示されるコマンドバッファとセマフォが含まれます。*/
   VkSubmitInfo submitInfo{};
   /** @brief
@@ -111,17 +152,32 @@ protected:
   /** @brief Depth stencil object */
   struct {
     VkImage image = VK_NULL_HANDLE;
-    VkDeviceMemory memory = VK_NULL_HANDLE;
+    Allocation allocation{};
     VkImageView view = VK_NULL_HANDLE;
   } depthStencil;
 
   Gui uiOverlay{};
+  Benchmark benchmark{};
+  /** @brief パスごとのGPU時間(クエリプールはdrawCmdBuffersごと) */
+  Profiler profiler{};
+  /** @brief アセットの並列読み込み(LoadAssetsで宣言し、まとめて読み込みます。) */
+  AssetLoader assets{};
+  /** @brief アセットの転送(LoadAssetsでまとめて記録し、1回で送信します。) */
+  UploadManager uploader{};
+  /** @brief テクスチャのミップレベルのストリーミング(PrepareFrameで転送を記録し、パーティションごとに記述子を書き直します。) */
+  TextureStreamer streamer{};
+  /** @brief フレームごとの定数(パーティションはdrawCmdBuffersごと) */
+  UniformRing uniformRing{};
+  /** @brief セカンダリコマンドバッファの並列記録 */
+  CommandRecorder recorder{};
 #if !defined(NDEBUG)
   DebugMessenger debugMessenger{};
 #endif
   GLFWwindow *window = nullptr;
   nlohmann::json config{};
   bool isFramebufferResized = false;
+  /** @brief VK_KHR_get_physical_device_properties2が有効になっているか？ */
+  bool isEnabledProperties2_ = false;
 
   std::vector<const char *> validationLayers_ = {
       "VK_LAYER_KHRONOS_validation",
@@ -3,14 +3,25 @@
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
 
+#include <algorithm>
 #include <array>
 #include <boost/assert.hpp>
+#include <random>
 #include <vector>
 
 #include "VK/Common.h"
 #include "VK/Initializer.h"
 #include "VK/Utils.h"
 
+/** @brief G-Bufferのカラーアタッチメントの形式(位置、法線、アルベド) */
+static constexpr std::array<VkFormat, 3> kGBufferFormats = {
+    VK_FORMAT_R16G16B16A16_SFLOAT,
+    VK_FORMAT_R16G16B16A16_SFLOAT,
+    VK_FORMAT_R8G8B8A8_UNORM,
+};
+/** @brief BVHで粗く棄却するオブジェクトの数の下限(未満ならすべてSIMDで判定します。) */
+static constexpr size_t kBvhMinObjects = 256;
+
 //*-----------------------------------------------------------------------------
 // Overrides functions
 //*-----------------------------------------------------------------------------
@@ -19,8 +30,14 @@ void Deferred::OnPostInit() {
   VkBase::OnPostInit();
 
   LoadAssets();
-  PrepareOffscreenFramebuffer();
+  // 1つのレンダーパスで描画する場合、G-BufferはSetupFramebuffersで作成しています。
+  if (!IsSinglePass()) {
+    PrepareOffscreenFramebuffer();
+  }
+  PrepareLights();
   PrepareUniformBuffers();
+  // 読み込んだアセットの転送をまとめて1回で送信します。(描画はこの送信の後に行われます。)
+  static_cast<void>(uploader.Submit(device));
 
   SetupDescriptorSetLayout();
   SetupPipelines();
@@ -28,8 +45,11 @@ void Deferred::OnPostInit() {
   SetupDescriptorSet();
 
   // UpdateUIOverlay();
+  PrepareOffscreenCulling();
   BuildCommandBuffers();
-  BuildDeferredCommandBuffer();
+  if (!IsSinglePass()) {
+    BuildDeferredCommandBuffer();
+  }
 }
 
 void Deferred::OnPreDestroy() {
@@ -42,11 +62,9 @@ void Deferred::OnPreDestroy() {
 
   vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
 
+  lightCulling.Destroy(device);
   offscreenFramebuffer.Destroy(device);
 
-  uniformBuffers.composition.Destroy(device);
-  uniformBuffers.offscreen.Destroy(device);
-
   models.floor.Destroy(device);
   models.torus.Destroy(device);
   models.teapot.Destroy(device);
@@ -63,7 +81,35 @@ void Deferred::OnUpdate(float t) {
 }
 
 void Deferred::OnRender() {
-  VkBase::PrepareFrame();
+  if (!VkBase::PrepareFrame()) {
+    return;
+  }
+  lightCulling.CheckOverflow();
+
+  // 視錐台の内側のオブジェクトが記録したときと変わった場合は、このイメージのオフスクリーンパスを記録し直します。
+  // このイメージの前回の送信はPrepareFrameで完了を待機しているため、コマンドバッファは実行中ではありません。
+  CullOffscreenDraws();
+  if (visibleDraws != recordedDraws[currentBuffer]) {
+    if (IsSinglePass()) {
+      RecordFrameCommandBuffer(currentBuffer);
+    } else {
+      RecordOffscreenCommandBuffer(currentBuffer);
+    }
+  }
+
+  // 1つのレンダーパスで描画する場合は、G-Bufferの描画から合成までが同じコマンドバッファにあるため、
+  // オフスクリーンの送信とセマフォは必要ありません。
+  if (IsSinglePass()) {
+    submitInfo.pWaitSemaphores = &semaphores.presentComplete;
+    submitInfo.pSignalSemaphores = &semaphores.renderComplete;
+    submitInfo.commandBufferCount =
+        static_cast<uint32_t>(frameCmdBuffers.size());
+    submitInfo.pCommandBuffers = frameCmdBuffers.data();
+    VK_CHECK_RESULT(
+        vkQueueSubmit(queue, 1, &submitInfo, waitFences[currentFrame]));
+    VkBase::SubmitFrame();
+    return;
+  }
 
   // シーンレンダリングコマンドバッファはオフスクリーンのレンダリングが終了まで待機する必要があります
   // これを確実にするために、オフスクリーンレンダリングが終了したときに通知される専用のオフスクリーン同期セマフォを使用します。
@@ -79,7 +125,7 @@ void Deferred::OnRender() {
 
   // Submit work
   submitInfo.commandBufferCount = 1;
-  submitInfo.pCommandBuffers = &offscreenCmdBuffer;
+  submitInfo.pCommandBuffers = &offscreenCmdBuffers[currentBuffer];
   VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
 
   // シーンレンダリング
@@ -90,14 +136,197 @@ void Deferred::OnRender() {
   submitInfo.pSignalSemaphores = &semaphores.renderComplete;
 
   // Submit work
-  submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
-  VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+  submitInfo.commandBufferCount =
+      static_cast<uint32_t>(frameCmdBuffers.size());
+  submitInfo.pCommandBuffers = frameCmdBuffers.data();
+  // フレームの最後の送信で現在のフレームのフェンスをシグナルします。
+  VK_CHECK_RESULT(
+      vkQueueSubmit(queue, 1, &submitInfo, waitFences[currentFrame]));
 
   VkBase::SubmitFrame();
 }
 
 void Deferred::ViewChanged() { UpdateUniformBuffers(); }
 
+/**
+ * @brief レンダーパスを設定します。
+ * @note
+ * 1つのレンダーパスで描画する場合は、G-Bufferを描画するサブパスと、それを入力アタッチメントとして読んで
+ * スワップチェーンに合成するサブパスを持つレンダーパスを作成します。<br>
+ * G-Bufferはレンダーパスの中で読み終わるため、タイルベースのGPUではタイルメモリから書き出されません。
+ */
+void Deferred::SetupRenderPass() {
+  if (!IsSinglePass()) {
+    VkBase::SetupRenderPass();
+    return;
+  }
+
+  // 0: スワップチェーンのカラー、1-3: G-Buffer、4: デプス
+  std::array<VkAttachmentDescription, 5> attachments{};
+  for (auto &attachment : attachments) {
+    attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    attachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  }
+  attachments[0].format = swapchain.format;
+  attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  // UIオーバーレイを描画する場合は、UIのレンダーパスで最終レイアウトに遷移します。
+  attachments[0].finalLayout = IsEnabledUIOverlay()
+                                   ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+                                   : swapchain.GetFinalLayout();
+  for (size_t i = 0; i < kGBufferFormats.size(); i++) {
+    attachments[i + 1].format = kGBufferFormats[i];
+    attachments[i + 1].finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  }
+  attachments[4].format = device.FindSupportedDepthFormat();
+  attachments[4].finalLayout =
+      VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+  const VkAttachmentReference colorRef = {
+      0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+  const std::array<VkAttachmentReference, 3> gbufferRefs = {{
+      {1, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL},
+      {2, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL},
+      {3, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL},
+  }};
+  const VkAttachmentReference depthRef = {
+      4, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+  const std::array<VkAttachmentReference, 3> inputRefs = {{
+      {1, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL},
+      {2, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL},
+      {3, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL},
+  }};
+
+  std::array<VkSubpassDescription, 2> subpasses{};
+  // G-Bufferを描画します。
+  subpasses[0].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+  subpasses[0].colorAttachmentCount =
+      static_cast<uint32_t>(gbufferRefs.size());
+  subpasses[0].pColorAttachments = gbufferRefs.data();
+  subpasses[0].pDepthStencilAttachment = &depthRef;
+  // G-Bufferを入力アタッチメントとして読み、スワップチェーンに合成します。
+  subpasses[1].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+  subpasses[1].colorAttachmentCount = 1;
+  subpasses[1].pColorAttachments = &colorRef;
+  subpasses[1].inputAttachmentCount = static_cast<uint32_t>(inputRefs.size());
+  subpasses[1].pInputAttachments = inputRefs.data();
+
+  std::array<VkSubpassDependency, 4> dependencies{};
+
+  // G-Bufferとデプスは1つしかないため、前のフレームの書き込みと読み込みを待ちます。
+  dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+  dependencies[0].dstSubpass = 0;
+  dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                                 VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+                                 VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+  dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                                 VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                                 VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+  dependencies[0].srcAccessMask =
+      VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+      VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  dependencies[0].dstAccessMask =
+      VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+      VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+      VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+  // スワップチェーンのカラーは合成のサブパスで初めて使うため、
+  // イメージの取得を待つ依存関係をそのサブパスに設定します。
+  dependencies[1].srcSubpass = VK_SUBPASS_EXTERNAL;
+  dependencies[1].dstSubpass = 1;
+  dependencies[1].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT |
+                                 VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  dependencies[1].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  dependencies[1].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+  dependencies[1].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
+                                  VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+  // G-Bufferの書き込みを、合成のフラグメントシェーダーの入力アタッチメントの読み込みより前にします。
+  // 同じ画素のみを読むため、領域ごとの依存関係でタイルの中で完結します。
+  dependencies[2].srcSubpass = 0;
+  dependencies[2].dstSubpass = 1;
+  dependencies[2].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  dependencies[2].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+  dependencies[2].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  dependencies[2].dstAccessMask = VK_ACCESS_INPUT_ATTACHMENT_READ_BIT;
+  dependencies[2].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+  dependencies[3].srcSubpass = 1;
+  dependencies[3].dstSubpass = VK_SUBPASS_EXTERNAL;
+  dependencies[3].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  dependencies[3].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+  dependencies[3].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
+                                  VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  dependencies[3].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+  dependencies[3].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+  VkRenderPassCreateInfo create = Initializer::RenderPassCreateInfo();
+  create.attachmentCount = static_cast<uint32_t>(attachments.size());
+  create.pAttachments = attachments.data();
+  create.subpassCount = static_cast<uint32_t>(subpasses.size());
+  create.pSubpasses = subpasses.data();
+  create.dependencyCount = static_cast<uint32_t>(dependencies.size());
+  create.pDependencies = dependencies.data();
+  VK_CHECK_RESULT(vkCreateRenderPass(device, &create, nullptr, &renderPass));
+}
+
+/**
+ * @brief スワップチェーンのイメージごとにフレームバッファを生成します。
+ * @note
+ * 1つのレンダーパスで描画する場合は、G-Bufferをスワップチェーンの大きさで作成し、
+ * すべてのフレームバッファで共有します。ウィンドウの大きさが変わった場合も作り直します。
+ */
+void Deferred::SetupFramebuffers() {
+  if (!IsSinglePass()) {
+    VkBase::SetupFramebuffers();
+    return;
+  }
+
+  // リサイズの前にデバイスの完了を待っているため、古いG-Bufferはすぐに破棄できます。
+  offscreenFramebuffer.Destroy(device);
+  offscreenFramebuffer.attachments.clear();
+  PrepareOffscreenFramebuffer();
+
+  std::array<VkImageView, 5> attachments{
+      VK_NULL_HANDLE,
+      offscreenFramebuffer.attachments[0].view,
+      offscreenFramebuffer.attachments[1].view,
+      offscreenFramebuffer.attachments[2].view,
+      depthStencil.view,
+  };
+  VkFramebufferCreateInfo create = Initializer::FramebufferCreateInfo();
+  create.renderPass = renderPass;
+  create.attachmentCount = static_cast<uint32_t>(attachments.size());
+  create.pAttachments = attachments.data();
+  create.width = swapchain.extent.width;
+  create.height = swapchain.extent.height;
+  create.layers = 1;
+
+  framebuffers.resize(swapchain.views.size());
+  for (size_t i = 0; i < framebuffers.size(); i++) {
+    attachments[0] = swapchain.views[i];
+    VK_CHECK_RESULT(
+        vkCreateFramebuffer(device, &create, nullptr, &framebuffers[i]));
+  }
+
+  // 記述子セットを作成した後(リサイズ)は、新しいG-Bufferを指すように書き直します。
+  if (descriptorSets.composition != VK_NULL_HANDLE) {
+    UpdateGBufferDescriptors();
+  }
+}
+
+/**
+ * @brief G-Bufferの描画と合成を、1つのレンダーパスのサブパスで行うかを返します。
+ */
+bool Deferred::IsSinglePass() const {
+  return config.value("SinglePass", false);
+}
+
 //*-----------------------------------------------------------------------------
 // Assets
 //*-----------------------------------------------------------------------------
@@ -107,33 +336,35 @@ void Deferred::LoadAssets() {
   // Teapot
   {
     const auto &teapot = config["Teapot"];
+    modelCreateInfo.optimize = teapot.value("Optimize", false);
     modelCreateInfo.color = glm::vec3(teapot["Color"][0].get<float>(),
                                       teapot["Color"][1].get<float>(),
                                       teapot["Color"][2].get<float>());
-    models.teapot.LoadFromFile(device,
-                               config["Teapot"]["Model"].get<std::string>(),
-                               queue, vertexLayout, modelCreateInfo);
+    assets.AddModel(models.teapot, teapot["Model"].get<std::string>(),
+                    vertexLayout, modelCreateInfo);
   }
   // Torus
   {
     const auto &torus = config["Torus"];
+    modelCreateInfo.optimize = torus.value("Optimize", false);
     modelCreateInfo.color = glm::vec3(torus["Color"][0].get<float>(),
                                       torus["Color"][1].get<float>(),
                                       torus["Color"][2].get<float>());
-    models.torus.LoadFromFile(device,
-                              config["Torus"]["Model"].get<std::string>(),
-                              queue, vertexLayout, modelCreateInfo);
+    assets.AddModel(models.torus, torus["Model"].get<std::string>(),
+                    vertexLayout, modelCreateInfo);
   }
   // Floor
   {
     const auto &floor = config["Floor"];
+    modelCreateInfo.optimize = floor.value("Optimize", false);
     modelCreateInfo.color = glm::vec3(floor["Color"][0].get<float>(),
                                       floor["Color"][1].get<float>(),
                                       floor["Color"][2].get<float>());
-    models.floor.LoadFromFile(device,
-                              config["Floor"]["Model"].get<std::string>(),
-                              queue, vertexLayout, modelCreateInfo);
+    assets.AddModel(models.floor, floor["Model"].get<std::string>(),
+                    vertexLayout, modelCreateInfo);
   }
+  // 宣言したアセットをワーカースレッドで読み込み、転送を記録します。
+  static_cast<void>(assets.Load(device, uploader));
 }
 
 //*-----------------------------------------------------------------------------
@@ -143,23 +374,31 @@ void Deferred::LoadAssets() {
 /**
  * @brief 使用される記述子のレイアウトを設定します。<br>
  * 基本的に、様々なシェーダーステージを記述子に接続して、UniformBuffersやImageSamplerなどをバインドします。<br>
- * したがって、すべてのシェーダーバインディングは、1つの記述子セットレイアウトバインディングにマップする必要があります。
+ * したがって、すべてのシェーダーバインディングは、1つの記述子セットレイアウトバインディングにマップする必要があります。<br>
+ * 1つのレンダーパスで描画する場合、G-Buffer(バインディング1-3)は入力アタッチメントです。
  */
 void Deferred::SetupDescriptorSetLayout() {
+  const VkDescriptorType gbufferType =
+      IsSinglePass() ? VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT
+                     : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
   std::vector<VkDescriptorSetLayoutBinding> descriptorSetLayoutBindings = {
-      Initializer::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-                                              VK_SHADER_STAGE_VERTEX_BIT, 0),
       Initializer::DescriptorSetLayoutBinding(
-          VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-          VK_SHADER_STAGE_FRAGMENT_BIT, 1),
+          VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_VERTEX_BIT,
+          0),
+      Initializer::DescriptorSetLayoutBinding(gbufferType,
+                                              VK_SHADER_STAGE_FRAGMENT_BIT, 1),
+      Initializer::DescriptorSetLayoutBinding(gbufferType,
+                                              VK_SHADER_STAGE_FRAGMENT_BIT, 2),
+      Initializer::DescriptorSetLayoutBinding(gbufferType,
+                                              VK_SHADER_STAGE_FRAGMENT_BIT, 3),
+      Initializer::DescriptorSetLayoutBinding(
+          VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+          VK_SHADER_STAGE_FRAGMENT_BIT, 4),
       Initializer::DescriptorSetLayoutBinding(
-          VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-          VK_SHADER_STAGE_FRAGMENT_BIT, 2),
+          VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 5),
       Initializer::DescriptorSetLayoutBinding(
-          VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-          VK_SHADER_STAGE_FRAGMENT_BIT, 3),
-      Initializer::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-                                              VK_SHADER_STAGE_FRAGMENT_BIT, 4),
+          VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+          VK_SHADER_STAGE_FRAGMENT_BIT, 6),
   };
 
   VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo =
@@ -184,9 +423,14 @@ void Deferred::SetupDescriptorSetLayout() {
 void Deferred::SetupDescriptorPool() {
   // APIに記述子の最大数を通知する必要があります。
   std::vector<VkDescriptorPoolSize> descriptorPoolSizes = {
-      Initializer::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 8),
+      Initializer::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+                                      8),
       Initializer::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
                                       9),
+      Initializer::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 3),
+      Initializer::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2),
+      Initializer::DescriptorPoolSize(
+          VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 2),
   };
 
   // グローバル記述子プールを生成します。
@@ -203,51 +447,69 @@ void Deferred::SetupDescriptorSet() {
       Initializer::DescriptorSetAllocateInfo(descriptorPool,
                                              &descriptorSetLayout, 1);
 
-  // オフスクリーンカラーアタッチメントのイメージ記述子を設定します。　
-  VkDescriptorImageInfo texPosDesc = Initializer::DescriptorImageInfo(
-      offscreenFramebuffer.sampler, offscreenFramebuffer.attachments[0].view,
-      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-  VkDescriptorImageInfo texNormDesc = Initializer::DescriptorImageInfo(
-      offscreenFramebuffer.sampler, offscreenFramebuffer.attachments[1].view,
-      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-  VkDescriptorImageInfo texAlbedoDesc = Initializer::DescriptorImageInfo(
-      offscreenFramebuffer.sampler, offscreenFramebuffer.attachments[2].view,
-      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-
   // Deferred Composition
   VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocateInfo,
                                            &descriptorSets.composition));
+  UpdateGBufferDescriptors();
   std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+      Initializer::WriteDescriptorSet(
+          descriptorSets.composition, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+          4, &uniformBuffers.composition.descriptor),
       Initializer::WriteDescriptorSet(descriptorSets.composition,
-                                      VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                                      1, &texPosDesc),
-      Initializer::WriteDescriptorSet(descriptorSets.composition,
-                                      VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                                      2, &texNormDesc),
-      Initializer::WriteDescriptorSet(descriptorSets.composition,
-                                      VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                                      3, &texAlbedoDesc),
-      Initializer::WriteDescriptorSet(descriptorSets.composition,
-                                      VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 4,
-                                      &uniformBuffers.composition.descriptor),
+                                      VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 5,
+                                      &lightCulling.lights.descriptor),
+      Initializer::WriteDescriptorSet(
+          descriptorSets.composition, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+          6, &lightCulling.tiles.descriptor),
   };
   vkUpdateDescriptorSets(device,
                          static_cast<uint32_t>(writeDescriptorSets.size()),
                          writeDescriptorSets.data(), 0, nullptr);
 
   // Offscreen Rendering
+  // 動的オフセットを指定するため、シェーダーで使わないライトのバッファも書き込みます。
   VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocateInfo,
                                            &descriptorSets.offscreen));
   writeDescriptorSets = {
       Initializer::WriteDescriptorSet(descriptorSets.offscreen,
-                                      VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0,
-                                      &uniformBuffers.offscreen.descriptor),
+                                      VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+                                      0, &uniformBuffers.offscreen.descriptor),
+      Initializer::WriteDescriptorSet(descriptorSets.offscreen,
+                                      VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 5,
+                                      &lightCulling.lights.descriptor),
+      Initializer::WriteDescriptorSet(
+          descriptorSets.offscreen, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+          6, &lightCulling.tiles.descriptor),
   };
   vkUpdateDescriptorSets(device,
                          static_cast<uint32_t>(writeDescriptorSets.size()),
                          writeDescriptorSets.data(), 0, nullptr);
 }
 
+/**
+ * @brief 合成の記述子セットのG-Bufferのイメージ記述子を書き込みます。
+ * @note 入力アタッチメントはサンプラーを使わないため、sampler(VK_NULL_HANDLE)は無視されます。
+ */
+void Deferred::UpdateGBufferDescriptors() {
+  const VkDescriptorType gbufferType =
+      IsSinglePass() ? VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT
+                     : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+
+  // オフスクリーンカラーアタッチメントのイメージ記述子を設定します。
+  std::array<VkDescriptorImageInfo, 3> imageDescs{};
+  std::vector<VkWriteDescriptorSet> writeDescriptorSets{};
+  for (uint32_t i = 0; i < imageDescs.size(); i++) {
+    imageDescs[i] = Initializer::DescriptorImageInfo(
+        offscreenFramebuffer.sampler, offscreenFramebuffer.attachments[i].view,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    writeDescriptorSets.emplace_back(Initializer::WriteDescriptorSet(
+        descriptorSets.composition, gbufferType, i + 1, &imageDescs[i]));
+  }
+  vkUpdateDescriptorSets(device,
+                         static_cast<uint32_t>(writeDescriptorSets.size()),
+                         writeDescriptorSets.data(), 0, nullptr);
+}
+
 /**
  * @note
  * Vulkanは、レンダリングパイプラインの概念を用いてFixedStatusをカプセル化し、OpenGLの複雑なステートマシンを置き換えます。<br>
@@ -309,16 +571,18 @@ void Deferred::SetupPipelines() {
   pipelineCreateInfo.pDynamicState = &dynamicState;
 
   // パイプラインシェーダーステージ情報を設定します。
+  // 1つのレンダーパスで描画する場合は、G-Bufferを入力アタッチメントから読むシェーダーで合成します。
   const auto &pipelinesConfig = config["Pipelines"];
+  const auto &compositionFS =
+      IsSinglePass() ? pipelinesConfig["CompositionSubpass"]["FragmentShader"]
+                     : pipelinesConfig["Composition"]["FragmentShader"];
   std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages{
       CreateShader(
           device,
           pipelinesConfig["Composition"]["VertexShader"].get<std::string>(),
           VK_SHADER_STAGE_VERTEX_BIT),
-      CreateShader(
-          device,
-          pipelinesConfig["Composition"]["FragmentShader"].get<std::string>(),
-          VK_SHADER_STAGE_FRAGMENT_BIT),
+      CreateShader(device, compositionFS.get<std::string>(),
+                   VK_SHADER_STAGE_FRAGMENT_BIT),
   };
   pipelineCreateInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
   pipelineCreateInfo.pStages = shaderStages.data();
@@ -327,6 +591,7 @@ void Deferred::SetupPipelines() {
   VkPipelineVertexInputStateCreateInfo emptyVertexInputState =
       Initializer::PipelineVertexInputStateCreateInfo();
   pipelineCreateInfo.pVertexInputState = &emptyVertexInputState;
+  pipelineCreateInfo.subpass = IsSinglePass() ? 1 : 0;
   VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1,
                                             &pipelineCreateInfo, nullptr,
                                             &pipelines.composition));
@@ -339,17 +604,9 @@ void Deferred::SetupPipelines() {
       Initializer::VertexInputBindingDescription(0, vertexLayout.Stride(),
                                                  VK_VERTEX_INPUT_RATE_VERTEX),
   };
-  std::vector<VkVertexInputAttributeDescription> vertexInputAttributes = {
-      // location = 0 : position
-      Initializer::VertexInputAttributeDescription(
-          0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0),
-      // location = 1 : normal
-      Initializer::VertexInputAttributeDescription(
-          0, 1, VK_FORMAT_R32G32B32_SFLOAT, 3 * sizeof(float)),
-      // location = 2 : color
-      Initializer::VertexInputAttributeDescription(
-          0, 2, VK_FORMAT_R32G32B32_SFLOAT, 6 * sizeof(float)),
-  };
+  // location = 0 : position, 1 : normal, 2 : color
+  std::vector<VkVertexInputAttributeDescription> vertexInputAttributes =
+      vertexLayout.Attributes(0);
   VkPipelineVertexInputStateCreateInfo vertexInputState =
       Initializer::PipelineVertexInputStateCreateInfo(vertexInputBindings,
                                                       vertexInputAttributes);
@@ -361,8 +618,11 @@ void Deferred::SetupPipelines() {
       device, pipelinesConfig["Offscreen"]["FragmentShader"].get<std::string>(),
       VK_SHADER_STAGE_FRAGMENT_BIT);
 
-  // レンダーパスは別にします。
-  pipelineCreateInfo.renderPass = offscreenFramebuffer.renderPass;
+  // レンダーパスは別にします。(1つのレンダーパスで描画する場合は最初のサブパスです。)
+  if (!IsSinglePass()) {
+    pipelineCreateInfo.renderPass = offscreenFramebuffer.renderPass;
+  }
+  pipelineCreateInfo.subpass = 0;
 
   // カラーアタッチメントに何も描画しないようにします。
   std::array<VkPipelineColorBlendAttachmentState, 3>
@@ -388,6 +648,10 @@ void Deferred::SetupPipelines() {
 
 /**
  * @brief オフスクリーンレンダリング用に新しいフレームバッファを用意します。
+ * @note
+ * 1つのレンダーパスで描画する場合は、G-Bufferのアタッチメントのみを作成します。<br>
+ * G-Bufferはサブパスの入力アタッチメントとして読むだけなので、一時的なアタッチメント
+ * (遅延割り当てのメモリがあればタイルメモリのみ、ストアしない)にします。
  */
 void Deferred::PrepareOffscreenFramebuffer() {
   offscreenFramebuffer.width = swapchain.extent.width;
@@ -398,18 +662,22 @@ void Deferred::PrepareOffscreenFramebuffer() {
   attachmentCreateInfo.height = offscreenFramebuffer.height;
   attachmentCreateInfo.layerCount = 1;
   attachmentCreateInfo.usage =
-      VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-  attachmentCreateInfo.format = VK_FORMAT_R16G16B16A16_SFLOAT;
-
-  // POSITION (World Space)
-  offscreenFramebuffer.AddAttachment(device, attachmentCreateInfo);
-
-  // NORMAL (World Space)
-  offscreenFramebuffer.AddAttachment(device, attachmentCreateInfo);
+      IsSinglePass() ? VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                           VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT |
+                           VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT
+                     : VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                           VK_IMAGE_USAGE_SAMPLED_BIT;
+
+  // POSITION (World Space), NORMAL (World Space), ALBEDO (Color)
+  for (const auto format : kGBufferFormats) {
+    attachmentCreateInfo.format = format;
+    offscreenFramebuffer.AddAttachment(device, attachmentCreateInfo);
+  }
 
-  // ALBEDO (Color)
-  attachmentCreateInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
-  offscreenFramebuffer.AddAttachment(device, attachmentCreateInfo);
+  // デプスはスワップチェーンのフレームバッファのものを使用します。
+  if (IsSinglePass()) {
+    return;
+  }
 
   // Depth attachment
   attachmentCreateInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
@@ -425,6 +693,24 @@ void Deferred::PrepareOffscreenFramebuffer() {
   VK_CHECK_RESULT(offscreenFramebuffer.CreateRenderPass(device));
 }
 
+/**
+ * @brief ライトをストレージバッファに転送し、タイルのライトカリングを用意します。
+ * @note
+ * タイルはオフスクリーンのG-Bufferの大きさで分けます。<br>
+ * 1つのレンダーパスで描画する場合、一時的なG-Bufferはコンピュートシェーダーから読めないため、
+ * 深度の範囲を使わずに選別します。
+ */
+void Deferred::PrepareLights() {
+  VkDescriptorImageInfo texPosDesc = Initializer::DescriptorImageInfo(
+      offscreenFramebuffer.sampler, offscreenFramebuffer.attachments[0].view,
+      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+  lightCulling.Prepare(
+      device, uploader, uniformRing, pipelineCache, GetLights(),
+      offscreenFramebuffer.width, offscreenFramebuffer.height,
+      IsSinglePass() ? nullptr : &texPosDesc,
+      config["Pipelines"]["LightCull"]["ComputeShader"].get<std::string>());
+}
+
 /**
  * @brief
  * シェーダーユニフォームを含むユニフォームバッファブロックを準備して初期化します。
@@ -432,19 +718,8 @@ void Deferred::PrepareOffscreenFramebuffer() {
  * OpenGLのような単一のユニフォームはVulkanに存在しなくなりました。すべてのシェーダーユニフォームはユニフォームバッファブロックを介して渡されます。
  */
 void Deferred::PrepareUniformBuffers() {
-  VK_CHECK_RESULT(uniformBuffers.offscreen.Create(
-      device, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-      sizeof(uboOffscreenVS), &uboOffscreenVS));
-  VK_CHECK_RESULT(uniformBuffers.offscreen.Map(device));
-
-  VK_CHECK_RESULT(uniformBuffers.composition.Create(
-      device, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-      sizeof(uboComposition), &uboComposition));
-  VK_CHECK_RESULT(uniformBuffers.composition.Map(device));
+  uniformBuffers.offscreen = uniformRing.Allocate(sizeof(uboOffscreenVS));
+  uniformBuffers.composition = uniformRing.Allocate(sizeof(uboComposition));
 
   UpdateUniformBuffers();
 }
@@ -457,9 +732,22 @@ void Deferred::PrepareUniformBuffers() {
  * @brief フレームバッファイメージごとに個別のコマンドバッファを構築します。
  * @note
  * OpenGLとは異なり、すべてのレンダリングコマンドはコマンドバッファに一度記録され、その後キューに再送信されます。<br>
- * これにより、Vulkanの最大の利点の１つである、複数のスレッドから事前に作業を生成できます。
+ * これにより、Vulkanの最大の利点の１つである、複数のスレッドから事前に作業を生成できます。<br>
+ * 1つのレンダーパスで描画する場合は、G-Bufferの描画も含めたフレーム全体を記録します。
  */
 void Deferred::BuildCommandBuffers() {
+  // リサイズなどで作り直したハンドルに番号を振り直します。
+  offscreenQueue.Reset();
+  if (IsSinglePass()) {
+    // 描画リストはメインスレッドで作成し、ワーカースレッドからは読み込みのみ行います。
+    recordedDraws.assign(drawCmdBuffers.size(), {});
+    CullOffscreenDraws();
+    for (size_t i = 0; i < drawCmdBuffers.size(); i++) {
+      RecordFrameCommandBuffer(static_cast<uint32_t>(i));
+    }
+    return;
+  }
+
   VkCommandBufferBeginInfo commandBufferBeginInfo =
       Initializer::CommandBufferBeginInfo();
 
@@ -484,6 +772,10 @@ void Deferred::BuildCommandBuffers() {
     renderPassBeginInfo.framebuffer = framebuffers[i];
     VK_CHECK_RESULT(
         vkBeginCommandBuffer(drawCmdBuffers[i], &commandBufferBeginInfo));
+    const auto pool = static_cast<uint32_t>(i);
+    profiler.Reset(drawCmdBuffers[i], pool);
+    const uint32_t query =
+        profiler.Begin(drawCmdBuffers[i], pool, "Composition");
 
     // デフォルトのレンダーパス設定で指定された最初のサブパスを開始します。
     // これにより、色と奥行きのアタッチメントがクリアされます。
@@ -500,34 +792,80 @@ void Deferred::BuildCommandBuffers() {
     vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
 
     // 記述子セットとパイプラインのバインド
+    const auto dynamicOffsets =
+        GetDynamicOffsets(uniformRing.GetPartition(static_cast<uint32_t>(i)));
     vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
                             pipelineLayout, 0, 1, &descriptorSets.composition,
-                            0, nullptr);
+                            static_cast<uint32_t>(dynamicOffsets.size()),
+                            dynamicOffsets.data());
     vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
                       pipelines.composition);
 
     vkCmdDraw(drawCmdBuffers[i], 3, 1, 0, 0);
 
-    DrawUI(drawCmdBuffers[i]);
-
     vkCmdEndRenderPass(drawCmdBuffers[i]);
+    profiler.End(drawCmdBuffers[i], pool, query);
 
     // レンダーパスを終了すると、フレームバッファのカラーアタッチメントに移行する暗黙のバリアが追加されます。
     VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
   }
+
+  // スワップチェーンの再生成でイメージが増えた場合は、オフスクリーンパスのコマンドバッファも追加します。
+  if (!offscreenCmdBuffers.empty()) {
+    CreateOffscreenCommandBuffers();
+  }
+}
+
+/**
+ * @brief 記述子セットをバインドするときの動的オフセットを返します。
+ * @note 2つの記述子セットはレイアウトを共有するため、どちらにもバインディング0、4、6の順でオフセットを指定します。
+ */
+std::array<uint32_t, 3> Deferred::GetDynamicOffsets(uint32_t partition) const {
+  return {
+      uniformRing.GetDynamicOffset(uniformBuffers.offscreen, partition),
+      uniformRing.GetDynamicOffset(uniformBuffers.composition, partition),
+      lightCulling.GetTileOffset(partition),
+  };
 }
 
 void Deferred::BuildDeferredCommandBuffer() {
-  if (offscreenCmdBuffer == VK_NULL_HANDLE) {
-    offscreenCmdBuffer =
-        device.CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, false);
-  }
   // オフスクリーンレンダリングと同期を行うために使用するセマフォを生成します。
   VkSemaphoreCreateInfo semaphoreCreateInfo =
       Initializer::SemaphoreCreateInfo();
   VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr,
                                     &offscreenSemaphore));
 
+  CreateOffscreenCommandBuffers();
+}
+
+/**
+ * @brief 足りないスワップチェーンイメージの分だけオフスクリーンパスのコマンドバッファを作成して記録します。
+ * @note
+ * ユニフォームバッファの動的オフセットがパーティションごとに異なるため、スワップチェーンイメージごとに記録します。
+ */
+void Deferred::CreateOffscreenCommandBuffers() {
+  const size_t first = offscreenCmdBuffers.size();
+  if (first >= drawCmdBuffers.size()) {
+    return;
+  }
+  offscreenCmdBuffers.resize(drawCmdBuffers.size());
+  recordedDraws.resize(drawCmdBuffers.size());
+
+  // 描画リストはメインスレッドで作成し、ワーカースレッドからは読み込みのみ行います。
+  CullOffscreenDraws();
+  for (size_t i = first; i < offscreenCmdBuffers.size(); i++) {
+    offscreenCmdBuffers[i] =
+        device.CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, false);
+    RecordOffscreenCommandBuffer(static_cast<uint32_t>(i));
+  }
+}
+
+/**
+ * @brief イメージのオフスクリーンパスのコマンドバッファに、視錐台の内側のオブジェクトを記録します。
+ * @note コマンドバッファとセカンダリコマンドバッファは実行中であってはいけません。
+ */
+void Deferred::RecordOffscreenCommandBuffer(uint32_t image) {
+  // 同じイメージの前回の送信は完了を待ってから送信されるため、同時使用のフラグは必要ありません。
   VkCommandBufferBeginInfo commandBufferBeginInfo =
       Initializer::CommandBufferBeginInfo();
 
@@ -548,45 +886,131 @@ void Deferred::BuildDeferredCommandBuffer() {
       static_cast<uint32_t>(clearValues.size());
   renderPassBeginInfo.pClearValues = clearValues.data();
 
-  VK_CHECK_RESULT(
-      vkBeginCommandBuffer(offscreenCmdBuffer, &commandBufferBeginInfo));
-  vkCmdBeginRenderPass(offscreenCmdBuffer, &renderPassBeginInfo,
-                       VK_SUBPASS_CONTENTS_INLINE);
+  BuildOffscreenQueue();
+  const auto inheritanceInfo = Initializer::CommandBufferInheritanceInfo(
+      offscreenFramebuffer.renderPass, 0, offscreenFramebuffer.framebuffer);
+
+  const uint32_t partition = uniformRing.GetPartition(image);
+  VkCommandBuffer commandBuffer = offscreenCmdBuffers[image];
+  VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo));
+  // 描画はセカンダリコマンドバッファに並列に記録し、ここでは実行のみ行います。
+  vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo,
+                       VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+  offscreenQueue.ResetStats();
+  const auto secondaries = recorder.Record(
+      device, image, inheritanceInfo, offscreenQueue.Size(),
+      [&](VkCommandBuffer secondary, uint32_t first, uint32_t count) {
+        RecordOffscreenDraws(secondary, partition, first, count);
+      });
+  offscreenStats = offscreenQueue.GetStats();
+  if (!secondaries.empty()) {
+    vkCmdExecuteCommands(commandBuffer,
+                         static_cast<uint32_t>(secondaries.size()),
+                         secondaries.data());
+  }
+  vkCmdEndRenderPass(commandBuffer);
+  // 書き込んだG-Bufferから、合成のパスが使うタイルのライトのリストを作成します。
+  lightCulling.RecordCulling(commandBuffer, partition, uniformRing);
+  VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+  recordedDraws[image] = visibleDraws;
+}
 
+/**
+ * @brief イメージのコマンドバッファに、1つのレンダーパスでG-Bufferの描画から合成までを記録します。
+ * @note
+ * G-Bufferはレンダーパスの中でのみ有効なため、タイルのライトのリストはレンダーパスの前に
+ * 深度の範囲を使わずに作成します。<br>
+ * コマンドバッファとセカンダリコマンドバッファは実行中であってはいけません。
+ */
+void Deferred::RecordFrameCommandBuffer(uint32_t image) {
+  VkCommandBufferBeginInfo commandBufferBeginInfo =
+      Initializer::CommandBufferBeginInfo();
+
+  // スワップチェーンのカラー、G-Buffer、デプスの順です。
+  std::array<VkClearValue, 5> clearValues{};
+  clearValues[0].color = {{0.1f, 0.1f, 0.1f, 1.0f}};
+  clearValues[1].color = {{0.0f, 0.0f, 0.0f, 0.0f}};
+  clearValues[2].color = {{0.0f, 0.0f, 0.0f, 0.0f}};
+  clearValues[3].color = {{0.0f, 0.0f, 0.0f, 0.0f}};
+  clearValues[4].depthStencil = {1.0f, 0};
+
+  VkRenderPassBeginInfo renderPassBeginInfo =
+      Initializer::RenderPassBeginInfo();
+  renderPassBeginInfo.renderPass = renderPass;
+  renderPassBeginInfo.framebuffer = framebuffers[image];
+  renderPassBeginInfo.renderArea.extent.width = swapchain.extent.width;
+  renderPassBeginInfo.renderArea.extent.height = swapchain.extent.height;
+  renderPassBeginInfo.clearValueCount =
+      static_cast<uint32_t>(clearValues.size());
+  renderPassBeginInfo.pClearValues = clearValues.data();
+
+  BuildOffscreenQueue();
+  const auto inheritanceInfo = Initializer::CommandBufferInheritanceInfo(
+      renderPass, 0, framebuffers[image]);
+
+  const uint32_t partition = uniformRing.GetPartition(image);
+  VkCommandBuffer commandBuffer = drawCmdBuffers[image];
+  VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo));
+  profiler.Reset(commandBuffer, image);
+  const uint32_t query = profiler.Begin(commandBuffer, image, "Deferred");
+
+  lightCulling.RecordCulling(commandBuffer, partition, uniformRing);
+
+  // G-Bufferの描画はセカンダリコマンドバッファに並列に記録し、ここでは実行のみ行います。
+  vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo,
+                       VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+  offscreenQueue.ResetStats();
+  const auto secondaries = recorder.Record(
+      device, image, inheritanceInfo, offscreenQueue.Size(),
+      [&](VkCommandBuffer secondary, uint32_t first, uint32_t count) {
+        RecordOffscreenDraws(secondary, partition, first, count);
+      });
+  offscreenStats = offscreenQueue.GetStats();
+  if (!secondaries.empty()) {
+    vkCmdExecuteCommands(commandBuffer,
+                         static_cast<uint32_t>(secondaries.size()),
+                         secondaries.data());
+  }
+
+  // G-Bufferを入力アタッチメントとして読み、スワップチェーンに合成します。
+  vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
   VkViewport viewport = Initializer::Viewport(
-      static_cast<float>(offscreenFramebuffer.width),
-      static_cast<float>(offscreenFramebuffer.height), 0.0f, 1.0f);
-  vkCmdSetViewport(offscreenCmdBuffer, 0, 1, &viewport);
-  VkRect2D scissor = Initializer::Rect2D(offscreenFramebuffer.width,
-                                         offscreenFramebuffer.height, 0, 0);
-  vkCmdSetScissor(offscreenCmdBuffer, 0, 1, &scissor);
+      static_cast<float>(swapchain.extent.width),
+      static_cast<float>(swapchain.extent.height), 0.0f, 1.0f);
+  vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+  VkRect2D scissor = Initializer::Rect2D(swapchain.extent.width,
+                                         swapchain.extent.height, 0, 0);
+  vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+  const auto dynamicOffsets = GetDynamicOffsets(partition);
+  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                          pipelineLayout, 0, 1, &descriptorSets.composition,
+                          static_cast<uint32_t>(dynamicOffsets.size()),
+                          dynamicOffsets.data());
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                    pipelines.composition);
+  vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+
+  vkCmdEndRenderPass(commandBuffer);
+  profiler.End(commandBuffer, image, query);
+  VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+  recordedDraws[image] = visibleDraws;
+}
 
-  vkCmdBindPipeline(offscreenCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                    pipelines.offscreen);
-  vkCmdBindDescriptorSets(offscreenCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                          pipelineLayout, 0, 1, &descriptorSets.offscreen, 0,
-                          nullptr);
-  VkDeviceSize offsets[] = {0};
+/**
+ * @brief オフスクリーンパスで描画するオブジェクトのリストを作成します。
+ */
+std::vector<Deferred::OffscreenDraw> Deferred::GetOffscreenDraws() {
+  std::vector<OffscreenDraw> draws{};
 
   // Teapot
   {
-    vkCmdBindVertexBuffers(offscreenCmdBuffer, 0, 1,
-                           &models.teapot.vertices.buffer, offsets);
-    vkCmdBindIndexBuffer(offscreenCmdBuffer, models.teapot.indices.buffer, 0,
-                         VK_INDEX_TYPE_UINT32);
     const auto &teapot = config["Teapot"];
     const auto scale = glm::vec3(teapot["Scale"].get<float>());
-    const auto model = glm::scale(glm::mat4(1.0f), scale);
-    vkCmdPushConstants(offscreenCmdBuffer, pipelineLayout,
-                       VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(model), &model);
-    vkCmdDrawIndexed(offscreenCmdBuffer, models.teapot.indexCount, 1, 0, 0, 0);
+    draws.push_back({&models.teapot, glm::scale(glm::mat4(1.0f), scale) *
+                                         models.teapot.DequantizeMatrix()});
   }
   // Torus
   {
-    vkCmdBindVertexBuffers(offscreenCmdBuffer, 0, 1,
-                           &models.torus.vertices.buffer, offsets);
-    vkCmdBindIndexBuffer(offscreenCmdBuffer, models.torus.indices.buffer, 0,
-                         VK_INDEX_TYPE_UINT32);
     const auto &torus = config["Torus"];
     const auto scale = glm::vec3(torus["Scale"].get<float>());
     const auto rotAxis = glm::vec3(torus["Rotate"]["Axis"][0].get<float>(),
@@ -599,17 +1023,10 @@ void Deferred::BuildDeferredCommandBuffer() {
     auto model = glm::translate(glm::mat4(1.0f), trans);
     model = glm::rotate(model, angle, rotAxis);
     model = glm::scale(model, scale);
-    vkCmdPushConstants(offscreenCmdBuffer, pipelineLayout,
-                       VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(model), &model);
-    vkCmdDrawIndexed(offscreenCmdBuffer, models.torus.indexCount, 1, 0, 0, 0);
+    draws.push_back({&models.torus, model * models.torus.DequantizeMatrix()});
   }
-
   // Floor
   {
-    vkCmdBindVertexBuffers(offscreenCmdBuffer, 0, 1,
-                           &models.floor.vertices.buffer, offsets);
-    vkCmdBindIndexBuffer(offscreenCmdBuffer, models.floor.indices.buffer, 0,
-                         VK_INDEX_TYPE_UINT32);
     const auto &floor = config["Floor"];
     const auto scale = glm::vec3(floor["Scale"].get<float>());
     const auto trans = glm::vec3(floor["Position"][0].get<float>(),
@@ -617,12 +1034,171 @@ void Deferred::BuildDeferredCommandBuffer() {
                                  floor["Position"][2].get<float>());
     auto model = glm::translate(glm::mat4(1.0f), trans);
     model = glm::scale(model, scale);
-    vkCmdPushConstants(offscreenCmdBuffer, pipelineLayout,
-                       VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(model), &model);
-    vkCmdDrawIndexed(offscreenCmdBuffer, models.floor.indexCount, 1, 0, 0, 0);
+    draws.push_back({&models.floor, model * models.floor.DequantizeMatrix()});
   }
-  vkCmdEndRenderPass(offscreenCmdBuffer);
-  VK_CHECK_RESULT(vkEndCommandBuffer(offscreenCmdBuffer));
+  return draws;
+}
+
+/**
+ * @brief シーンのライトのリストを作成します。
+ * @note
+ * Lightsのライトは距離(Range)を省略するとすべてのタイルに影響します。<br>
+ * LightFieldを指定した場合は、床の上に点光源とスポットライトを乱数で並べて加えます。
+ */
+std::vector<LightCulling::Light> Deferred::GetLights() const {
+  std::vector<LightCulling::Light> lights{};
+  for (const auto &light : config["Lights"]) {
+    LightCulling::Light dst{};
+    for (int j = 0; j < 4; j++) {
+      dst.position[j] = light["Position"][j].get<float>();
+    }
+    for (int j = 0; j < 3; j++) {
+      dst.color[j] = light["Color"][j].get<float>();
+    }
+    dst.radius = light["Radius"].get<float>();
+    dst.range = light.value("Range", 0.0f);
+    lights.emplace_back(dst);
+  }
+
+  if (!config.contains("LightField")) {
+    return lights;
+  }
+  const auto &field = config["LightField"];
+  const auto count = field["Count"].get<uint32_t>();
+  const float spotRatio = field.value("SpotRatio", 0.0f);
+  const float intensity = field["Intensity"].get<float>();
+  const float innerAngle = glm::radians(field["SpotAngles"][0].get<float>());
+  const float outerAngle = glm::radians(field["SpotAngles"][1].get<float>());
+
+  std::mt19937 rng(field.value("Seed", 0u));
+  std::uniform_real_distribution<float> dist01(0.0f, 1.0f);
+  // 配列[最小, 最大]の範囲の一様乱数を返します。
+  const auto uniform = [&](const nlohmann::json &range) {
+    const auto lo = range[0].get<float>();
+    const auto hi = range[1].get<float>();
+    return lo + (hi - lo) * dist01(rng);
+  };
+  const glm::vec2 extent(field["Extent"][0].get<float>(),
+                         field["Extent"][1].get<float>());
+  for (uint32_t i = 0; i < count; i++) {
+    LightCulling::Light dst{};
+    const glm::vec2 xz = (glm::vec2(dist01(rng), dist01(rng)) * 2.0f - 1.0f) *
+                         extent;
+    dst.position = glm::vec4(xz.x, uniform(field["Height"]), xz.y, 1.0f);
+    dst.color = glm::vec3(dist01(rng), dist01(rng), dist01(rng)) * 0.8f +
+                glm::vec3(0.2f);
+    dst.radius = intensity;
+    dst.range = uniform(field["Range"]);
+    if (dist01(rng) < spotRatio) {
+      // 真下から少し傾けた向きを照らします。
+      dst.type = LightCulling::kSpot;
+      dst.direction = glm::normalize(glm::vec3(
+          dist01(rng) - 0.5f, -1.0f, dist01(rng) - 0.5f));
+      dst.cosInner = std::cos(innerAngle);
+      dst.cosOuter = std::cos(outerAngle);
+    }
+    lights.emplace_back(dst);
+  }
+  return lights;
+}
+
+/**
+ * @brief 描画リストを作成し、各オブジェクトのワールド空間の境界からBVHを構築します。
+ * @note 境界はメッシュごとのバウンディングボックスをモデル行列で変換して合わせたものです。
+ */
+void Deferred::PrepareOffscreenCulling() {
+  offscreenDraws = GetOffscreenDraws();
+  offscreenBounds.clear();
+  for (const auto &draw : offscreenDraws) {
+    AABB bounds{};
+    for (const auto &mesh : draw.model->meshes) {
+      bounds.Merge(mesh.bounds.Transform(draw.matrix));
+    }
+    offscreenBounds.emplace_back(bounds);
+  }
+  offscreenBvh.Build(offscreenBounds);
+
+  offscreenCuller.Clear();
+  offscreenCuller.Reserve(offscreenBounds.size());
+  for (const auto index : offscreenBvh.GetIndices()) {
+    offscreenCuller.Add(offscreenBounds[index]);
+  }
+}
+
+/**
+ * @brief 現在のカメラの視錐台の内側にあるオブジェクトを求めます。
+ * @note
+ * BVHで視錐台の外側の部分木を棄却し、内側の部分木はまとめて加えます。<br>
+ * 平面と交差する葉の範囲はoffscreenCullerでまとめて判定します。<br>
+ * オブジェクトが少なければBVHを走査せず、すべてoffscreenCullerで判定します。
+ */
+void Deferred::CullOffscreenDraws() {
+  const auto planes = Frustum::ExtractPlanes(camera.GetProjectionMatrix() *
+                                             camera.GetViewMatrix());
+  culledLeaves.clear();
+  if (offscreenBounds.size() < kBvhMinObjects) {
+    visibleDraws.clear();
+    offscreenCuller.CullRange(planes, 0, offscreenCuller.Size(), culledLeaves);
+  } else {
+    offscreenBvh.Cull(planes, visibleDraws, partialLeaves);
+    for (const auto &range : partialLeaves) {
+      offscreenCuller.CullRange(planes, range.first, range.count,
+                                culledLeaves);
+    }
+  }
+
+  // offscreenCullerの番号は葉の位置なので、オブジェクトの番号に戻します。
+  const auto &indices = offscreenBvh.GetIndices();
+  for (const auto leaf : culledLeaves) {
+    visibleDraws.emplace_back(indices[leaf]);
+  }
+  std::sort(visibleDraws.begin(), visibleDraws.end());
+}
+
+/**
+ * @brief 視錐台の内側のオブジェクトをオフスクリーンパスのレンダーキューに加え、ソートキーの順に並べ替えます。
+ * @note 深度はモデルの原点のカメラからの距離です。
+ */
+void Deferred::BuildOffscreenQueue() {
+  offscreenQueue.Clear();
+  const glm::mat4 view = camera.GetViewMatrix();
+  for (const auto index : visibleDraws) {
+    const auto &draw = offscreenDraws[index];
+    RenderQueue::DrawItem item{};
+    item.pipeline = pipelines.offscreen;
+    item.pipelineLayout = pipelineLayout;
+    item.descriptorSet = descriptorSets.offscreen;
+    item.dynamicOffsetCount = 3;
+    item.mesh = RenderQueue::MeshOf(*draw.model);
+    const glm::vec4 origin = view * draw.matrix[3];
+    item.depth = -origin.z / camera.GetFar();
+    item.pushConstants = &draw.matrix;
+    item.pushConstantsSize = sizeof(draw.matrix);
+    item.pushConstantStages = VK_SHADER_STAGE_VERTEX_BIT;
+    offscreenQueue.Push(item);
+  }
+  offscreenQueue.Sort();
+}
+
+/**
+ * @brief レンダーキューの[first, first + count)をセカンダリコマンドバッファに記録します。
+ * @note 複数のワーカースレッドから同時に呼び出されるため、メンバを変更してはいけません。
+ */
+void Deferred::RecordOffscreenDraws(VkCommandBuffer commandBuffer,
+                                    uint32_t partition, uint32_t first,
+                                    uint32_t count) const {
+  VkViewport viewport = Initializer::Viewport(
+      static_cast<float>(offscreenFramebuffer.width),
+      static_cast<float>(offscreenFramebuffer.height), 0.0f, 1.0f);
+  vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+  VkRect2D scissor = Initializer::Rect2D(offscreenFramebuffer.width,
+                                         offscreenFramebuffer.height, 0, 0);
+  vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+  const auto dynamicOffsets = GetDynamicOffsets(partition);
+  offscreenQueue.Record(
+      commandBuffer, partition, first, count,
+      std::vector<uint32_t>(dynamicOffsets.begin(), dynamicOffsets.end()));
 }
 
 //*-----------------------------------------------------------------------------
@@ -630,16 +1206,31 @@ void Deferred::BuildDeferredCommandBuffer() {
 //*-----------------------------------------------------------------------------
 
 void Deferred::UpdateUniformBuffers() {
-  const auto CAMERA_RADIUS = config["Camera"]["Radius"].get<float>();
-  camera.SetupOrient(glm::vec3(CAMERA_RADIUS * std::sin(camAngle), 1.0f,
-                               CAMERA_RADIUS * std::cos(camAngle)),
-                     glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+  const auto &cameraConfig = config["Camera"];
+  if (cameraConfig.contains("Position")) {
+    // 位置が指定されている場合(ベンチマークのカメラパスなど)はそれを使用します。
+    camera.SetupOrient(glm::vec3(cameraConfig["Position"][0].get<float>(),
+                                 cameraConfig["Position"][1].get<float>(),
+                                 cameraConfig["Position"][2].get<float>()),
+                       glm::vec3(cameraConfig["Target"][0].get<float>(),
+                                 cameraConfig["Target"][1].get<float>(),
+                                 cameraConfig["Target"][2].get<float>()),
+                       glm::vec3(0.0f, 1.0f, 0.0f));
+  } else {
+    const auto CAMERA_RADIUS = cameraConfig["Radius"].get<float>();
+    camera.SetupOrient(glm::vec3(CAMERA_RADIUS * std::sin(camAngle), 1.0f,
+                                 CAMERA_RADIUS * std::cos(camAngle)),
+                       glm::vec3(0.0f, 1.0f, 0.0f),
+                       glm::vec3(0.0f, 1.0f, 0.0f));
+  }
   camera.SetupPerspective(glm::radians(60.0f),
                           static_cast<float>(swapchain.extent.width) /
                               static_cast<float>(swapchain.extent.height),
                           0.3f, 100.0f);
   UpdateOffscreenUniformBuffers();
   UpdateCompositionUniformBuffers();
+  lightCulling.SetCamera(uniformRing, camera.GetViewMatrix(),
+                         camera.GetProjectionMatrix());
 }
 
 void Deferred::UpdateOffscreenUniformBuffers() {
@@ -648,33 +1239,36 @@ void Deferred::UpdateOffscreenUniformBuffers() {
   uboOffscreenVS.proj = camera.GetProjectionMatrix();
 
   // ユニフォームバッファへコピーします。
-  uniformBuffers.offscreen.Copy(&uboOffscreenVS, sizeof(uboOffscreenVS));
+  uniformRing.Write(uniformBuffers.offscreen, &uboOffscreenVS,
+                    sizeof(uboOffscreenVS));
 }
 
 void Deferred::UpdateCompositionUniformBuffers() {
   uboComposition.viewPos = glm::vec4(camera.GetPosition(), 0.0f);
-
-  int i = 0;
-  for (const auto &light : config["Lights"]) {
-    for (int j = 0; j < 4; j++) {
-      uboComposition.lights[i].pos[j] = light["Position"][j].get<float>();
-    }
-    for (int j = 0; j < 3; j++) {
-      uboComposition.lights[i].color[j] = light["Color"][j].get<float>();
-    }
-    uboComposition.lights[i].radius = light["Radius"].get<float>();
-    i++;
-  }
-
-  uboComposition.lightsNum = static_cast<int>(config["Lights"].size());
+  uboComposition.lightsNum = static_cast<int>(lightCulling.GetLightCount());
   uboComposition.dispTarget = settings.dispRenderTarget;
+  uboComposition.tileCountX = lightCulling.GetTileCountX();
+  uboComposition.tileCountY = lightCulling.GetTileCountY();
+  uboComposition.tileScale = lightCulling.GetTileScale();
 
-  uniformBuffers.composition.Copy(&uboComposition, sizeof(uboComposition));
+  uniformRing.Write(uniformBuffers.composition, &uboComposition,
+                    sizeof(uboComposition));
 }
 
 void Deferred::OnUpdateUIOverlay() {
   if (uiOverlay.Combo("Display Render Target", &settings.dispRenderTarget,
-                      {"Final Result", "Position", "Normal", "Albedo"})) {
+                      {"Final Result", "Position", "Normal", "Albedo",
+                       "Light Heatmap"})) {
     UpdateCompositionUniformBuffers();
   }
+  uiOverlay.Text("G-Buffer: %s", IsSinglePass() ? "transient (subpasses)"
+                                                : "offscreen");
+  uiOverlay.Text("Lights: %u (%ux%u tiles%s)", lightCulling.GetLightCount(),
+                 lightCulling.GetTileCountX(), lightCulling.GetTileCountY(),
+                 lightCulling.HasDepthBounds() ? "" : ", no depth bounds");
+  uiOverlay.Text("Visible: %zu / %u objects", visibleDraws.size(),
+                 offscreenBvh.Size());
+  uiOverlay.Text("Offscreen: %u draws, %u state changes (%u saved)",
+                 offscreenStats.draws, offscreenStats.StateChanges(),
+                 offscreenStats.saved);
 }
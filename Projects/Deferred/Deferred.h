@@ -2,14 +2,20 @@
 
 #include "VK/VkBase.h"
 
+#include <array>
 #include <string>
 #include <vector>
 
 #include "VK/Buffer.h"
 #include "VK/Framebuffer.h"
+#include "VK/LightCulling.h"
 #include "VK/Model.h"
+#include "VK/RenderQueue.h"
 #include "VK/Texture.h"
+#include "VK/UniformRing.h"
+#include "Geometry/BVH.h"
 #include "View/Camera.h"
+#include "View/FrustumCuller.h"
 
 class Deferred : public VkBase {
 public:
@@ -21,6 +27,7 @@ public:
 
   void LoadAssets();
   void PrepareOffscreenFramebuffer();
+  void PrepareLights();
   void PrepareUniformBuffers();
 
   void UpdateUniformBuffers();
@@ -32,18 +39,62 @@ public:
   void SetupDescriptorPool();
   void SetupDescriptorSet();
 
+  void SetupRenderPass() override;
+  void SetupFramebuffers() override;
   void BuildCommandBuffers() override;
 
   void BuildDeferredCommandBuffer();
+  void CreateOffscreenCommandBuffers();
+  [[nodiscard]] std::array<uint32_t, 3>
+  GetDynamicOffsets(uint32_t partition) const;
 
   void ViewChanged() override;
 
 private:
+  /** @brief オフスクリーンパスで描画するオブジェクト */
+  struct OffscreenDraw {
+    const Model *model = nullptr;
+    glm::mat4 matrix = glm::mat4(1.0f);
+  };
+
+  [[nodiscard]] bool IsSinglePass() const;
+  void UpdateGBufferDescriptors();
+  [[nodiscard]] std::vector<OffscreenDraw> GetOffscreenDraws();
+  [[nodiscard]] std::vector<LightCulling::Light> GetLights() const;
+  void PrepareOffscreenCulling();
+  void CullOffscreenDraws();
+  void BuildOffscreenQueue();
+  void RecordOffscreenCommandBuffer(uint32_t image);
+  void RecordFrameCommandBuffer(uint32_t image);
+  void RecordOffscreenDraws(VkCommandBuffer commandBuffer, uint32_t partition,
+                            uint32_t first, uint32_t count) const;
+
+  /** @brief オフスクリーンパスで描画するすべてのオブジェクト */
+  std::vector<OffscreenDraw> offscreenDraws{};
+  /** @brief offscreenDrawsのワールド空間の境界 */
+  std::vector<AABB> offscreenBounds{};
+  /** @brief offscreenBoundsの階層(オブジェクトの番号はoffscreenDrawsと一致します。) */
+  BVH offscreenBvh{};
+  /** @brief offscreenBoundsを葉の順(BVH::GetIndices)に並べたSIMDカリング */
+  FrustumCuller offscreenCuller{};
+  /** @brief 視錐台と交差する葉の範囲(CullOffscreenDrawsの作業用) */
+  std::vector<BVH::LeafRange> partialLeaves{};
+  /** @brief offscreenCullerが返した葉の位置(CullOffscreenDrawsの作業用) */
+  std::vector<uint32_t> culledLeaves{};
+  /** @brief 視錐台の内側にあるoffscreenDrawsの番号(昇順) */
+  std::vector<uint32_t> visibleDraws{};
+  /** @brief コマンドバッファごとに、記録したときのvisibleDraws */
+  std::vector<std::vector<uint32_t>> recordedDraws{};
+  /** @brief オフスクリーンパスの描画を状態の順に並べたキュー */
+  RenderQueue offscreenQueue{};
+  /** @brief 最後に記録したコマンドバッファのオフスクリーンパスの状態の変更の数 */
+  RenderQueue::Stats offscreenStats{};
+
   VertexLayout vertexLayout{
       {
-          VertexLayoutComponent::Position,
-          VertexLayoutComponent::Normal,
-          VertexLayoutComponent::Color,
+          VertexLayoutComponent::PositionHalf,
+          VertexLayoutComponent::NormalOct,
+          VertexLayoutComponent::ColorUnorm8,
       },
   };
 
@@ -58,22 +109,19 @@ private:
     alignas(16) glm::mat4 proj;
   } uboOffscreenVS;
 
-  struct Light {
-    alignas(16) glm::vec4 pos;
-    alignas(16) glm::vec3 color;
-    alignas(4) float radius;
-  };
-
+  /** @brief ライトはlightCullingのストレージバッファに置き、タイルのリストから引きます。 */
   struct {
-    Light lights[8];
     alignas(16) glm::vec4 viewPos;
     alignas(4) int lightsNum;
     alignas(4) int dispTarget;
+    alignas(4) uint32_t tileCountX;
+    alignas(4) uint32_t tileCountY;
+    alignas(8) glm::vec2 tileScale;
   } uboComposition;
 
   struct {
-    Buffer offscreen;
-    Buffer composition;
+    UniformAllocation offscreen;
+    UniformAllocation composition;
   } uniformBuffers;
 
   struct {
@@ -83,14 +131,20 @@ private:
   VkPipelineLayout pipelineLayout;
 
   struct {
-    VkDescriptorSet offscreen;
-    VkDescriptorSet composition;
+    VkDescriptorSet offscreen = VK_NULL_HANDLE;
+    VkDescriptorSet composition = VK_NULL_HANDLE;
   } descriptorSets;
   VkDescriptorSetLayout descriptorSetLayout;
 
+  /**
+   * @brief G-Buffer
+   * @note 1つのレンダーパスで描画する場合は一時的なアタッチメントのみを持ち、デプスはVkBaseのものを使用します。
+   */
   Framebuffer offscreenFramebuffer;
+  /** @brief G-Bufferの位置からタイルごとのライトのリストを作成します。 */
+  LightCulling lightCulling{};
 
-  VkCommandBuffer offscreenCmdBuffer = VK_NULL_HANDLE;
+  std::vector<VkCommandBuffer> offscreenCmdBuffers{};
   VkSemaphore offscreenSemaphore = VK_NULL_HANDLE;
 
   Camera camera{};
@@ -8,10 +8,10 @@
 #include "Deferred.h"
 #include "Json.h"
 
-int main() {
+int main(int argc, char **argv) {
   const auto config = Json::Parse("./Configs/SceneDeferred.json");
   BOOST_ASSERT_MSG(config, "Failed to open Config.json!");
 
-  App app(config.value());
+  App app(config.value(), argc, argv);
   return app.Run(std::make_unique<Deferred>());
 }
@@ -8,10 +8,10 @@
 #include "Json.h"
 #include "PBR.h"
 
-int main() {
+int main(int argc, char **argv) {
   const auto config = Json::Parse("./Configs/ScenePBR.json");
   BOOST_ASSERT_MSG(config, "Failed to open Config.json!");
 
-  App app(config.value());
+  App app(config.value(), argc, argv);
   return app.Run(std::make_unique<PBR>());
 }
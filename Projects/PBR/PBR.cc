@@ -20,7 +20,10 @@ void PBR::OnPostInit() {
 
   PrepareCamera();
   LoadAssets();
+  PrepareInstances();
   PrepareUniformBuffers();
+  // 読み込んだアセットの転送をまとめて1回で送信します。(描画はこの送信の後に行われます。)
+  static_cast<void>(uploader.Submit(device));
 
   SetupDescriptorSetLayout();
   SetupPipelines();
@@ -32,12 +35,10 @@ void PBR::OnPostInit() {
 }
 
 void PBR::OnPreDestroy() {
+  instanceBatches.Destroy(device);
   models.floor.Destroy(device);
   models.spot.Destroy(device);
 
-  uniformBuffers.params.Destroy(device);
-  uniformBuffers.object.Destroy(device);
-
   vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
 
   vkDestroyPipeline(device, pipeline, nullptr);
@@ -70,12 +71,20 @@ void PBR::BuildCommandBuffers() {
   renderPassBeginInfo.clearValueCount = 2;
   renderPassBeginInfo.pClearValues = clear.data();
 
+  // リサイズなどで作り直したハンドルに番号を振り直します。
+  renderQueue.Reset();
+  BuildQueue();
   for (size_t i = 0; i < drawCmdBuffers.size(); i++) {
     // ターゲットフレームバッファを設定します。
     renderPassBeginInfo.framebuffer = framebuffers[i];
     VK_CHECK_RESULT(
         vkBeginCommandBuffer(drawCmdBuffers[i], &commandBufferBeginInfo));
 
+    // 描画するインスタンスを選別し、間接描画の引数を書き込みます。
+    const uint32_t partition =
+        uniformRing.GetPartition(static_cast<uint32_t>(i));
+    instanceBatches.RecordCulling(drawCmdBuffers[i], partition, uniformRing);
+
     // デフォルトのレンダーパス設定で指定された最初のサブパスを開始します。
     // これにより、色と奥行きのアタッチメントがクリアされます。
     vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo,
@@ -90,90 +99,13 @@ void PBR::BuildCommandBuffers() {
                                            swapchain.extent.height, 0, 0);
     vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
 
-    // 記述子セットとパイプラインのバインド
-    vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
-                            pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
-    vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
-                      pipeline);
-
-    // Spotの頂点バッファとインデックスバッファをバインドします。
-    VkDeviceSize offsets[] = {0};
-    vkCmdBindVertexBuffers(drawCmdBuffers[i], 0, 1,
-                           &models.spot.vertices.buffer, offsets);
-    vkCmdBindIndexBuffer(drawCmdBuffers[i], models.spot.indices.buffer, 0,
-                         VK_INDEX_TYPE_UINT32);
-    // Spot左側
-    {
-      const auto &spot = config["Spot"];
-      const auto trans = glm::vec3(spot["Positions"][0][0].get<float>(),
-                                   spot["Positions"][0][1].get<float>(),
-                                   spot["Positions"][0][2].get<float>());
-      const auto model = glm::translate(glm::mat4(1.0f), trans);
-      vkCmdPushConstants(drawCmdBuffers[i], pipelineLayout,
-                         VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(model), &model);
-      Material mat{};
-      mat.rough = settings.metalRough;
-      mat.metal = 1.0f;
-      mat.reflect = settings.dielectricReflectance;
-      mat.r = settings.metalSpecular.r;
-      mat.g = settings.metalSpecular.g;
-      mat.b = settings.metalSpecular.b;
-      vkCmdPushConstants(drawCmdBuffers[i], pipelineLayout,
-                         VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(model),
-                         sizeof(mat), &mat);
-      vkCmdDrawIndexed(drawCmdBuffers[i], models.spot.indexCount, 1, 0, 0, 0);
-    }
-    // Spot右側
-    {
-      const auto &spot = config["Spot"];
-      const auto trans = glm::vec3(spot["Positions"][1][0].get<float>(),
-                                   spot["Positions"][1][1].get<float>(),
-                                   spot["Positions"][1][2].get<float>());
-      const auto model = glm::translate(glm::mat4(1.0f), trans);
-      vkCmdPushConstants(drawCmdBuffers[i], pipelineLayout,
-                         VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(model), &model);
-      Material mat{};
-      mat.rough = settings.dielectricRough;
-      mat.metal = 0.0f;
-      mat.reflect = settings.dielectricReflectance;
-      mat.r = settings.dielectricBaseColor.r;
-      mat.g = settings.dielectricBaseColor.g;
-      mat.b = settings.dielectricBaseColor.b;
-      vkCmdPushConstants(drawCmdBuffers[i], pipelineLayout,
-                         VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(model),
-                         sizeof(mat), &mat);
-      vkCmdDrawIndexed(drawCmdBuffers[i], models.spot.indexCount, 1, 0, 0, 0);
-    }
-
-    // Floor
-    {
-      vkCmdBindVertexBuffers(drawCmdBuffers[i], 0, 1,
-                             &models.floor.vertices.buffer, offsets);
-      vkCmdBindIndexBuffer(drawCmdBuffers[i], models.floor.indices.buffer, 0,
-                           VK_INDEX_TYPE_UINT32);
-
-      const auto trans = glm::vec3(config["Floor"]["Position"][0].get<float>(),
-                                   config["Floor"]["Position"][1].get<float>(),
-                                   config["Floor"]["Position"][2].get<float>());
-      auto model = glm::translate(glm::mat4(1.0f), trans);
-      model =
-          glm::scale(model, glm::vec3(config["Floor"]["Scale"].get<float>()));
-      vkCmdPushConstants(drawCmdBuffers[i], pipelineLayout,
-                         VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(model), &model);
-      Material mat{};
-      mat.rough = 1.0f;
-      mat.metal = 0.0f;
-      mat.reflect = 1.0f;
-      mat.r = 0.0f;
-      mat.g = 0.0f;
-      mat.b = 0.0f;
-      vkCmdPushConstants(drawCmdBuffers[i], pipelineLayout,
-                         VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(model),
-                         sizeof(mat), &mat);
-      vkCmdDrawIndexed(drawCmdBuffers[i], models.floor.indexCount, 1, 0, 0, 0);
-    }
-
-    DrawUI(drawCmdBuffers[i]);
+    // 記述子セットとパイプラインはキューがバインドします。
+    // ユニフォームバッファと見えるインスタンスは、このコマンドバッファのパーティションを動的オフセットで指定します。
+    renderQueue.Record(
+        drawCmdBuffers[i], partition, 0, renderQueue.Size(),
+        {uniformRing.GetDynamicOffset(uniformBuffers.object, partition),
+         uniformRing.GetDynamicOffset(uniformBuffers.params, partition),
+         instanceBatches.GetVisibleOffset(partition)});
 
     vkCmdEndRenderPass(drawCmdBuffers[i]);
 
@@ -182,6 +114,30 @@ void PBR::BuildCommandBuffers() {
   }
 }
 
+/**
+ * @brief インスタンスのバッチをレンダーキューに加えます。
+ * @note 各バッチはGPUで選別したインスタンスの数で間接描画します。
+ */
+void PBR::BuildQueue() {
+  renderQueue.Clear();
+  const auto batchCount =
+      static_cast<uint32_t>(instanceBatches.GetBatches().size());
+  for (uint32_t b = 0; b < batchCount; b++) {
+    RenderQueue::DrawItem item{};
+    item.pipeline = pipeline;
+    item.pipelineLayout = pipelineLayout;
+    item.descriptorSet = descriptorSet;
+    item.dynamicOffsetCount = 3;
+    item.mesh = instanceBatches.MeshOf(b);
+    const PushConstants pushConsts{instanceBatches.BaseInstance(b)};
+    item.pushConstants = &pushConsts;
+    item.pushConstantsSize = sizeof(pushConsts);
+    item.pushConstantStages = VK_SHADER_STAGE_VERTEX_BIT;
+    renderQueue.Push(item);
+  }
+  renderQueue.Sort();
+}
+
 void PBR::OnUpdate(float t) {
   const float deltaT = prevTime == 0.0f ? 0.0f : t - prevTime;
   prevTime = t;
@@ -197,6 +153,12 @@ void PBR::ViewChanged() {
   UpdateUniformBufferVS();
 }
 
+VkPhysicalDeviceFeatures PBR::GetEnabledFeatures() const {
+  VkPhysicalDeviceFeatures enabledFeatures{};
+  InstanceBatches::RequestFeatures(device, enabledFeatures);
+  return enabledFeatures;
+}
+
 //*-----------------------------------------------------------------------------
 // Assets
 //*-----------------------------------------------------------------------------
@@ -205,13 +167,15 @@ void PBR::LoadAssets() {
   // Spot
   {
     const auto &modelPath = config["Spot"]["Model"].get<std::string>();
-    models.spot.LoadFromFile(device, modelPath, queue, vertexLayout);
+    assets.AddModel(models.spot, modelPath, vertexLayout);
   }
   // Floor
   {
     const auto &modelPath = config["Floor"]["Model"].get<std::string>();
-    models.floor.LoadFromFile(device, modelPath, queue, vertexLayout);
+    assets.AddModel(models.floor, modelPath, vertexLayout);
   }
+  // 宣言したアセットをワーカースレッドで読み込み、転送を記録します。
+  static_cast<void>(assets.Load(device, uploader));
 }
 
 //*-----------------------------------------------------------------------------
@@ -225,10 +189,17 @@ void PBR::LoadAssets() {
  */
 void PBR::SetupDescriptorSetLayout() {
   std::vector<VkDescriptorSetLayoutBinding> descriptorSetLayoutBindings = {
-      Initializer::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-                                              VK_SHADER_STAGE_VERTEX_BIT, 0),
-      Initializer::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-                                              VK_SHADER_STAGE_FRAGMENT_BIT, 1),
+      Initializer::DescriptorSetLayoutBinding(
+          VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_VERTEX_BIT,
+          0),
+      Initializer::DescriptorSetLayoutBinding(
+          VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+          VK_SHADER_STAGE_FRAGMENT_BIT, 1),
+      Initializer::DescriptorSetLayoutBinding(
+          VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 2),
+      Initializer::DescriptorSetLayoutBinding(
+          VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, VK_SHADER_STAGE_VERTEX_BIT,
+          3),
   };
 
   VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo =
@@ -243,9 +214,7 @@ void PBR::SetupDescriptorSetLayout() {
 
   std::vector<VkPushConstantRange> pushConstantRanges = {
       Initializer::PushConstantRange(VK_SHADER_STAGE_VERTEX_BIT,
-                                     sizeof(glm::mat4), 0),
-      Initializer::PushConstantRange(VK_SHADER_STAGE_FRAGMENT_BIT,
-                                     sizeof(Material), sizeof(glm::mat4)),
+                                     sizeof(PushConstants), 0),
   };
   pipelineLayoutCreateInfo.pushConstantRangeCount =
       static_cast<uint32_t>(pushConstantRanges.size());
@@ -257,7 +226,11 @@ void PBR::SetupDescriptorSetLayout() {
 void PBR::SetupDescriptorPool() {
   // APIに記述子の最大数を通知する必要があります。
   std::vector<VkDescriptorPoolSize> descriptorPoolSizes = {
-      Initializer::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 16),
+      Initializer::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+                                      16),
+      Initializer::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1),
+      Initializer::DescriptorPoolSize(
+          VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1),
   };
 
   // グローバル記述子プールを生成します。
@@ -278,11 +251,17 @@ void PBR::SetupDescriptorSet() {
 
   std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
       Initializer::WriteDescriptorSet(descriptorSet,
-                                      VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0,
-                                      &uniformBuffers.object.descriptor),
+                                      VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+                                      0, &uniformBuffers.object.descriptor),
       Initializer::WriteDescriptorSet(descriptorSet,
-                                      VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1,
-                                      &uniformBuffers.params.descriptor),
+                                      VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+                                      1, &uniformBuffers.params.descriptor),
+      Initializer::WriteDescriptorSet(descriptorSet,
+                                      VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2,
+                                      &instanceBatches.instances.descriptor),
+      Initializer::WriteDescriptorSet(
+          descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 3,
+          &instanceBatches.visible.descriptor),
   };
   vkUpdateDescriptorSets(device,
                          static_cast<uint32_t>(writeDescriptorSets.size()),
@@ -355,12 +334,8 @@ void PBR::SetupPipelines() {
 
   // 入力属性バインディングはシェーダー属性の場所とメモリレイアウトを記述します。
   // これらはシェーダーレイアウトに一致します。
-  std::vector<VkVertexInputAttributeDescription> vertexInputAttributes = {
-      Initializer::VertexInputAttributeDescription(
-          0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0),
-      Initializer::VertexInputAttributeDescription(
-          0, 1, VK_FORMAT_R32G32B32_SFLOAT, 3 * sizeof(float)),
-  };
+  std::vector<VkVertexInputAttributeDescription> vertexInputAttributes =
+      vertexLayout.Attributes(0);
 
   // パイプラインの作成に使用される頂点入力ステート
   VkPipelineVertexInputStateCreateInfo vertexInputState =
@@ -405,6 +380,42 @@ void PBR::SetupPipelines() {
 // Prepare
 //*-----------------------------------------------------------------------------
 
+/**
+ * @brief オブジェクトをモデルごとのインスタンスにまとめ、転送します。
+ * @note 2つのSpotは1つのバッチになり、1回の間接描画で描画します。
+ */
+void PBR::PrepareInstances() {
+  const auto &spot = config["Spot"];
+  const std::array<MaterialType, 2> spotMaterials = {MaterialType::Metal,
+                                                     MaterialType::Dielectric};
+  for (size_t i = 0; i < spotMaterials.size(); i++) {
+    const auto trans = glm::vec3(spot["Positions"][i][0].get<float>(),
+                                 spot["Positions"][i][1].get<float>(),
+                                 spot["Positions"][i][2].get<float>());
+    const auto model = glm::translate(glm::mat4(1.0f), trans) *
+                       models.spot.DequantizeMatrix();
+    static_cast<void>(instanceBatches.Add(
+        models.spot, model, static_cast<uint32_t>(spotMaterials[i])));
+  }
+
+  // Floor
+  {
+    const auto trans = glm::vec3(config["Floor"]["Position"][0].get<float>(),
+                                 config["Floor"]["Position"][1].get<float>(),
+                                 config["Floor"]["Position"][2].get<float>());
+    auto model = glm::translate(glm::mat4(1.0f), trans);
+    model = glm::scale(model, glm::vec3(config["Floor"]["Scale"].get<float>()));
+    model *= models.floor.DequantizeMatrix();
+    static_cast<void>(instanceBatches.Add(
+        models.floor, model, static_cast<uint32_t>(MaterialType::Floor)));
+  }
+
+  instanceBatches.Prepare(device, uploader, uniformRing, pipelineCache,
+                          config["InstanceCullShader"].get<std::string>());
+  renderQueue.SetMaxDrawIndirectCount(
+      InstanceBatches::MaxDrawIndirectCount(device));
+}
+
 void PBR::PrepareCamera() {
   const auto camPt = glm::vec3(config["Camera"]["Position"][0].get<float>(),
                                config["Camera"]["Position"][1].get<float>(),
@@ -426,19 +437,8 @@ void PBR::PrepareCamera() {
  * OpenGLのような単一のユニフォームはVulkanに存在しなくなりました。すべてのシェーダーユニフォームはユニフォームバッファブロックを介して渡されます。
  */
 void PBR::PrepareUniformBuffers() {
-  VK_CHECK_RESULT(
-      uniformBuffers.object.Create(device, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                                       VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                                   sizeof(uboVS), &uboVS));
-  VK_CHECK_RESULT(uniformBuffers.object.Map(device));
-
-  VK_CHECK_RESULT(
-      uniformBuffers.params.Create(device, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                                       VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                                   sizeof(uboFS), &uboFS));
-  VK_CHECK_RESULT(uniformBuffers.params.Map(device));
+  uniformBuffers.object = uniformRing.Allocate(sizeof(uboVS));
+  uniformBuffers.params = uniformRing.Allocate(sizeof(uboFS));
 
   UpdateUniformBufferVS();
   UpdateUniformBufferFS();
@@ -455,7 +455,8 @@ void PBR::UpdateUniformBufferVS() {
   uboVS.viewProj = proj * view;
 
   // ユニフォームバッファへコピーします。
-  uniformBuffers.object.Copy(&uboVS, sizeof(uboVS));
+  uniformRing.Write(uniformBuffers.object, &uboVS, sizeof(uboVS));
+  instanceBatches.SetFrustum(uniformRing, uboVS.viewProj);
 }
 
 void PBR::UpdateUniformBufferFS() {
@@ -480,14 +481,38 @@ void PBR::UpdateUniformBufferFS() {
     }
   }
 
-  uniformBuffers.params.Copy(&uboFS, sizeof(uboFS));
+  auto &metal = uboFS.materials[static_cast<size_t>(MaterialType::Metal)];
+  metal.color = glm::vec4(settings.metalSpecular, 1.0f);
+  metal.rough = settings.metalRough;
+  metal.metal = 1.0f;
+  metal.reflect = settings.dielectricReflectance;
+  auto &dielectric =
+      uboFS.materials[static_cast<size_t>(MaterialType::Dielectric)];
+  dielectric.color = glm::vec4(settings.dielectricBaseColor, 1.0f);
+  dielectric.rough = settings.dielectricRough;
+  dielectric.metal = 0.0f;
+  dielectric.reflect = settings.dielectricReflectance;
+  auto &floor = uboFS.materials[static_cast<size_t>(MaterialType::Floor)];
+  floor.color = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+  floor.rough = 1.0f;
+  floor.metal = 0.0f;
+  floor.reflect = 1.0f;
+
+  uniformRing.Write(uniformBuffers.params, &uboFS, sizeof(uboFS));
 }
 
 void PBR::OnUpdateUIOverlay() {
-  uiOverlay.ColorEdit3("Metal Specular", &settings.metalSpecular);
-  uiOverlay.SliderFloat("Metal Roughness", &settings.metalRough, 0.0f, 1.0f);
-  uiOverlay.ColorEdit3("Non-Metal Diffuse Albedo",
-                       &settings.dielectricBaseColor);
-  uiOverlay.SliderFloat("Non-Metal Roughness", &settings.dielectricRough, 0.0f,
-                        1.0f);
+  bool changed = false;
+  changed |= uiOverlay.ColorEdit3("Metal Specular", &settings.metalSpecular);
+  changed |= uiOverlay.SliderFloat("Metal Roughness", &settings.metalRough,
+                                   0.0f, 1.0f);
+  changed |= uiOverlay.ColorEdit3("Non-Metal Diffuse Albedo",
+                                  &settings.dielectricBaseColor);
+  changed |= uiOverlay.SliderFloat("Non-Metal Roughness",
+                                   &settings.dielectricRough, 0.0f, 1.0f);
+
+  // マテリアルはユニフォームバッファにあるため、コマンドバッファを記録し直す必要はありません。
+  if (changed) {
+    UpdateUniformBufferFS();
+  }
 }
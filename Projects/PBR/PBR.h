@@ -6,8 +6,11 @@
 #include <vector>
 
 #include "VK/Buffer.h"
+#include "VK/InstanceBatches.h"
 #include "VK/Model.h"
+#include "VK/RenderQueue.h"
 #include "VK/Texture.h"
+#include "VK/UniformRing.h"
 #include "View/Camera.h"
 
 enum struct MetalColor : std::uint32_t {
@@ -33,6 +36,7 @@ public:
 
   void PrepareCamera();
   void LoadAssets();
+  void PrepareInstances();
   void PrepareUniformBuffers();
   void UpdateUniformBufferVS();
   void UpdateUniformBufferFS();
@@ -45,8 +49,25 @@ public:
   void BuildCommandBuffers() override;
 
   void ViewChanged() override;
+  [[nodiscard]] VkPhysicalDeviceFeatures GetEnabledFeatures() const override;
 
 private:
+  /** @brief インスタンスのマテリアルの番号 */
+  enum struct MaterialType : uint32_t {
+    Metal,
+    Dielectric,
+    Floor,
+    Num,
+  };
+
+  /** @brief マテリアル(インスタンスのマテリアルの番号で引きます。) */
+  struct Material {
+    alignas(16) glm::vec4 color;
+    alignas(4) float rough;
+    alignas(4) float metal;
+    alignas(4) float reflect;
+  };
+
   struct UniformBufferObjectVS {
     alignas(16) glm::mat4 viewProj;
   } uboVS;
@@ -59,16 +80,16 @@ private:
     alignas(16) glm::vec3 eye;
     Light lights[8];
     alignas(4) int lightsNum;
+    Material materials[static_cast<size_t>(MaterialType::Num)];
   } uboFS;
 
-  struct Material {
-    float rough;
-    float metal;
-    float reflect;
-    float r;
-    float g;
-    float b;
+  /** @brief プッシュ定数(変換とマテリアルはインスタンスから読みます。) */
+  struct PushConstants {
+    alignas(4) uint32_t baseInstance;
   };
+
+  void BuildQueue();
+
   VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
   VkPipeline pipeline = VK_NULL_HANDLE;
 
@@ -78,8 +99,8 @@ private:
   Camera camera{};
 
   VertexLayout vertexLayout{{
-      VertexLayoutComponent::Position,
-      VertexLayoutComponent::Normal,
+      VertexLayoutComponent::PositionHalf,
+      VertexLayoutComponent::NormalOct,
   }};
 
   struct {
@@ -87,9 +108,14 @@ private:
     Model floor;
   } models;
 
+  /** @brief モデルごとにまとめたインスタンス */
+  InstanceBatches instanceBatches{};
+  /** @brief バッチの描画を状態の順に並べたキュー */
+  RenderQueue renderQueue{};
+
   struct {
-    Buffer object{};
-    Buffer params{};
+    UniformAllocation object{};
+    UniformAllocation params{};
   } uniformBuffers;
 
   float prevTime = 0.0f;
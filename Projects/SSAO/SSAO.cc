@@ -3,6 +3,7 @@
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
 
+#include <algorithm>
 #include <array>
 #include <boost/assert.hpp>
 #include <random>
@@ -14,6 +15,14 @@
 
 #include "Math/UniformDistribution.h"
 
+/**
+ * @brief G-Bufferのパイプラインのカリングモード
+ * @note
+ * ティーポットは蓋と注ぎ口の隙間から内側が見えるため、両面を描画します。<br>
+ * クラスターカリングの裏向きの判定は、裏面を棄却する場合のみ有効にします。
+ */
+static constexpr VkCullModeFlags kGBufferCullMode = VK_CULL_MODE_NONE;
+
 //*-----------------------------------------------------------------------------
 // Overrides functions
 //*-----------------------------------------------------------------------------
@@ -21,28 +30,60 @@
 void SSAO::OnPostInit() {
   VkBase::OnPostInit();
 
+  if (config.contains("AOMode") &&
+      config["AOMode"].get<std::string>() == "Compute") {
+    aoMode = AOMode::Compute;
+  }
+
   LoadAssets();
   PrepareOffscreenFramebuffer();
+  PrepareComputeImages();
+  PrepareClusterCulling();
+  PrepareInstances();
   PrepareUniformBuffers();
+  // 読み込んだアセットの転送をまとめて1回で送信します。(描画はこの送信の後に行われます。)
+  static_cast<void>(uploader.Submit(device));
 
   SetupDescriptorPool();
   SetupDescriptorSet();
   SetupPipelines();
+  SetupComputePipelines();
 
   BuildCommandBuffers();
 }
 
 void SSAO::OnPreDestroy() {
+  instanceBatches.Destroy(device);
+
+  vkDestroyPipeline(device, pipelines.clusterCull, nullptr);
+  vkDestroyPipeline(device, pipelines.upsample, nullptr);
+  vkDestroyPipeline(device, pipelines.blurVertical, nullptr);
+  vkDestroyPipeline(device, pipelines.blurHorizontal, nullptr);
+  vkDestroyPipeline(device, pipelines.ssaoHalf, nullptr);
+  vkDestroyPipeline(device, pipelines.downsample, nullptr);
   vkDestroyPipeline(device, pipelines.lighting, nullptr);
   vkDestroyPipeline(device, pipelines.blur, nullptr);
   vkDestroyPipeline(device, pipelines.ssao, nullptr);
   vkDestroyPipeline(device, pipelines.gBuffer, nullptr);
 
+  vkDestroyPipelineLayout(device, pipelineLayouts.clusterCull, nullptr);
+  vkDestroyPipelineLayout(device, pipelineLayouts.upsample, nullptr);
+  vkDestroyPipelineLayout(device, pipelineLayouts.bilateralBlur, nullptr);
+  vkDestroyPipelineLayout(device, pipelineLayouts.ssaoHalf, nullptr);
+  vkDestroyPipelineLayout(device, pipelineLayouts.downsample, nullptr);
   vkDestroyPipelineLayout(device, pipelineLayouts.lighting, nullptr);
   vkDestroyPipelineLayout(device, pipelineLayouts.blur, nullptr);
   vkDestroyPipelineLayout(device, pipelineLayouts.ssao, nullptr);
   vkDestroyPipelineLayout(device, pipelineLayouts.gBuffer, nullptr);
 
+  vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.clusterCull,
+                               nullptr);
+  vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.upsample, nullptr);
+  vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.bilateralBlur,
+                               nullptr);
+  vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.ssaoHalf, nullptr);
+  vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.downsample,
+                               nullptr);
   vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.lighting, nullptr);
   vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.blur, nullptr);
   vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.ssao, nullptr);
@@ -52,9 +93,14 @@ void SSAO::OnPreDestroy() {
   frameBuffers.ssao.Destroy(device);
   frameBuffers.gBuffer.Destroy(device);
 
-  uniformBuffers.lighting.Destroy(device);
-  uniformBuffers.ssao.Destroy(device);
-  uniformBuffers.gBuffer.Destroy(device);
+  clusterCulling.commands.Destroy(device);
+  clusterCulling.indices.Destroy(device);
+
+  DestroyStorageImage(computeImages.upsampled);
+  DestroyStorageImage(computeImages.ao[1]);
+  DestroyStorageImage(computeImages.ao[0]);
+  DestroyStorageImage(computeImages.normal);
+  DestroyStorageImage(computeImages.position);
 
   textures.noise.Destroy(device);
   textures.wall.Destroy(device);
@@ -66,6 +112,12 @@ void SSAO::OnPreDestroy() {
 
 void SSAO::ViewChanged() { UpdateUniformBuffers(); }
 
+VkPhysicalDeviceFeatures SSAO::GetEnabledFeatures() const {
+  VkPhysicalDeviceFeatures enabledFeatures{};
+  InstanceBatches::RequestFeatures(device, enabledFeatures);
+  return enabledFeatures;
+}
+
 //*-----------------------------------------------------------------------------
 // Assets
 //*-----------------------------------------------------------------------------
@@ -75,29 +127,71 @@ void SSAO::LoadAssets() {
   // Teapot
   {
     const auto &teapot = config["Teapot"];
+    modelCreateInfo.optimize = teapot.value("Optimize", false);
+    modelCreateInfo.clusters = teapot.value("Clusters", false);
     modelCreateInfo.color = glm::vec3(teapot["Color"][0].get<float>(),
                                       teapot["Color"][1].get<float>(),
                                       teapot["Color"][2].get<float>());
-    models.teapot.LoadFromFile(device,
-                               config["Teapot"]["Model"].get<std::string>(),
-                               queue, vertexLayout, modelCreateInfo);
+    assets.AddModel(models.teapot, teapot["Model"].get<std::string>(),
+                    vertexLayout, modelCreateInfo);
   }
 
   // Floor
   {
     const auto &floor = config["Floor"];
+    modelCreateInfo.optimize = floor.value("Optimize", false);
+    modelCreateInfo.clusters = false;
     modelCreateInfo.uvscale = glm::vec3(4.0f, 4.0f, 4.0f);
-    models.floor.LoadFromFile(device,
-                              config["Floor"]["Model"].get<std::string>(),
-                              queue, vertexLayout, modelCreateInfo);
-    textures.floor.Load(device, floor["Texture"].get<std::string>(), queue);
+    assets.AddModel(models.floor, floor["Model"].get<std::string>(),
+                    vertexLayout, modelCreateInfo);
+    LoadTexture(textures.floor, floor);
   }
 
   // Wall
   {
     const auto &wall = config["Wall"];
     modelCreateInfo.uvscale = glm::vec3(16.0f, 16.0f, 16.0f);
-    textures.wall.Load(device, wall["Texture"].get<std::string>(), queue);
+    LoadTexture(textures.wall, wall);
+  }
+
+  // 宣言したアセットをワーカースレッドで読み込み、転送を記録します。
+  static_cast<void>(assets.Load(device, uploader));
+}
+
+/**
+ * @brief テクスチャを読み込みます。("Stream"が有効な場合はミップレベルをストリーミングします。)
+ */
+void SSAO::LoadTexture(Texture2D &texture, const nlohmann::json &asset) {
+  const auto filepath = asset["Texture"].get<std::string>();
+  if (asset.value("Stream", false)) {
+    static_cast<void>(streamer.Add(device, uploader, texture, filepath));
+  } else {
+    assets.AddTexture(texture, filepath);
+  }
+}
+
+/**
+ * @brief パーティションの記述子セットのストリーミングしているテクスチャを書き直します。
+ * @note 記述子セットを書き直すと、それをバインドしたコマンドバッファは記録し直す必要があります。
+ */
+void SSAO::OnTexturesStreamed(uint32_t partition) {
+  const VkDescriptorSet descriptorSet = descriptorSets.gBuffer[partition];
+  const std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+      Initializer::WriteDescriptorSet(descriptorSet,
+                                      VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                      1, &textures.floor.descriptor),
+      Initializer::WriteDescriptorSet(descriptorSet,
+                                      VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                      2, &textures.wall.descriptor),
+  };
+  vkUpdateDescriptorSets(device,
+                         static_cast<uint32_t>(writeDescriptorSets.size()),
+                         writeDescriptorSets.data(), 0, nullptr);
+
+  const auto draws = GetGBufferDraws();
+  for (uint32_t i = partition; i < drawCmdBuffers.size();
+       i += uniformRing.GetPartitionCount()) {
+    RecordCommandBuffer(i, draws);
   }
 }
 
@@ -106,17 +200,27 @@ void SSAO::LoadAssets() {
 //*-----------------------------------------------------------------------------
 
 void SSAO::SetupDescriptorPool() {
+  // G-Bufferの記述子セットはパーティションごとに作るため、2つ目以降の分を加えます。
+  const uint32_t partitionCount = uniformRing.GetPartitionCount();
+  const uint32_t extraSets = partitionCount - 1;
+
   // APIに記述子の最大数を通知する必要があります。
   std::vector<VkDescriptorPoolSize> descriptorPoolSizes = {
-      Initializer::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 16),
+      Initializer::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+                                      16 + extraSets),
       Initializer::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                                      16),
+                                      32 + 3 * extraSets),
+      Initializer::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 8),
+      Initializer::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                      3 + extraSets),
+      Initializer::DescriptorPoolSize(
+          VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 3 + extraSets),
   };
 
   // グローバル記述子プールを生成します。
   VkDescriptorPoolCreateInfo descriptorPoolInfo =
-      Initializer::DescriptorPoolCreateInfo(descriptorPoolSizes,
-                                            descriptorSets.maxSets);
+      Initializer::DescriptorPoolCreateInfo(
+          descriptorPoolSizes, descriptorSets.maxSets + partitionCount);
 
   VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptorPoolInfo, nullptr,
                                          &descriptorPool));
@@ -139,9 +243,11 @@ void SSAO::SetupDescriptorSet() {
 
   // G-Buffer creation
   {
+    // 見えるインスタンスの番号はコマンドバッファごとの領域を動的オフセットで指定します。
     descriptorSetLayoutBindings = {
         Initializer::DescriptorSetLayoutBinding(
-            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 0),
+            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+            VK_SHADER_STAGE_VERTEX_BIT, 0),
         Initializer::DescriptorSetLayoutBinding(
             VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
             VK_SHADER_STAGE_FRAGMENT_BIT, 1),
@@ -151,6 +257,11 @@ void SSAO::SetupDescriptorSet() {
         Initializer::DescriptorSetLayoutBinding(
             VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
             VK_SHADER_STAGE_FRAGMENT_BIT, 3),
+        Initializer::DescriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 4),
+        Initializer::DescriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+            VK_SHADER_STAGE_VERTEX_BIT, 5),
     };
     descriptorSetLayoutCreateInfo =
         Initializer::DescriptorSetLayoutCreateInfo(descriptorSetLayoutBindings);
@@ -160,9 +271,8 @@ void SSAO::SetupDescriptorSet() {
 
     pipelineLayoutCreateInfo.pSetLayouts = &descriptorSetLayouts.gBuffer;
     std::vector<VkPushConstantRange> pushConstantRanges = {
-        Initializer::PushConstantRange(VK_SHADER_STAGE_VERTEX_BIT |
-                                           VK_SHADER_STAGE_FRAGMENT_BIT,
-                                       sizeof(pushConsts), 0),
+        Initializer::PushConstantRange(VK_SHADER_STAGE_VERTEX_BIT,
+                                       sizeof(PushConstants), 0),
     };
     pipelineLayoutCreateInfo.pushConstantRangeCount =
         static_cast<uint32_t>(pushConstantRanges.size());
@@ -170,23 +280,38 @@ void SSAO::SetupDescriptorSet() {
     VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo,
                                            nullptr, &pipelineLayouts.gBuffer));
 
-    descriptorSetAllocateInfo.pSetLayouts = &descriptorSetLayouts.gBuffer;
+    // ストリーミングするテクスチャは、パーティションを使う送信の完了後にそのセットだけ書き直します。
+    descriptorSets.gBuffer.resize(uniformRing.GetPartitionCount());
+    const std::vector<VkDescriptorSetLayout> gBufferLayouts(
+        descriptorSets.gBuffer.size(), descriptorSetLayouts.gBuffer);
+    descriptorSetAllocateInfo.pSetLayouts = gBufferLayouts.data();
+    descriptorSetAllocateInfo.descriptorSetCount =
+        static_cast<uint32_t>(gBufferLayouts.size());
     VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocateInfo,
-                                             &descriptorSets.gBuffer));
-    writeDescriptorSets = {
-        Initializer::WriteDescriptorSet(descriptorSets.gBuffer,
-                                        VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0,
-                                        &uniformBuffers.gBuffer.descriptor),
-        Initializer::WriteDescriptorSet(
-            descriptorSets.gBuffer, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-            1, &textures.floor.descriptor),
-        Initializer::WriteDescriptorSet(
-            descriptorSets.gBuffer, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-            2, &textures.wall.descriptor),
-    };
-    vkUpdateDescriptorSets(device,
-                           static_cast<uint32_t>(writeDescriptorSets.size()),
-                           writeDescriptorSets.data(), 0, nullptr);
+                                             descriptorSets.gBuffer.data()));
+    descriptorSetAllocateInfo.descriptorSetCount = 1;
+    for (const auto descriptorSet : descriptorSets.gBuffer) {
+      writeDescriptorSets = {
+          Initializer::WriteDescriptorSet(
+              descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 0,
+              &uniformBuffers.gBuffer.descriptor),
+          Initializer::WriteDescriptorSet(
+              descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1,
+              &textures.floor.descriptor),
+          Initializer::WriteDescriptorSet(
+              descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2,
+              &textures.wall.descriptor),
+          Initializer::WriteDescriptorSet(
+              descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4,
+              &instanceBatches.instances.descriptor),
+          Initializer::WriteDescriptorSet(
+              descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 5,
+              &instanceBatches.visible.descriptor),
+      };
+      vkUpdateDescriptorSets(device,
+                             static_cast<uint32_t>(writeDescriptorSets.size()),
+                             writeDescriptorSets.data(), 0, nullptr);
+    }
 
     pipelineLayoutCreateInfo.pushConstantRangeCount = 0;
     pipelineLayoutCreateInfo.pPushConstantRanges = nullptr;
@@ -205,7 +330,8 @@ void SSAO::SetupDescriptorSet() {
             VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
             VK_SHADER_STAGE_FRAGMENT_BIT, 2),
         Initializer::DescriptorSetLayoutBinding(
-            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 3),
+            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+            VK_SHADER_STAGE_FRAGMENT_BIT, 3),
     };
     descriptorSetLayoutCreateInfo =
         Initializer::DescriptorSetLayoutCreateInfo(descriptorSetLayoutBindings);
@@ -241,9 +367,9 @@ void SSAO::SetupDescriptorSet() {
         Initializer::WriteDescriptorSet(
             descriptorSets.ssao, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2,
             &textures.noise.descriptor),
-        Initializer::WriteDescriptorSet(descriptorSets.ssao,
-                                        VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3,
-                                        &uniformBuffers.ssao.descriptor),
+        Initializer::WriteDescriptorSet(
+            descriptorSets.ssao, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 3,
+            &uniformBuffers.ssao.descriptor),
     };
     vkUpdateDescriptorSets(device,
                            static_cast<uint32_t>(writeDescriptorSets.size()),
@@ -290,7 +416,8 @@ void SSAO::SetupDescriptorSet() {
   {
     descriptorSetLayoutBindings = {
         Initializer::DescriptorSetLayoutBinding(
-            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 0),
+            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+            VK_SHADER_STAGE_FRAGMENT_BIT, 0),
         Initializer::DescriptorSetLayoutBinding(
             VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
             VK_SHADER_STAGE_FRAGMENT_BIT, 1),
@@ -342,9 +469,9 @@ void SSAO::SetupDescriptorSet() {
             VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
     };
     writeDescriptorSets = {
-        Initializer::WriteDescriptorSet(descriptorSets.lighting,
-                                        VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0,
-                                        &uniformBuffers.lighting.descriptor),
+        Initializer::WriteDescriptorSet(
+            descriptorSets.lighting, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+            0, &uniformBuffers.lighting.descriptor),
         Initializer::WriteDescriptorSet(
             descriptorSets.lighting, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
             1, &imageDescriptors[0]),
@@ -365,6 +492,372 @@ void SSAO::SetupDescriptorSet() {
                            static_cast<uint32_t>(writeDescriptorSets.size()),
                            writeDescriptorSets.data(), 0, nullptr);
   }
+
+  // Compute: ストレージイメージは常にGENERALレイアウトで読み書きします。
+  const auto storageImageInfo = [](const StorageImage &storageImage) {
+    return Initializer::DescriptorImageInfo(VK_NULL_HANDLE, storageImage.view,
+                                            VK_IMAGE_LAYOUT_GENERAL);
+  };
+  const auto sampledImageInfo = [&](const StorageImage &storageImage) {
+    return Initializer::DescriptorImageInfo(frameBuffers.gBuffer.sampler,
+                                            storageImage.view,
+                                            VK_IMAGE_LAYOUT_GENERAL);
+  };
+
+  // Downsample
+  {
+    descriptorSetLayoutBindings = {
+        Initializer::DescriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            VK_SHADER_STAGE_COMPUTE_BIT, 0),
+        Initializer::DescriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            VK_SHADER_STAGE_COMPUTE_BIT, 1),
+        Initializer::DescriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 2),
+        Initializer::DescriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 3),
+    };
+    descriptorSetLayoutCreateInfo =
+        Initializer::DescriptorSetLayoutCreateInfo(descriptorSetLayoutBindings);
+    VK_CHECK_RESULT(
+        vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCreateInfo,
+                                    nullptr, &descriptorSetLayouts.downsample));
+
+    pipelineLayoutCreateInfo.pSetLayouts = &descriptorSetLayouts.downsample;
+    VK_CHECK_RESULT(vkCreatePipelineLayout(
+        device, &pipelineLayoutCreateInfo, nullptr,
+        &pipelineLayouts.downsample));
+
+    descriptorSetAllocateInfo.pSetLayouts = &descriptorSetLayouts.downsample;
+    VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocateInfo,
+                                             &descriptorSets.downsample));
+
+    imageDescriptors = {
+        Initializer::DescriptorImageInfo(
+            frameBuffers.gBuffer.sampler,
+            frameBuffers.gBuffer.attachments[0].view,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+        Initializer::DescriptorImageInfo(
+            frameBuffers.gBuffer.sampler,
+            frameBuffers.gBuffer.attachments[1].view,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+        storageImageInfo(computeImages.position),
+        storageImageInfo(computeImages.normal),
+    };
+    writeDescriptorSets = {
+        Initializer::WriteDescriptorSet(
+            descriptorSets.downsample,
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &imageDescriptors[0]),
+        Initializer::WriteDescriptorSet(
+            descriptorSets.downsample,
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &imageDescriptors[1]),
+        Initializer::WriteDescriptorSet(descriptorSets.downsample,
+                                        VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 2,
+                                        &imageDescriptors[2]),
+        Initializer::WriteDescriptorSet(descriptorSets.downsample,
+                                        VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 3,
+                                        &imageDescriptors[3]),
+    };
+    vkUpdateDescriptorSets(device,
+                           static_cast<uint32_t>(writeDescriptorSets.size()),
+                           writeDescriptorSets.data(), 0, nullptr);
+  }
+
+  // SSAO (Half resolution)
+  {
+    descriptorSetLayoutBindings = {
+        Initializer::DescriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            VK_SHADER_STAGE_COMPUTE_BIT, 0),
+        Initializer::DescriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            VK_SHADER_STAGE_COMPUTE_BIT, 1),
+        Initializer::DescriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            VK_SHADER_STAGE_COMPUTE_BIT, 2),
+        Initializer::DescriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+            VK_SHADER_STAGE_COMPUTE_BIT, 3),
+        Initializer::DescriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 4),
+    };
+    descriptorSetLayoutCreateInfo =
+        Initializer::DescriptorSetLayoutCreateInfo(descriptorSetLayoutBindings);
+    VK_CHECK_RESULT(
+        vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCreateInfo,
+                                    nullptr, &descriptorSetLayouts.ssaoHalf));
+
+    pipelineLayoutCreateInfo.pSetLayouts = &descriptorSetLayouts.ssaoHalf;
+    VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo,
+                                           nullptr, &pipelineLayouts.ssaoHalf));
+
+    descriptorSetAllocateInfo.pSetLayouts = &descriptorSetLayouts.ssaoHalf;
+    VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocateInfo,
+                                             &descriptorSets.ssaoHalf));
+
+    // 乱数テクスチャとユニフォームはフラグメントシェーダー版と共有します。
+    imageDescriptors = {
+        sampledImageInfo(computeImages.position),
+        sampledImageInfo(computeImages.normal),
+        storageImageInfo(computeImages.ao[0]),
+    };
+    writeDescriptorSets = {
+        Initializer::WriteDescriptorSet(
+            descriptorSets.ssaoHalf, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            0, &imageDescriptors[0]),
+        Initializer::WriteDescriptorSet(
+            descriptorSets.ssaoHalf, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            1, &imageDescriptors[1]),
+        Initializer::WriteDescriptorSet(
+            descriptorSets.ssaoHalf, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            2, &textures.noise.descriptor),
+        Initializer::WriteDescriptorSet(
+            descriptorSets.ssaoHalf, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+            3, &uniformBuffers.ssao.descriptor),
+        Initializer::WriteDescriptorSet(descriptorSets.ssaoHalf,
+                                        VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 4,
+                                        &imageDescriptors[2]),
+    };
+    vkUpdateDescriptorSets(device,
+                           static_cast<uint32_t>(writeDescriptorSets.size()),
+                           writeDescriptorSets.data(), 0, nullptr);
+  }
+
+  // Bilateral blur
+  {
+    descriptorSetLayoutBindings = {
+        Initializer::DescriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            VK_SHADER_STAGE_COMPUTE_BIT, 0),
+        Initializer::DescriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            VK_SHADER_STAGE_COMPUTE_BIT, 1),
+        Initializer::DescriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 2),
+    };
+    descriptorSetLayoutCreateInfo =
+        Initializer::DescriptorSetLayoutCreateInfo(descriptorSetLayoutBindings);
+    VK_CHECK_RESULT(vkCreateDescriptorSetLayout(
+        device, &descriptorSetLayoutCreateInfo, nullptr,
+        &descriptorSetLayouts.bilateralBlur));
+
+    pipelineLayoutCreateInfo.pSetLayouts = &descriptorSetLayouts.bilateralBlur;
+    VK_CHECK_RESULT(vkCreatePipelineLayout(
+        device, &pipelineLayoutCreateInfo, nullptr,
+        &pipelineLayouts.bilateralBlur));
+
+    // 横方向はao[0]からao[1]へ、縦方向はao[1]からao[0]へ書き込みます。
+    descriptorSetAllocateInfo.pSetLayouts = &descriptorSetLayouts.bilateralBlur;
+    VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocateInfo,
+                                             &descriptorSets.blurHorizontal));
+    VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocateInfo,
+                                             &descriptorSets.blurVertical));
+
+    imageDescriptors = {
+        sampledImageInfo(computeImages.ao[0]),
+        sampledImageInfo(computeImages.position),
+        storageImageInfo(computeImages.ao[1]),
+        sampledImageInfo(computeImages.ao[1]),
+        storageImageInfo(computeImages.ao[0]),
+    };
+    writeDescriptorSets = {
+        Initializer::WriteDescriptorSet(
+            descriptorSets.blurHorizontal,
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &imageDescriptors[0]),
+        Initializer::WriteDescriptorSet(
+            descriptorSets.blurHorizontal,
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &imageDescriptors[1]),
+        Initializer::WriteDescriptorSet(descriptorSets.blurHorizontal,
+                                        VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 2,
+                                        &imageDescriptors[2]),
+        Initializer::WriteDescriptorSet(
+            descriptorSets.blurVertical,
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &imageDescriptors[3]),
+        Initializer::WriteDescriptorSet(
+            descriptorSets.blurVertical,
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &imageDescriptors[1]),
+        Initializer::WriteDescriptorSet(descriptorSets.blurVertical,
+                                        VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 2,
+                                        &imageDescriptors[4]),
+    };
+    vkUpdateDescriptorSets(device,
+                           static_cast<uint32_t>(writeDescriptorSets.size()),
+                           writeDescriptorSets.data(), 0, nullptr);
+  }
+
+  // Upsample
+  {
+    descriptorSetLayoutBindings = {
+        Initializer::DescriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            VK_SHADER_STAGE_COMPUTE_BIT, 0),
+        Initializer::DescriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            VK_SHADER_STAGE_COMPUTE_BIT, 1),
+        Initializer::DescriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            VK_SHADER_STAGE_COMPUTE_BIT, 2),
+        Initializer::DescriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 3),
+    };
+    descriptorSetLayoutCreateInfo =
+        Initializer::DescriptorSetLayoutCreateInfo(descriptorSetLayoutBindings);
+    VK_CHECK_RESULT(
+        vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCreateInfo,
+                                    nullptr, &descriptorSetLayouts.upsample));
+
+    pipelineLayoutCreateInfo.pSetLayouts = &descriptorSetLayouts.upsample;
+    VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo,
+                                           nullptr, &pipelineLayouts.upsample));
+
+    descriptorSetAllocateInfo.pSetLayouts = &descriptorSetLayouts.upsample;
+    VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocateInfo,
+                                             &descriptorSets.upsample));
+
+    imageDescriptors = {
+        sampledImageInfo(computeImages.ao[0]),
+        sampledImageInfo(computeImages.position),
+        Initializer::DescriptorImageInfo(
+            frameBuffers.gBuffer.sampler,
+            frameBuffers.gBuffer.attachments[0].view,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+        storageImageInfo(computeImages.upsampled),
+    };
+    writeDescriptorSets = {
+        Initializer::WriteDescriptorSet(
+            descriptorSets.upsample, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            0, &imageDescriptors[0]),
+        Initializer::WriteDescriptorSet(
+            descriptorSets.upsample, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            1, &imageDescriptors[1]),
+        Initializer::WriteDescriptorSet(
+            descriptorSets.upsample, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            2, &imageDescriptors[2]),
+        Initializer::WriteDescriptorSet(descriptorSets.upsample,
+                                        VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 3,
+                                        &imageDescriptors[3]),
+    };
+    vkUpdateDescriptorSets(device,
+                           static_cast<uint32_t>(writeDescriptorSets.size()),
+                           writeDescriptorSets.data(), 0, nullptr);
+  }
+
+  // Lighting (Compute)
+  {
+    // レイアウトは共通で、AOのみ拡大したコンピュート版の結果を参照します。
+    // コンピュート版はブラーを必ず行うため、AOTexとAOBlurTexは同じイメージです。
+    descriptorSetAllocateInfo.pSetLayouts = &descriptorSetLayouts.lighting;
+    VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocateInfo,
+                                             &descriptorSets.lightingCompute));
+
+    imageDescriptors = {
+        Initializer::DescriptorImageInfo(
+            frameBuffers.gBuffer.sampler,
+            frameBuffers.gBuffer.attachments[0].view,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+        Initializer::DescriptorImageInfo(
+            frameBuffers.gBuffer.sampler,
+            frameBuffers.gBuffer.attachments[1].view,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+        Initializer::DescriptorImageInfo(
+            frameBuffers.gBuffer.sampler,
+            frameBuffers.gBuffer.attachments[2].view,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+        sampledImageInfo(computeImages.upsampled),
+    };
+    writeDescriptorSets = {
+        Initializer::WriteDescriptorSet(
+            descriptorSets.lightingCompute,
+            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 0,
+            &uniformBuffers.lighting.descriptor),
+        Initializer::WriteDescriptorSet(
+            descriptorSets.lightingCompute,
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &imageDescriptors[0]),
+        Initializer::WriteDescriptorSet(
+            descriptorSets.lightingCompute,
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &imageDescriptors[1]),
+        Initializer::WriteDescriptorSet(
+            descriptorSets.lightingCompute,
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3, &imageDescriptors[2]),
+        Initializer::WriteDescriptorSet(
+            descriptorSets.lightingCompute,
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4, &imageDescriptors[3]),
+        Initializer::WriteDescriptorSet(
+            descriptorSets.lightingCompute,
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 5, &imageDescriptors[3]),
+    };
+    vkUpdateDescriptorSets(device,
+                           static_cast<uint32_t>(writeDescriptorSets.size()),
+                           writeDescriptorSets.data(), 0, nullptr);
+  }
+
+  // Cluster culling
+  if (!models.teapot.clusters.empty()) {
+    // 出力とカメラはコマンドバッファごとの領域を動的オフセットで指定します。
+    descriptorSetLayoutBindings = {
+        Initializer::DescriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+        Initializer::DescriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+        Initializer::DescriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+            VK_SHADER_STAGE_COMPUTE_BIT, 2),
+        Initializer::DescriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+            VK_SHADER_STAGE_COMPUTE_BIT, 3),
+        Initializer::DescriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+            VK_SHADER_STAGE_COMPUTE_BIT, 4),
+    };
+    descriptorSetLayoutCreateInfo =
+        Initializer::DescriptorSetLayoutCreateInfo(descriptorSetLayoutBindings);
+    VK_CHECK_RESULT(vkCreateDescriptorSetLayout(
+        device, &descriptorSetLayoutCreateInfo, nullptr,
+        &descriptorSetLayouts.clusterCull));
+
+    std::vector<VkPushConstantRange> pushConstantRanges = {
+        Initializer::PushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT,
+                                       sizeof(ClusterCullPushConstants), 0),
+    };
+    pipelineLayoutCreateInfo.pSetLayouts = &descriptorSetLayouts.clusterCull;
+    pipelineLayoutCreateInfo.pushConstantRangeCount =
+        static_cast<uint32_t>(pushConstantRanges.size());
+    pipelineLayoutCreateInfo.pPushConstantRanges = pushConstantRanges.data();
+    VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo,
+                                           nullptr,
+                                           &pipelineLayouts.clusterCull));
+    pipelineLayoutCreateInfo.pushConstantRangeCount = 0;
+    pipelineLayoutCreateInfo.pPushConstantRanges = nullptr;
+
+    descriptorSetAllocateInfo.pSetLayouts = &descriptorSetLayouts.clusterCull;
+    VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptorSetAllocateInfo,
+                                             &descriptorSets.clusterCull));
+
+    writeDescriptorSets = {
+        Initializer::WriteDescriptorSet(
+            descriptorSets.clusterCull, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0,
+            &models.teapot.clusterBuffer.descriptor),
+        Initializer::WriteDescriptorSet(
+            descriptorSets.clusterCull, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1,
+            &models.teapot.indices.descriptor),
+        Initializer::WriteDescriptorSet(
+            descriptorSets.clusterCull,
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 2,
+            &clusterCulling.indices.descriptor),
+        Initializer::WriteDescriptorSet(
+            descriptorSets.clusterCull,
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 3,
+            &clusterCulling.commands.descriptor),
+        Initializer::WriteDescriptorSet(
+            descriptorSets.clusterCull,
+            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 4,
+            &uniformBuffers.cull.descriptor),
+    };
+    vkUpdateDescriptorSets(device,
+                           static_cast<uint32_t>(writeDescriptorSets.size()),
+                           writeDescriptorSets.data(), 0, nullptr);
+  }
 }
 
 /**
@@ -515,20 +1008,9 @@ void SSAO::SetupPipelines() {
         Initializer::VertexInputBindingDescription(0, vertexLayout.Stride(),
                                                    VK_VERTEX_INPUT_RATE_VERTEX),
     };
-    std::vector<VkVertexInputAttributeDescription> vertexInputAttributes = {
-        // location = 0 : position
-        Initializer::VertexInputAttributeDescription(
-            0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0),
-        // location = 1 : normal
-        Initializer::VertexInputAttributeDescription(
-            0, 1, VK_FORMAT_R32G32B32_SFLOAT, 3 * sizeof(float)),
-        // location = 2 : color
-        Initializer::VertexInputAttributeDescription(
-            0, 2, VK_FORMAT_R32G32B32_SFLOAT, 6 * sizeof(float)),
-        // location = 3 : uv
-        Initializer::VertexInputAttributeDescription(
-            0, 3, VK_FORMAT_R32G32_SFLOAT, 9 * sizeof(float)),
-    };
+    // location = 0 : position, 1 : normal, 2 : color, 3 : uv
+    std::vector<VkVertexInputAttributeDescription> vertexInputAttributes =
+        vertexLayout.Attributes(0);
     VkPipelineVertexInputStateCreateInfo vertexInputState =
         Initializer::PipelineVertexInputStateCreateInfo(vertexInputBindings,
                                                         vertexInputAttributes);
@@ -544,6 +1026,7 @@ void SSAO::SetupPipelines() {
     // レンダーパスは別にします。
     pipelineCreateInfo.renderPass = frameBuffers.gBuffer.renderPass;
     pipelineCreateInfo.layout = pipelineLayouts.gBuffer;
+    rasterizationState.cullMode = kGBufferCullMode;
 
     // カラーアタッチメントに何も描画しないようにします。
     std::array<VkPipelineColorBlendAttachmentState, 3>
@@ -564,6 +1047,129 @@ void SSAO::SetupPipelines() {
   }
 }
 
+/**
+ * @brief コンピュート版SSAOとクラスターカリングのパイプラインを生成します。
+ */
+void SSAO::SetupComputePipelines() {
+  const auto &pipelinesConfig = config["Pipelines"];
+  VkComputePipelineCreateInfo computePipelineCreateInfo{};
+
+  // Downsample pipeline
+  {
+    computePipelineCreateInfo =
+        Initializer::ComputePipelineCreateInfo(pipelineLayouts.downsample);
+    computePipelineCreateInfo.stage = CreateShader(
+        device,
+        pipelinesConfig["Downsample"]["ComputeShader"].get<std::string>(),
+        VK_SHADER_STAGE_COMPUTE_BIT);
+    VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1,
+                                             &computePipelineCreateInfo,
+                                             nullptr, &pipelines.downsample));
+    vkDestroyShaderModule(device, computePipelineCreateInfo.stage.module,
+                          nullptr);
+  }
+
+  // SSAO (Half resolution) pipeline
+  {
+    struct SpecializationData {
+      uint32_t kernelSize = KERNEL_SIZE;
+    } specializationData;
+    std::vector<VkSpecializationMapEntry> specializationMapEntries{
+        Initializer::SpecializationMapEntry(
+            0, offsetof(SpecializationData, kernelSize),
+            sizeof(SpecializationData::kernelSize)),
+    };
+    VkSpecializationInfo specializationInfo = Initializer::SpecializationInfo(
+        specializationMapEntries, sizeof(specializationData),
+        &specializationData);
+    computePipelineCreateInfo =
+        Initializer::ComputePipelineCreateInfo(pipelineLayouts.ssaoHalf);
+    computePipelineCreateInfo.stage = CreateShader(
+        device, pipelinesConfig["SSAOHalf"]["ComputeShader"].get<std::string>(),
+        VK_SHADER_STAGE_COMPUTE_BIT, &specializationInfo);
+    VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1,
+                                             &computePipelineCreateInfo,
+                                             nullptr, &pipelines.ssaoHalf));
+    vkDestroyShaderModule(device, computePipelineCreateInfo.stage.module,
+                          nullptr);
+  }
+
+  // Bilateral blur pipelines
+  {
+    // ブラーの軸を特殊化定数で切り替え、横方向と縦方向の2つのパイプラインを生成します。
+    struct SpecializationData {
+      int32_t axis = 0;
+    } specializationData;
+    std::vector<VkSpecializationMapEntry> specializationMapEntries{
+        Initializer::SpecializationMapEntry(
+            0, offsetof(SpecializationData, axis),
+            sizeof(SpecializationData::axis)),
+    };
+    VkSpecializationInfo specializationInfo = Initializer::SpecializationInfo(
+        specializationMapEntries, sizeof(specializationData),
+        &specializationData);
+    computePipelineCreateInfo =
+        Initializer::ComputePipelineCreateInfo(pipelineLayouts.bilateralBlur);
+    computePipelineCreateInfo.stage = CreateShader(
+        device,
+        pipelinesConfig["BilateralBlur"]["ComputeShader"].get<std::string>(),
+        VK_SHADER_STAGE_COMPUTE_BIT, &specializationInfo);
+
+    specializationData.axis = 0;
+    VK_CHECK_RESULT(vkCreateComputePipelines(
+        device, pipelineCache, 1, &computePipelineCreateInfo, nullptr,
+        &pipelines.blurHorizontal));
+    specializationData.axis = 1;
+    VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1,
+                                             &computePipelineCreateInfo,
+                                             nullptr, &pipelines.blurVertical));
+    vkDestroyShaderModule(device, computePipelineCreateInfo.stage.module,
+                          nullptr);
+  }
+
+  // Upsample pipeline
+  {
+    computePipelineCreateInfo =
+        Initializer::ComputePipelineCreateInfo(pipelineLayouts.upsample);
+    computePipelineCreateInfo.stage = CreateShader(
+        device, pipelinesConfig["Upsample"]["ComputeShader"].get<std::string>(),
+        VK_SHADER_STAGE_COMPUTE_BIT);
+    VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1,
+                                             &computePipelineCreateInfo,
+                                             nullptr, &pipelines.upsample));
+    vkDestroyShaderModule(device, computePipelineCreateInfo.stage.module,
+                          nullptr);
+  }
+
+  // Cluster culling pipeline
+  if (!models.teapot.clusters.empty()) {
+    // 裏を向いたクラスターの棄却は、G-Bufferで裏面を描画しない場合のみ行います。
+    struct SpecializationData {
+      int32_t backfaceCulling =
+          (kGBufferCullMode & VK_CULL_MODE_BACK_BIT) != 0 ? 1 : 0;
+    } specializationData;
+    std::vector<VkSpecializationMapEntry> specializationMapEntries{
+        Initializer::SpecializationMapEntry(
+            0, offsetof(SpecializationData, backfaceCulling),
+            sizeof(SpecializationData::backfaceCulling)),
+    };
+    VkSpecializationInfo specializationInfo = Initializer::SpecializationInfo(
+        specializationMapEntries, sizeof(specializationData),
+        &specializationData);
+    computePipelineCreateInfo =
+        Initializer::ComputePipelineCreateInfo(pipelineLayouts.clusterCull);
+    computePipelineCreateInfo.stage = CreateShader(
+        device,
+        pipelinesConfig["ClusterCull"]["ComputeShader"].get<std::string>(),
+        VK_SHADER_STAGE_COMPUTE_BIT, &specializationInfo);
+    VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, 1,
+                                             &computePipelineCreateInfo,
+                                             nullptr, &pipelines.clusterCull));
+    vkDestroyShaderModule(device, computePipelineCreateInfo.stage.module,
+                          nullptr);
+  }
+}
+
 //*-----------------------------------------------------------------------------
 // Prepare
 //*-----------------------------------------------------------------------------
@@ -634,6 +1240,132 @@ void SSAO::PrepareOffscreenFramebuffer() {
   }
 }
 
+/**
+ * @brief コンピュート版SSAOが読み書きするストレージイメージを用意します。
+ * @note
+ * AOは半分の解像度で計算するため、縦横それぞれ切り上げて半分の大きさにします。
+ */
+void SSAO::PrepareComputeImages() {
+  const uint32_t width = swapchain.extent.width;
+  const uint32_t height = swapchain.extent.height;
+  const uint32_t halfWidth = (width + 1) / 2;
+  const uint32_t halfHeight = (height + 1) / 2;
+
+  // R16G16B16A16_SFLOATとR32_SFLOATは拡張フォーマット無しでストレージイメージに使用できます。
+  CreateStorageImage(computeImages.position, VK_FORMAT_R32G32B32A32_SFLOAT,
+                     halfWidth, halfHeight);
+  CreateStorageImage(computeImages.normal, VK_FORMAT_R16G16B16A16_SFLOAT,
+                     halfWidth, halfHeight);
+  CreateStorageImage(computeImages.ao[0], VK_FORMAT_R32_SFLOAT, halfWidth,
+                     halfHeight);
+  CreateStorageImage(computeImages.ao[1], VK_FORMAT_R32_SFLOAT, halfWidth,
+                     halfHeight);
+  CreateStorageImage(computeImages.upsampled, VK_FORMAT_R32_SFLOAT, width,
+                     height);
+}
+
+/**
+ * @brief GPUで選別したクラスターのインデックスと間接描画の引数を書き込むバッファを用意します。
+ * @note 記録済みのコマンドバッファごとに、ストレージバッファのオフセットの制約に揃えた領域を割り当てます。
+ */
+void SSAO::PrepareClusterCulling() {
+  const Model &teapot = models.teapot;
+  clusterCulling.enabled = !teapot.clusters.empty();
+  if (!clusterCulling.enabled) {
+    return;
+  }
+
+  const VkDeviceSize alignment = std::max<VkDeviceSize>(
+      device.properties.limits.minStorageBufferOffsetAlignment, 4);
+  const auto align = [&](VkDeviceSize size) {
+    return (size + alignment - 1) / alignment * alignment;
+  };
+  const uint32_t partitionCount = uniformRing.GetPartitionCount();
+  clusterCulling.indicesStride =
+      align(VkDeviceSize{teapot.indexCount} * sizeof(uint32_t));
+  clusterCulling.commandsStride = align(sizeof(VkDrawIndexedIndirectCommand));
+
+  VK_CHECK_RESULT(clusterCulling.indices.Create(
+      device,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      clusterCulling.indicesStride * partitionCount));
+  clusterCulling.indices.SetupDescriptor(clusterCulling.indicesStride);
+  VK_CHECK_RESULT(clusterCulling.commands.Create(
+      device,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+          VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+          VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      clusterCulling.commandsStride * partitionCount));
+  clusterCulling.commands.SetupDescriptor(
+      sizeof(VkDrawIndexedIndirectCommand));
+}
+
+/**
+ * @brief G-Bufferパスのオブジェクトをモデルごとのインスタンスにまとめ、転送します。
+ * @note
+ * クラスター単位で選別するモデルは、インスタンスの選別から外します。
+ * (クラスターカリングを切り替えた場合はUpdateInstanceFlagsで変更します。)
+ */
+void SSAO::PrepareInstances() {
+  for (const auto &draw : GetGBufferDraws()) {
+    const uint32_t flags =
+        draw.clusterCulled ? InstanceBatches::kNoCull : 0u;
+    static_cast<void>(
+        instanceBatches.Add(*draw.model, draw.matrix, draw.tex, flags));
+  }
+  instanceBatches.Prepare(
+      device, uploader, uniformRing, pipelineCache,
+      config["Pipelines"]["InstanceCull"]["ComputeShader"].get<std::string>());
+  gBufferQueue.SetMaxDrawIndirectCount(
+      InstanceBatches::MaxDrawIndirectCount(device));
+}
+
+/**
+ * @brief クラスターカリングの設定に合わせて、クラスターを持つモデルをインスタンスの選別から外す、または戻します。
+ * @note 処理中のフレームの完了を待ってから呼び出します。転送は次のフレームの描画の前に送信されます。
+ */
+void SSAO::UpdateInstanceFlags() {
+  for (const auto &draw : GetGBufferDraws()) {
+    if (draw.model->clusters.empty()) {
+      continue;
+    }
+    instanceBatches.SetFlag(device, uploader,
+                            instanceBatches.BatchOf(*draw.model),
+                            InstanceBatches::kNoCull, draw.clusterCulled);
+  }
+}
+
+void SSAO::CreateStorageImage(StorageImage &storageImage, VkFormat format,
+                              uint32_t width, uint32_t height) {
+  storageImage.width = width;
+  storageImage.height = height;
+  VK_CHECK_RESULT(CreateImage(
+      device, storageImage.image, storageImage.allocation, format,
+      VK_IMAGE_TYPE_2D, width, height, 1, 1, 1,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+      VK_IMAGE_TILING_OPTIMAL));
+  VK_CHECK_RESULT(CreateImageView(device, storageImage.view,
+                                  storageImage.image, VK_IMAGE_VIEW_TYPE_2D,
+                                  format, VK_IMAGE_ASPECT_COLOR_BIT));
+
+  // 以降はレイアウトを変更しないため、アセットの転送と一緒にGENERALへ遷移します。
+  VkImageSubresourceRange subresourceRange{};
+  subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  subresourceRange.levelCount = 1;
+  subresourceRange.layerCount = 1;
+  uploader.TransitionImage(device, storageImage.image, subresourceRange,
+                           VK_IMAGE_LAYOUT_GENERAL);
+}
+
+void SSAO::DestroyStorageImage(const StorageImage &storageImage) const {
+  vkDestroyImageView(device, storageImage.view, nullptr);
+  vkDestroyImage(device, storageImage.image, nullptr);
+  device.allocator->Free(device, storageImage.allocation);
+}
+
 /**
  * @brief
  * シェーダーユニフォームを含むユニフォームバッファブロックを準備して初期化します。
@@ -641,26 +1373,10 @@ void SSAO::PrepareOffscreenFramebuffer() {
  * OpenGLのような単一のユニフォームはVulkanに存在しなくなりました。すべてのシェーダーユニフォームはユニフォームバッファブロックを介して渡されます。
  */
 void SSAO::PrepareUniformBuffers() {
-  VK_CHECK_RESULT(
-      uniformBuffers.gBuffer.Create(device, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                                        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                                    sizeof(uboGBuffer), &uboGBuffer));
-  VK_CHECK_RESULT(uniformBuffers.gBuffer.Map(device));
-
-  VK_CHECK_RESULT(
-      uniformBuffers.ssao.Create(device, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                                     VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                                 sizeof(uboSSAO), &uboSSAO));
-  VK_CHECK_RESULT(uniformBuffers.ssao.Map(device));
-
-  VK_CHECK_RESULT(
-      uniformBuffers.lighting.Create(device, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                                         VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                                     sizeof(uboLighting), &uboLighting));
-  VK_CHECK_RESULT(uniformBuffers.lighting.Map(device));
+  uniformBuffers.gBuffer = uniformRing.Allocate(sizeof(uboGBuffer));
+  uniformBuffers.ssao = uniformRing.Allocate(sizeof(uboSSAO));
+  uniformBuffers.lighting = uniformRing.Allocate(sizeof(uboLighting));
+  uniformBuffers.cull = uniformRing.Allocate(sizeof(uboCull));
 
   std::random_device rd;
   std::mt19937 engine(rd());
@@ -693,7 +1409,9 @@ void SSAO::PrepareUniformBuffers() {
     textures.noise.FromBuffer(device, randDir.data(),
                               randDir.size() * sizeof(glm::vec4),
                               VK_FORMAT_R32G32B32A32_SFLOAT, ROT_TEX_SIZE,
-                              ROT_TEX_SIZE, queue, VK_FILTER_NEAREST);
+                              ROT_TEX_SIZE, uploader, VK_FILTER_NEAREST,
+                              VK_IMAGE_USAGE_SAMPLED_BIT,
+                              VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false);
   }
 
   // Lighting
@@ -717,259 +1435,529 @@ void SSAO::PrepareUniformBuffers() {
  * これにより、Vulkanの最大の利点の１つである、複数のスレッドから事前に作業を生成できます。
  */
 void SSAO::BuildCommandBuffers() {
+  // リサイズなどで作り直したハンドルに番号を振り直します。
+  gBufferQueue.Reset();
+  // 描画リストはメインスレッドで作成し、ワーカースレッドからは読み込みのみ行います。
+  const auto draws = GetGBufferDraws();
+  BuildGBufferQueue();
+
+  for (uint32_t i = 0; i < drawCmdBuffers.size(); i++) {
+    RecordCommandBuffer(i, draws);
+  }
+}
+
+/**
+ * @brief スワップチェーンイメージのコマンドバッファを記録します。
+ * @param image スワップチェーンイメージのインデックス
+ * @param draws G-Bufferパスで描画するオブジェクト
+ */
+void SSAO::RecordCommandBuffer(uint32_t image,
+                               const std::vector<GBufferDraw> &draws) {
+  VkCommandBuffer commandBuffer = drawCmdBuffers[image];
   VkCommandBufferBeginInfo commandBufferBeginInfo =
       Initializer::CommandBufferBeginInfo();
+  VK_CHECK_RESULT(
+      vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo));
+  const uint32_t pool = image;
+  const uint32_t partition = uniformRing.GetPartition(pool);
+  profiler.Reset(commandBuffer, pool);
 
-  for (size_t i = 0; i < drawCmdBuffers.size(); i++) {
+  VkRenderPassBeginInfo renderPassBeginInfo =
+      Initializer::RenderPassBeginInfo();
 
-    VK_CHECK_RESULT(
-        vkBeginCommandBuffer(drawCmdBuffers[i], &commandBufferBeginInfo));
-
-    VkRenderPassBeginInfo renderPassBeginInfo =
-        Initializer::RenderPassBeginInfo();
-
-    // Fill G-Buffer
-    {
-      // フラグメントシェーダーで使用するすべてのアタッチメントをこの値でクリアします。
-      std::array<VkClearValue, 4> clearValues{};
-      clearValues[0].color = {{0.0f, 0.0f, 0.0f, 0.0f}};
-      clearValues[1].color = {{0.0f, 0.0f, 0.0f, 0.0f}};
-      clearValues[2].color = {{0.0f, 0.0f, 0.0f, 0.0f}};
-      clearValues[3].depthStencil = {1.0f, 0};
-
-      renderPassBeginInfo.renderPass = frameBuffers.gBuffer.renderPass;
-      renderPassBeginInfo.framebuffer = frameBuffers.gBuffer.framebuffer;
-      renderPassBeginInfo.renderArea.extent.width = frameBuffers.gBuffer.width;
-      renderPassBeginInfo.renderArea.extent.height =
-          frameBuffers.gBuffer.height;
-      renderPassBeginInfo.clearValueCount =
-          static_cast<uint32_t>(clearValues.size());
-      renderPassBeginInfo.pClearValues = clearValues.data();
-
-      vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo,
-                           VK_SUBPASS_CONTENTS_INLINE);
-
-      VkViewport viewport = Initializer::Viewport(
-          static_cast<float>(frameBuffers.gBuffer.width),
-          static_cast<float>(frameBuffers.gBuffer.height), 0.0f, 1.0f);
-      vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
-      VkRect2D scissor = Initializer::Rect2D(frameBuffers.gBuffer.width,
-                                             frameBuffers.gBuffer.height, 0, 0);
-      vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
-
-      vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
-                        pipelines.gBuffer);
-      vkCmdBindDescriptorSets(
-          drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
-          pipelineLayouts.gBuffer, 0, 1, &descriptorSets.gBuffer, 0, nullptr);
-      VkDeviceSize offsets[] = {0};
-
-      // Teapot
-      {
-        vkCmdBindVertexBuffers(drawCmdBuffers[i], 0, 1,
-                               &models.teapot.vertices.buffer, offsets);
-        vkCmdBindIndexBuffer(drawCmdBuffers[i], models.teapot.indices.buffer, 0,
-                             VK_INDEX_TYPE_UINT32);
-        const auto &teapot = config["Teapot"];
-        const auto scale = glm::vec3(teapot["Scale"].get<float>());
-        const auto trans = glm::vec3(teapot["Position"][0].get<float>(),
-                                     teapot["Position"][1].get<float>(),
-                                     teapot["Position"][2].get<float>());
-        auto model = glm::translate(glm::mat4(1.0f), trans);
-        model = glm::rotate(model, glm::radians(30.0f),
-                            glm::vec3(0.0f, 1.0f, 0.0f));
-        model = glm::scale(model, scale);
-        pushConsts.model = model;
-        pushConsts.tex = 0;
-        vkCmdPushConstants(drawCmdBuffers[i], pipelineLayouts.gBuffer,
-                           VK_SHADER_STAGE_VERTEX_BIT |
-                               VK_SHADER_STAGE_FRAGMENT_BIT,
-                           0, sizeof(pushConsts), &pushConsts);
-        vkCmdDrawIndexed(drawCmdBuffers[i], models.teapot.indexCount, 1, 0, 0,
-                         0);
-      }
-
-      // Floor
-      {
-        vkCmdBindVertexBuffers(drawCmdBuffers[i], 0, 1,
-                               &models.floor.vertices.buffer, offsets);
-        vkCmdBindIndexBuffer(drawCmdBuffers[i], models.floor.indices.buffer, 0,
-                             VK_INDEX_TYPE_UINT32);
-        const auto scale = glm::vec3(4.0f);
-        const auto trans = glm::vec3(0.0f, 0.0f, 0.0f);
-        auto model = glm::translate(glm::mat4(1.0f), trans);
-        model = glm::scale(model, scale);
-        pushConsts.model = model;
-        pushConsts.tex = 1;
-        vkCmdPushConstants(drawCmdBuffers[i], pipelineLayouts.gBuffer,
-                           VK_SHADER_STAGE_VERTEX_BIT |
-                               VK_SHADER_STAGE_FRAGMENT_BIT,
-                           0, sizeof(pushConsts), &pushConsts);
-        vkCmdDrawIndexed(drawCmdBuffers[i], models.floor.indexCount, 1, 0, 0,
-                         0);
-      }
-
-      // Wall1
-      {
-        vkCmdBindVertexBuffers(drawCmdBuffers[i], 0, 1,
-                               &models.floor.vertices.buffer, offsets);
-        vkCmdBindIndexBuffer(drawCmdBuffers[i], models.floor.indices.buffer, 0,
-                             VK_INDEX_TYPE_UINT32);
-        const auto scale = glm::vec3(4.0f);
-        const auto trans = glm::vec3(0.0f, 0.0f, -2.0f);
-        auto model = glm::translate(glm::mat4(1.0f), trans);
-        model = glm::rotate(model, glm::radians(90.0f),
-                            glm::vec3(1.0f, 0.0f, 0.0f));
-        model = glm::scale(model, scale);
-        pushConsts.model = model;
-        pushConsts.tex = 2;
-        vkCmdPushConstants(drawCmdBuffers[i], pipelineLayouts.gBuffer,
-                           VK_SHADER_STAGE_VERTEX_BIT |
-                               VK_SHADER_STAGE_FRAGMENT_BIT,
-                           0, sizeof(pushConsts), &pushConsts);
-        vkCmdDrawIndexed(drawCmdBuffers[i], models.floor.indexCount, 1, 0, 0,
-                         0);
-      }
-
-      // Wall2
-      {
-        vkCmdBindVertexBuffers(drawCmdBuffers[i], 0, 1,
-                               &models.floor.vertices.buffer, offsets);
-        vkCmdBindIndexBuffer(drawCmdBuffers[i], models.floor.indices.buffer, 0,
-                             VK_INDEX_TYPE_UINT32);
-        const auto scale = glm::vec3(4.0f);
-        const auto trans = glm::vec3(-2.0f, 0.0f, 0.0f);
-        auto model = glm::translate(glm::mat4(1.0f), trans);
-        model = glm::rotate(model, glm::radians(90.0f),
-                            glm::vec3(0.0f, 1.0f, 0.0f));
-        model =
-            glm::rotate(model, glm::radians(90.0f), glm::vec3(1.0f, 0.0, 0.0f));
-        model = glm::scale(model, scale);
-        pushConsts.model = model;
-        pushConsts.tex = 2;
-        vkCmdPushConstants(drawCmdBuffers[i], pipelineLayouts.gBuffer,
-                           VK_SHADER_STAGE_VERTEX_BIT |
-                               VK_SHADER_STAGE_FRAGMENT_BIT,
-                           0, sizeof(pushConsts), &pushConsts);
-        vkCmdDrawIndexed(drawCmdBuffers[i], models.floor.indexCount, 1, 0, 0,
-                         0);
-      }
-
-      vkCmdEndRenderPass(drawCmdBuffers[i]);
-    }
+  // Cluster culling
+  if (clusterCulling.enabled) {
+    RecordClusterCulling(commandBuffer, pool, draws);
+  }
 
-    // SSAO
-    {
-      std::vector<VkClearValue> clearValues(2);
-      clearValues[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
-      clearValues[1].depthStencil = {1.0f, 0};
-
-      renderPassBeginInfo.renderPass = frameBuffers.ssao.renderPass;
-      renderPassBeginInfo.framebuffer = frameBuffers.ssao.framebuffer;
-      renderPassBeginInfo.renderArea.extent.width = frameBuffers.ssao.width;
-      renderPassBeginInfo.renderArea.extent.height = frameBuffers.ssao.height;
-      renderPassBeginInfo.clearValueCount =
-          static_cast<uint32_t>(clearValues.size());
-      renderPassBeginInfo.pClearValues = clearValues.data();
-
-      vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo,
-                           VK_SUBPASS_CONTENTS_INLINE);
-
-      VkViewport viewport = Initializer::Viewport(
-          static_cast<float>(frameBuffers.ssao.width),
-          static_cast<float>(frameBuffers.ssao.height), 0.0f, 1.0f);
-      vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
-      VkRect2D scissor = Initializer::Rect2D(frameBuffers.ssao.width,
-                                             frameBuffers.ssao.height, 0, 0);
-      vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
-
-      vkCmdBindDescriptorSets(
-          drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
-          pipelineLayouts.ssao, 0, 1, &descriptorSets.ssao, 0, nullptr);
-      vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
-                        pipelines.ssao);
-      vkCmdDraw(drawCmdBuffers[i], 3, 1, 0, 0);
-
-      vkCmdEndRenderPass(drawCmdBuffers[i]);
-    }
+  // Instance culling
+  {
+    ProfileScope scope(profiler, commandBuffer, pool, "Instance Culling");
+    instanceBatches.RecordCulling(commandBuffer, partition, uniformRing);
+  }
 
-    // Blur
-    {
-      std::vector<VkClearValue> clearValues(2);
-      clearValues[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
-      clearValues[1].depthStencil = {1.0f, 0};
-
-      renderPassBeginInfo.renderPass = frameBuffers.blur.renderPass;
-      renderPassBeginInfo.framebuffer = frameBuffers.blur.framebuffer;
-      renderPassBeginInfo.renderArea.extent.width = frameBuffers.blur.width;
-      renderPassBeginInfo.renderArea.extent.height = frameBuffers.blur.height;
-      renderPassBeginInfo.clearValueCount =
-          static_cast<uint32_t>(clearValues.size());
-      renderPassBeginInfo.pClearValues = clearValues.data();
-
-      vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo,
-                           VK_SUBPASS_CONTENTS_INLINE);
-
-      VkViewport viewport = Initializer::Viewport(
-          static_cast<float>(frameBuffers.blur.width),
-          static_cast<float>(frameBuffers.blur.height), 0.0f, 1.0f);
-      vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
-      VkRect2D scissor = Initializer::Rect2D(frameBuffers.blur.width,
-                                             frameBuffers.blur.height, 0, 0);
-      vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
-
-      vkCmdBindDescriptorSets(
-          drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
-          pipelineLayouts.blur, 0, 1, &descriptorSets.blur, 0, nullptr);
-      vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
-                        pipelines.blur);
-      vkCmdDraw(drawCmdBuffers[i], 3, 1, 0, 0);
-
-      vkCmdEndRenderPass(drawCmdBuffers[i]);
+  // Fill G-Buffer
+  {
+    ProfileScope scope(profiler, commandBuffer, pool, "G-Buffer");
+    // フラグメントシェーダーで使用するすべてのアタッチメントをこの値でクリアします。
+    std::array<VkClearValue, 4> clearValues{};
+    clearValues[0].color = {{0.0f, 0.0f, 0.0f, 0.0f}};
+    clearValues[1].color = {{0.0f, 0.0f, 0.0f, 0.0f}};
+    clearValues[2].color = {{0.0f, 0.0f, 0.0f, 0.0f}};
+    clearValues[3].depthStencil = {1.0f, 0};
+
+    renderPassBeginInfo.renderPass = frameBuffers.gBuffer.renderPass;
+    renderPassBeginInfo.framebuffer = frameBuffers.gBuffer.framebuffer;
+    renderPassBeginInfo.renderArea.extent.width = frameBuffers.gBuffer.width;
+    renderPassBeginInfo.renderArea.extent.height = frameBuffers.gBuffer.height;
+    renderPassBeginInfo.clearValueCount =
+        static_cast<uint32_t>(clearValues.size());
+    renderPassBeginInfo.pClearValues = clearValues.data();
+
+    // 描画はセカンダリコマンドバッファに並列に記録し、ここでは実行のみ行います。
+    vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo,
+                         VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+    const auto inheritanceInfo = Initializer::CommandBufferInheritanceInfo(
+        frameBuffers.gBuffer.renderPass, 0, frameBuffers.gBuffer.framebuffer);
+    gBufferQueue.ResetStats();
+    const auto secondaries = recorder.Record(
+        device, pool, inheritanceInfo, gBufferQueue.Size(),
+        [&](VkCommandBuffer secondary, uint32_t first, uint32_t count) {
+          RecordGBufferDraws(secondary, partition, first, count);
+        });
+    gBufferStats = gBufferQueue.GetStats();
+    if (!secondaries.empty()) {
+      vkCmdExecuteCommands(commandBuffer,
+                           static_cast<uint32_t>(secondaries.size()),
+                           secondaries.data());
     }
 
-    // Lighting
-    {
-      std::array<VkClearValue, 2> clear{};
-      clear[0].color = {{0.1f, 0.1f, 0.1f, 1.0f}};
-      clear[1].depthStencil = {1.0f, 0};
-
-      renderPassBeginInfo.framebuffer = framebuffers[i];
-      renderPassBeginInfo.renderPass = renderPass;
-      renderPassBeginInfo.renderArea.extent.width = swapchain.extent.width;
-      renderPassBeginInfo.renderArea.extent.height = swapchain.extent.height;
-
-      // デフォルトのレンダーパス設定で指定された最初のサブパスを開始します。
-      // これにより、色と奥行きのアタッチメントがクリアされます。
-      vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo,
-                           VK_SUBPASS_CONTENTS_INLINE);
-
-      // ビューポートとシザーの更新
-      VkViewport viewport = Initializer::Viewport(
-          static_cast<float>(swapchain.extent.width),
-          static_cast<float>(swapchain.extent.height), 0.0f, 1.0f);
-      vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
-      VkRect2D scissor = Initializer::Rect2D(swapchain.extent.width,
-                                             swapchain.extent.height, 0, 0);
-      vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
-
-      // 記述子セットとパイプラインのバインド
-      vkCmdBindDescriptorSets(
-          drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
-          pipelineLayouts.lighting, 0, 1, &descriptorSets.lighting, 0, nullptr);
-      vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
-                        pipelines.lighting);
-
-      vkCmdDraw(drawCmdBuffers[i], 3, 1, 0, 0);
-
-      DrawUI(drawCmdBuffers[i]);
-
-      vkCmdEndRenderPass(drawCmdBuffers[i]);
-    }
+    vkCmdEndRenderPass(commandBuffer);
+  }
+
+  // SSAO
+  if (aoMode == AOMode::Compute) {
+    RecordComputeSSAO(commandBuffer, pool);
+  } else {
+    RecordFragmentSSAO(commandBuffer, pool);
+  }
+
+  // Lighting
+  {
+    ProfileScope scope(profiler, commandBuffer, pool, "Lighting");
+    std::array<VkClearValue, 2> clear{};
+    clear[0].color = {{0.1f, 0.1f, 0.1f, 1.0f}};
+    clear[1].depthStencil = {1.0f, 0};
+
+    renderPassBeginInfo.framebuffer = framebuffers[image];
+    renderPassBeginInfo.renderPass = renderPass;
+    renderPassBeginInfo.renderArea.extent.width = swapchain.extent.width;
+    renderPassBeginInfo.renderArea.extent.height = swapchain.extent.height;
+    renderPassBeginInfo.clearValueCount = static_cast<uint32_t>(clear.size());
+    renderPassBeginInfo.pClearValues = clear.data();
+
+    // デフォルトのレンダーパス設定で指定された最初のサブパスを開始します。
+    // これにより、色と奥行きのアタッチメントがクリアされます。
+    vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo,
+                         VK_SUBPASS_CONTENTS_INLINE);
+
+    // ビューポートとシザーの更新
+    VkViewport viewport = Initializer::Viewport(
+        static_cast<float>(swapchain.extent.width),
+        static_cast<float>(swapchain.extent.height), 0.0f, 1.0f);
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    VkRect2D scissor = Initializer::Rect2D(swapchain.extent.width,
+                                           swapchain.extent.height, 0, 0);
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+    // 記述子セットとパイプラインのバインド
+    const uint32_t dynamicOffset =
+        uniformRing.GetDynamicOffset(uniformBuffers.lighting, partition);
+    // コンピュート版は拡大したAOを参照する記述子セットを使用します。
+    const VkDescriptorSet lightingSet = aoMode == AOMode::Compute
+                                            ? descriptorSets.lightingCompute
+                                            : descriptorSets.lighting;
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                            pipelineLayouts.lighting, 0, 1, &lightingSet, 1,
+                            &dynamicOffset);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                      pipelines.lighting);
+
+    vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+
+    vkCmdEndRenderPass(commandBuffer);
+  }
+
+  // レンダーパスを終了すると、フレームバッファのカラーアタッチメントに移行する暗黙のバリアが追加されます。
+  VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+}
+
+/**
+ * @brief フル解像度のフラグメントシェーダーでAOを計算し、ぼかします。
+ */
+void SSAO::RecordFragmentSSAO(VkCommandBuffer commandBuffer, uint32_t pool) {
+  VkRenderPassBeginInfo renderPassBeginInfo =
+      Initializer::RenderPassBeginInfo();
+
+  // SSAO
+  {
+    ProfileScope scope(profiler, commandBuffer, pool, "SSAO");
+    std::vector<VkClearValue> clearValues(2);
+    clearValues[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+    clearValues[1].depthStencil = {1.0f, 0};
+
+    renderPassBeginInfo.renderPass = frameBuffers.ssao.renderPass;
+    renderPassBeginInfo.framebuffer = frameBuffers.ssao.framebuffer;
+    renderPassBeginInfo.renderArea.extent.width = frameBuffers.ssao.width;
+    renderPassBeginInfo.renderArea.extent.height = frameBuffers.ssao.height;
+    renderPassBeginInfo.clearValueCount =
+        static_cast<uint32_t>(clearValues.size());
+    renderPassBeginInfo.pClearValues = clearValues.data();
+
+    vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo,
+                         VK_SUBPASS_CONTENTS_INLINE);
+
+    VkViewport viewport = Initializer::Viewport(
+        static_cast<float>(frameBuffers.ssao.width),
+        static_cast<float>(frameBuffers.ssao.height), 0.0f, 1.0f);
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    VkRect2D scissor = Initializer::Rect2D(frameBuffers.ssao.width,
+                                           frameBuffers.ssao.height, 0, 0);
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+    const uint32_t dynamicOffset =
+        uniformRing.GetDynamicOffset(uniformBuffers.ssao,
+                                     uniformRing.GetPartition(pool));
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                            pipelineLayouts.ssao, 0, 1, &descriptorSets.ssao,
+                            1, &dynamicOffset);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                      pipelines.ssao);
+    vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+
+    vkCmdEndRenderPass(commandBuffer);
+  }
+
+  // Blur
+  {
+    ProfileScope scope(profiler, commandBuffer, pool, "Blur");
+    std::vector<VkClearValue> clearValues(2);
+    clearValues[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+    clearValues[1].depthStencil = {1.0f, 0};
+
+    renderPassBeginInfo.renderPass = frameBuffers.blur.renderPass;
+    renderPassBeginInfo.framebuffer = frameBuffers.blur.framebuffer;
+    renderPassBeginInfo.renderArea.extent.width = frameBuffers.blur.width;
+    renderPassBeginInfo.renderArea.extent.height = frameBuffers.blur.height;
+    renderPassBeginInfo.clearValueCount =
+        static_cast<uint32_t>(clearValues.size());
+    renderPassBeginInfo.pClearValues = clearValues.data();
+
+    vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo,
+                         VK_SUBPASS_CONTENTS_INLINE);
+
+    VkViewport viewport = Initializer::Viewport(
+        static_cast<float>(frameBuffers.blur.width),
+        static_cast<float>(frameBuffers.blur.height), 0.0f, 1.0f);
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    VkRect2D scissor = Initializer::Rect2D(frameBuffers.blur.width,
+                                           frameBuffers.blur.height, 0, 0);
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                            pipelineLayouts.blur, 0, 1, &descriptorSets.blur,
+                            0, nullptr);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                      pipelines.blur);
+    vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+
+    vkCmdEndRenderPass(commandBuffer);
+  }
+}
+
+/**
+ * @brief 半分の解像度のコンピュートシェーダーでAOを計算し、ぼかしてから拡大します。
+ * @note
+ * ストレージイメージは常にGENERALレイアウトのため、パスの間にはメモリバリアのみを挿入します。
+ */
+void SSAO::RecordComputeSSAO(VkCommandBuffer commandBuffer, uint32_t pool) {
+  const auto groupCount = [](uint32_t size, uint32_t groupSize) {
+    return (size + groupSize - 1) / groupSize;
+  };
+  const auto &half = computeImages.ao[0];
+  const auto &full = computeImages.upsampled;
+
+  // G-Bufferの書き込みと、前のフレームのライティングによる読み込みを待ちます。
+  VkMemoryBarrier memoryBarrier = Initializer::MemoryBarrier();
+  memoryBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  vkCmdPipelineBarrier(commandBuffer,
+                       VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                           VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+                       &memoryBarrier, 0, nullptr, 0, nullptr);
+
+  // 前のディスパッチの書き込みを次のディスパッチから読めるようにします。
+  memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  const auto computeBarrier = [&] {
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+                         &memoryBarrier, 0, nullptr, 0, nullptr);
+  };
+
+  // Downsample
+  {
+    ProfileScope scope(profiler, commandBuffer, pool, "Downsample");
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                      pipelines.downsample);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                            pipelineLayouts.downsample, 0, 1,
+                            &descriptorSets.downsample, 0, nullptr);
+    vkCmdDispatch(commandBuffer, groupCount(half.width, 8),
+                  groupCount(half.height, 8), 1);
+  }
+  computeBarrier();
+
+  // SSAO (Half resolution)
+  {
+    ProfileScope scope(profiler, commandBuffer, pool, "SSAO (Half)");
+    const uint32_t dynamicOffset =
+        uniformRing.GetDynamicOffset(uniformBuffers.ssao,
+                                     uniformRing.GetPartition(pool));
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                      pipelines.ssaoHalf);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                            pipelineLayouts.ssaoHalf, 0, 1,
+                            &descriptorSets.ssaoHalf, 1, &dynamicOffset);
+    vkCmdDispatch(commandBuffer, groupCount(half.width, 8),
+                  groupCount(half.height, 8), 1);
+  }
+  computeBarrier();
+
+  // Bilateral blur
+  {
+    // ワークグループはブラーの軸に沿ったタイルを担当し、Yで直交する行を選びます。
+    ProfileScope scope(profiler, commandBuffer, pool, "Bilateral Blur");
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                      pipelines.blurHorizontal);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                            pipelineLayouts.bilateralBlur, 0, 1,
+                            &descriptorSets.blurHorizontal, 0, nullptr);
+    vkCmdDispatch(commandBuffer, groupCount(half.width, BLUR_TILE_SIZE),
+                  half.height, 1);
+    computeBarrier();
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                      pipelines.blurVertical);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                            pipelineLayouts.bilateralBlur, 0, 1,
+                            &descriptorSets.blurVertical, 0, nullptr);
+    vkCmdDispatch(commandBuffer, groupCount(half.height, BLUR_TILE_SIZE),
+                  half.width, 1);
+  }
+  computeBarrier();
+
+  // Upsample
+  {
+    ProfileScope scope(profiler, commandBuffer, pool, "Upsample");
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                      pipelines.upsample);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                            pipelineLayouts.upsample, 0, 1,
+                            &descriptorSets.upsample, 0, nullptr);
+    vkCmdDispatch(commandBuffer, groupCount(full.width, 8),
+                  groupCount(full.height, 8), 1);
+  }
+
+  // ライティングのフラグメントシェーダーから拡大したAOを読めるようにします。
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 1,
+                       &memoryBarrier, 0, nullptr, 0, nullptr);
+}
+
+/**
+ * @brief クラスターを選別し、見えるクラスターのインデックスと間接描画の引数を書き込みます。
+ * @note
+ * ワークグループごとに1つのクラスターを判定し、見える場合はグループ全体でインデックスをコピーします。
+ */
+void SSAO::RecordClusterCulling(VkCommandBuffer commandBuffer, uint32_t pool,
+                                const std::vector<GBufferDraw> &draws) {
+  const auto it =
+      std::find_if(draws.begin(), draws.end(),
+                   [](const GBufferDraw &draw) { return draw.clusterCulled; });
+  if (it == draws.end()) {
+    return;
+  }
+  const Model &model = *it->model;
+  ProfileScope scope(profiler, commandBuffer, pool, "Cluster Culling");
+
+  // 前回このコマンドバッファで行った間接描画とインデックスの読み込みを待ちます。
+  VkMemoryBarrier memoryBarrier = Initializer::MemoryBarrier();
+  memoryBarrier.srcAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT |
+                                VK_ACCESS_INDEX_READ_BIT;
+  memoryBarrier.dstAccessMask =
+      VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  vkCmdPipelineBarrier(commandBuffer,
+                       VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+                           VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT |
+                           VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+  // インデックスの数を0に戻してから、シェーダーで見えるクラスターの分を加算します。
+  const uint32_t partition = uniformRing.GetPartition(pool);
+  const VkDeviceSize commandOffset =
+      clusterCulling.commandsStride * partition;
+  const VkDrawIndexedIndirectCommand command{
+      0, 1, 0, 0,
+      instanceBatches.IndirectFirstInstance(instanceBatches.BatchOf(model))};
+  vkCmdUpdateBuffer(commandBuffer, clusterCulling.commands.buffer,
+                    commandOffset, sizeof(command), &command);
+  memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  memoryBarrier.dstAccessMask =
+      VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+                       &memoryBarrier, 0, nullptr, 0, nullptr);
+
+  // 動的オフセットはバインディングの順(出力のインデックス、引数、カメラ)に並べます。
+  const std::array<uint32_t, 3> dynamicOffsets = {
+      static_cast<uint32_t>(clusterCulling.indicesStride * partition),
+      static_cast<uint32_t>(commandOffset),
+      uniformRing.GetDynamicOffset(uniformBuffers.cull, partition),
+  };
+  const ClusterCullPushConstants pushConsts{
+      it->matrix,
+      static_cast<uint32_t>(model.clusters.size()),
+      model.indexType == VK_INDEX_TYPE_UINT16 ? 1u : 0u,
+  };
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                    pipelines.clusterCull);
+  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                          pipelineLayouts.clusterCull, 0, 1,
+                          &descriptorSets.clusterCull,
+                          static_cast<uint32_t>(dynamicOffsets.size()),
+                          dynamicOffsets.data());
+  vkCmdPushConstants(commandBuffer, pipelineLayouts.clusterCull,
+                     VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConsts),
+                     &pushConsts);
+  vkCmdDispatch(commandBuffer, static_cast<uint32_t>(model.clusters.size()),
+                1, 1);
+
+  // G-Bufferパスの間接描画とインデックスの読み込みから結果を読めるようにします。
+  memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  memoryBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT |
+                                VK_ACCESS_INDEX_READ_BIT;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+                           VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                       0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+}
+
+/**
+ * @brief G-Bufferパスで描画するオブジェクトのリストを作成します。
+ */
+std::vector<SSAO::GBufferDraw> SSAO::GetGBufferDraws() {
+  std::vector<GBufferDraw> draws{};
+
+  // Teapot
+  {
+    const auto &teapot = config["Teapot"];
+    const auto scale = glm::vec3(teapot["Scale"].get<float>());
+    const auto trans = glm::vec3(teapot["Position"][0].get<float>(),
+                                 teapot["Position"][1].get<float>(),
+                                 teapot["Position"][2].get<float>());
+    auto model = glm::translate(glm::mat4(1.0f), trans);
+    model =
+        glm::rotate(model, glm::radians(30.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    model = glm::scale(model, scale);
+    draws.push_back({&models.teapot, model * models.teapot.DequantizeMatrix(),
+                     0, clusterCulling.enabled});
+  }
 
-    // レンダーパスを終了すると、フレームバッファのカラーアタッチメントに移行する暗黙のバリアが追加されます。
-    VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
+  // Floor
+  {
+    const auto scale = glm::vec3(4.0f);
+    const auto trans = glm::vec3(0.0f, 0.0f, 0.0f);
+    auto model = glm::translate(glm::mat4(1.0f), trans);
+    model = glm::scale(model, scale);
+    draws.push_back(
+        {&models.floor, model * models.floor.DequantizeMatrix(), 1});
+  }
+
+  // Wall1
+  {
+    const auto scale = glm::vec3(4.0f);
+    const auto trans = glm::vec3(0.0f, 0.0f, -2.0f);
+    auto model = glm::translate(glm::mat4(1.0f), trans);
+    model =
+        glm::rotate(model, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+    model = glm::scale(model, scale);
+    draws.push_back(
+        {&models.floor, model * models.floor.DequantizeMatrix(), 2});
+  }
+
+  // Wall2
+  {
+    const auto scale = glm::vec3(4.0f);
+    const auto trans = glm::vec3(-2.0f, 0.0f, 0.0f);
+    auto model = glm::translate(glm::mat4(1.0f), trans);
+    model =
+        glm::rotate(model, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    model = glm::rotate(model, glm::radians(90.0f), glm::vec3(1.0f, 0.0, 0.0f));
+    model = glm::scale(model, scale);
+    draws.push_back(
+        {&models.floor, model * models.floor.DequantizeMatrix(), 2});
+  }
+  return draws;
+}
+
+/**
+ * @brief インスタンスのバッチをG-Bufferパスのレンダーキューに加え、ソートキーの順に並べ替えます。
+ * @note
+ * 各バッチはGPUで選別したインスタンスの数で間接描画します。<br>
+ * 深度はバッチの中で最もカメラに近いインスタンスの原点の距離です。
+ */
+void SSAO::BuildGBufferQueue() {
+  gBufferQueue.Clear();
+  const glm::mat4 view = camera.GetViewMatrix();
+  const auto &batches = instanceBatches.GetBatches();
+  const auto &instances = instanceBatches.GetInstances();
+  for (uint32_t b = 0; b < batches.size(); b++) {
+    const auto &batch = batches[b];
+    RenderQueue::DrawItem item{};
+    item.pipeline = pipelines.gBuffer;
+    item.pipelineLayout = pipelineLayouts.gBuffer;
+    item.descriptorSet = descriptorSets.gBuffer[0];
+    item.partitionDescriptorSets = descriptorSets.gBuffer.data();
+    item.dynamicOffsetCount = 2;
+    item.mesh = instanceBatches.MeshOf(b);
+    // 選別したクラスターは、パーティションの領域の32bitのインデックスで間接描画します。
+    if (clusterCulling.enabled && !batch.model->clusters.empty()) {
+      item.mesh.indexBuffer = clusterCulling.indices.buffer;
+      item.mesh.indexType = VK_INDEX_TYPE_UINT32;
+      item.mesh.indexPartitionStride = clusterCulling.indicesStride;
+      item.mesh.indirectBuffer = clusterCulling.commands.buffer;
+      item.mesh.indirectOffset = 0;
+      item.mesh.indirectPartitionStride = clusterCulling.commandsStride;
+    }
+    float depth = 1.0f;
+    for (uint32_t j = 0; j < batch.instanceCount; j++) {
+      const auto &instance = instances[batch.firstInstance + j];
+      const glm::vec4 origin = view * instance.model[3];
+      depth = std::min(depth, -origin.z / camera.GetFar());
+    }
+    item.depth = depth;
+    const PushConstants pushConsts{instanceBatches.BaseInstance(b)};
+    item.pushConstants = &pushConsts;
+    item.pushConstantsSize = sizeof(pushConsts);
+    item.pushConstantStages = VK_SHADER_STAGE_VERTEX_BIT;
+    gBufferQueue.Push(item);
   }
+  gBufferQueue.Sort();
+}
+
+/**
+ * @brief レンダーキューの[first, first + count)をセカンダリコマンドバッファに記録します。
+ * @note 複数のワーカースレッドから同時に呼び出されるため、メンバを変更してはいけません。
+ */
+void SSAO::RecordGBufferDraws(VkCommandBuffer commandBuffer,
+                              uint32_t partition, uint32_t first,
+                              uint32_t count) const {
+  VkViewport viewport = Initializer::Viewport(
+      static_cast<float>(frameBuffers.gBuffer.width),
+      static_cast<float>(frameBuffers.gBuffer.height), 0.0f, 1.0f);
+  vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+  VkRect2D scissor = Initializer::Rect2D(frameBuffers.gBuffer.width,
+                                         frameBuffers.gBuffer.height, 0, 0);
+  vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+  // 動的オフセットはバインディングの順(カメラ、見えるインスタンス)に並べます。
+  gBufferQueue.Record(
+      commandBuffer, partition, first, count,
+      {uniformRing.GetDynamicOffset(uniformBuffers.gBuffer, partition),
+       instanceBatches.GetVisibleOffset(partition)});
 }
 
 //*-----------------------------------------------------------------------------
@@ -991,6 +1979,7 @@ void SSAO::UpdateUniformBuffers() {
                           0.3f, 100.0f);
 
   UpdateGBufferUniformBuffer();
+  UpdateCullUniformBuffer();
   UpdateSSAOUniformBuffer();
   UpdateLightingUniformBuffer();
 }
@@ -1001,13 +1990,26 @@ void SSAO::UpdateGBufferUniformBuffer() {
   uboGBuffer.proj = camera.GetProjectionMatrix();
 
   // ユニフォームバッファへコピーします。
-  uniformBuffers.gBuffer.Copy(&uboGBuffer, sizeof(uboGBuffer));
+  uniformRing.Write(uniformBuffers.gBuffer, &uboGBuffer, sizeof(uboGBuffer));
+}
+
+/**
+ * @brief クラスターの選別に使う視錐台の平面とカメラの位置を求めます。
+ */
+void SSAO::UpdateCullUniformBuffer() {
+  const glm::mat4 viewProj = uboGBuffer.proj * uboGBuffer.view;
+  const auto planes = Frustum::ExtractPlanes(viewProj);
+  std::copy(planes.begin(), planes.end(), uboCull.frustum);
+  uboCull.cameraPos = glm::inverse(uboGBuffer.view)[3];
+
+  uniformRing.Write(uniformBuffers.cull, &uboCull, sizeof(uboCull));
+  instanceBatches.SetFrustum(uniformRing, viewProj);
 }
 
 void SSAO::UpdateSSAOUniformBuffer() {
   uboSSAO.proj = camera.GetProjectionMatrix();
 
-  uniformBuffers.ssao.Copy(&uboSSAO, sizeof(uboSSAO));
+  uniformRing.Write(uniformBuffers.ssao, &uboSSAO, sizeof(uboSSAO));
 }
 
 void SSAO::UpdateLightingUniformBuffer() {
@@ -1026,10 +2028,24 @@ void SSAO::UpdateLightingUniformBuffer() {
 
   uboLighting.lightsNum = static_cast<int>(config["Lights"].size());
 
-  uniformBuffers.lighting.Copy(&uboLighting, sizeof(uboLighting));
+  uniformRing.Write(uniformBuffers.lighting, &uboLighting,
+                    sizeof(uboLighting));
 }
 
 void SSAO::OnUpdateUIOverlay() {
+  // 計算方法を切り替えると、記録済みのコマンドバッファを構築し直します。
+  auto mode = static_cast<int32_t>(aoMode);
+  if (uiOverlay.Combo("AO Mode", &mode, {"Fragment", "Compute (Half Res)"})) {
+    aoMode = static_cast<AOMode>(mode);
+    WaitFramesInFlight();
+    BuildCommandBuffers();
+  }
+  if (!models.teapot.clusters.empty() &&
+      uiOverlay.Checkbox("Cluster Culling", &clusterCulling.enabled)) {
+    WaitFramesInFlight();
+    UpdateInstanceFlags();
+    BuildCommandBuffers();
+  }
   if (uiOverlay.Combo("Display Render Target", &uboLighting.displayRenderTarget,
                       {"Final Result", "Only SSAO", "No SSAO", "Position",
                        "Normal", "Albedo"})) {
@@ -1048,4 +2064,10 @@ void SSAO::OnUpdateUIOverlay() {
                             10.0f)) {
     UpdateLightingUniformBuffer();
   }
+  uiOverlay.Text("G-Buffer: %u draws, %u state changes (%u saved)",
+                 gBufferStats.draws, gBufferStats.StateChanges(),
+                 gBufferStats.saved);
+  uiOverlay.Text("Instances: %zu in %zu batches",
+                 instanceBatches.GetInstances().size(),
+                 instanceBatches.GetBatches().size());
 }
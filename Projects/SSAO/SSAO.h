@@ -7,8 +7,11 @@
 
 #include "VK/Buffer.h"
 #include "VK/Framebuffer.h"
+#include "VK/InstanceBatches.h"
 #include "VK/Model.h"
+#include "VK/RenderQueue.h"
 #include "VK/Texture.h"
+#include "VK/UniformRing.h"
 #include "View/Camera.h"
 
 class SSAO : public VkBase {
@@ -18,32 +21,69 @@ public:
   void OnUpdateUIOverlay() override;
 
   void LoadAssets();
+  void LoadTexture(Texture2D &texture, const nlohmann::json &asset);
   void PrepareOffscreenFramebuffer();
+  void PrepareComputeImages();
+  void PrepareClusterCulling();
+  void PrepareInstances();
+  void UpdateInstanceFlags();
   void PrepareUniformBuffers();
 
   void UpdateUniformBuffers();
   void UpdateGBufferUniformBuffer();
+  void UpdateCullUniformBuffer();
   void UpdateSSAOUniformBuffer();
   void UpdateLightingUniformBuffer();
 
   void SetupDescriptorPool();
   void SetupDescriptorSet();
   void SetupPipelines();
+  void SetupComputePipelines();
 
   void BuildCommandBuffers() override;
+  void OnTexturesStreamed(uint32_t partition) override;
 
   void ViewChanged() override;
+  [[nodiscard]] VkPhysicalDeviceFeatures GetEnabledFeatures() const override;
 
 private:
   static constexpr inline size_t KERNEL_SIZE = 64;
   static constexpr inline size_t ROT_TEX_SIZE = 4;
+  /** @brief バイラテラルブラーのタイルの大きさ(シェーダーのTILE_SIZEと一致させます。) */
+  static constexpr inline uint32_t BLUR_TILE_SIZE = 64;
+
+  /**
+   * @brief SSAOの計算方法
+   * @note
+   * Computeはフル解像度のG-Bufferを半分の解像度に縮小してAOを計算し、深度を考慮してぼかしてから拡大します。
+   */
+  enum class AOMode : int32_t {
+    Fragment,
+    Compute,
+  };
+  AOMode aoMode = AOMode::Fragment;
+
+  /** @brief コンピュートシェーダーが読み書きするイメージ(常にGENERALレイアウトです。) */
+  struct StorageImage {
+    VkImage image = VK_NULL_HANDLE;
+    Allocation allocation{};
+    VkImageView view = VK_NULL_HANDLE;
+    uint32_t width = 0;
+    uint32_t height = 0;
+  };
+
+  void CreateStorageImage(StorageImage &storageImage, VkFormat format,
+                          uint32_t width, uint32_t height);
+  void DestroyStorageImage(const StorageImage &storageImage) const;
+  void RecordFragmentSSAO(VkCommandBuffer commandBuffer, uint32_t pool);
+  void RecordComputeSSAO(VkCommandBuffer commandBuffer, uint32_t pool);
 
   VertexLayout vertexLayout{
       {
-          VertexLayoutComponent::Position,
-          VertexLayoutComponent::Normal,
-          VertexLayoutComponent::Color,
-          VertexLayoutComponent::UV,
+          VertexLayoutComponent::PositionHalf,
+          VertexLayoutComponent::NormalOct,
+          VertexLayoutComponent::ColorUnorm8,
+          VertexLayoutComponent::UVHalf,
       },
   };
 
@@ -58,16 +98,71 @@ private:
     Texture2D noise;
   } textures;
 
+  /** @brief G-Bufferパスのプッシュ定数(変換とテクスチャはインスタンスから読みます。) */
   struct PushConstants {
+    alignas(4) uint32_t baseInstance;
+  };
+
+  /** @brief G-Bufferパスで描画するオブジェクト */
+  struct GBufferDraw {
+    const Model *model = nullptr;
+    glm::mat4 matrix = glm::mat4(1.0f);
+    /** @brief フラグメントシェーダーで使うテクスチャ(0の場合は頂点カラー) */
+    uint32_t tex = 0;
+    /** @brief GPUで選別したクラスターのみを間接描画するか */
+    bool clusterCulled = false;
+  };
+
+  [[nodiscard]] std::vector<GBufferDraw> GetGBufferDraws();
+  void BuildGBufferQueue();
+  void RecordCommandBuffer(uint32_t image,
+                           const std::vector<GBufferDraw> &draws);
+  void RecordGBufferDraws(VkCommandBuffer commandBuffer, uint32_t partition,
+                          uint32_t first, uint32_t count) const;
+
+  /** @brief G-Bufferパスのオブジェクトをモデルごとにまとめたインスタンス */
+  InstanceBatches instanceBatches{};
+  /** @brief G-Bufferパスの描画を状態の順に並べたキュー */
+  RenderQueue gBufferQueue{};
+  /** @brief 最後に記録したコマンドバッファのG-Bufferパスの状態の変更の数 */
+  RenderQueue::Stats gBufferStats{};
+  void RecordClusterCulling(VkCommandBuffer commandBuffer, uint32_t pool,
+                            const std::vector<GBufferDraw> &draws);
+
+  /**
+   * @brief クラスターを視錐台と法線の円錐で選別し、見えるクラスターのインデックスを詰めて書き込みます。
+   * @note
+   * 出力は記録済みのコマンドバッファごとに領域を分け、動的オフセットで切り替えます。<br>
+   * 選別するのはクラスターを持つティーポットのみです。
+   */
+  struct {
+    bool enabled = false;
+    /** @brief 見えるクラスターの32bitのインデックス */
+    Buffer indices{};
+    /** @brief vkCmdDrawIndexedIndirectの引数(インデックスの数はシェーダーが加算します。) */
+    Buffer commands{};
+    VkDeviceSize indicesStride = 0;
+    VkDeviceSize commandsStride = 0;
+  } clusterCulling;
+
+  struct ClusterCullPushConstants {
     alignas(16) glm::mat4 model;
-    alignas(4) int tex;
-  } pushConsts;
+    alignas(4) uint32_t clusterCount;
+    /** @brief 元のインデックスが16bitか */
+    alignas(4) uint32_t index16;
+  };
 
   struct {
     alignas(16) glm::mat4 view;
     alignas(16) glm::mat4 proj;
   } uboGBuffer;
 
+  struct {
+    /** @brief ワールド空間の視錐台の平面(xyzは内向きの単位法線です。) */
+    alignas(16) glm::vec4 frustum[6];
+    alignas(16) glm::vec4 cameraPos;
+  } uboCull;
+
   struct {
     alignas(16) glm::vec4 kernel[KERNEL_SIZE];
     alignas(16) glm::mat4 proj;
@@ -90,10 +185,10 @@ private:
   } uboLighting;
 
   struct {
-    Buffer gBuffer;
-    Buffer ssao;
-    Buffer blur;
-    Buffer lighting;
+    UniformAllocation gBuffer;
+    UniformAllocation ssao;
+    UniformAllocation lighting;
+    UniformAllocation cull;
   } uniformBuffers;
 
   struct {
@@ -101,6 +196,12 @@ private:
     VkPipeline ssao;
     VkPipeline blur;
     VkPipeline lighting;
+    VkPipeline downsample;
+    VkPipeline ssaoHalf;
+    VkPipeline blurHorizontal;
+    VkPipeline blurVertical;
+    VkPipeline upsample;
+    VkPipeline clusterCull = VK_NULL_HANDLE;
   } pipelines;
 
   struct {
@@ -108,14 +209,29 @@ private:
     VkPipelineLayout ssao;
     VkPipelineLayout blur;
     VkPipelineLayout lighting;
+    VkPipelineLayout downsample;
+    VkPipelineLayout ssaoHalf;
+    VkPipelineLayout bilateralBlur;
+    VkPipelineLayout upsample;
+    VkPipelineLayout clusterCull = VK_NULL_HANDLE;
   } pipelineLayouts;
 
   struct {
-    VkDescriptorSet gBuffer;
+    /** @brief ストリーミングするテクスチャを書き直すため、パーティションごとに作ります。 */
+    std::vector<VkDescriptorSet> gBuffer{};
     VkDescriptorSet ssao;
     VkDescriptorSet blur;
     VkDescriptorSet lighting;
-    const uint32_t maxSets = 4;
+    VkDescriptorSet downsample;
+    VkDescriptorSet ssaoHalf;
+    VkDescriptorSet blurHorizontal;
+    VkDescriptorSet blurVertical;
+    VkDescriptorSet upsample;
+    /** @brief コンピュート版のAOを参照するライティング用の記述子セット */
+    VkDescriptorSet lightingCompute;
+    VkDescriptorSet clusterCull = VK_NULL_HANDLE;
+    /** @brief G-Buffer以外の記述子セットの数 */
+    const uint32_t maxSets = 10;
   } descriptorSets;
 
   struct {
@@ -123,6 +239,11 @@ private:
     VkDescriptorSetLayout ssao;
     VkDescriptorSetLayout blur;
     VkDescriptorSetLayout lighting;
+    VkDescriptorSetLayout downsample;
+    VkDescriptorSetLayout ssaoHalf;
+    VkDescriptorSetLayout bilateralBlur;
+    VkDescriptorSetLayout upsample;
+    VkDescriptorSetLayout clusterCull = VK_NULL_HANDLE;
   } descriptorSetLayouts;
 
   struct {
@@ -131,5 +252,16 @@ private:
     Framebuffer blur;
   } frameBuffers;
 
+  struct {
+    /** @brief 半分の解像度の位置と深度 */
+    StorageImage position;
+    /** @brief 半分の解像度の法線 */
+    StorageImage normal;
+    /** @brief 半分の解像度のAO(ブラーの入出力を交互に使います。) */
+    StorageImage ao[2];
+    /** @brief フル解像度に拡大したAO */
+    StorageImage upsampled;
+  } computeImages;
+
   Camera camera{};
 };
@@ -25,6 +25,8 @@ void TextureMapping::OnPostInit() {
   VkBase::OnPostInit();
 
   LoadAssets();
+  // 読み込んだアセットの転送をまとめて1回で送信します。(描画はこの送信の後に行われます。)
+  static_cast<void>(uploader.Submit(device));
 
   PrepareCamera();
   PrepareVertices();
@@ -42,7 +44,6 @@ void TextureMapping::OnPostInit() {
 void TextureMapping::OnPreDestroy() {
   texture.Destroy(device);
 
-  uniformBuffer.Destroy(device);
   indexBuffer.Destroy(device);
   vertexBuffer.Destroy(device);
 
@@ -99,8 +100,11 @@ void TextureMapping::BuildCommandBuffers() {
     vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
 
     // 記述子セットとパイプラインのバインド
+    const uint32_t dynamicOffset = uniformRing.GetDynamicOffset(
+        uniformBuffer, uniformRing.GetPartition(static_cast<uint32_t>(i)));
     vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
-                            pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+                            pipelineLayout, 0, 1, &descriptorSet, 1,
+                            &dynamicOffset);
     vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
                       pipeline);
 
@@ -114,8 +118,6 @@ void TextureMapping::BuildCommandBuffers() {
     // インデックス付きの三角形を描画します。
     vkCmdDrawIndexed(drawCmdBuffers[i], indexCount, 1, 0, 0, 1);
 
-    DrawUI(drawCmdBuffers[i]);
-
     vkCmdEndRenderPass(drawCmdBuffers[i]);
 
     // レンダーパスを終了すると、フレームバッファのカラーアタッチメントに移行する暗黙のバリアが追加されます。
@@ -130,8 +132,15 @@ void TextureMapping::ViewChanged() { UpdateUniformBuffers(); }
 //*-----------------------------------------------------------------------------
 
 void TextureMapping::LoadAssets() {
-  texture.Load(device, "./Assets/Textures/dds/dxt5/Brick/ruin_wall_01.dds",
-               queue, VK_FORMAT_BC3_SRGB_BLOCK);
+  // PNG/JPEGはデバイスが対応しているブロック圧縮の形式に圧縮して読み込みます。
+  const auto format = device.FindSupportedTextureFormat({
+      VK_FORMAT_BC7_SRGB_BLOCK,
+      VK_FORMAT_BC3_SRGB_BLOCK,
+      VK_FORMAT_BC1_RGB_SRGB_BLOCK,
+      VK_FORMAT_R8G8B8A8_SRGB,
+  });
+  texture.Load(device, config["Texture"].get<std::string>(), uploader,
+               format);
 }
 
 //*-----------------------------------------------------------------------------
@@ -145,8 +154,9 @@ void TextureMapping::LoadAssets() {
  */
 void TextureMapping::SetupDescriptorSetLayout() {
   std::vector<VkDescriptorSetLayoutBinding> descriptorSetLayoutBindings = {
-      Initializer::DescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-                                              VK_SHADER_STAGE_VERTEX_BIT, 0),
+      Initializer::DescriptorSetLayoutBinding(
+          VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_VERTEX_BIT,
+          0),
       Initializer::DescriptorSetLayoutBinding(
           VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
           VK_SHADER_STAGE_FRAGMENT_BIT, 1),
@@ -277,7 +287,8 @@ void TextureMapping::SetupPipelines() {
 void TextureMapping::SetupDescriptorPool() {
   // APIに記述子の最大数を通知する必要があります。
   std::vector<VkDescriptorPoolSize> descriptorPoolSizes = {
-      Initializer::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1),
+      Initializer::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+                                      1),
       Initializer::DescriptorPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
                                       1),
   };
@@ -301,8 +312,8 @@ void TextureMapping::SetupDescriptorSet() {
   // サンプラーとして使用されている現在のテクスチャの記述子画像情報を設定します。
   std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
       Initializer::WriteDescriptorSet(descriptorSet,
-                                      VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0,
-                                      &uniformBuffer.descriptor),
+                                      VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+                                      0, &uniformBuffer.descriptor),
       Initializer::WriteDescriptorSet(descriptorSet,
                                       VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
                                       1, &texture.descriptor),
@@ -360,12 +371,7 @@ void TextureMapping::PrepareVertices() {
  * OpenGLのような単一のユニフォームはVulkanに存在しなくなりました。すべてのシェーダーユニフォームはユニフォームバッファブロックを介して渡されます。
  */
 void TextureMapping::PrepareUniformBuffers() {
-  VK_CHECK_RESULT(uniformBuffer.Create(device,
-                                       VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                                       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                                           VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                                       sizeof(ubo), &ubo));
-  VK_CHECK_RESULT(uniformBuffer.Map(device));
+  uniformBuffer = uniformRing.Allocate(sizeof(ubo));
   UpdateUniformBuffers();
 }
 
@@ -381,7 +387,7 @@ void TextureMapping::UpdateUniformBuffers() {
   ubo.mvp = proj * view * model;
 
   // ユニフォームバッファへコピーします。
-  uniformBuffer.Copy(&ubo, sizeof(ubo));
+  uniformRing.Write(uniformBuffer, &ubo, sizeof(ubo));
 }
 
 void TextureMapping::OnUpdateUIOverlay() {
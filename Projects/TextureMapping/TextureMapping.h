@@ -6,6 +6,7 @@
 
 #include "VK/Buffer.h"
 #include "VK/Texture.h"
+#include "VK/UniformRing.h"
 #include "View/Camera.h"
 
 class TextureMapping : public VkBase {
@@ -52,7 +53,7 @@ private:
   Buffer vertexBuffer{};
   Buffer indexBuffer{};
   uint32_t indexCount = 0;
-  Buffer uniformBuffer{};
+  UniformAllocation uniformBuffer{};
 
   Camera camera{};
 };
@@ -0,0 +1,185 @@
+"""
+@file pack_assets.py
+@brief 各シーンの設定が参照するアセットを1つのアーカイブにまとめます。
+"""
+
+
+import json
+import logging
+import os
+import posixpath
+import struct
+import zlib
+from pathlib import Path
+
+
+class Packer(object):
+    # Core/VK/AssetArchive.hと合わせます。
+    MAGIC = 0x4b505652
+    VERSION = 1
+    HEADER = struct.Struct('<4I2Q')
+    ENTRY = struct.Struct('<3Q4I')
+    FLAG_DEFLATE = 1 << 0
+
+    # 各ファイルの先頭をページ境界に揃え、マップしたまま参照できるようにします。
+    ALIGNMENT = 4096
+
+    # 読み込み時にパースするテキスト形式のみ圧縮します。
+    # SPIR-VやKTXなどは圧縮せず、マップしたページを直接転送します。
+    COMPRESSIBLE = {'.dae', '.obj', '.gltf', '.ply', '.ttf', '.otf'}
+
+    # Core/VK/Gui.ccが読み込むファイル
+    UI_OVERLAY_FILES = [
+        './Assets/Shaders/HLSL/SPIR-V/UI/UIOverlay.vs.spv',
+        './Assets/Shaders/HLSL/SPIR-V/UI/UIOverlay.fs.spv',
+        './Assets/Fonts/UbuntuMono/UbuntuMono-Regular.ttf',
+        './Assets/Fonts/rounded-x-mplus/rounded-x-mplus-2c-medium.ttf',
+    ]
+
+    # Core/VK/Model.hのModelCreateInfo::cacheDirectory
+    MESH_CACHE_DIRECTORY = './MeshCache'
+
+    def __init__(self, logger=None):
+        scripts_path = Path('.').resolve()
+        self.WORKING_DIRECTORY_PATH = scripts_path.parent
+        self.CONFIGS_PATH = self.WORKING_DIRECTORY_PATH.joinpath('Configs')
+
+        # ロガーの設定
+        self.LOGGER_FORMAT = '%(asctime)s - %(levelname)s: %(message)s'
+        if logger is None:
+            self.logger = logging.getLogger(__name__)
+            ch = logging.StreamHandler()
+            formatter = logging.Formatter(self.LOGGER_FORMAT)
+            ch.setFormatter(formatter)
+            self.logger.addHandler(ch)
+            self.logger.setLevel(logging.INFO)
+        else:
+            self.logger = logger
+
+    # アーカイブのパスを指定しているすべての設定について、アーカイブを生成します。
+    def packs(self):
+        self.logger.info('start pack.')
+
+        for config_path in sorted(self.CONFIGS_PATH.glob('*.json')):
+            with open(config_path, encoding='utf-8') as f:
+                config = json.load(f)
+            if 'Archive' not in config:
+                self.logger.debug('skip - {}'.format(config_path.name))
+                continue
+            self.pack(config, config['Archive']['Path'])
+
+        self.logger.info('finished pack.')
+
+    # 設定が参照するファイルを集め、アーカイブに書き込みます。
+    def pack(self, config, archive):
+        files = self.collect(config)
+        dst = self.WORKING_DIRECTORY_PATH.joinpath(archive)
+        self.logger.info('Start pack: {} ({} files)'.format(dst, len(files)))
+
+        # 目次はパスのUTF-8のバイト列の昇順に並べ、実行時に二分探索します。
+        keys = sorted(files, key=lambda key: key.encode('utf-8'))
+        strings = bytearray()
+        blobs = []
+        for key in keys:
+            data = files[key].read_bytes()
+            stored, flags = data, 0
+            if Path(key).suffix.lower() in self.COMPRESSIBLE:
+                compressed = zlib.compress(data, 9)
+                if len(compressed) < len(data) * 9 // 10:
+                    stored, flags = compressed, self.FLAG_DEFLATE
+            path = key.encode('utf-8')
+            blobs.append((len(strings), len(path), stored, len(data), flags))
+            strings += path
+
+        strings_offset = self.HEADER.size + self.ENTRY.size * len(keys)
+        offset = self.align(strings_offset + len(strings))
+        toc = bytearray()
+        for path_offset, path_length, stored, size, flags in blobs:
+            toc += self.ENTRY.pack(offset, len(stored), size,
+                                   path_offset, path_length, flags, 0)
+            offset = self.align(offset + len(stored))
+
+        # 書き込み中に終了しても壊れたアーカイブが残らないようにします。
+        dst.parent.mkdir(parents=True, exist_ok=True)
+        temporary = dst.with_name(dst.name + '.tmp')
+        with open(temporary, 'wb') as f:
+            f.write(self.HEADER.pack(self.MAGIC, self.VERSION, len(keys),
+                                     self.ALIGNMENT, strings_offset,
+                                     len(strings)))
+            f.write(toc)
+            f.write(strings)
+            for _, _, stored, _, _ in blobs:
+                f.write(b'\0' * (self.align(f.tell()) - f.tell()))
+                f.write(stored)
+        os.replace(temporary, dst)
+
+        compressed = sum(1 for blob in blobs if blob[4] & self.FLAG_DEFLATE)
+        self.logger.info('Finished pack: {} ({} bytes, {} compressed)'.format(
+            dst, dst.stat().st_size, compressed))
+
+    # 設定の文字列のうち、Assets以下の存在するファイルを指すものを集めます。
+    def collect(self, config):
+        paths = []
+
+        def walk(value):
+            if isinstance(value, dict):
+                [walk(v) for v in value.values()]
+            elif isinstance(value, list):
+                [walk(v) for v in value]
+            elif isinstance(value, str):
+                paths.append(value)
+        walk(config)
+        if config.get('UIOverlay', False):
+            paths += self.UI_OVERLAY_FILES
+
+        files = {}
+        for path in paths:
+            key = self.normalize(path)
+            if not key.startswith('Assets/'):
+                continue
+            src = self.WORKING_DIRECTORY_PATH.joinpath(key)
+            if not src.is_file():
+                self.logger.warning('Not found: {}'.format(path))
+                continue
+            files[key] = src
+            # 変換済みのキャッシュがあれば、実行時の変換を省くために含めます。
+            [files.setdefault(self.normalize(str(cache.relative_to(
+                self.WORKING_DIRECTORY_PATH))), cache)
+             for cache in self.caches(src)]
+        return files
+
+    # 元のファイルから生成されたキャッシュ(メッシュ、ブロック圧縮したテクスチャ)を探します。
+    def caches(self, src):
+        suffix = src.suffix.lower()
+        if suffix in {'.png', '.jpg', '.jpeg'}:
+            return self.hashed(src.parent, src.stem, '.ktx')
+        if suffix in {'.dae', '.obj', '.gltf', '.fbx', '.ply'}:
+            directory = self.WORKING_DIRECTORY_PATH.joinpath(
+                self.MESH_CACHE_DIRECTORY)
+            return self.hashed(directory, src.stem, '.mesh')
+        return []
+
+    # "<stem>-<16桁の16進数><suffix>"の名前のファイルを返します。
+    @staticmethod
+    def hashed(directory, stem, suffix):
+        if not directory.is_dir():
+            return []
+        caches = []
+        for path in directory.glob('{}-*{}'.format(stem, suffix)):
+            key = path.name[len(stem) + 1:-len(suffix)]
+            if len(key) == 16 and all(c in '0123456789abcdef' for c in key):
+                caches.append(path)
+        return sorted(caches)
+
+    # 実行時(std::filesystem::path::lexically_normal)と同じ形に正規化します。
+    @staticmethod
+    def normalize(path):
+        return posixpath.normpath(path.replace('\\', '/'))
+
+    def align(self, offset):
+        return (offset + self.ALIGNMENT - 1) // self.ALIGNMENT * self.ALIGNMENT
+
+
+if __name__ == '__main__':
+    packer = Packer()
+    packer.packs()
@@ -34,6 +34,10 @@ class Compiler(object):
         self.EXT2STAGE = {'vs': 'vert', 'fs': 'frag',
                           'gs': 'geom', 'tc': 'tesc',
                           'te': 'tese', 'cs': 'comp'}
+        # HLSLのシェーダーステージとdxcのプロファイルの対応
+        self.EXT2PROFILE = {'vs': 'vs_6_0', 'fs': 'ps_6_0',
+                            'gs': 'gs_6_0', 'tc': 'hs_6_0',
+                            'te': 'ds_6_0', 'cs': 'cs_6_0'}
 
     # GLSLもしくはHLSLのすべてのファイルをSPIR-Vへコンパイルします。
     def compiles(self, lang):
@@ -54,13 +58,29 @@ class Compiler(object):
         self.logger.debug('src - {}'.format(src))
         self.logger.debug('dst - {}'.format(dst))
 
-        # glslcを使います。
-        # 詳しくは https://github.com/google/shaderc/tree/main/glslc を参照ください。
+        # GLSLはglslcを、HLSLはdxcを使います。
+        # 詳しくは https://github.com/google/shaderc/tree/main/glslc および
+        # https://github.com/microsoft/DirectXShaderCompiler を参照ください。
         self.logger.info('Start compile: {}'.format(src))
-        cp = subprocess.run(
-            ['glslc', '-fshader-stage={}'.format(stage), src, '-o', dst])
+        dst.parent.mkdir(parents=True, exist_ok=True)
+        if shader.endswith('.hlsl'):
+            profile = self.EXT2PROFILE[shader.split('.')[1]]
+            cp = subprocess.run(
+                ['dxc', '-spirv', '-T', profile, '-E', 'main', src,
+                 '-Fo', dst])
+        else:
+            cp = subprocess.run(
+                ['glslc', '-fshader-stage={}'.format(stage), src, '-o', dst])
         if cp.returncode != 0:
             self.logger.error('Failed to compile: {}'.format(src))
+            return
+        self.validate(src, dst)
+
+    # 出力したSPIR-Vをspirv-valで検証します。(SPIRV-Toolsに含まれます。)
+    def validate(self, src, dst):
+        cp = subprocess.run(['spirv-val', '--target-env', 'vulkan1.0', dst])
+        if cp.returncode != 0:
+            self.logger.error('Failed to validate: {}'.format(dst))
         else:
             self.logger.info('Finished compile: {}'.format(src))
 
@@ -69,4 +89,4 @@ if __name__ == '__main__':
     compiler = Compiler()
 
     compiler.compiles('GLSL')
-    #compiler.compiles('HLSL')
+    compiler.compiles('HLSL')